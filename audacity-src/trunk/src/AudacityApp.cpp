@@ -289,6 +289,12 @@ void QuitAudacity(bool bForce)
    //release ODManager Threads
    ODManager::Quit();
 
+   //stop rendering waveforms and spectrograms in the background
+   WaveClip::StopRendering();
+
+   //finish writing new block files and stop that thread
+   DirManager::QuitPendingWrites();
+
    //print out profile if we have one by deleting it
    //temporarilly commented out till it is added to all projects
    //delete Profiler::Instance();
@@ -1805,7 +1811,6 @@ int AudacityApp::OnExit()
    UnloadEffects();
 
    DeinitFFT();
-   BlockFile::Deinit();
 
    DeinitAudioIO();
 
@@ -261,6 +261,22 @@
 use wxWidgets wxThread), this class sits in a thread loop reading and
 writing audio.
 
+*//****************************************************************//**
+
+\class AudioMixPool
+\brief Runs the playback Mixers of one FillBuffers() pass concurrently.
+
+  Every playback track has its own Mixer, which resamples, warps and
+  applies the envelope to that track alone, so the Mixers of a pass
+  can run on several threads at once.  The pool's AudioMixThreads and
+  the audio thread itself take Mixers one at a time until none are
+  left; Process() then waits for the last one to finish, so that the
+  audio thread puts the results in the RingBuffers as before.
+
+  The number of threads is read from "/AudioIO/PlaybackMixThreads" when
+  a stream starts.  With one thread, or one playback track, there is
+  no pool and FillBuffers() runs the Mixers itself.
+
 *//*******************************************************************/
 
 #include "Audacity.h"
@@ -270,6 +286,7 @@ writing audio.
 #include <math.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <vector>
 
 #ifdef __WXMSW__
 #include <malloc.h>
@@ -298,6 +315,7 @@ writing audio.
 #include "MixerBoard.h"
 #include "Resample.h"
 #include "RingBuffer.h"
+#include "ondemand/ODTaskThread.h"
 #include "Prefs.h"
 #include "Project.h"
 #include "WaveTrack.h"
@@ -447,6 +465,140 @@ class MidiThread : public AudioThread {
 };
 #endif
 
+class AudioMixPool {
+ public:
+   AudioMixPool(int numThreads);
+   ~AudioMixPool();
+
+   int GetNumThreads() { return (int)mThreads.size(); }
+
+   /// Calls Process(len) on each of the mixers and stores the results in
+   /// processed.  Returns when all of them are done.
+   void Process(Mixer **mixers, int numMixers, sampleCount len,
+                int *processed);
+
+   /// The loop of an AudioMixThread
+   void Work();
+
+ private:
+   /// Processes mixers until none are left to take.  Call with mLock held.
+   void ProcessMixers();
+
+   std::vector<AudioThread *> mThreads;
+
+   ODLock mLock;
+   ODCondition mStart;
+   ODCondition mDone;
+
+   Mixer **mMixers;
+   int mNumMixers;
+   sampleCount mLen;
+   int *mProcessed;
+   int mNext;
+   int mRemaining;
+   int mPass;
+   bool mQuit;
+};
+
+class AudioMixThread : public AudioThread {
+ public:
+   AudioMixThread(AudioMixPool *pool) { mPool = pool; }
+   virtual ExitCode Entry();
+ private:
+   AudioMixPool *mPool;
+};
+
+AudioThread::ExitCode AudioMixThread::Entry()
+{
+   mPool->Work();
+   return 0;
+}
+
+AudioMixPool::AudioMixPool(int numThreads):
+   mStart(&mLock),
+   mDone(&mLock)
+{
+   mMixers = NULL;
+   mNumMixers = 0;
+   mLen = 0;
+   mProcessed = NULL;
+   mNext = 0;
+   mRemaining = 0;
+   mPass = 0;
+   mQuit = false;
+
+   for (int i = 0; i < numThreads; i++) {
+      AudioThread *thread = new AudioMixThread(this);
+      thread->Create();
+      thread->Run();
+      mThreads.push_back(thread);
+   }
+}
+
+AudioMixPool::~AudioMixPool()
+{
+   mLock.Lock();
+   mQuit = true;
+   mStart.Broadcast();
+   mLock.Unlock();
+
+   for (unsigned int i = 0; i < mThreads.size(); i++) {
+      mThreads[i]->Delete();
+      delete mThreads[i];
+   }
+}
+
+void AudioMixPool::Process(Mixer **mixers, int numMixers, sampleCount len,
+                           int *processed)
+{
+   mLock.Lock();
+   mMixers = mixers;
+   mNumMixers = numMixers;
+   mLen = len;
+   mProcessed = processed;
+   mNext = 0;
+   mRemaining = numMixers;
+   mPass++;
+   mStart.Broadcast();
+
+   // The audio thread mixes too, rather than just waiting
+   ProcessMixers();
+   while (mRemaining > 0)
+      mDone.Wait();
+   mLock.Unlock();
+}
+
+void AudioMixPool::Work()
+{
+   int pass = 0;
+
+   mLock.Lock();
+   for (;;) {
+      while (!mQuit && mPass == pass)
+         mStart.Wait();
+      if (mQuit)
+         break;
+      pass = mPass;
+      ProcessMixers();
+   }
+   mLock.Unlock();
+}
+
+void AudioMixPool::ProcessMixers()
+{
+   while (mNext < mNumMixers) {
+      int i = mNext++;
+
+      mLock.Unlock();
+      int processed = mMixers[i]->Process(mLen);
+      mLock.Lock();
+
+      mProcessed[i] = processed;
+      if (--mRemaining == 0)
+         mDone.Signal();
+   }
+}
+
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -540,6 +692,9 @@ AudioIO::AudioIO()
 #endif
    mSilentBuf = NULL;
    mLastSilentBufSize = 0;
+   mCaptureResampleIn = NULL;
+   mCaptureResampleOut = NULL;
+   mCaptureResampleOutLen = 0;
 
    mStreamToken = 0;
    mStopStreamCount = 0;
@@ -1187,6 +1342,8 @@ int AudioIO::StartStream(WaveTrackArray playbackTracks,
    mCutPreviewGapLen = cutPreviewGapLen;
    mPlaybackBuffers = NULL;
    mPlaybackMixers = NULL;
+   mMixPool = NULL;
+   mMixProcessed = NULL;
    mCaptureBuffers = NULL;
    mResample = NULL;
 
@@ -1312,6 +1469,30 @@ int AudioIO::StartStream(WaveTrackArray playbackTracks,
                                                mRate, floatSample, false);
                mPlaybackMixers[i]->ApplyTrackGains(false);
             }
+
+            // The audio thread mixes too, so it needs one thread fewer
+            mMixProcessed = new int[mPlaybackTracks.GetCount()];
+            long mixThreads = 1;
+            gPrefs->Read(wxT("/AudioIO/PlaybackMixThreads"), &mixThreads, 1L);
+            mixThreads = std::min(mixThreads, (long)mPlaybackTracks.GetCount());
+            if (mixThreads > 1)
+               mMixPool = new AudioMixPool(mixThreads - 1);
+
+            // Looped playback pads short tracks with silence, at most as
+            // much as FillBuffers() copies at once
+            if (mPlayLooped && mLastSilentBufSize < playbackMixBufferSize + 1)
+            {
+               if (mSilentBuf)
+                  DeleteSamples(mSilentBuf);
+               mLastSilentBufSize = playbackMixBufferSize + 1;
+               mSilentBuf = NewSamples(mLastSilentBufSize, floatSample);
+               if (!mSilentBuf)
+               {
+                  mLastSilentBufSize = 0;
+                  throw std::bad_alloc();
+               }
+               ClearSamples(mSilentBuf, floatSample, 0, mLastSilentBufSize);
+            }
          }
 
          if( mNumCaptureChannels > 0 )
@@ -1343,6 +1524,15 @@ int AudioIO::StartStream(WaveTrackArray playbackTracks,
                                                     captureBufferSize );
                mResample[i] = new Resample(true, mFactor, mFactor); // constant rate resampling
             }
+
+            // FillBuffers() resamples at most a ring buffer's worth at a time
+            if (mFactor != 1.0)
+            {
+               mCaptureResampleIn = new float[captureBufferSize];
+               mCaptureResampleOutLen =
+                  (sampleCount)(captureBufferSize * mFactor) + 1;
+               mCaptureResampleOut = new float[mCaptureResampleOutLen];
+            }
          }
       }
       catch(std::bad_alloc&)
@@ -1396,6 +1586,9 @@ int AudioIO::StartStream(WaveTrackArray playbackTracks,
    }
 
    mAudioThreadFillBuffersLoopRunning = true;
+
+   // From here on FillBuffers() should work in the buffers allocated above
+   WatchSampleAllocations(mThread->GetId());
 #ifdef EXPERIMENTAL_MIDI_OUT
    // If audio is not running, mNumFrames will not be incremented and
    // MIDI will hang waiting for it unless we do it here.
@@ -1427,6 +1620,19 @@ void AudioIO::StartStreamCleanup(bool bOnlyBuffers)
       mPlaybackBuffers = NULL;
    }
 
+   // Stop the mixing threads before deleting their mixers
+   if(mMixPool)
+   {
+      delete mMixPool;
+      mMixPool = NULL;
+   }
+
+   if(mMixProcessed)
+   {
+      delete [] mMixProcessed;
+      mMixProcessed = NULL;
+   }
+
    if(mPlaybackMixers)
    {
       for( unsigned int i = 0; i < mPlaybackTracks.GetCount(); i++ )
@@ -1451,6 +1657,11 @@ void AudioIO::StartStreamCleanup(bool bOnlyBuffers)
       mResample = NULL;
    }
 
+   delete [] mCaptureResampleIn;
+   mCaptureResampleIn = NULL;
+   delete [] mCaptureResampleOut;
+   mCaptureResampleOut = NULL;
+
    if(!bOnlyBuffers)
    {
       Pa_AbortStream( mPortStreamV19 );
@@ -1715,6 +1926,12 @@ void AudioIO::StopStream()
          wxMilliSleep( 50 );
       }
 
+      int allocations = GetWatchedSampleAllocations();
+      WatchSampleAllocations(0);
+      if (allocations > 0)
+         wxLogDebug(wxT("AudioIO: the audio thread allocated %d times while the stream ran"),
+                    allocations);
+
       //
       // Everything is taken care of.  Now, just free all the resources
       // we allocated in StartStream()
@@ -1722,6 +1939,11 @@ void AudioIO::StopStream()
 
       if( mPlaybackTracks.GetCount() > 0 )
       {
+         delete mMixPool;
+         mMixPool = NULL;
+         delete[] mMixProcessed;
+         mMixProcessed = NULL;
+
          for( unsigned int i = 0; i < mPlaybackTracks.GetCount(); i++ )
          {
             delete mPlaybackBuffers[i];
@@ -1802,6 +2024,11 @@ void AudioIO::StopStream()
 
          delete[] mCaptureBuffers;
          delete[] mResample;
+
+         delete [] mCaptureResampleIn;
+         mCaptureResampleIn = NULL;
+         delete [] mCaptureResampleOut;
+         mCaptureResampleOut = NULL;
       }
    }
 
@@ -1861,6 +2088,18 @@ bool AudioIO::IsStreamActive(int token)
    return (this->IsStreamActive() && this->IsAudioTokenActive(token));
 }
 
+bool AudioIO::IsCapturingInto(WaveClip *clip)
+{
+   if (!IsBusy())
+      return false;
+
+   for (unsigned int i = 0; i < mCaptureTracks.GetCount(); i++)
+      if (mCaptureTracks[i]->GetClipIndex(clip) >= 0)
+         return true;
+
+   return false;
+}
+
 bool AudioIO::IsAudioTokenActive(int token)
 {
    return ( token > 0 && token == mStreamToken );
@@ -2717,19 +2956,29 @@ void AudioIO::FillBuffers()
 
             secsAvail -= deltat;
 
+            // The mixers here aren't actually mixing: they're just doing
+            // resampling, format conversion, and possibly time track
+            // warping, each for its own track, so the pool can run them
+            // all at once
+            //don't do anything if we have no length.  In particular, Process() will fail an wxAssert
+            //that causes a crash since this is not the GUI thread and wxASSERT is a GUI call.
+            if(deltat > 0.0)
+            {
+               if (mMixPool)
+                  mMixPool->Process(mPlaybackMixers, mPlaybackTracks.GetCount(),
+                                    lrint(deltat * mRate), mMixProcessed);
+               else
+                  for( i = 0; i < mPlaybackTracks.GetCount(); i++ )
+                     mMixProcessed[i] = mPlaybackMixers[i]->Process(lrint(deltat * mRate));
+            }
+
             for( i = 0; i < mPlaybackTracks.GetCount(); i++ )
             {
-               // The mixer here isn't actually mixing: it's just doing
-               // resampling, format conversion, and possibly time track
-               // warping
                int processed = 0;
-               samplePtr warpedSamples;
-               //don't do anything if we have no length.  In particular, Process() will fail an wxAssert
-               //that causes a crash since this is not the GUI thread and wxASSERT is a GUI call.
                if(deltat > 0.0)
                {
-                  processed = mPlaybackMixers[i]->Process(lrint(deltat * mRate));
-                  warpedSamples = mPlaybackMixers[i]->GetBuffer();
+                  processed = mMixProcessed[i];
+                  samplePtr warpedSamples = mPlaybackMixers[i]->GetBuffer();
                   mPlaybackBuffers[i]->Put(warpedSamples, floatSample, processed);
                }
                //if looping and processed is less than the full chunk/block/buffer that gets pulled from
@@ -2778,7 +3027,7 @@ void AudioIO::FillBuffers()
       {
          // Append captured samples to the end of the WaveTracks.
          // The WaveTracks have their own buffering for efficiency.
-         XMLStringWriter blockFileLog;
+         mBlockFileLog.Reset();
          int numChannels = mCaptureTracks.GetCount();
 
          for( i = 0; (int)i < numChannels; i++ )
@@ -2786,46 +3035,52 @@ void AudioIO::FillBuffers()
             int avail = commonlyAvail;
             sampleFormat trackFormat = mCaptureTracks[i]->GetSampleFormat();
 
-            XMLStringWriter appendLog;
+            mAppendLog.Reset();
 
             if( mFactor == 1.0 )
             {
-               samplePtr temp = NewSamples(avail, trackFormat);
-               mCaptureBuffers[i]->Get   (temp, trackFormat, avail);
-               mCaptureTracks[i]-> Append(temp, trackFormat, avail, 1,
-                                          &appendLog);
-               DeleteSamples(temp);
+               // The ring buffer holds samples in the track's format, so
+               // append them straight from it
+               samplePtr region[2];
+               int regionLen[2];
+               avail = mCaptureBuffers[i]->AcquireReadRegions(avail,
+                                          &region[0], &regionLen[0],
+                                          &region[1], &regionLen[1]);
+               for (int r = 0; r < 2; r++)
+                  if (regionLen[r] > 0)
+                     mCaptureTracks[i]-> Append(region[r], trackFormat,
+                                                regionLen[r], 1, &mAppendLog);
+               mCaptureBuffers[i]->ReleaseRead(avail);
             }
             else
             {
                int size = lrint(avail * mFactor);
-               samplePtr temp1 = NewSamples(avail, floatSample);
-               samplePtr temp2 = NewSamples(size, floatSample);
-               mCaptureBuffers[i]->Get(temp1, floatSample, avail);
+               if (size > mCaptureResampleOutLen)
+                  size = mCaptureResampleOutLen;
+               mCaptureBuffers[i]->Get((samplePtr)mCaptureResampleIn,
+                                       floatSample, avail);
                /* we are re-sampling on the fly. The last resampling call
                 * must flush any samples left in the rate conversion buffer
                 * so that they get recorded
                 */
-               size = mResample[i]->Process(mFactor, (float *)temp1, avail, !IsStreamActive(),
-                                            &size, (float *)temp2, size);
-               mCaptureTracks[i]-> Append(temp2, floatSample, size, 1,
-                                          &appendLog);
-               DeleteSamples(temp1);
-               DeleteSamples(temp2);
+               size = mResample[i]->Process(mFactor, mCaptureResampleIn, avail, !IsStreamActive(),
+                                            &size, mCaptureResampleOut, size);
+               mCaptureTracks[i]-> Append((samplePtr)mCaptureResampleOut,
+                                          floatSample, size, 1, &mAppendLog);
             }
 
-            if (!appendLog.IsEmpty())
+            if (!mAppendLog.IsEmpty())
             {
-               blockFileLog.StartTag(wxT("recordingrecovery"));
-               blockFileLog.WriteAttr(wxT("channel"), (int)i);
-               blockFileLog.WriteAttr(wxT("numchannels"), numChannels);
-               blockFileLog.WriteSubTree(appendLog);
-               blockFileLog.EndTag(wxT("recordingrecovery"));
+               mBlockFileLog.StartTag(wxT("recordingrecovery"));
+               mBlockFileLog.WriteAttr(wxT("channel"), (int)i);
+               mBlockFileLog.WriteAttr(wxT("numchannels"), numChannels);
+               mBlockFileLog.WriteSubTree(mAppendLog);
+               mBlockFileLog.EndTag(wxT("recordingrecovery"));
             }
          }
 
-         if (mListener && !blockFileLog.IsEmpty())
-            mListener->OnAudioIONewBlockFiles(blockFileLog);
+         if (mListener && !mBlockFileLog.IsEmpty())
+            mListener->OnAudioIONewBlockFiles(mBlockFileLog);
       }
    }  // end of record buffering
 }
@@ -3486,10 +3741,15 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
                   continue;
                }
 
+            // Mix straight out of the ring buffer, which hands the
+            // samples over in two pieces if they wrap around its end
+            samplePtr region[2];
+            int regionLen[2];
             unsigned int len = (unsigned int)
-               gAudioIO->mPlaybackBuffers[t]->Get((samplePtr)tempFloats,
-                                                  floatSample,
-                                                  (int)framesPerBuffer);
+               gAudioIO->mPlaybackBuffers[t]->AcquireReadRegions(
+                                                  (int)framesPerBuffer,
+                                                  &region[0], &regionLen[0],
+                                                  &region[1], &regionLen[1]);
 #else
             // This code was reorganized so that if all audio tracks
             // are muted, we still return paComplete when the end of
@@ -3500,6 +3760,8 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
             // silence? If it terminates immediately, does that terminate any MIDI
             // playback that might also be going on? ...Maybe muted audio tracks + MIDI,
             // the playback would NEVER terminate. ...I think the #else part is probably preferable...
+            samplePtr region[2];
+            int regionLen[2];
             unsigned int len;
             if (cut)
             {
@@ -3508,9 +3770,10 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
             } else
             {
                len = (unsigned int)
-                  gAudioIO->mPlaybackBuffers[t]->Get((samplePtr)tempFloats,
-                                                     floatSample,
-                                                     (int)framesPerBuffer);
+                  gAudioIO->mPlaybackBuffers[t]->AcquireReadRegions(
+                                                     (int)framesPerBuffer,
+                                                     &region[0], &regionLen[0],
+                                                     &region[1], &regionLen[1]);
             }
 #endif
             // If our buffer is empty and the time indicator is past
@@ -3527,42 +3790,51 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
                continue;
 #endif
 
-            if (vt->GetChannel() == Track::LeftChannel ||
-                vt->GetChannel() == Track::MonoChannel)
+            unsigned int offset = 0;
+            for (int r = 0; r < 2; offset += regionLen[r], r++)
             {
-               float gain = vt->GetChannelGain(0);
+               float *src = (float *)region[r];
+               float *meterDest = outputMeterFloats + numPlaybackChannels*offset;
+               float *dest = outputFloats + numPlaybackChannels*offset;
+               unsigned int rlen = (unsigned int)regionLen[r];
 
-               // Output volume emulation: possibly copy meter samples, then
-               // apply volume, then copy to the output buffer
-               if (outputMeterFloats != outputFloats)
-                  for (i = 0; i < len; ++i)
-                     outputMeterFloats[numPlaybackChannels*i] +=
-                        gain*tempFloats[i];
+               if (vt->GetChannel() == Track::LeftChannel ||
+                   vt->GetChannel() == Track::MonoChannel)
+               {
+                  float gain = vt->GetChannelGain(0);
 
-               if (gAudioIO->mEmulateMixerOutputVol)
-                  gain *= gAudioIO->mMixerOutputVol;
+                  // Output volume emulation: possibly copy meter samples, then
+                  // apply volume, then copy to the output buffer
+                  if (outputMeterFloats != outputFloats)
+                     for (i = 0; i < rlen; ++i)
+                        meterDest[numPlaybackChannels*i] += gain*src[i];
 
-               for(i=0; i<len; i++)
-                  outputFloats[numPlaybackChannels*i] += gain*tempFloats[i];
-            }
+                  if (gAudioIO->mEmulateMixerOutputVol)
+                     gain *= gAudioIO->mMixerOutputVol;
 
-            if (vt->GetChannel() == Track::RightChannel ||
-                vt->GetChannel() == Track::MonoChannel)
-            {
-               float gain = vt->GetChannelGain(1);
+                  for(i=0; i<rlen; i++)
+                     dest[numPlaybackChannels*i] += gain*src[i];
+               }
+
+               if (vt->GetChannel() == Track::RightChannel ||
+                   vt->GetChannel() == Track::MonoChannel)
+               {
+                  float gain = vt->GetChannelGain(1);
 
-               // Output volume emulation (as above)
-               if (outputMeterFloats != outputFloats)
-                  for (i = 0; i < len; ++i)
-                     outputMeterFloats[numPlaybackChannels*i+1] +=
-                        gain*tempFloats[i];
+                  // Output volume emulation (as above)
+                  if (outputMeterFloats != outputFloats)
+                     for (i = 0; i < rlen; ++i)
+                        meterDest[numPlaybackChannels*i+1] += gain*src[i];
 
-               if (gAudioIO->mEmulateMixerOutputVol)
-                  gain *= gAudioIO->mMixerOutputVol;
+                  if (gAudioIO->mEmulateMixerOutputVol)
+                     gain *= gAudioIO->mMixerOutputVol;
 
-               for(i=0; i<len; i++)
-                  outputFloats[numPlaybackChannels*i+1] += gain*tempFloats[i];
+                  for(i=0; i<rlen; i++)
+                     dest[numPlaybackChannels*i+1] += gain*src[i];
+               }
             }
+
+            gAudioIO->mPlaybackBuffers[t]->ReleaseRead(len);
          }
 
          //
@@ -3614,43 +3886,71 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
          if (len > 0) {
             for( t = 0; t < numCaptureChannels; t++) {
 
-               // dmazzoni:
-               // Un-interleave.  Ugly special-case code required because the
-               // capture channels could be in three different sample formats;
-               // it'd be nice to be able to call CopySamples, but it can't
-               // handle multiplying by the gain and then clipping.  Bummer.
-
-               switch(gAudioIO->mCaptureFormat) {
-               case floatSample: {
-                  float *inputFloats = (float *)inputBuffer;
-                  for( i = 0; i < len; i++)
-                     tempFloats[i] =
-                        inputFloats[numCaptureChannels*i+t];
-               } break;
-               case int24Sample:
-                  // We should never get here. Audacity's int24Sample format
-                  // is different from PortAudio's sample format and so we
-                  // make PortAudio return float samples when recording in
-                  // 24-bit samples.
-                  wxASSERT(false);
-                  break;
-               case int16Sample: {
-                  short *inputShorts = (short *)inputBuffer;
-                  short *tempShorts = (short *)tempBuffer;
-                  for( i = 0; i < len; i++) {
-                     float tmp = inputShorts[numCaptureChannels*i+t];
-                     if (tmp > 32767)
-                        tmp = 32767;
-                     if (tmp < -32768)
-                        tmp = -32768;
-                     tempShorts[i] = (short)(tmp);
-                  }
-               } break;
-               } // switch
+               RingBuffer *ring = gAudioIO->mCaptureBuffers[t];
+
+               // When the track records in PortAudio's format, un-interleave
+               // straight into the ring buffer's free space (in up to two
+               // pieces, where it wraps around); otherwise un-interleave
+               // into tempBuffer and let Put() convert.
+               samplePtr region[2];
+               int regionLen[2];
+               bool inPlace = (ring->GetFormat() == gAudioIO->mCaptureFormat);
+               int written = len;
+               if (inPlace)
+                  written = ring->AcquireWriteRegions(len,
+                                            &region[0], &regionLen[0],
+                                            &region[1], &regionLen[1]);
+               else {
+                  region[0] = (samplePtr)tempBuffer;
+                  regionLen[0] = len;
+                  regionLen[1] = 0;
+               }
+
+               unsigned int offset = 0;
+               for (int r = 0; r < 2; offset += regionLen[r], r++) {
+                  unsigned int rlen = (unsigned int)regionLen[r];
+
+                  // dmazzoni:
+                  // Un-interleave.  Ugly special-case code required because the
+                  // capture channels could be in three different sample formats;
+                  // it'd be nice to be able to call CopySamples, but it can't
+                  // handle multiplying by the gain and then clipping.  Bummer.
+
+                  switch(gAudioIO->mCaptureFormat) {
+                  case floatSample: {
+                     float *inputFloats = (float *)inputBuffer + numCaptureChannels*offset;
+                     float *destFloats = (float *)region[r];
+                     for( i = 0; i < rlen; i++)
+                        destFloats[i] =
+                           inputFloats[numCaptureChannels*i+t];
+                  } break;
+                  case int24Sample:
+                     // We should never get here. Audacity's int24Sample format
+                     // is different from PortAudio's sample format and so we
+                     // make PortAudio return float samples when recording in
+                     // 24-bit samples.
+                     wxASSERT(false);
+                     break;
+                  case int16Sample: {
+                     short *inputShorts = (short *)inputBuffer + numCaptureChannels*offset;
+                     short *destShorts = (short *)region[r];
+                     for( i = 0; i < rlen; i++) {
+                        float tmp = inputShorts[numCaptureChannels*i+t];
+                        if (tmp > 32767)
+                           tmp = 32767;
+                        if (tmp < -32768)
+                           tmp = -32768;
+                        destShorts[i] = (short)(tmp);
+                     }
+                  } break;
+                  } // switch
+               }
 
-               gAudioIO->mCaptureBuffers[t]->Put((samplePtr)tempBuffer,
-                                                 gAudioIO->mCaptureFormat,
-                                                 len);
+               if (inPlace)
+                  ring->CommitWrite(written);
+               else
+                  ring->Put((samplePtr)tempBuffer, gAudioIO->mCaptureFormat,
+                            len);
             }
          }
       }
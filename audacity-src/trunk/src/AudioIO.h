@@ -34,6 +34,7 @@
 
 #include "WaveTrack.h"
 #include "SampleFormat.h"
+#include "xml/XMLWriter.h"
 
 class AudioIO;
 class RingBuffer;
@@ -41,6 +42,7 @@ class Mixer;
 class Resample;
 class TimeTrack;
 class AudioThread;
+class AudioMixPool;
 class Meter;
 class TimeTrack;
 class wxDialog;
@@ -140,6 +142,10 @@ class AUDACITY_DLL_API AudioIO {
    bool IsStreamActive();
    bool IsStreamActive(int token);
 
+   /** \brief Returns true if the audio thread may be appending to clip,
+    * because it belongs to a track that is being recorded into */
+   bool IsCapturingInto(WaveClip *clip);
+
 #ifdef EXPERIMENTAL_MIDI_OUT
    /** \brief Compute the current PortMidi timestamp time.
     *
@@ -490,6 +496,8 @@ private:
    WaveTrackArray      mPlaybackTracks;
 
    Mixer             **mPlaybackMixers;
+   AudioMixPool       *mMixPool;
+   int                *mMixProcessed;
    int                 mStreamToken;
    int                 mStopStreamCount;
    static int          mNextStreamToken;
@@ -554,6 +562,14 @@ private:
    samplePtr mSilentBuf;
    sampleCount mLastSilentBufSize;
 
+   // Scratch space for FillBuffers(), allocated in StartStream() so that
+   // the audio thread doesn't allocate while the stream runs
+   float              *mCaptureResampleIn;
+   float              *mCaptureResampleOut;
+   sampleCount         mCaptureResampleOutLen;
+   XMLStringWriter     mBlockFileLog;
+   XMLStringWriter     mAppendLog;
+
    AudioIOListener*    mListener;
 
    friend class AudioThread;
@@ -18,6 +18,9 @@ recover previous Audacity projects that were closed incorrectly.
 #include "Audacity.h"
 #include "AudacityApp.h"
 #include "FileNames.h"
+#include "Internat.h"
+#include "Tags.h"
+#include "Track.h"
 #include "blockfile/SimpleBlockFile.h"
 
 #include <wx/wxprec.h>
@@ -25,6 +28,17 @@ recover previous Audacity projects that were closed incorrectly.
 #include <wx/dir.h>
 #include <wx/dialog.h>
 #include <wx/app.h>
+#include <wx/file.h>
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#ifdef __WXMSW__
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 enum {
    ID_RECOVER_ALL = 10000,
@@ -249,6 +263,140 @@ bool ShowAutoRecoveryDialogIfNeeded(AudacityProject** pproj,
    }
 }
 
+////////////////////////////////////////////////////////////////////////////
+/// Auto-save journal framing
+////////////////////////////////////////////////////////////////////////////
+
+// Precedes each journal entry as "<!--journal <bytes> <checksum>-->\n".
+// A comment, so the XML parser skips it.
+static const char kJournalMarker[] = "<!--journal ";
+static const char kJournalMarkerEnd[] = "-->\n";
+
+// FNV-1a, which is plenty to catch a torn write
+static wxUint32 JournalChecksum(const char *data, size_t len)
+{
+   wxUint32 sum = 2166136261u;
+   for (size_t i = 0; i < len; i++) {
+      sum ^= (unsigned char)data[i];
+      sum *= 16777619u;
+   }
+   return sum;
+}
+
+static bool SyncFile(wxFile &file)
+{
+#ifdef __WXMSW__
+   return _commit(file.fd()) == 0;
+#else
+   return fsync(file.fd()) == 0;
+#endif
+}
+
+wxFileOffset AppendAutoSaveJournalEntry(const wxString &fileName,
+                                        const wxString &entry)
+{
+   wxCharBuffer utf8 = entry.mb_str(wxConvUTF8);
+   size_t len = strlen(utf8);
+
+   char header[64];
+   sprintf(header, "%s%lu %08lx%s", kJournalMarker, (unsigned long)len,
+           (unsigned long)JournalChecksum(utf8, len), kJournalMarkerEnd);
+   size_t headerLen = strlen(header);
+
+   wxFile f(fileName, wxFile::write_append);
+   if (!f.IsOpened() ||
+       f.Write(header, headerLen) != headerLen ||
+       f.Write(utf8, len) != len ||
+       !SyncFile(f))
+      return 0;
+
+   return headerLen + len;
+}
+
+// Returns the offset just past the frame that starts at pos, or -1 if
+// there is no complete frame there
+static long JournalFrameEnd(const char *data, long size, long pos)
+{
+   long markerLen = strlen(kJournalMarker);
+   if (size - pos < markerLen ||
+       strncmp(data + pos, kJournalMarker, markerLen) != 0)
+      return -1;
+
+   // The header is short; don't scan past what it can be
+   char header[64];
+   long headerLen = wxMin(size - pos, (long)sizeof(header) - 1);
+   memcpy(header, data + pos, headerLen);
+   header[headerLen] = '\0';
+
+   char *end = strstr(header, kJournalMarkerEnd);
+   unsigned long len, sum;
+   if (!end ||
+       sscanf(header + markerLen, "%lu %lx", &len, &sum) != 2)
+      return -1;
+
+   long start = pos + (end - header) + strlen(kJournalMarkerEnd);
+   if ((unsigned long)(size - start) < len ||
+       JournalChecksum(data + start, len) != sum)
+      return -1;
+
+   return start + len;
+}
+
+void TrimAutoSaveJournal(const wxString &fileName)
+{
+   wxFile f(fileName, wxFile::read_write);
+   if (!f.IsOpened())
+      return;
+
+   wxFileOffset length = f.Length();
+   if (length <= 0)
+      return;
+
+   std::vector<char> data((size_t)length);
+   if (f.Read(&data[0], (size_t)length) != (ssize_t)length)
+      return;
+
+   // The snapshot comes first, and can't contain the marker, since the
+   // XML writer escapes '<' in text
+   const char *begin = &data[0];
+   long size = (long)length;
+   long markerLen = strlen(kJournalMarker);
+   const char *first = std::search(begin, begin + size, kJournalMarker,
+                                   kJournalMarker + markerLen);
+   long pos = first - begin;
+   if (pos < size) {
+      long next;
+      while ((next = JournalFrameEnd(begin, size, pos)) >= 0)
+         pos = next;
+   }
+   else {
+      // No entry, unless a crash tore the marker of the first one
+      const char *last = begin + size;
+      while (last > begin && begin + size - last < markerLen && *(last - 1) != '<')
+         last--;
+      if (last == begin || *(last - 1) != '<')
+         return;
+      pos = (last - 1) - begin;
+      if (strncmp(begin + pos, kJournalMarker, size - pos) != 0)
+         return;
+   }
+
+   // Whatever follows the last complete entry was torn, or is the
+   // </project> that an earlier attempt to open the file added
+   if (pos < size) {
+      wxLogDebug(wxT("Dropping %ld bytes after the auto-save journal"),
+                 size - pos);
+#ifdef __WXMSW__
+      if (_chsize(f.fd(), pos) != 0)
+         return;
+#else
+      if (ftruncate(f.fd(), pos) != 0)
+         return;
+#endif
+      SyncFile(f);
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////
 /// Recording recovery handler
 
@@ -345,3 +493,74 @@ XMLTagHandler* RecordingRecoveryHandler::HandleXMLChild(const wxChar *tag)
 
    return NULL;
 }
+
+////////////////////////////////////////////////////////////////////////////
+/// Auto-save journal handler
+
+AutoSaveJournalHandler::AutoSaveJournalHandler(AudacityProject* proj)
+{
+   mProject = proj;
+   mOldTracks = new TrackList();
+}
+
+AutoSaveJournalHandler::~AutoSaveJournalHandler()
+{
+   mOldTracks->Clear(true);
+   delete mOldTracks;
+}
+
+bool AutoSaveJournalHandler::HandleXMLTag(const wxChar *tag,
+                                          const wxChar **attrs)
+{
+   if (wxStrcmp(tag, wxT("autosavejournal")) != 0)
+      return false;
+
+   // loop through attrs, which is a null-terminated list of
+   // attribute-value pairs
+   double dValue;
+   while(*attrs)
+   {
+      const wxChar *attr = *attrs++;
+      const wxChar *value = *attrs++;
+
+      if (!value)
+         break;
+
+      const wxString strValue = value;
+      if (!XMLValueChecker::IsGoodString(strValue) ||
+          !Internat::CompatibleToDouble(strValue, &dValue))
+         return false;
+
+      if (wxStrcmp(attr, wxT("sel0")) == 0)
+         mProject->SetSel0(dValue);
+      else if (wxStrcmp(attr, wxT("sel1")) == 0)
+         mProject->SetSel1(dValue);
+   }
+
+   // The tracks of this entry replace all of those read so far
+   TrackList *tracks = mProject->GetTracks();
+   std::vector<Track *> old;
+   TrackListIterator iter(tracks);
+   for (Track *t = iter.First(); t; t = iter.Next())
+      old.push_back(t);
+   tracks->Clear(false);
+   for (size_t i = 0; i < old.size(); i++)
+      mOldTracks->Add(old[i]);
+
+   mProject->GetTags()->Clear();
+
+   return true;
+}
+
+XMLTagHandler* AutoSaveJournalHandler::HandleXMLChild(const wxChar *tag)
+{
+   // The project knows how to read tracks and tags
+   if (wxStrcmp(tag, wxT("tags")) == 0 ||
+       wxStrcmp(tag, wxT("wavetrack")) == 0 ||
+       wxStrcmp(tag, wxT("notetrack")) == 0 ||
+       wxStrcmp(tag, wxT("labeltrack")) == 0 ||
+       wxStrcmp(tag, wxT("timetrack")) == 0)
+      return mProject->HandleXMLChild(tag);
+
+   return NULL;
+}
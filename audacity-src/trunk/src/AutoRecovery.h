@@ -15,6 +15,7 @@
 #include "xml/XMLTagHandler.h"
 
 #include <wx/debug.h>
+#include <wx/filefn.h>
 
 //
 // Show auto recovery dialog if there are projects to recover. Should be
@@ -32,6 +33,22 @@
 bool ShowAutoRecoveryDialogIfNeeded(AudacityProject** pproj,
                                     bool *didRecoverAnything);
 
+//
+// Appends an <autosavejournal> entry to an auto-save file and syncs it to
+// the disk.  The entry is preceded by a comment giving its length in
+// bytes and a checksum, so that recovery can tell a complete entry from
+// one that a crash tore.  Returns the number of bytes written, or 0 if
+// the entry couldn't be written.
+//
+wxFileOffset AppendAutoSaveJournalEntry(const wxString &fileName,
+                                        const wxString &entry);
+
+//
+// Cuts an auto-save file back to the end of its last complete journal
+// entry, if one after it is incomplete.  Call before parsing the file.
+//
+void TrimAutoSaveJournal(const wxString &fileName);
+
 //
 // XML Handler for a <recordingrecovery> tag
 //
@@ -51,4 +68,27 @@ private:
    int mNumChannels;
 };
 
+//
+// XML Handler for an <autosavejournal> tag, which replaces the tracks read
+// so far with the later version of them that it holds
+//
+class AutoSaveJournalHandler: public XMLTagHandler
+{
+public:
+   AutoSaveJournalHandler(AudacityProject* proj);
+   virtual ~AutoSaveJournalHandler();
+   virtual bool HandleXMLTag(const wxChar *tag, const wxChar **attrs);
+   virtual XMLTagHandler *HandleXMLChild(const wxChar *tag);
+
+   // This class only knows reading tags
+   virtual void WriteXML(XMLWriter & WXUNUSED(xmlFile)) { wxASSERT(false); }
+
+private:
+   AudacityProject* mProject;
+   // The tracks of every version replaced so far.  They hold on to their
+   // blocks until the handler is deleted, which the project does once
+   // the recovered tracks have references of their own.
+   TrackList* mOldTracks;
+};
+
 #endif
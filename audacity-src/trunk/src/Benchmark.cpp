@@ -17,6 +17,8 @@ of the BlockFile system.
 
 #include "Audacity.h"
 
+#include <math.h>
+
 #include <wx/log.h>
 #include <wx/textctrl.h>
 #include <wx/button.h>
@@ -34,6 +36,7 @@ of the BlockFile system.
 #include <wx/intl.h>
 
 #include "Benchmark.h"
+#include "BlockFile.h"
 #include "Project.h"
 #include "WaveTrack.h"
 #include "Sequence.h"
@@ -516,6 +519,45 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
           wxT("simultaneous tracks that could be played at once: %.1f\n"),
           (nChunks*chunkSize/44100.0)/(elapsed/1000.0));
 
+   {
+      Printf(wxT("Timing summary computation...\n"));
+      wxTheApp->Yield();
+      FlushPrint();
+
+      sampleCount summaryLen = (sampleCount)dataSize * 1048576 / sizeof(float);
+      float *samples = new float[summaryLen];
+      for (i = 0; i < summaryLen; i++)
+         samples[i] = (rand() - RAND_MAX / 2) / (float)RAND_MAX;
+
+      sampleCount numWindows = (summaryLen + 255) / 256;
+      float *scalarSummary = new float[numWindows * 3];
+      float *summary = new float[numWindows * 3];
+
+      timer.Start();
+      BlockFile::CalcSummary256Scalar(samples, summaryLen, scalarSummary);
+      long scalarElapsed = timer.Time();
+
+      timer.Start();
+      BlockFile::CalcSummary256(samples, summaryLen, summary);
+      elapsed = timer.Time();
+
+      bad = 0;
+      for (i = 0; i < numWindows; i++)
+         if (summary[3*i] != scalarSummary[3*i] ||
+             summary[3*i+1] != scalarSummary[3*i+1] ||
+             fabs(summary[3*i+2] - scalarSummary[3*i+2]) > 1e-5)
+            bad++;
+
+      Printf(wxT("Time to summarize %.1f MB: %ld ms (plain loop: %ld ms)\n"),
+             summaryLen * sizeof(float) / 1048576.0, elapsed, scalarElapsed);
+      if (bad > 0)
+         Printf(wxT("Summaries differ in %d/%d windows\n"), bad, (int)numWindows);
+
+      delete[] samples;
+      delete[] scalarSummary;
+      delete[] summary;
+   }
+
    goto success;
 
  fail:
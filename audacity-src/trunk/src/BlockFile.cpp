@@ -54,6 +54,11 @@ out.
 #include "BlockFile.h"
 #include "Internat.h"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BLOCKFILE_USE_SSE
+#endif
+
 // msmeyer: Define this to add debug output via printf()
 //#define DEBUG_BLOCKFILE
 
@@ -78,13 +83,46 @@ SummaryInfo::SummaryInfo(sampleCount samples)
 
    frames64K = (samples + 65535) / 65536;
    frames256 = frames64K * 256;
+   frames1K = frames64K * 64;
+   frames4K = frames64K * 16;
+   frames16K = frames64K * 4;
 
    offset64K = headerTagLen;
    offset256 = offset64K + (frames64K * bytesPerFrame);
-   totalSummaryBytes = offset256 + (frames256 * bytesPerFrame);
+   offset1K = offset256 + (frames256 * bytesPerFrame);
+   offset4K = offset1K + (frames1K * bytesPerFrame);
+   offset16K = offset4K + (frames4K * bytesPerFrame);
+   totalSummaryBytes = offset16K + (frames16K * bytesPerFrame);
 }
 
-char *BlockFile::fullSummary = 0;
+int SummaryInfo::GetLevel(int divisor, sampleCount *frames) const
+{
+   switch (divisor) {
+   case 256:
+      *frames = frames256;
+      return offset256;
+   case 65536:
+      *frames = frames64K;
+      return offset64K;
+   }
+
+   if (frames1K == 0)
+      return -1;
+
+   switch (divisor) {
+   case 1024:
+      *frames = frames1K;
+      return offset1K;
+   case 4096:
+      *frames = frames4K;
+      return offset4K;
+   case 16384:
+      *frames = frames16K;
+      return offset16K;
+   }
+
+   return -1;
+}
 
 /// Initializes the base BlockFile data.  The block is initially
 /// unlocked and its reference count is 1.
@@ -179,9 +217,104 @@ bool BlockFile::Deref()
       return false;
 }
 
-void BlockFile::Deinit()
+/// Computes the minimum, maximum and RMS of every 256-sample window of
+/// buffer, storing three floats per window in summary256.  The last
+/// window may be partial.  This plain version is the reference for
+/// CalcSummary256(); BenchmarkDialog compares the two.
+void BlockFile::CalcSummary256Scalar(const float *buffer, sampleCount len,
+                                     float *summary256)
+{
+   sampleCount sumLen = (len + 255) / 256;
+
+   for (sampleCount i = 0; i < sumLen; i++) {
+      const float *window = buffer + i * 256;
+      sampleCount jcount = 256;
+      if (i * 256 + jcount > len)
+         jcount = len - i * 256;
+
+      float min = window[0];
+      float max = window[0];
+      float sumsq = min * min;
+      for (sampleCount j = 1; j < jcount; j++) {
+         float f1 = window[j];
+         sumsq += f1 * f1;
+         if (f1 < min)
+            min = f1;
+         else if (f1 > max)
+            max = f1;
+      }
+
+      summary256[i * 3] = min;
+      summary256[i * 3 + 1] = max;
+      summary256[i * 3 + 2] = (float)sqrt(sumsq / jcount);
+   }
+}
+
+/// Same as CalcSummary256Scalar(), but reduces four lanes at a time with
+/// SSE where the compiler targets it.  It keeps no state, so any number of
+/// threads may run it at once.  The RMS may differ from the scalar version
+/// in the last bits, since the squares are summed in a different order.
+void BlockFile::CalcSummary256(const float *buffer, sampleCount len,
+                               float *summary256)
 {
-   if(fullSummary)delete[] fullSummary;
+#ifdef BLOCKFILE_USE_SSE
+   sampleCount sumLen = (len + 255) / 256;
+
+   for (sampleCount i = 0; i < sumLen; i++) {
+      const float *window = buffer + i * 256;
+      sampleCount jcount = 256;
+      if (i * 256 + jcount > len)
+         jcount = len - i * 256;
+
+      float min, max, sumsq;
+      sampleCount j = 0;
+
+      if (jcount >= 4) {
+         __m128 v = _mm_loadu_ps(window);
+         __m128 vmin = v;
+         __m128 vmax = v;
+         __m128 vsumsq = _mm_mul_ps(v, v);
+         for (j = 4; j + 4 <= jcount; j += 4) {
+            v = _mm_loadu_ps(window + j);
+            vmin = _mm_min_ps(vmin, v);
+            vmax = _mm_max_ps(vmax, v);
+            vsumsq = _mm_add_ps(vsumsq, _mm_mul_ps(v, v));
+         }
+
+         // Fold the four lanes
+         vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+         vmin = _mm_min_ss(vmin, _mm_shuffle_ps(vmin, vmin, 1));
+         vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+         vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+         vsumsq = _mm_add_ps(vsumsq, _mm_movehl_ps(vsumsq, vsumsq));
+         vsumsq = _mm_add_ss(vsumsq, _mm_shuffle_ps(vsumsq, vsumsq, 1));
+         _mm_store_ss(&min, vmin);
+         _mm_store_ss(&max, vmax);
+         _mm_store_ss(&sumsq, vsumsq);
+      }
+      else {
+         min = max = window[0];
+         sumsq = min * min;
+         j = 1;
+      }
+
+      // Leftovers of a partial window
+      for (; j < jcount; j++) {
+         float f1 = window[j];
+         sumsq += f1 * f1;
+         if (f1 < min)
+            min = f1;
+         if (f1 > max)
+            max = f1;
+      }
+
+      summary256[i * 3] = min;
+      summary256[i * 3 + 1] = max;
+      summary256[i * 3 + 2] = (float)sqrt(sumsq / jcount);
+   }
+#else
+   CalcSummary256Scalar(buffer, len, summary256);
+#endif
 }
 
 /// Get a buffer containing a summary block describing this sample
@@ -192,8 +325,9 @@ void BlockFile::Deinit()
 /// This method also has the side effect of setting the mMin, mMax,
 /// and mRMS members of this class.
 ///
-/// You must not delete the returned buffer; it is static to this
-/// method.
+/// The returned buffer is allocated for each call, so this can run on
+/// several threads at once (as the OD tasks do); the caller must delete[]
+/// it as a char array.
 ///
 /// @param buffer A buffer containing the sample data to be analyzed
 /// @param len    The length of the sample data
@@ -201,20 +335,36 @@ void BlockFile::Deinit()
 void *BlockFile::CalcSummary(samplePtr buffer, sampleCount len,
                              sampleFormat format)
 {
-   if(fullSummary)delete[] fullSummary;
-   fullSummary = new char[mSummaryInfo.totalSummaryBytes];
+   char *fullSummary = new char[mSummaryInfo.totalSummaryBytes];
+
+   // Don't allocate and copy if we don't need to.
+   float *scratch = (format == floatSample) ? NULL : new float[len];
+   CalcSummaryInto(fullSummary, buffer, len, format, scratch);
+   delete[] scratch;
 
+   return fullSummary;
+}
+
+void BlockFile::CalcSummaryInto(char *fullSummary, samplePtr buffer,
+                                sampleCount len, sampleFormat format,
+                                float *scratch)
+{
    memcpy(fullSummary, headerTag, headerTagLen);
 
    float *summary64K = (float *)(fullSummary + mSummaryInfo.offset64K);
    float *summary256 = (float *)(fullSummary + mSummaryInfo.offset256);
 
-   float *fbuffer = new float[len];
-   CopySamples(buffer, format,
-               (samplePtr)fbuffer, floatSample, len);
+   float *fbuffer;
+   if (format == floatSample)
+      fbuffer = (float *)buffer;
+   else {
+      fbuffer = scratch;
+      CopySamples(buffer, format,
+                  (samplePtr)fbuffer, floatSample, len);
+   }
 
    sampleCount sumLen;
-   sampleCount i, j, jcount;
+   sampleCount i, j;
 
    float min, max;
    float sumsq;
@@ -222,28 +372,8 @@ void *BlockFile::CalcSummary(samplePtr buffer, sampleCount len,
    // Recalc 256 summaries
    sumLen = (len + 255) / 256;
 
-   for (i = 0; i < sumLen; i++) {
-      min = fbuffer[i * 256];
-      max = fbuffer[i * 256];
-      sumsq = ((float)min) * ((float)min);
-      jcount = 256;
-      if (i * 256 + jcount > len)
-         jcount = len - i * 256;
-      for (j = 1; j < jcount; j++) {
-         float f1 = fbuffer[i * 256 + j];
-         sumsq += ((float)f1) * ((float)f1);
-         if (f1 < min)
-            min = f1;
-         else if (f1 > max)
-            max = f1;
-      }
-
-      float rms = (float)sqrt(sumsq / jcount);
+   CalcSummary256(fbuffer, len, summary256);
 
-      summary256[i * 3] = min;
-      summary256[i * 3 + 1] = max;
-      summary256[i * 3 + 2] = rms;
-   }
    for (i = sumLen; i < mSummaryInfo.frames256; i++) {
       // filling in the remaining bits with non-harming/contributing values
       summary256[i * 3] = FLT_MAX;  // min
@@ -251,6 +381,9 @@ void *BlockFile::CalcSummary(samplePtr buffer, sampleCount len,
       summary256[i * 3 + 2] = 0.0f; // rms
    }
 
+   // Recalc 1K, 4K and 16K summaries
+   CalcSummaryLevels(fullSummary);
+
    // Recalc 64K summaries
    sumLen = (len + 65535) / 65536;
 
@@ -298,10 +431,61 @@ void *BlockFile::CalcSummary(samplePtr buffer, sampleCount len,
    mMin = min;
    mMax = max;
    mRMS = sqrt(sumsq / sumLen);
+}
+
+// Combines each group of four frames of a summary level into one frame
+// of the next coarser level.  Unused frames of the finer level hold
+// FLT_MAX / -FLT_MAX / 0 and so don't contribute.
+static void CalcCoarserSummary(const float *fine, float *coarse,
+                               sampleCount coarseFrames)
+{
+   for (sampleCount i = 0; i < coarseFrames; i++) {
+      const float *f = &fine[i * 12];
+      float min = f[0];
+      float max = f[1];
+      float sumsq = f[2] * f[2];
+      for (int j = 1; j < 4; j++) {
+         if (f[3 * j] < min)
+            min = f[3 * j];
+         if (f[3 * j + 1] > max)
+            max = f[3 * j + 1];
+         sumsq += f[3 * j + 2] * f[3 * j + 2];
+      }
+      coarse[i * 3] = min;
+      coarse[i * 3 + 1] = max;
+      coarse[i * 3 + 2] = (float)sqrt(sumsq / 4);
+   }
+}
 
-   delete[] fbuffer;
+void BlockFile::CalcSummaryLevels(void *data)
+{
+   if (mSummaryInfo.frames1K == 0 ||
+       mSummaryInfo.format != floatSample ||
+       mSummaryInfo.fields != 3)
+      return;
 
-   return fullSummary;
+   char *summary = (char *)data;
+   CalcCoarserSummary((float *)(summary + mSummaryInfo.offset256),
+                      (float *)(summary + mSummaryInfo.offset1K),
+                      mSummaryInfo.frames1K);
+   CalcCoarserSummary((float *)(summary + mSummaryInfo.offset1K),
+                      (float *)(summary + mSummaryInfo.offset4K),
+                      mSummaryInfo.frames4K);
+   CalcCoarserSummary((float *)(summary + mSummaryInfo.offset4K),
+                      (float *)(summary + mSummaryInfo.offset16K),
+                      mSummaryInfo.frames16K);
+}
+
+bool BlockFile::CompleteSummary(void *data, int bytesRead)
+{
+   if (bytesRead == mSummaryInfo.totalSummaryBytes)
+      return true;
+
+   if (mSummaryInfo.frames1K == 0 || bytesRead != mSummaryInfo.offset1K)
+      return false;
+
+   CalcSummaryLevels(data);
+   return true;
 }
 
 static void ComputeMinMax256(float *summary256,
@@ -439,31 +623,7 @@ void BlockFile::GetMinMax(float *outMin, float *outMax, float *outRMS)
 bool BlockFile::Read256(float *buffer,
                         sampleCount start, sampleCount len)
 {
-   wxASSERT(start >= 0);
-
-   char *summary = new char[mSummaryInfo.totalSummaryBytes];
-   this->ReadSummary(summary);
-
-   if (start+len > mSummaryInfo.frames256)
-      len = mSummaryInfo.frames256 - start;
-
-   CopySamples(summary + mSummaryInfo.offset256 + (start * mSummaryInfo.bytesPerFrame),
-               mSummaryInfo.format,
-               (samplePtr)buffer, floatSample, len * mSummaryInfo.fields);
-
-   if (mSummaryInfo.fields == 2) {
-      // No RMS info
-      int i;
-      for(i=len-1; i>=0; i--) {
-         buffer[3*i+2] = (fabs(buffer[2*i]) + fabs(buffer[2*i+1]))/4.0;
-         buffer[3*i+1] = buffer[2*i+1];
-         buffer[3*i] = buffer[2*i];
-      }
-   }
-
-   delete[] summary;
-
-   return true;
+   return ReadSummaryLevel(256, buffer, start, len);
 }
 
 /// Retrieves a portion of the 64K summary buffer from this BlockFile.  This
@@ -477,19 +637,38 @@ bool BlockFile::Read256(float *buffer,
 /// @param len     The number of 64K-sample summary frames to read
 bool BlockFile::Read64K(float *buffer,
                         sampleCount start, sampleCount len)
+{
+   return ReadSummaryLevel(65536, buffer, start, len);
+}
+
+/// Retrieves a portion of one level of the summary: the minimum, maximum
+/// and RMS value for every group of divisor samples in the file.
+///
+/// @param divisor One of 256, 1024, 4096, 16384 or 65536; see
+///                HasSummaryLevel()
+/// @param *buffer The area where the summary information will be
+///                written.  It must be at least len*3 long.
+/// @param start   The offset in divisor-sample increments
+/// @param len     The number of summary frames to read
+bool BlockFile::ReadSummaryLevel(int divisor, float *buffer,
+                                 sampleCount start, sampleCount len)
 {
    wxASSERT(start >= 0);
 
+   sampleCount frames;
+   int offset = mSummaryInfo.GetLevel(divisor, &frames);
+   if (offset < 0)
+      return false;
+
    char *summary = new char[mSummaryInfo.totalSummaryBytes];
    this->ReadSummary(summary);
 
-   if (start+len > mSummaryInfo.frames64K)
-      len = mSummaryInfo.frames64K - start;
+   if (start+len > frames)
+      len = frames - start;
 
-   CopySamples(summary + mSummaryInfo.offset64K +
-               (start * mSummaryInfo.bytesPerFrame),
+   CopySamples(summary + offset + (start * mSummaryInfo.bytesPerFrame),
                mSummaryInfo.format,
-               (samplePtr)buffer, floatSample, len*mSummaryInfo.fields);
+               (samplePtr)buffer, floatSample, len * mSummaryInfo.fields);
 
    if (mSummaryInfo.fields == 2) {
       // No RMS info; make guess
@@ -506,6 +685,12 @@ bool BlockFile::Read64K(float *buffer,
    return true;
 }
 
+bool BlockFile::HasSummaryLevel(int divisor)
+{
+   sampleCount frames;
+   return mSummaryInfo.GetLevel(divisor, &frames) >= 0;
+}
+
 /// Constructs an AliasBlockFile based on the given information about
 /// the aliased file.
 ///
@@ -585,6 +770,7 @@ void AliasBlockFile::WriteSummary()
                                             floatSample);
    summaryFile.Write(summaryData, mSummaryInfo.totalSummaryBytes);
 
+   delete[] (char *)summaryData;
    DeleteSamples(sampleData);
 }
 
@@ -624,7 +810,7 @@ bool AliasBlockFile::ReadSummary(void *data)
 
    FixSummary(data);
 
-   return (read == mSummaryInfo.totalSummaryBytes);
+   return CompleteSummary(data, read);
 }
 
 /// Modify this block to point at a different file.  This is generally
@@ -26,6 +26,11 @@ class SummaryInfo {
  public:
    SummaryInfo(sampleCount samples);
 
+   /// Returns the byte offset of the summary level with one frame per
+   /// divisor samples and sets *frames to its length, or returns -1 if
+   /// there is no such level.
+   int GetLevel(int divisor, sampleCount *frames) const;
+
    int            fields; /* Usually 3 for Min, Max, RMS */
    sampleFormat   format;
    int            bytesPerFrame;
@@ -33,6 +38,15 @@ class SummaryInfo {
    int            offset64K;
    sampleCount    frames256;
    int            offset256;
+   // Intermediate levels, appended after the 256 level so that older
+   // versions still read the rest.  frames1K is 0 when they are absent
+   // (legacy block files).
+   sampleCount    frames1K;
+   int            offset1K;
+   sampleCount    frames4K;
+   int            offset4K;
+   sampleCount    frames16K;
+   int            offset16K;
    int            totalSummaryBytes;
 };
 
@@ -47,20 +61,34 @@ class BlockFile {
    BlockFile(wxFileName fileName, sampleCount samples);
    virtual ~BlockFile();
 
-   static void Deinit();
-
    // Reading
 
    /// Retrieves audio data from this BlockFile
    virtual int ReadData(samplePtr data, sampleFormat format,
                         sampleCount start, sampleCount len) = 0;
 
+   /// Returns a pointer straight to the stored samples from start to
+   /// start+len, if they are held in memory or mapped in exactly the
+   /// requested format; otherwise NULL, and the caller should use
+   /// ReadData().  A non-NULL pointer stays valid until the token it sets
+   /// is given to ReleaseDirectData().  Several threads may read the same
+   /// block at once, each with its own token.
+   virtual samplePtr GetDirectData(sampleFormat WXUNUSED(format),
+                                   sampleCount WXUNUSED(start),
+                                   sampleCount WXUNUSED(len),
+                                   void **token) { *token = NULL; return NULL; }
+   virtual void ReleaseDirectData(void *WXUNUSED(token)) {}
+
    // Other Properties
 
    // Write cache to disk, if it has any
    virtual bool GetNeedWriteCacheToDisk() { return false; }
    virtual void WriteCacheToDisk() { /* no cache by default */ }
 
+   // Whether writing the file of a new block failed, so that the file is
+   // missing or incomplete
+   virtual bool GetWriteFailed() { return false; }
+
    // Fill read cache of block file, if it has any
    virtual bool GetNeedFillCache() { return false; }
    virtual void FillCache() { /* no cache by default */ }
@@ -93,6 +121,19 @@ class BlockFile {
    virtual bool Read256(float *buffer, sampleCount start, sampleCount len);
    /// Returns the 64K summary data block
    virtual bool Read64K(float *buffer, sampleCount start, sampleCount len);
+   /// Returns the summary frames for windows of divisor samples, where
+   /// divisor is 256, 1024, 4096, 16384 or 65536
+   virtual bool ReadSummaryLevel(int divisor, float *buffer,
+                                 sampleCount start, sampleCount len);
+   /// Returns TRUE if this block has a summary level for divisor
+   bool HasSummaryLevel(int divisor);
+
+   /// Computes min, max and RMS of each 256-sample window into summary256
+   static void CalcSummary256(const float *buffer, sampleCount len,
+                              float *summary256);
+   /// Unvectorized reference version of CalcSummary256
+   static void CalcSummary256Scalar(const float *buffer, sampleCount len,
+                                    float *summary256);
 
    /// Returns TRUE if this block references another disk file
    virtual bool IsAlias() { return false; }
@@ -145,9 +186,15 @@ class BlockFile {
    virtual int RefCount(){return mRefCount;}
 
  protected:
-   /// Calculate summary data for the given sample data
+   /// Calculate summary data for the given sample data.  The caller
+   /// owns the returned buffer.
    virtual void *CalcSummary(samplePtr buffer, sampleCount len,
                              sampleFormat format);
+   /// Calculates the summary into fullSummary, which holds
+   /// mSummaryInfo.totalSummaryBytes.  Unless format is floatSample,
+   /// scratch must hold len floats.
+   void CalcSummaryInto(char *fullSummary, samplePtr buffer, sampleCount len,
+                        sampleFormat format, float *scratch);
    /// Read the summary section of the file.  Derived classes implement.
    virtual bool ReadSummary(void *data) = 0;
 
@@ -155,12 +202,19 @@ class BlockFile {
    /// on a different platform
    virtual void FixSummary(void *data);
 
+   /// Called by ReadSummary() with the number of bytes it found on disk.
+   /// Summaries written before the 1K, 4K and 16K levels existed end
+   /// after the 256 level; those levels are computed from it here.
+   /// Returns TRUE if data now holds the complete summary.
+   bool CompleteSummary(void *data, int bytesRead);
+
+   /// Compute the 1K, 4K and 16K levels from the 256 level
+   void CalcSummaryLevels(void *data);
+
  private:
    int mLockCount;
    int mRefCount;
 
-   static char *fullSummary;
-
  protected:
    wxFileName mFileName;
    sampleCount mLen;
@@ -55,9 +55,11 @@ WX_DECLARE_HASH_MAP(BlockFile *, bool,
 
 // Given a project, returns a single array of all SeqBlocks
 // in the current set of tracks.  Enumerating that array allows
-// you to process all block files in the current set.
+// you to process all block files in the current set.  Only pass
+// writable if the blocks will be replaced: it gives each sequence
+// blocks of its own, unshared with the undo history.
 static void GetAllSeqBlocks(AudacityProject *project,
-                            BlockArray *outBlocks)
+                            BlockArray *outBlocks, bool writable)
 {
    TrackList *tracks = project->GetTracks();
    TrackListIterator iter(tracks);
@@ -69,7 +71,9 @@ static void GetAllSeqBlocks(AudacityProject *project,
          while(node) {
             WaveClip *clip = node->GetData();
             Sequence *sequence = clip->GetSequence();
-            BlockArray *blocks = sequence->GetBlockArray();
+            const BlockArray *blocks = writable ?
+               sequence->GetWritableBlockArray() :
+               ((const Sequence *)sequence)->GetBlockArray();
             int i;
             for (i = 0; i < (int)blocks->GetCount(); i++)
                outBlocks->Add(blocks->Item(i));
@@ -90,7 +94,7 @@ static void ReplaceBlockFiles(AudacityProject *project,
 {
    DirManager *dirManager = project->GetDirManager();
    BlockArray blocks;
-   GetAllSeqBlocks(project, &blocks);
+   GetAllSeqBlocks(project, &blocks, true);
 
    int i;
    for (i = 0; i < (int)blocks.GetCount(); i++) {
@@ -112,7 +116,7 @@ void FindDependencies(AudacityProject *project,
    sampleFormat format = project->GetDefaultFormat();
 
    BlockArray blocks;
-   GetAllSeqBlocks(project, &blocks);
+   GetAllSeqBlocks(project, &blocks, false);
 
    AliasedFileHash aliasedFileHash;
    BoolBlockFileHash blockFileHash;
@@ -179,7 +183,7 @@ static void RemoveDependencies(AudacityProject *project,
    }
 
    BlockArray blocks;
-   GetAllSeqBlocks(project, &blocks);
+   GetAllSeqBlocks(project, &blocks, false);
 
    const sampleFormat format = project->GetDefaultFormat();
    ReplacedBlockFileHash blockFileHash;
@@ -349,6 +349,8 @@ DirManager::DirManager()
 
    mLoadingTarget = NULL;
    mMaxSamples = -1;
+   mKeepFiles = false;
+   mBackgroundImports = 0;
 
    // toplevel pool hash is fully populated to begin
    {
@@ -384,6 +386,10 @@ void DirManager::CleanTempDir()
    if (dontDeleteTempFiles)
       return; // do nothing
 
+   // Pooled block file handles would keep the files from being removed
+   // on Windows
+   SimpleBlockFileHandlePool::Instance()->CloseAll();
+
    wxArrayString filePathArray;
 
    // Subtract 1 because we don't want to delete the global temp directory,
@@ -442,6 +448,8 @@ bool DirManager::SetProject(wxString& newProjPath, wxString& newProjName, const
       saved version of the old project must not be moved,
       otherwise the old project would not be safe.) */
 
+   AssertNoBackgroundImports();
+
    /*i18n-hint: This title appears on a dialog that indicates the progress in doing something.*/
    ProgressDialog *progress = new ProgressDialog(_("Progress"),
                                                  _("Saving project data files"));
@@ -840,7 +848,8 @@ wxFileName DirManager::MakeBlockFileName()
 
       baseFileName.Printf(wxT("e%02x%02x%03x"),topnum,midnum,filenum);
 
-      if (mBlockFileHash.find(baseFileName) == mBlockFileHash.end()){
+      if (mBlockFileHash.find(baseFileName) == mBlockFileHash.end() &&
+          mReservedFileNames.find(baseFileName) == mReservedFileNames.end()){
          // not in the hash, good.
          if (!this->AssignFile(ret, baseFileName, true))
          {
@@ -867,12 +876,23 @@ BlockFile *DirManager::NewSimpleBlockFile(
                                  sampleFormat format,
                                  bool allowDeferredWrite)
 {
-   wxFileName fileName = MakeBlockFileName();
+   wxFileName fileName;
+   {
+      wxCriticalSectionLocker locker(mBlockFileHashCS);
+      fileName = MakeBlockFileName();
+      mReservedFileNames[fileName.GetName()] = NULL;
+   }
 
+   // The summary is computed without holding the lock, so that several
+   // threads can make blocks at once.  The block, its name and its place
+   // in the hash are still allocated, on the audio thread too.
+   CountWatchedAllocation();
    BlockFile *newBlockFile =
        new SimpleBlockFile(fileName, sampleData, sampleLen, format,
                            allowDeferredWrite);
 
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
+   mReservedFileNames.erase(fileName.GetName());
    mBlockFileHash[fileName.GetName()]=newBlockFile;
 
    return newBlockFile;
@@ -882,6 +902,7 @@ BlockFile *DirManager::NewAliasBlockFile(
                                  wxString aliasedFile, sampleCount aliasStart,
                                  sampleCount aliasLen, int aliasChannel)
 {
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
    wxFileName fileName = MakeBlockFileName();
 
    BlockFile *newBlockFile =
@@ -898,6 +919,7 @@ BlockFile *DirManager::NewODAliasBlockFile(
                                  wxString aliasedFile, sampleCount aliasStart,
                                  sampleCount aliasLen, int aliasChannel)
 {
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
    wxFileName fileName = MakeBlockFileName();
 
    BlockFile *newBlockFile =
@@ -914,6 +936,7 @@ BlockFile *DirManager::NewODDecodeBlockFile(
                                  wxString aliasedFile, sampleCount aliasStart,
                                  sampleCount aliasLen, int aliasChannel, int decodeType)
 {
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
    wxFileName fileName = MakeBlockFileName();
 
    BlockFile *newBlockFile =
@@ -929,12 +952,14 @@ BlockFile *DirManager::NewODDecodeBlockFile(
 
 bool DirManager::ContainsBlockFile(BlockFile *b)
 {
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
    return b ? mBlockFileHash[b->GetFileName().GetName()] == b : false;
 }
 
 bool DirManager::ContainsBlockFile(wxString filepath)
 {
    // check what the hash returns in case the blockfile is from a different project
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
    return mBlockFileHash[filepath] != NULL;
 }
 
@@ -950,8 +975,10 @@ BlockFile *DirManager::CopyBlockFile(BlockFile *b)
       //but it's something to watch out for.
       //
       // LLL: Except for silent block files which have uninitialized filename.
-      if (b->GetFileName().IsOk())
+      if (b->GetFileName().IsOk()) {
+         wxCriticalSectionLocker locker(mBlockFileHashCS);
          mBlockFileHash[b->GetFileName().GetName()]=b;
+      }
       return b;
    }
 
@@ -963,7 +990,12 @@ BlockFile *DirManager::CopyBlockFile(BlockFile *b)
       b2 = b->Copy(wxFileName());
    else
    {
-      wxFileName newFile = MakeBlockFileName();
+      wxFileName newFile;
+      {
+         wxCriticalSectionLocker locker(mBlockFileHashCS);
+         newFile = MakeBlockFileName();
+         mReservedFileNames[newFile.GetName()] = NULL;
+      }
 
       // We assume that the new file should have the same extension
       // as the existing file
@@ -971,14 +1003,19 @@ BlockFile *DirManager::CopyBlockFile(BlockFile *b)
 
       //some block files such as ODPCMAliasBlockFIle don't always have
       //a summary file, so we should check before we copy.
+      bool copied = true;
       if(b->IsSummaryAvailable())
       {
-         if( !wxCopyFile(b->GetFileName().GetFullPath(),
-                  newFile.GetFullPath()) )
-            return NULL;
+         SimpleBlockFileWriter::Instance()->Wait(b);
+
+         copied = wxCopyFile(b->GetFileName().GetFullPath(),
+                             newFile.GetFullPath());
       }
 
-      b2 = b->Copy(newFile);
+      b2 = copied ? b->Copy(newFile) : NULL;
+
+      wxCriticalSectionLocker locker(mBlockFileHashCS);
+      mReservedFileNames.erase(newFile.GetName());
 
       if (b2 == NULL)
          return NULL;
@@ -1051,6 +1088,12 @@ bool DirManager::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
       // BuildFromXML failed, or we didn't find a valid blockfile tag.
       return false;
 
+   *mLoadingTarget = AddLoadedBlockFile(pBlockFile);
+   return (*mLoadingTarget != NULL);
+}
+
+BlockFile *DirManager::AddLoadedBlockFile(BlockFile *pBlockFile)
+{
    // Check the length here so we don't have to do it in each BuildFromXML method.
    if ((mMaxSamples > -1) && // is initialized
          (pBlockFile->GetLength() > mMaxSamples))
@@ -1059,10 +1102,8 @@ bool DirManager::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
       // Lock pBlockFile so that the ~BlockFile() will not delete the file on disk.
       pBlockFile->Lock();
       delete pBlockFile;
-      return false;
+      return NULL;
    }
-   else
-      *mLoadingTarget = pBlockFile;
 
    //
    // If the block we loaded is already in the hash table, then the
@@ -1070,26 +1111,26 @@ bool DirManager::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
    // return a reference to the existing object instead.
    //
 
-   wxString name = (*mLoadingTarget)->GetFileName().GetName();
+   wxString name = pBlockFile->GetFileName().GetName();
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
    BlockFile *retrieved = mBlockFileHash[name];
    if (retrieved) {
       // Lock it in order to delete it safely, i.e. without having
       // it delete the file, too...
-      (*mLoadingTarget)->Lock();
-      delete (*mLoadingTarget);
+      pBlockFile->Lock();
+      delete pBlockFile;
 
       Ref(retrieved); // Add one to its reference count
-      *mLoadingTarget = retrieved;
-      return true;
+      return retrieved;
    }
 
    // This is a new object
-   mBlockFileHash[name]=*mLoadingTarget;
+   mBlockFileHash[name]=pBlockFile;
    // MakeBlockFileName wasn't used so we must add the directory
    // balancing information
    BalanceInfoAdd(name);
 
-   return true;
+   return pBlockFile;
 }
 
 bool DirManager::MoveOrCopyToNewProjectDirectory(BlockFile *f, bool copy)
@@ -1106,10 +1147,17 @@ bool DirManager::MoveOrCopyToNewProjectDirectory(BlockFile *f, bool copy)
    if (!this->AssignFile(newFileName, f->GetFileName().GetFullName(), false))
       return false;
 
+   // The file may not have been written yet
+   SimpleBlockFileWriter::Instance()->Wait(f);
+
    if (newFileName != f->GetFileName()) {
       //check to see that summary exists before we copy.
       bool summaryExisted = f->IsSummaryAvailable();
       if (summaryExisted) {
+         // Open files can't be renamed on all platforms.
+         if (!copy)
+            SimpleBlockFileHandlePool::Instance()->Close(f);
+
          if(!copy && !wxRenameFile(f->GetFileName().GetFullPath(), newFileName.GetFullPath()))
             return false;
          if(copy && !wxCopyFile(f->GetFileName().GetFullPath(), newFileName.GetFullPath()))
@@ -1173,11 +1221,16 @@ void DirManager::Deref(BlockFile * f)
    //       f->mRefCount-1,
    //       (const char *)f->mFileName.GetFullPath().mb_str());
 
+   // Lock it so that ~BlockFile() leaves the file alone
+   if (mKeepFiles && f->mRefCount == 1)
+      f->Lock();
+
    if (f->Deref()) {
       // If Deref() returned true, the reference count reached zero
       // and this block is no longer needed.  Remove it from the hash
       // table.
 
+      wxCriticalSectionLocker locker(mBlockFileHashCS);
       mBlockFileHash.erase(theFileName);
       BalanceInfoDel(theFileName);
 
@@ -1235,6 +1288,7 @@ bool DirManager::EnsureSafeFilename(wxFileName fName)
 
    bool needToRename = false;
    wxBusyCursor busy;
+   AssertNoBackgroundImports();
    BlockHash::iterator iter = mBlockFileHash.begin();
    while (iter != mBlockFileHash.end())
    {
@@ -1332,18 +1386,25 @@ bool DirManager::EnsureSafeFilename(wxFileName fName)
 
 void DirManager::Ref()
 {
+   // Sequences are made and deleted on import and rendering threads too
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
    wxASSERT(mRef > 0); // MM: If mRef is smaller, it should have been deleted already
    ++mRef;
 }
 
 void DirManager::Deref()
 {
-   wxASSERT(mRef > 0); // MM: If mRef is smaller, it should have been deleted already
+   bool last;
+   {
+      wxCriticalSectionLocker locker(mBlockFileHashCS);
+      wxASSERT(mRef > 0); // MM: If mRef is smaller, it should have been deleted already
 
-   --mRef;
+      --mRef;
+      last = (mRef == 0);
+   }
 
    // MM: Automatically delete if refcount reaches zero
-   if (mRef == 0)
+   if (last)
       delete this;
 }
 
@@ -1669,6 +1730,7 @@ void DirManager::FindMissingAliasedFiles(
       BlockHash& missingAliasedFileAUFHash,     // output: (.auf) AliasBlockFiles whose aliased files are missing
       BlockHash& missingAliasedFilePathHash)    // output: full paths of missing aliased files
 {
+   AssertNoBackgroundImports();
    BlockHash::iterator iter = mBlockFileHash.begin();
    while (iter != mBlockFileHash.end())
    {
@@ -1704,6 +1766,7 @@ void DirManager::FindMissingAliasedFiles(
 void DirManager::FindMissingAUFs(
       BlockHash& missingAUFHash)                // output: missing (.auf) AliasBlockFiles
 {
+   AssertNoBackgroundImports();
    BlockHash::iterator iter = mBlockFileHash.begin();
    while (iter != mBlockFileHash.end())
    {
@@ -1730,6 +1793,7 @@ void DirManager::FindMissingAUFs(
 void DirManager::FindMissingAUs(
       BlockHash& missingAUHash)                 // missing data (.au) blockfiles
 {
+   AssertNoBackgroundImports();
    BlockHash::iterator iter = mBlockFileHash.begin();
    while (iter != mBlockFileHash.end())
    {
@@ -1830,6 +1894,7 @@ void DirManager::FillBlockfilesCache()
    BlockHash::iterator iter;
    int numNeed = 0;
 
+   AssertNoBackgroundImports();
    iter = mBlockFileHash.begin();
    while (iter != mBlockFileHash.end())
    {
@@ -1862,11 +1927,57 @@ void DirManager::FillBlockfilesCache()
 #endif // DEPRECATED_AUDIO_CACHE
 }
 
+bool DirManager::FlushPendingWrites()
+{
+   bool success = SimpleBlockFileWriter::Instance()->Flush();
+
+   // A block whose file couldn't be written still has its samples in
+   // memory, but the project file can't refer to it yet
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
+   BlockHash::iterator iter = mBlockFileHash.begin();
+   while (iter != mBlockFileHash.end()) {
+      if (iter->second->GetWriteFailed())
+         success = false;
+      iter++;
+   }
+
+   return success;
+}
+
+// static
+void DirManager::QuitPendingWrites()
+{
+   SimpleBlockFileWriter::Instance()->Quit();
+}
+
+void DirManager::BeginBackgroundImport()
+{
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
+   mBackgroundImports++;
+}
+
+void DirManager::EndBackgroundImport()
+{
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
+   wxASSERT(mBackgroundImports > 0);
+   mBackgroundImports--;
+}
+
+void DirManager::AssertNoBackgroundImports()
+{
+#ifdef __WXDEBUG__
+   wxCriticalSectionLocker locker(mBlockFileHashCS);
+   wxASSERT_MSG(mBackgroundImports == 0,
+                wxT("Walking the block files while an import makes them"));
+#endif
+}
+
 void DirManager::WriteCacheToDisk()
 {
    BlockHash::iterator iter;
    int numNeed = 0;
 
+   AssertNoBackgroundImports();
    iter = mBlockFileHash.begin();
    while (iter != mBlockFileHash.end())
    {
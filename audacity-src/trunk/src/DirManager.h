@@ -15,6 +15,7 @@
 #include <wx/string.h>
 #include <wx/filename.h>
 #include <wx/hashmap.h>
+#include <wx/thread.h>
 
 #include "WaveTrack.h"
 
@@ -42,7 +43,8 @@ class DirManager: public XMLTagHandler {
 
    static void SetTempDir(wxString _temp) { globaltemp = _temp; }
 
-   // MM: Ref count mechanism for the DirManager itself
+   // MM: Ref count mechanism for the DirManager itself.  Safe to call
+   // from any thread.
    void Ref();
    void Deref();
 
@@ -56,6 +58,11 @@ class DirManager: public XMLTagHandler {
 
    wxLongLong GetFreeDiskSpace();
 
+   // Making, copying and dropping single block files may be done on
+   // import threads while the GUI thread does the same, and so may Ref()
+   // and Deref() of the DirManager.  Functions that walk every block file,
+   // such as saving or checking the project, must not run while an import
+   // is making blocks in the background.
    BlockFile *NewSimpleBlockFile(samplePtr sampleData,
                                  sampleCount sampleLen,
                                  sampleFormat format,
@@ -103,7 +110,16 @@ class DirManager: public XMLTagHandler {
    void SetLoadingFormat(sampleFormat format) { mLoadingFormat = format; }
    void SetLoadingBlockLength(sampleCount len) { mLoadingBlockLen = len; }
    void SetMaxSamples(sampleCount max) { mMaxSamples = max; }
+   // While set, a block file whose last reference is dropped keeps its
+   // file on disk.  Opening a project sets it, since the versions of the
+   // tracks an auto-save journal replaces may use files the saved
+   // project still needs.
+   void SetKeepFiles(bool keep) { mKeepFiles = keep; }
    bool HandleXMLTag(const wxChar *tag, const wxChar **attrs);
+   // Takes a block file read from a project into the hash table, or
+   // returns the one already there for the same file instead.  Returns
+   // NULL if the block is longer than SetMaxSamples() allows.
+   BlockFile *AddLoadedBlockFile(BlockFile *pBlockFile);
    XMLTagHandler *HandleXMLChild(const wxChar * WXUNUSED(tag)) { return NULL; }
    void WriteXML(XMLWriter & WXUNUSED(xmlFile)) { wxASSERT(false); }; // This class only reads tags.
    bool AssignFile(wxFileName &filename,wxString value,bool check);
@@ -153,11 +169,28 @@ class DirManager: public XMLTagHandler {
    // Write all write-cached block files to disc, if any
    void WriteCacheToDisk();
 
+   // Wait until new block files still being written in the background
+   // (of any project) are on disk, and sync them.  Call this before
+   // writing a project file that refers to them.  Returns false if that
+   // failed, or if a block file of this project could not be written.
+   bool FlushPendingWrites();
+
+   // Stop the thread that writes new block files; call once on exit
+   static void QuitPendingWrites();
+
    // Fill cache of blockfiles, if caching is enabled (otherwise do nothing)
    void FillBlockfilesCache();
 
+   // An import that makes block files on threads of its own brackets
+   // them with these.  The walks over every block file don't lock the
+   // hash, so in debug builds they assert that no such import is running.
+   void BeginBackgroundImport();
+   void EndBackgroundImport();
+
  private:
 
+   void AssertNoBackgroundImports();
+
    wxFileName MakeBlockFileName();
    wxFileName MakeBlockFilePath(wxString value);
 
@@ -166,6 +199,8 @@ class DirManager: public XMLTagHandler {
    int mRef; // MM: Current refcount
 
    BlockHash mBlockFileHash; // repository for blockfiles
+   BlockHash mReservedFileNames; // named, but not yet in mBlockFileHash
+   wxCriticalSection mBlockFileHashCS; // guards both, and the dir pools
    DirHash   dirTopPool;    // available toplevel dirs
    DirHash   dirTopFull;    // full toplevel dirs
    DirHash   dirMidPool;    // available two-level dirs
@@ -189,6 +224,8 @@ class DirManager: public XMLTagHandler {
    sampleCount mLoadingBlockLen;
 
    sampleCount mMaxSamples; // max samples per block
+   bool mKeepFiles;
+   int mBackgroundImports; // guarded by mBlockFileHashCS
 
    static wxString globaltemp;
    wxString mytemp;
@@ -1175,6 +1175,45 @@ void Envelope::GetValues(double *buffer, int bufferLen,
    }
 }
 
+bool Envelope::GetConstantValue(double t0, double t1, double *value) const
+{
+   t0 -= mOffset;
+   t1 -= mOffset;
+
+   int len = mEnv.Count();
+
+   // The same easy cases as GetValues()
+   if (len <= 0) {
+      *value = mDefaultValue;
+      return true;
+   }
+   if (t1 <= mEnv[0]->GetT()) {
+      *value = mEnv[0]->GetVal();
+      return true;
+   }
+   if (t0 >= mEnv[len - 1]->GetT()) {
+      *value = mEnv[len - 1]->GetVal();
+      return true;
+   }
+
+   // Otherwise all the points from the one at or before t0 to the one
+   // at or after t1 must have the same value
+   int first = 0;
+   while (first + 1 < len && mEnv[first + 1]->GetT() <= t0)
+      first++;
+
+   double v = mEnv[first]->GetVal();
+   for (int i = first + 1; i < len; i++) {
+      if (mEnv[i]->GetVal() != v)
+         return false;
+      if (mEnv[i]->GetT() >= t1)
+         break;
+   }
+
+   *value = v;
+   return true;
+}
+
 int Envelope::NumberOfPointsAfter(double t)
 {
    if( t >= mEnv[mEnv.Count()-1]->GetT() )
@@ -160,6 +160,10 @@ class Envelope : public XMLTagHandler {
     * more than one value in a row. */
    void GetValues(double *buffer, int len, double t0, double tstep) const;
 
+   /** \brief Returns true, and the value, if GetValues() would give the
+    * same value everywhere from t0 to t1 */
+   bool GetConstantValue(double t0, double t1, double *value) const;
+
    int NumberOfPointsAfter(double t);
    double NextPointAfter(double t);
 
@@ -60,6 +60,7 @@ simplifies construction of menu items.
 #ifdef USE_MIDI
 #include "import/ImportMIDI.h"
 #endif // USE_MIDI
+#include "import/Import.h"
 #include "import/ImportRaw.h"
 #include "export/Export.h"
 #include "export/ExportMultiple.h"
@@ -724,6 +725,9 @@ void AudacityProject::CreateMenusAndCommands()
    c->AddItem(wxT("Resample"), _("&Resample..."), FN(OnResample),
               AudioIONotBusyFlag | WaveTracksSelectedFlag,
               AudioIONotBusyFlag | WaveTracksSelectedFlag);
+   c->AddItem(wxT("Reblock"), _("Re&block Tracks"), FN(OnReblock),
+              AudioIONotBusyFlag | WaveTracksSelectedFlag,
+              AudioIONotBusyFlag | WaveTracksSelectedFlag);
 
    c->AddSeparator();
 
@@ -4633,6 +4637,9 @@ void AudacityProject::OnImport()
    selectedFiles.Sort(CompareNoCaseFileName);
    ODManager::Pause();
 
+   // Let the next files import in the background while each is finished
+   wxGetApp().mImporter->StartImports(selectedFiles, mTrackFactory);
+
    for (size_t ff = 0; ff < selectedFiles.GetCount(); ff++) {
       wxString fileName = selectedFiles[ff];
 
@@ -4642,6 +4649,8 @@ void AudacityProject::OnImport()
       Import(fileName);
    }
 
+   wxGetApp().mImporter->CancelImports();
+
    gPrefs->Write(wxT("/LastOpenType"),wxT(""));
 
    gPrefs->Flush();
@@ -5940,6 +5949,34 @@ void AudacityProject::OnResample()
    FinishAutoScroll();
 }
 
+// Rewrite the selected tracks' block files at the size that suits their
+// length: larger for long recordings, back to the default for short ones
+void AudacityProject::OnReblock()
+{
+   TrackListIterator iter(mTracks);
+   bool success = true;
+   bool changed = false;
+
+   {
+      wxBusyCursor busy;
+      for (Track *t = iter.First(); t; t = iter.Next())
+      {
+         if (t->GetSelected() && t->GetKind() == Track::Wave)
+            success &= ((WaveTrack*)t)->Reblock(0, &changed);
+      }
+   }
+
+   // A clip that fails is left as it was, but others may have changed
+   if (changed) {
+      PushState(_("Reblocked audio track(s)"), _("Reblock Track"));
+      RedrawProject();
+   }
+
+   if (!success)
+      wxMessageBox(_("Some audio could not be reblocked, and was left as it was."),
+                   _("Reblock Tracks"), wxOK | wxICON_ERROR, this);
+}
+
 void AudacityProject::OnSnapToOff()
 {
    SetSnapTo(SNAP_OFF);
@@ -378,6 +378,7 @@ void PrevFrame();
 void NextFrame();
 
 void OnResample();
+void OnReblock();
 
 // Make sure we return to "public" for subsequent declarations in Project.h.
 public:
@@ -42,6 +42,11 @@
 #include "Resample.h"
 #include "float_cast.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIX_USE_SSE2
+#endif
+
 //TODO-MB: wouldn't it make more sense to delete the time track after 'mix and render'?
 bool MixAndRender(TrackList *tracks, TrackFactory *trackFactory,
                   double rate, sampleFormat format,
@@ -254,6 +259,7 @@ Mixer::Mixer(int numInputTracks, WaveTrack **inputTracks,
    mFormat = outFormat;
    mApplyTrackGains = true;
    mGains = new float[mNumChannels];
+   mChannelFlags = new int[mNumChannels];
    if( mixerSpec && mixerSpec->GetNumChannels() == mNumChannels &&
          mixerSpec->GetNumTracks() == mNumInputTracks )
       mMixerSpec = mixerSpec;
@@ -319,6 +325,7 @@ Mixer::~Mixer()
    delete[] mEnvValues;
    delete[] mFloatBuffer;
    delete[] mGains;
+   delete[] mChannelFlags;
    delete[] mSamplePos;
 
    for(i=0; i<mNumInputTracks; i++) {
@@ -343,10 +350,62 @@ void Mixer::Clear()
    }
 }
 
+/// Multiplies len samples of buffer by the matching envelope values
+static void MultiplyByEnvelope(float *buffer, const double *env, int len)
+{
+   int i = 0;
+#ifdef MIX_USE_SSE2
+   for (; i + 4 <= len; i += 4) {
+      __m128 e = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(env + i)),
+                               _mm_cvtpd_ps(_mm_loadu_pd(env + i + 2)));
+      _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), e));
+   }
+#endif
+   for (; i < len; i++)
+      buffer[i] *= env[i];
+}
+
+/// Multiplies len samples of buffer by value
+static void MultiplyByValue(float *buffer, float value, int len)
+{
+   int i = 0;
+#ifdef MIX_USE_SSE2
+   __m128 v = _mm_set1_ps(value);
+   for (; i + 4 <= len; i += 4)
+      _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), v));
+#endif
+   for (; i < len; i++)
+      buffer[i] *= value;
+}
+
 void MixBuffers(int numChannels, int *channelFlags, float *gains,
                 samplePtr src, samplePtr *dests,
                 int len, bool interleaved)
 {
+   float *temp = (float *)src;
+
+#ifdef MIX_USE_SSE2
+   // The common interleaved stereo case mixes both channels in one pass
+   if (interleaved && numChannels == 2 && channelFlags[0] && channelFlags[1]) {
+      float *dest = (float *)dests[0];
+      __m128 g = _mm_setr_ps(gains[0], gains[1], gains[0], gains[1]);
+      int j = 0;
+      for (; j + 4 <= len; j += 4) {
+         __m128 s = _mm_loadu_ps(temp + j);
+         float *d = dest + 2 * j;
+         _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d),
+                                     _mm_mul_ps(_mm_unpacklo_ps(s, s), g)));
+         _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4),
+                                         _mm_mul_ps(_mm_unpackhi_ps(s, s), g)));
+      }
+      for (; j < len; j++) {
+         dest[2 * j] += temp[j] * gains[0];
+         dest[2 * j + 1] += temp[j] * gains[1];
+      }
+      return;
+   }
+#endif
+
    for (int c = 0; c < numChannels; c++) {
       if (!channelFlags[c])
          continue;
@@ -364,8 +423,18 @@ void MixBuffers(int numChannels, int *channelFlags, float *gains,
 
       float gain = gains[c];
       float *dest = (float *)destPtr;
-      float *temp = (float *)src;
-      for (int j = 0; j < len; j++) {
+      int j = 0;
+#ifdef MIX_USE_SSE2
+      if (skip == 1) {
+         __m128 g = _mm_set1_ps(gain);
+         for (; j + 4 <= len; j += 4)
+            _mm_storeu_ps(dest + j,
+                          _mm_add_ps(_mm_loadu_ps(dest + j),
+                                     _mm_mul_ps(_mm_loadu_ps(temp + j), g)));
+         dest += j;
+      }
+#endif
+      for (; j < len; j++) {
          *dest += temp[j] * gain;   // the actual mixing process
          dest += skip;
       }
@@ -425,13 +494,19 @@ sampleCount Mixer::MixVariableRates(int *channelFlags, WaveTrack *track,
                        *pos,
                        getLen);
 
-            track->GetEnvelopeValues(mEnvValues,
-                                     getLen,
-                                     (*pos) / trackRate,
-                                     tstep);
-
-            for (int i = 0; i < getLen; i++) {
-               queue[(*queueLen) + i] *= mEnvValues[i];
+            double envValue;
+            double t0 = (*pos) / trackRate;
+            if (track->GetConstantEnvelopeValue(t0, t0 + (getLen - 1) * tstep,
+                                                &envValue)) {
+               if (envValue != 1.0)
+                  MultiplyByValue(&queue[*queueLen], (float)envValue, getLen);
+            }
+            else {
+               track->GetEnvelopeValues(mEnvValues,
+                                        getLen,
+                                        t0,
+                                        tstep);
+               MultiplyByEnvelope(&queue[*queueLen], mEnvValues, getLen);
             }
 
             *queueLen += getLen;
@@ -519,15 +594,21 @@ sampleCount Mixer::MixSameRate(int *channelFlags, WaveTrack *track,
       slen = mMaxOut;
 
    track->Get((samplePtr)mFloatBuffer, floatSample, *pos, slen);
-   track->GetEnvelopeValues(mEnvValues, slen, t, 1.0 / mRate);
-   for(int i=0; i<slen; i++)
-      mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
+
+   // Where the envelope is flat, it is folded into the gains below
+   // rather than applied sample by sample
+   double envValue;
+   if (!track->GetConstantEnvelopeValue(t, t + (slen - 1) / mRate, &envValue)) {
+      track->GetEnvelopeValues(mEnvValues, slen, t, 1.0 / mRate);
+      MultiplyByEnvelope(mFloatBuffer, mEnvValues, slen);
+      envValue = 1.0;
+   }
 
    for(c=0; c<mNumChannels; c++)
       if (mApplyTrackGains)
-         mGains[c] = track->GetChannelGain(c);
+         mGains[c] = track->GetChannelGain(c) * envValue;
       else
-         mGains[c] = 1.0;
+         mGains[c] = envValue;
 
    MixBuffers(mNumChannels, channelFlags, mGains,
               (samplePtr)mFloatBuffer, mTemp, slen, mInterleaved);
@@ -547,7 +628,9 @@ sampleCount Mixer::Process(sampleCount maxToProcess)
    int i, j;
    sampleCount out;
    sampleCount maxOut = 0;
-   int *channelFlags = new int[mNumChannels];
+   // Process() runs on the audio thread, so it uses the flags allocated
+   // in the constructor rather than allocating its own
+   int *channelFlags = mChannelFlags;
 
    mMaxOut = maxToProcess;
 
@@ -621,8 +704,6 @@ sampleCount Mixer::Process(sampleCount maxToProcess)
    // MB: this doesn't take warping into account, replaced with code based on mSamplePos
    //mT += (maxOut / mRate);
 
-   delete [] channelFlags;
-
    return maxOut;
 }
 
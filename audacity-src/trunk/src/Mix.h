@@ -133,6 +133,7 @@ class AUDACITY_DLL_API Mixer {
    sampleCount     *mSamplePos;
    bool             mApplyTrackGains;
    float           *mGains;
+   int             *mChannelFlags;
    double          *mEnvValues;
    double           mT0; // Start time
    double           mT1; // Stop time (none if mT0==mT1)
@@ -107,6 +107,7 @@ scroll information.  It also has some status flags.
 #include "Mix.h"
 #include "NoteTrack.h"
 #include "Prefs.h"
+#include "Sequence.h"
 #include "Snap.h"
 #include "Tags.h"
 #include "Track.h"
@@ -758,6 +759,13 @@ AudacityProject::AudacityProject(wxWindow * parent, wxWindowID id,
      mAutoSaving(false),
      mIsRecovered(false),
      mRecordingRecoveryHandler(NULL),
+     mAutoSaveJournalHandler(NULL),
+     mAutoSaveJournal(new SequenceJournal()),
+     mAutoSaveTracks(NULL),
+     mAutoSaveSnapshotSize(0),
+     mAutoSaveJournalSize(0),
+     mAutoSaveRecording(false),
+     mAutoSaveFailed(false),
      mImportedDependencies(false),
      mWantSaveCompressed(false),
      mLastEffect(NULL),
@@ -1042,6 +1050,7 @@ void AudacityProject::UpdatePrefsVariables()
 void AudacityProject::UpdatePrefs()
 {
    UpdatePrefsVariables();
+   WaveClip::UpdateRenderPrefs();
 
    SetProjectTitle();
 
@@ -1963,6 +1972,9 @@ void AudacityProject::OnCloseWindow(wxCloseEvent & event)
    // The project is now either saved or the user doesn't want to save it,
    // so there's no need to keep auto save info around anymore
    DeleteCurrentAutoSaveFile();
+   DiscardAutoSaveTracks();
+   delete mAutoSaveJournal;
+   mAutoSaveJournal = NULL;
 
    // DMM: Save the size of the last window the user closes
    //
@@ -2454,6 +2466,10 @@ void AudacityProject::OpenFile(wxString fileName, bool addtohistory)
    if (mFileName.Length() >= autoSaveExt.Length() &&
        mFileName.Right(autoSaveExt.Length()) == autoSaveExt)
    {
+      // A crash while a journal entry was appended leaves it incomplete,
+      // and the parser would reject the whole file
+      TrimAutoSaveJournal(fileName);
+
       // This is an auto-save file, add </project> tag, if necessary
       wxFile f(fileName, wxFile::read_write);
       if (f.IsOpened())
@@ -2484,7 +2500,19 @@ void AudacityProject::OpenFile(wxString fileName, bool addtohistory)
 
    XMLFileReader xmlFile;
 
+   // Auto-save files refer back to the block lists they have already,
+   // and saved projects may have an index of their blocks
+   SequenceJournal journal;
+   Sequence::SetJournal(&journal);
+   SequenceIndex index;
+   if (index.Read(fileName))
+      Sequence::SetIndex(&index);
+   // Nothing read may delete files the saved project or its history
+   // could still refer to
+   GetDirManager()->SetKeepFiles(true);
    bool bParseSuccess = xmlFile.Parse(this, fileName);
+   Sequence::SetIndex(NULL);
+   Sequence::SetJournal(NULL);
    if (bParseSuccess) {
       // By making a duplicate set of pointers to the existing blocks
       // on disk, we add one to their reference count, guaranteeing
@@ -2552,6 +2580,17 @@ void AudacityProject::OpenFile(wxString fileName, bool addtohistory)
          t = iter.Next();
       }
 
+      // The versions of the tracks the auto-save journal replaced, and
+      // the block lists it kept, can go now that the project has
+      // references of its own
+      if (mAutoSaveJournalHandler)
+      {
+         delete mAutoSaveJournalHandler;
+         mAutoSaveJournalHandler = NULL;
+      }
+      journal.Reset();
+      GetDirManager()->SetKeepFiles(false);
+
       InitialState();
       mTrackPanel->SetFocusedTrack(iter.First());
       HandleResize();
@@ -2649,6 +2688,14 @@ void AudacityProject::OpenFile(wxString fileName, bool addtohistory)
       mRecordingRecoveryHandler = NULL;
    }
 
+   if (mAutoSaveJournalHandler)
+   {
+      delete mAutoSaveJournalHandler;
+      mAutoSaveJournalHandler = NULL;
+   }
+   journal.Reset();
+   GetDirManager()->SetKeepFiles(false);
+
    if (!bParseSuccess)
       return; // No need to do further processing if parse failed.
 
@@ -2968,6 +3015,12 @@ XMLTagHandler *AudacityProject::HandleXMLChild(const wxChar *tag)
       return mRecordingRecoveryHandler;
    }
 
+   if (!wxStrcmp(tag, wxT("autosavejournal"))) {
+      if (!mAutoSaveJournalHandler)
+         mAutoSaveJournalHandler = new AutoSaveJournalHandler(this);
+      return mAutoSaveJournalHandler;
+   }
+
    if (!wxStrcmp(tag, wxT("import"))) {
       if (mImportXMLTagHandler == NULL)
          mImportXMLTagHandler = new ImportXMLTagHandler(this);
@@ -3146,6 +3199,14 @@ bool AudacityProject::Save(bool overwrite /* = true */ ,
       }
    }
 
+   // The project file must only refer to block files that are on disk
+   if (!mDirManager->FlushPendingWrites()) {
+      wxMessageBox(_("Could not save project. Some of its audio could not be written to disk.\nFree some space on the disk, then save again."),
+                   _("Error Saving Project"),
+                   wxICON_ERROR, this);
+      return false;
+   }
+
    //
    // Always save a backup of the original project file
    //
@@ -3227,20 +3288,25 @@ bool AudacityProject::Save(bool overwrite /* = true */ ,
       }
    }
 
-   // Write the AUP file.
+   // Write the AUP file, and keep the block lists for the index
    XMLFileWriter saveFile;
+   SequenceIndex index;
 
    try
    {
       saveFile.Open(mFileName, wxT("wb"));
 
+      Sequence::SetIndex(&index);
       WriteXMLHeader(saveFile);
       WriteXML(saveFile);
+      Sequence::SetIndex(NULL);
 
       saveFile.Close();
    }
    catch (XMLFileWriterException* pException)
    {
+      Sequence::SetIndex(NULL);
+
       wxMessageBox(wxString::Format(
          _("Couldn't write to file \"%s\": %s"),
          mFileName.c_str(), pException->GetMessage().c_str()),
@@ -3265,6 +3331,15 @@ bool AudacityProject::Save(bool overwrite /* = true */ ,
    fn.MacSetTypeAndCreator(AUDACITY_PROJECT_TYPE, AUDACITY_CREATOR);
 #endif
 
+   // The index of the blocks lets the project open without reading them
+   // from the XML; it's only ever used with the .aup it was written with,
+   // so an old one does no harm, but remove it when there's no new one
+   if (bWantSaveCompressed || !index.Write(mFileName)) {
+      wxString indexFileName = SequenceIndex::GetFileName(mFileName);
+      if (wxFileExists(indexFileName))
+         wxRemoveFile(indexFileName);
+   }
+
    if (bWantSaveCompressed)
       mWantSaveCompressed = false; // Don't want this mode for AudacityProject::WriteXML() any more.
    else
@@ -4477,6 +4552,31 @@ void AudacityProject::AutoSave()
 {
    //    SonifyBeginAutoSave(); // part of RBD's r10680 stuff now backed out
 
+   // The auto-save file must only refer to block files that are on disk.
+   // Until they are, keep the one there is.
+   if (!mDirManager->FlushPendingWrites()) {
+      if (!mAutoSaveFailed)
+         wxMessageBox(_("Could not auto-save the project. Some of its audio could not be written to disk.\nCheck that there is enough free space."),
+                      _("Error Writing Autosave File"), wxICON_ERROR, this);
+      mAutoSaveFailed = true;
+      return;
+   }
+   mAutoSaveFailed = false;
+
+   // Usually it's enough to append the changes to the journal of the
+   // current auto-save file.  Once the journal is bigger than the
+   // snapshot it follows, write a new snapshot instead, so that
+   // recovery doesn't take longer than it needs to.
+   if (!mAutoSaveFileName.IsEmpty() && mAutoSaveTracks &&
+       !mAutoSaveRecording &&
+       mAutoSaveJournalSize < mAutoSaveSnapshotSize &&
+       AutoSaveJournalEntry())
+      return;
+
+   // The journal of the snapshot starts over
+   DiscardAutoSaveTracks();
+   mAutoSaveJournal->Reset();
+
    // To minimize the possibility of race conditions, we first write to a
    // file with the extension ".tmp", then rename the file to .autosave
    wxString projName;
@@ -4497,8 +4597,10 @@ void AudacityProject::AutoSave()
 
       {
          VarSetter<bool> setter(&mAutoSaving, true, false);
+         Sequence::SetJournal(mAutoSaveJournal);
          WriteXMLHeader(saveFile);
          WriteXML(saveFile);
+         Sequence::SetJournal(NULL);
       }
 
       // JKC Calling XMLFileWriter::Close will close the <project> scope.
@@ -4509,6 +4611,8 @@ void AudacityProject::AutoSave()
    }
    catch (XMLFileWriterException* pException)
    {
+      Sequence::SetJournal(NULL);
+
       wxMessageBox(wxString::Format(
          _("Couldn't write to file \"%s\": %s"),
          (fn + wxT(".tmp")).c_str(), pException->GetMessage().c_str()),
@@ -4533,11 +4637,83 @@ void AudacityProject::AutoSave()
    }
 
    mAutoSaveFileName += fn + wxT(".autosave");
+
+   wxFFile snapshot(mAutoSaveFileName);
+   mAutoSaveSnapshotSize = snapshot.IsOpened() ? snapshot.Length() : 0;
+   mAutoSaveJournalSize = 0;
+   mAutoSaveJournal->EndEntry();
+   KeepAutoSaveTracks();
+
    // no-op cruft that's not #ifdefed for NoteTrack
    // See above for further comments.
    //   SonifyEndAutoSave();
 }
 
+// Appends the project to the journal of the auto-save file, but for the
+// block lists that the file has already, which it refers to by id.  Those
+// are the ones the project shares with mAutoSaveTracks, so only the
+// sequences changed since the last auto-save are written in full.
+// Returns false if a new auto-save file needs to be written instead.
+bool AudacityProject::AutoSaveJournalEntry()
+{
+   XMLStringWriter entry;
+
+   Sequence::SetJournal(mAutoSaveJournal);
+   entry.StartTag(wxT("autosavejournal"));
+   entry.WriteAttr(wxT("sel0"), mViewInfo.sel0, 10);
+   entry.WriteAttr(wxT("sel1"), mViewInfo.sel1, 10);
+
+   mTags->WriteXML(entry);
+
+   TrackListIterator iter(mTracks);
+   for (Track *t = iter.First(); t; t = iter.Next())
+      t->WriteXML(entry);
+
+   entry.EndTag(wxT("autosavejournal"));
+   Sequence::SetJournal(NULL);
+
+   // AutoSave() has made sure the block files are on disk
+   wxFileOffset written = AppendAutoSaveJournalEntry(mAutoSaveFileName, entry);
+   if (written == 0)
+      return false;
+
+   mAutoSaveJournalSize += written;
+   mAutoSaveJournal->EndEntry();
+   KeepAutoSaveTracks();
+
+   return true;
+}
+
+// Copies the tracks as they were auto-saved.  The copies share their
+// block lists with the project until it changes them.
+void AudacityProject::KeepAutoSaveTracks()
+{
+   // The audio thread may be appending to the tracks being recorded.
+   // This is called from inside AudioIO::StartStream(), before the
+   // stream has a token, so the stream can't be asked.
+   if (mAutoSaveRecording) {
+      DiscardAutoSaveTracks();
+      return;
+   }
+
+   TrackList *tracks = new TrackList();
+   TrackListIterator iter(mTracks);
+   for (Track *t = iter.First(); t; t = iter.Next())
+      tracks->Add(t->Duplicate());
+
+   DiscardAutoSaveTracks();
+   mAutoSaveTracks = tracks;
+}
+
+void AudacityProject::DiscardAutoSaveTracks()
+{
+   if (mAutoSaveTracks) {
+      mAutoSaveTracks->Clear(true);
+      delete mAutoSaveTracks;
+      mAutoSaveTracks = NULL;
+   }
+}
+
 void AudacityProject::DeleteCurrentAutoSaveFile()
 {
    if (!mAutoSaveFileName.IsEmpty())
@@ -4592,6 +4768,9 @@ void AudacityProject::OnAudioIOStartRecording()
    // since no block files are written during recording that could be
    // recovered.
    //
+   // While recording, every auto-save is a whole snapshot, and no copies
+   // of the tracks are kept for the journal.
+   mAutoSaveRecording = true;
    if (!GetCacheBlockFiles())
       AutoSave();
 }
@@ -4602,6 +4781,8 @@ void AudacityProject::OnAudioIOStopRecording()
    // Write all cached files to disk, if any
    mDirManager->WriteCacheToDisk();
 
+   mAutoSaveRecording = false;
+
    // Now we auto-save again to get the project to a "normal" state again.
    AutoSave();
 }
@@ -4612,6 +4793,10 @@ void AudacityProject::OnAudioIONewBlockFiles(const wxString& blockFileLog)
    if (!GetCacheBlockFiles() &&
        !mAutoSaveFileName.IsEmpty())
    {
+      // Log them only once they are on disk.  Should some not be, the
+      // next save or auto-save reports it.
+      mDirManager->FlushPendingWrites();
+
       wxFFile f(mAutoSaveFileName, wxT("at"));
       if (!f.IsOpened())
          return; // Keep recording going, there's not much we can do here
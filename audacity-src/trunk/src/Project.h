@@ -52,7 +52,9 @@ class wxPanel;
 class AudacityProject;
 class Importer;
 class ODLock;
+class AutoSaveJournalHandler;
 class RecordingRecoveryHandler;
+class SequenceJournal;
 class TrackList;
 class Tags;
 
@@ -422,6 +424,9 @@ class AUDACITY_DLL_API AudacityProject:  public wxFrame,
    void GetRegionsByLabel( Regions &regions );
 
    void AutoSave();
+   bool AutoSaveJournalEntry();
+   void KeepAutoSaveTracks();
+   void DiscardAutoSaveTracks();
    void DeleteCurrentAutoSaveFile();
 
    static bool GetCacheBlockFiles();
@@ -554,6 +559,22 @@ class AUDACITY_DLL_API AudacityProject:  public wxFrame,
    // The handler that handles recovery of <recordingrecovery> tags
    RecordingRecoveryHandler* mRecordingRecoveryHandler;
 
+   // The handler that replays <autosavejournal> tags
+   AutoSaveJournalHandler* mAutoSaveJournalHandler;
+
+   // The auto-save file is a snapshot of the project followed by journal
+   // entries, which refer to the block lists the file has already.  The
+   // tracks as last auto-saved keep those block lists from changing.
+   SequenceJournal *mAutoSaveJournal;
+   TrackList *mAutoSaveTracks;
+   wxLongLong mAutoSaveSnapshotSize;
+   wxLongLong mAutoSaveJournalSize;
+   // Between OnAudioIOStartRecording() and OnAudioIOStopRecording(),
+   // while the audio thread appends to the tracks
+   bool mAutoSaveRecording;
+   // The last auto-save failed, and the user has been told so
+   bool mAutoSaveFailed;
+
    // Dependencies have been imported and a warning should be shown on save
    bool mImportedDependencies;
 
@@ -19,11 +19,44 @@
   AvailForPut and AvailForGet may underestimate but will never
   overestimate.
 
+  Each side publishes its position only after a memory barrier, so
+  that on CPUs that reorder memory accesses the reader never sees
+  the writer's new mEnd before the samples it covers, and the writer
+  never overwrites samples the reader is still copying out.
+
+  Besides Put and Get, which copy and convert, the Acquire...Regions
+  methods give each side direct access to the samples in the buffer's
+  own format.  The space comes in up to two pieces, because it can
+  wrap around the end of the buffer.
+
 *//*******************************************************************/
 
 
 #include "RingBuffer.h"
 
+// The same barriers as PortAudio's pa_memorybarrier.h, which isn't
+// available when we build against a system PortAudio
+#if defined(__APPLE__)
+#include <libkern/OSAtomic.h>
+#define RingBufferFullBarrier()  OSMemoryBarrier()
+#define RingBufferReadBarrier()  OSMemoryBarrier()
+#define RingBufferWriteBarrier() OSMemoryBarrier()
+#elif defined(__GNUC__)
+#define RingBufferFullBarrier()  __sync_synchronize()
+#define RingBufferReadBarrier()  __sync_synchronize()
+#define RingBufferWriteBarrier() __sync_synchronize()
+#elif defined(_MSC_VER)
+// x86 doesn't reorder loads with loads or stores with stores, so it's
+// enough to stop the compiler from doing so
+#include <intrin.h>
+#pragma intrinsic(_ReadWriteBarrier)
+#define RingBufferFullBarrier()  _ReadWriteBarrier()
+#define RingBufferReadBarrier()  _ReadWriteBarrier()
+#define RingBufferWriteBarrier() _ReadWriteBarrier()
+#else
+#error Memory barriers are not defined for this compiler
+#endif
+
 RingBuffer::RingBuffer(sampleFormat format, int size)
 {
    mFormat = format;
@@ -38,9 +71,23 @@ RingBuffer::~RingBuffer()
    DeleteSamples(mBuffer);
 }
 
-int RingBuffer::Len()
+int RingBuffer::Filled(int start, int end)
 {
-   return (mEnd + mBufferSize - mStart) % mBufferSize;
+   return (end + mBufferSize - start) % mBufferSize;
+}
+
+void RingBuffer::GetRegions(int pos, int samples,
+                            samplePtr *region1, int *len1,
+                            samplePtr *region2, int *len2)
+{
+   int first = samples;
+   if (first > mBufferSize - pos)
+      first = mBufferSize - pos;
+
+   *region1 = mBuffer + pos * SAMPLE_SIZE(mFormat);
+   *len1 = first;
+   *region2 = mBuffer;
+   *len2 = samples - first;
 }
 
 //
@@ -49,41 +96,49 @@ int RingBuffer::Len()
 
 int RingBuffer::AvailForPut()
 {
-   return (mBufferSize-4) - Len();
+   return (mBufferSize-4) - Filled(mStart, mEnd);
 }
 
-int RingBuffer::Put(samplePtr buffer, sampleFormat format,
-                    int samplesToCopy)
+int RingBuffer::AcquireWriteRegions(int samples,
+                                    samplePtr *region1, int *len1,
+                                    samplePtr *region2, int *len2)
 {
-   samplePtr src;
-   int block;
-   int copied;
-   int pos;
-   int len = Len();
+   int start = mStart;
+   // Don't let our writes to the space the reader released move ahead
+   // of our reading that it was released
+   RingBufferFullBarrier();
 
-   if (samplesToCopy > (mBufferSize-4) - len)
-      samplesToCopy = (mBufferSize-4) - len;
+   int avail = (mBufferSize-4) - Filled(start, mEnd);
+   if (samples > avail)
+      samples = avail;
 
-   src = buffer;
-   copied = 0;
-   pos = mEnd;
+   GetRegions(mEnd, samples, region1, len1, region2, len2);
 
-   while(samplesToCopy) {
-      block = samplesToCopy;
-      if (block > mBufferSize - pos)
-         block = mBufferSize - pos;
+   return samples;
+}
 
-      CopySamples(src, format,
-                  mBuffer + pos * SAMPLE_SIZE(mFormat), mFormat,
-                  block);
+void RingBuffer::CommitWrite(int samples)
+{
+   // The samples must be in memory before the reader can see them
+   RingBufferWriteBarrier();
+   mEnd = (mEnd + samples) % mBufferSize;
+}
 
-      src += block * SAMPLE_SIZE(format);
-      pos = (pos + block) % mBufferSize;
-      samplesToCopy -= block;
-      copied += block;
-   }
+int RingBuffer::Put(samplePtr buffer, sampleFormat format,
+                    int samplesToCopy)
+{
+   samplePtr region[2];
+   int len[2];
 
-   mEnd = pos;
+   int copied = AcquireWriteRegions(samplesToCopy,
+                                    &region[0], &len[0], &region[1], &len[1]);
+
+   CopySamples(buffer, format, region[0], mFormat, len[0]);
+   if (len[1] > 0)
+      CopySamples(buffer + len[0] * SAMPLE_SIZE(format), format,
+                  region[1], mFormat, len[1]);
+
+   CommitWrite(copied);
 
    return copied;
 }
@@ -94,49 +149,60 @@ int RingBuffer::Put(samplePtr buffer, sampleFormat format,
 
 int RingBuffer::AvailForGet()
 {
-   return Len();
+   return Filled(mStart, mEnd);
 }
 
-int RingBuffer::Get(samplePtr buffer, sampleFormat format,
-                    int samplesToCopy)
+int RingBuffer::AcquireReadRegions(int samples,
+                                   samplePtr *region1, int *len1,
+                                   samplePtr *region2, int *len2)
 {
-   samplePtr dest;
-   int block;
-   int copied;
-   int len = Len();
+   int end = mEnd;
+   // Read the samples only after seeing that they were written
+   RingBufferReadBarrier();
 
-   if (samplesToCopy > len)
-      samplesToCopy = len;
+   int avail = Filled(mStart, end);
+   if (samples > avail)
+      samples = avail;
+
+   GetRegions(mStart, samples, region1, len1, region2, len2);
+
+   return samples;
+}
 
-   dest = buffer;
-   copied = 0;
+void RingBuffer::ReleaseRead(int samples)
+{
+   // Finish reading the samples before the writer may overwrite them
+   RingBufferFullBarrier();
+   mStart = (mStart + samples) % mBufferSize;
+}
+
+int RingBuffer::Get(samplePtr buffer, sampleFormat format,
+                    int samplesToCopy)
+{
+   samplePtr region[2];
+   int len[2];
 
-   while(samplesToCopy) {
-      block = samplesToCopy;
-      if (block > mBufferSize - mStart)
-         block = mBufferSize - mStart;
+   int copied = AcquireReadRegions(samplesToCopy,
+                                   &region[0], &len[0], &region[1], &len[1]);
 
-      CopySamples(mBuffer + mStart * SAMPLE_SIZE(mFormat), mFormat,
-                  dest, format,
-                  block);
+   CopySamples(region[0], mFormat, buffer, format, len[0]);
+   if (len[1] > 0)
+      CopySamples(region[1], mFormat,
+                  buffer + len[0] * SAMPLE_SIZE(format), format, len[1]);
 
-      dest += block * SAMPLE_SIZE(format);
-      mStart = (mStart + block) % mBufferSize;
-      samplesToCopy -= block;
-      copied += block;
-   }
+   ReleaseRead(copied);
 
    return copied;
 }
 
 int RingBuffer::Discard(int samplesToDiscard)
 {
-   int len = Len();
+   int len = AvailForGet();
 
    if (samplesToDiscard > len)
       samplesToDiscard = len;
 
-   mStart = (mStart + samplesToDiscard) % mBufferSize;
+   ReleaseRead(samplesToDiscard);
 
    return samplesToDiscard;
 }
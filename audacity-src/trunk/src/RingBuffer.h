@@ -18,6 +18,8 @@ class RingBuffer {
    RingBuffer(sampleFormat format, int size);
    ~RingBuffer();
 
+   sampleFormat GetFormat() const { return mFormat; }
+
    //
    // For the writer only:
    //
@@ -25,6 +27,15 @@ class RingBuffer {
    int AvailForPut();
    int Put(samplePtr buffer, sampleFormat format, int samples);
 
+   /// Returns how many of the requested samples can be written in place,
+   /// in GetFormat(), and where: the first len1 go to region1, the rest
+   /// to region2 (len2 is 0 unless the space wraps around the end).
+   /// They are not seen by the reader until CommitWrite().
+   int AcquireWriteRegions(int samples,
+                           samplePtr *region1, int *len1,
+                           samplePtr *region2, int *len2);
+   void CommitWrite(int samples);
+
    //
    // For the reader only:
    //
@@ -33,12 +44,25 @@ class RingBuffer {
    int Get(samplePtr buffer, sampleFormat format, int samples);
    int Discard(int samples);
 
+   /// Returns how many of the requested samples can be read in place,
+   /// in GetFormat(), split into two regions as for AcquireWriteRegions().
+   /// They stay valid until ReleaseRead() hands their space back.
+   int AcquireReadRegions(int samples,
+                          samplePtr *region1, int *len1,
+                          samplePtr *region2, int *len2);
+   void ReleaseRead(int samples);
+
  private:
-   int Len();
+   int Filled(int start, int end);
+   void GetRegions(int pos, int samples,
+                   samplePtr *region1, int *len1,
+                   samplePtr *region2, int *len2);
 
    sampleFormat  mFormat;
-   int           mStart;
-   int           mEnd;
+   // mStart is only written by the reader and mEnd only by the writer;
+   // each side reads the other's with a barrier (see RingBuffer.cpp)
+   volatile int  mStart;
+   volatile int  mEnd;
    int           mBufferSize;
    samplePtr     mBuffer;
 };
@@ -35,6 +35,7 @@
 *//*******************************************************************/
 
 #include <wx/intl.h>
+#include <wx/thread.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -74,8 +75,31 @@ const wxChar *GetSampleFormatStr(sampleFormat format)
    return wxT("Unknown format"); // compiler food
 }
 
+static volatile unsigned long gWatchedThread = 0;
+static volatile int gWatchedAllocations = 0;
+
+void WatchSampleAllocations(unsigned long threadId)
+{
+   gWatchedAllocations = 0;
+   gWatchedThread = threadId;
+}
+
+int GetWatchedSampleAllocations()
+{
+   return gWatchedAllocations;
+}
+
+void CountWatchedAllocation()
+{
+   // Only the watched thread writes the count
+   if (gWatchedThread != 0 && wxThread::GetCurrentId() == gWatchedThread)
+      gWatchedAllocations++;
+}
+
 AUDACITY_DLL_API samplePtr NewSamples(int count, sampleFormat format)
 {
+   CountWatchedAllocation();
+
    return (samplePtr)malloc(count * SAMPLE_SIZE(format));
 }
 
@@ -47,6 +47,17 @@ const wxChar *GetSampleFormatStr(sampleFormat format);
 AUDACITY_DLL_API samplePtr NewSamples(int count, sampleFormat format);
 AUDACITY_DLL_API void DeleteSamples(samplePtr p);
 
+// Code that must not allocate, such as the audio thread once a stream is
+// running, can have the allocations made on its thread counted.
+// WatchSampleAllocations() starts counting from zero on the thread with
+// the given id (0 stops counting), and GetWatchedSampleAllocations()
+// returns the count so far.  NewSamples() counts itself; the other code
+// that still allocates on the audio thread's paths calls
+// CountWatchedAllocation().
+void WatchSampleAllocations(unsigned long threadId);
+int GetWatchedSampleAllocations();
+void CountWatchedAllocation();
+
 //
 // Copying, Converting and Clearing Samples
 //
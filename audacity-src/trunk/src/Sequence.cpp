@@ -49,6 +49,201 @@
 #include "blockfile/SilentBlockFile.h"
 
 int Sequence::sMaxDiskBlockSize = 1048576;
+SequenceJournal *Sequence::sJournal = NULL;
+SequenceIndex *Sequence::sIndex = NULL;
+
+// ChooseMaxSamples() doubles the block size until a sequence fits in
+// about this many blocks, up to kLargestDiskBlockSize bytes per block.
+// Each kEditsPerHalving edits halve that limit, down to the default size.
+static const sampleCount kBlocksPerSequence = 1024;
+static const int kLargestDiskBlockSize = 16 * 1048576;
+static const int kEditsPerHalving = 8;
+
+// Reblock() can't split alias blocks or blocks that are still being
+// decoded; it keeps them as they are
+static bool IsFixedBlock(BlockFile *f)
+{
+   return f->IsAlias() || !f->IsDataAvailable();
+}
+
+// Silent blocks have no file on disk, so Reblock() only splits them
+static bool IsSilentBlock(BlockFile *f)
+{
+   return dynamic_cast<SilentBlockFile *>(f) != NULL;
+}
+
+// Guards the share counts of block arrays, since copies of a Sequence
+// can be made and destroyed on other threads than the one editing it
+static wxCriticalSection sBlockSharesCS;
+
+// SequenceJournal methods
+SequenceJournal::SequenceJournal()
+{
+   mNextId = 0;
+}
+
+SequenceJournal::~SequenceJournal()
+{
+   Reset();
+}
+
+void SequenceJournal::Reset()
+{
+   std::map<int, Sequence *>::iterator it;
+   for (it = mRead.begin(); it != mRead.end(); it++)
+      delete it->second;
+   mRead.clear();
+   mWritten.clear();
+   mWriting.clear();
+}
+
+void SequenceJournal::EndEntry()
+{
+   mWritten.swap(mWriting);
+   mWriting.clear();
+}
+
+// SequenceIndex methods
+
+// The index file starts with this; the block lists follow
+struct SequenceIndexHeader {
+   char          magic[8];
+   wxUint32      byteOrder;
+   wxUint32      version;
+   wxLongLong_t  projectSize;
+   wxULongLong_t projectHash;
+};
+
+static const char kIndexMagic[8] = {'A', 'U', 'P', 'I', 'N', 'D', 'E', 'X'};
+static const wxUint32 kIndexByteOrder = 0x01020304;
+static const wxUint32 kIndexVersion = 1;
+
+// The kinds of blocks the index has; a sequence with any other kind is
+// written as kIndexNotIndexed instead of a block count
+enum {
+   kIndexSimple,
+   kIndexSilent
+};
+static const wxInt32 kIndexNotIndexed = -1;
+
+// An FNV-1a hash of the project file, which the index must have been
+// written with to be used
+static bool HashProjectFile(const wxString &fileName,
+                            wxLongLong_t *size, wxULongLong_t *hash)
+{
+   wxFFile f(fileName, wxT("rb"));
+   if (!f.IsOpened())
+      return false;
+
+   std::vector<unsigned char> buffer(65536);
+   wxULongLong_t h = wxULL(0xcbf29ce484222325);
+   wxLongLong_t total = 0;
+   size_t len;
+   while ((len = f.Read(&buffer[0], buffer.size())) > 0) {
+      for (size_t i = 0; i < len; i++) {
+         h ^= buffer[i];
+         h *= wxULL(0x100000001b3);
+      }
+      total += len;
+   }
+   if (f.Error())
+      return false;
+
+   *size = total;
+   *hash = h;
+   return true;
+}
+
+SequenceIndex::SequenceIndex()
+{
+   mPos = 0;
+   mValid = false;
+}
+
+wxString SequenceIndex::GetFileName(const wxString &projectFileName)
+{
+   return projectFileName + wxT(".idx");
+}
+
+bool SequenceIndex::Write(const wxString &projectFileName)
+{
+   SequenceIndexHeader header;
+   memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+   header.byteOrder = kIndexByteOrder;
+   header.version = kIndexVersion;
+   if (!HashProjectFile(projectFileName,
+                        &header.projectSize, &header.projectHash))
+      return false;
+
+   wxString fileName = GetFileName(projectFileName);
+   wxFFile f(fileName, wxT("wb"));
+   if (!f.IsOpened())
+      return false;
+
+   bool ok = (f.Write(&header, sizeof(header)) == sizeof(header)) &&
+             (mData.empty() ||
+              f.Write(&mData[0], mData.size()) == mData.size());
+   ok = f.Close() && ok;
+
+   if (!ok)
+      wxRemoveFile(fileName);
+   return ok;
+}
+
+bool SequenceIndex::Read(const wxString &projectFileName)
+{
+   mData.clear();
+   mPos = 0;
+   mValid = false;
+
+   wxString fileName = GetFileName(projectFileName);
+   if (!wxFileExists(fileName))
+      return false;
+
+   wxFFile f(fileName, wxT("rb"));
+   if (!f.IsOpened())
+      return false;
+
+   SequenceIndexHeader header;
+   if (f.Read(&header, sizeof(header)) != sizeof(header) ||
+       memcmp(header.magic, kIndexMagic, sizeof(header.magic)) ||
+       header.byteOrder != kIndexByteOrder ||
+       header.version != kIndexVersion)
+      return false;
+
+   wxLongLong_t size;
+   wxULongLong_t hash;
+   if (!HashProjectFile(projectFileName, &size, &hash) ||
+       size != header.projectSize || hash != header.projectHash)
+      return false;
+
+   wxFileOffset len = f.Length() - (wxFileOffset)sizeof(header);
+   if (len < 0)
+      return false;
+   mData.resize((size_t)len);
+   if (len > 0 && f.Read(&mData[0], mData.size()) != mData.size())
+      return false;
+
+   mValid = true;
+   return true;
+}
+
+template<class T> void SequenceIndex::Put(const T &value)
+{
+   const char *bytes = (const char *)&value;
+   mData.insert(mData.end(), bytes, bytes + sizeof(T));
+}
+
+template<class T> bool SequenceIndex::Get(T *value)
+{
+   if (!mValid || mData.size() - mPos < sizeof(T)) {
+      mValid = false;
+      return false;
+   }
+   memcpy(value, &mData[mPos], sizeof(T));
+   mPos += sizeof(T);
+   return true;
+}
 
 // Sequence methods
 Sequence::Sequence(DirManager * projDirManager, sampleFormat format)
@@ -58,10 +253,14 @@ Sequence::Sequence(DirManager * projDirManager, sampleFormat format)
    mNumSamples = 0;
    mSampleFormat = format;
    mBlock = new BlockArray();
+   mBlockShares = new int(1);
 
    mMinSamples = sMaxDiskBlockSize / SAMPLE_SIZE(mSampleFormat) / 2;
    mMaxSamples = mMinSamples * 2;
    mErrorOpening = false;
+   mJournalId = -1;
+   mBlocksFromIndex = false;
+   mEdits = 0;
 }
 
 Sequence::Sequence(const Sequence &orig, DirManager *projDirManager)
@@ -77,24 +276,98 @@ Sequence::Sequence(const Sequence &orig, DirManager *projDirManager)
    mMaxSamples = orig.mMaxSamples;
    mMinSamples = orig.mMinSamples;
    mErrorOpening = false;
+   mJournalId = -1;
+   mBlocksFromIndex = false;
+   mEdits = 0;
+
+   if (projDirManager == orig.mDirManager) {
+      // Within one project, share orig's blocks until either of the
+      // two Sequences changes them.  Undo states are made this way, so
+      // pushing a state costs nothing for tracks the edit didn't touch.
+      wxCriticalSectionLocker locker(sBlockSharesCS);
+      mBlock = orig.mBlock;
+      mBlockShares = orig.mBlockShares;
+      (*mBlockShares)++;
+      mNumSamples = orig.mNumSamples;
+      mEdits = orig.mEdits;
+      return;
+   }
 
    mBlock = new BlockArray();
+   mBlockShares = new int(1);
 
    bool bResult = Paste(0, &orig);
    wxASSERT(bResult); // TO DO: Actually handle this.
    (void)bResult;
+
+   // The copy has had the edits of the original, not a paste
+   mEdits = orig.mEdits;
 }
 
 Sequence::~Sequence()
 {
+   ReleaseBlocks();
+   mDirManager->Deref();
+}
+
+void Sequence::ReleaseBlocks()
+{
+   bool last;
+   {
+      wxCriticalSectionLocker locker(sBlockSharesCS);
+      last = (--(*mBlockShares) == 0);
+   }
+
+   if (last) {
+      for (unsigned int i = 0; i < mBlock->GetCount(); i++) {
+         if (mBlock->Item(i)->f)
+            mDirManager->Deref(mBlock->Item(i)->f);
+         delete mBlock->Item(i);
+      }
+
+      delete mBlock;
+      delete mBlockShares;
+   }
+   mBlock = NULL;
+   mBlockShares = NULL;
+}
+
+void Sequence::ShareBlocks(const Sequence &other)
+{
+   wxASSERT(other.mDirManager == mDirManager);
+
+   ReleaseBlocks();
+
+   wxCriticalSectionLocker locker(sBlockSharesCS);
+   mBlock = other.mBlock;
+   mBlockShares = other.mBlockShares;
+   (*mBlockShares)++;
+   mNumSamples = other.mNumSamples;
+}
+
+void Sequence::MakeBlocksUnique()
+{
+   wxCriticalSectionLocker locker(sBlockSharesCS);
+
+   if (*mBlockShares == 1)
+      return;
+
+   // The other sharers keep the old array and their references to its
+   // block files; this Sequence takes new references to the same files
+   BlockArray *newBlock = new BlockArray();
+   newBlock->Alloc(mBlock->GetCount());
    for (unsigned int i = 0; i < mBlock->GetCount(); i++) {
-      if (mBlock->Item(i)->f)
-         mDirManager->Deref(mBlock->Item(i)->f);
-      delete mBlock->Item(i);
+      SeqBlock *b = new SeqBlock();
+      b->start = mBlock->Item(i)->start;
+      b->f = mBlock->Item(i)->f;
+      if (b->f)
+         mDirManager->Ref(b->f);
+      newBlock->Add(b);
    }
 
-   delete mBlock;
-   mDirManager->Deref();
+   (*mBlockShares)--;
+   mBlock = newBlock;
+   mBlockShares = new int(1);
 }
 
 sampleCount Sequence::GetMaxBlockSize() const
@@ -154,6 +427,8 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format, bool* pbChanged)
    if (format == mSampleFormat)
       return true;
 
+   MakeBlocksUnique();
+
    if (mBlock->GetCount() == 0)
    {
       mSampleFormat = format;
@@ -165,9 +440,10 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format, bool* pbChanged)
    mSampleFormat = format;
 
    sampleCount oldMaxSamples = mMaxSamples;
-   // These are the same calculations as in the constructor.
-   mMinSamples = sMaxDiskBlockSize / SAMPLE_SIZE(mSampleFormat) / 2;
-   mMaxSamples = mMinSamples * 2;
+   // Keep the same number of bytes per block, which may not be the
+   // default if the sequence was reblocked.
+   SetMaxSamples(oldMaxSamples * SAMPLE_SIZE(oldFormat) /
+                 SAMPLE_SIZE(mSampleFormat));
 
    BlockArray* pNewBlockArray = new BlockArray();
    // Use the ratio of old to new mMaxSamples to make a reasonable guess at allocation.
@@ -398,6 +674,143 @@ bool Sequence::GetRMS(sampleCount start, sampleCount len,
    return true;
 }
 
+// Follows the quiet samples found by Sequence::GetQuietRuns() in order
+// and keeps the runs it should report
+class QuietRunFinder {
+ public:
+   QuietRunFinder(sampleCount start, sampleCount end, sampleCount minRun,
+                  std::vector<sampleCount> &runs)
+      : mStart(start), mEnd(end), mMinRun(minRun), mRunStart(-1), mRuns(runs)
+   {
+   }
+
+   bool InRun() const { return mRunStart >= 0; }
+
+   void Quiet(sampleCount pos)
+   {
+      if (mRunStart < 0)
+         mRunStart = pos;
+   }
+
+   void Loud(sampleCount pos)
+   {
+      if (mRunStart >= 0) {
+         if (pos - mRunStart >= mMinRun || mRunStart == mStart || pos == mEnd) {
+            mRuns.push_back(mRunStart);
+            mRuns.push_back(pos);
+         }
+         mRunStart = -1;
+      }
+   }
+
+   void Samples(const float *buffer, sampleCount pos, sampleCount len,
+                float threshold)
+   {
+      for (sampleCount i = 0; i < len; i++) {
+         if (fabs(buffer[i]) < threshold)
+            Quiet(pos + i);
+         else
+            Loud(pos + i);
+      }
+   }
+
+ private:
+   sampleCount mStart;
+   sampleCount mEnd;
+   sampleCount mMinRun;
+   sampleCount mRunStart;
+   std::vector<sampleCount> &mRuns;
+};
+
+bool Sequence::GetQuietRuns(sampleCount start, sampleCount len,
+                            float threshold, sampleCount minRun,
+                            std::vector<sampleCount> &runs) const
+{
+   if (start < 0 || len < 0 || start + len > mNumSamples)
+      return false;
+   if (len == 0)
+      return true;
+
+   const sampleCount window = 256;
+   sampleCount end = start + len;
+   QuietRunFinder finder(start, end, minRun, runs);
+
+   // A loud window between two loud windows can only be part of quiet
+   // runs shorter than two windows, so when minRun is longer than that
+   // its samples are never needed.
+   bool skipLoud = minRun >= 2 * window - 1;
+
+   int b0 = FindBlock(start);
+   int b1 = b0;
+   sampleCount maxLen = 0;
+   for (; b1 < (int)mBlock->GetCount() && mBlock->Item(b1)->start < end; b1++)
+      maxLen = wxMax(maxLen, mBlock->Item(b1)->f->GetLength());
+
+   samplePtr buffer = NewSamples(maxLen, floatSample);
+   float *summary = new float[3 * ((maxLen + window - 1) / window)];
+
+   for (int b = b0; b < b1; b++) {
+      SeqBlock *block = mBlock->Item(b);
+      BlockFile *f = block->f;
+      sampleCount s0 = wxMax(start, block->start) - block->start;
+      sampleCount s1 = wxMin(end, block->start + f->GetLength()) - block->start;
+
+      float blockMin = 0, blockMax = 0, blockRMS;
+      bool haveSummary = f->IsSummaryAvailable();
+      if (haveSummary)
+         f->GetMinMax(&blockMin, &blockMax, &blockRMS);
+
+      if (haveSummary && blockMax < threshold && blockMin > -threshold) {
+         // The whole block is quiet
+         finder.Quiet(block->start + s0);
+         continue;
+      }
+
+      sampleCount w0 = s0 / window;
+      sampleCount w1 = (s1 + window - 1) / window;
+      if (!haveSummary || !f->Read256(summary, w0, w1 - w0)) {
+         Read(buffer, floatSample, block, s0, s1 - s0);
+         finder.Samples((float *)buffer, block->start + s0, s1 - s0,
+                        threshold);
+         continue;
+      }
+
+      for (sampleCount w = w0; w < w1; w++) {
+         sampleCount ws = wxMax(w * window, s0);
+         sampleCount we = wxMin((w + 1) * window, s1);
+         float *frame = summary + 3 * (w - w0);
+
+         if (frame[1] < threshold && frame[0] > -threshold) {
+            finder.Quiet(block->start + ws);
+            continue;
+         }
+
+         // Read a loud window only where a run we report may begin or
+         // end in it: next to a quiet window or at the end of the range
+         // or block.  The last window may be cut short by the range, so
+         // its summary says nothing about the samples we look at.
+         bool edge = !skipLoud || finder.InRun() ||
+            block->start + ws == start || w == w1 - 1 ||
+            (w == w1 - 2 && block->start + s1 == end) ||
+            (frame[4] < threshold && frame[3] > -threshold);
+         if (edge) {
+            Read(buffer, floatSample, block, ws, we - ws);
+            finder.Samples((float *)buffer, block->start + ws, we - ws,
+                           threshold);
+         }
+         else
+            finder.Loud(block->start + ws);
+      }
+   }
+
+   finder.Loud(end);
+
+   delete[] summary;
+   DeleteSamples(buffer);
+
+   return true;
+}
+
 bool Sequence::Copy(sampleCount s0, sampleCount s1, Sequence **dest)
 {
    *dest = 0;
@@ -413,6 +826,8 @@ bool Sequence::Copy(sampleCount s0, sampleCount s1, Sequence **dest)
       b1 = numBlocks;
 
    *dest = new Sequence(mDirManager, mSampleFormat);
+   // The blocks in the middle are shared, so the copy needs our block size
+   (*dest)->SetMaxSamples(mMaxSamples);
 
    samplePtr buffer = NewSamples(mMaxSamples, mSampleFormat);
 
@@ -483,6 +898,33 @@ bool Sequence::Paste(sampleCount s, const Sequence *src)
       return false;
    }
 
+   // Blocks may be pasted as they are, but pasting keeps this sequence's
+   // block size: a source with longer blocks is reblocked to it first
+   unsigned int i;
+   for (i = 0; i < src->mBlock->GetCount(); i++) {
+      BlockFile *f = src->mBlock->Item(i)->f;
+      if (!IsFixedBlock(f) && f->GetLength() > mMaxSamples) {
+         Sequence resized(*src, mDirManager);
+         if (!resized.Reblock(mMaxSamples))
+            return false;
+         // Reblock() stops at the longest block it can't split
+         if (resized.mMaxSamples > mMaxSamples)
+            SetMaxSamples(resized.mMaxSamples);
+         return Paste(s, &resized);
+      }
+   }
+
+   // Blocks still being decoded can't be split, so they must still fit
+   for (i = 0; i < src->mBlock->GetCount(); i++) {
+      BlockFile *f = src->mBlock->Item(i)->f;
+      if (!f->IsAlias() && f->GetLength() > mMaxSamples)
+         SetMaxSamples(src->mMaxSamples);
+   }
+
+   mEdits++;
+
+   MakeBlocksUnique();
+
    BlockArray *srcBlock = src->mBlock;
    sampleCount addedLen = src->mNumSamples;
    unsigned int srcNumBlocks = srcBlock->GetCount();
@@ -566,7 +1008,6 @@ bool Sequence::Paste(sampleCount s, const Sequence *src)
    sampleCount splitLen = mBlock->Item(b)->f->GetLength();
    int splitPoint = s - splitBlock->start;
 
-   unsigned int i;
    if (srcNumBlocks <= 4) {
 
       sampleCount sum = splitLen + addedLen;
@@ -734,6 +1175,7 @@ bool Sequence::AppendAlias(wxString fullPath,
    newBlock->f = useOD?
       mDirManager->NewODAliasBlockFile(fullPath, start, len, channel):
       mDirManager->NewAliasBlockFile(fullPath, start, len, channel);
+   MakeBlocksUnique();
    mBlock->Add(newBlock);
    mNumSamples += newBlock->f->GetLength();
 
@@ -751,6 +1193,7 @@ bool Sequence::AppendCoded(wxString fName, sampleCount start,
 
    newBlock->start = mNumSamples;
    newBlock->f = mDirManager->NewODDecodeBlockFile(fName, start, len, channel, decodeType);
+   MakeBlocksUnique();
    mBlock->Add(newBlock);
    mNumSamples += newBlock->f->GetLength();
 
@@ -776,6 +1219,7 @@ bool Sequence::AppendBlock(SeqBlock * b)
    //Don't need to Ref because it was done by CopyBlockFile, above...
    //mDirManager->Ref(newBlock->f);
 
+   MakeBlocksUnique();
    mBlock->Add(newBlock);
    mNumSamples += newBlock->f->GetLength();
 
@@ -909,7 +1353,7 @@ bool Sequence::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
                mErrorOpening = true;
                return false;
             }
-            mMaxSamples = nValue;
+            SetMaxSamples(nValue);
             mDirManager->SetMaxSamples(mMaxSamples);
          }
          else if (!wxStrcmp(attr, wxT("sampleformat")))
@@ -933,6 +1377,31 @@ bool Sequence::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
             }
             mNumSamples = nValue;
 		 }
+         else if (!wxStrcmp(attr, wxT("blocksid")) ||
+                  !wxStrcmp(attr, wxT("blocksref")))
+         {
+            // Written by the auto-save journal; see SequenceJournal
+            long id;
+            if (!XMLValueChecker::IsGoodInt(strValue) || !strValue.ToLong(&id) || (id < 0))
+            {
+               mErrorOpening = true;
+               return false;
+            }
+            mJournalId = id;
+
+            if (!wxStrcmp(attr, wxT("blocksref")))
+            {
+               // The blocks were written earlier in the file
+               std::map<int, Sequence *>::iterator it;
+               if (!sJournal ||
+                   (it = sJournal->mRead.find(id)) == sJournal->mRead.end())
+               {
+                  mErrorOpening = true;
+                  return false;
+               }
+               ShareBlocks(*it->second);
+            }
+         }
       } // while
 
       //// Both mMaxSamples and mSampleFormat should have been set.
@@ -944,6 +1413,9 @@ bool Sequence::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
       //   return false;
       //}
 
+      if (sIndex && mJournalId < 0)
+         mBlocksFromIndex = ReadBlocksFromIndex();
+
       return true;
    }
 
@@ -1011,11 +1483,20 @@ void Sequence::HandleXMLEndTag(const wxChar *tag)
       mNumSamples = numSamples;
       mErrorOpening = true;
    }
+
+   if (sJournal && mJournalId >= 0) {
+      // Later entries of the journal may refer to these blocks
+      Sequence *&copy = sJournal->mRead[mJournalId];
+      delete copy;
+      copy = new Sequence(*this, mDirManager);
+   }
 }
 
 XMLTagHandler *Sequence::HandleXMLChild(const wxChar *tag)
 {
-   if (!wxStrcmp(tag, wxT("waveblock")))
+   if (mBlocksFromIndex)
+      return NULL; // The index had the blocks, so skip their XML
+   else if (!wxStrcmp(tag, wxT("waveblock")))
       return this;
    else {
       mDirManager->SetLoadingFormat(mSampleFormat);
@@ -1033,6 +1514,30 @@ void Sequence::WriteXML(XMLWriter &xmlFile)
    xmlFile.WriteAttr(wxT("sampleformat"), mSampleFormat);
    xmlFile.WriteAttr(wxT("numsamples"), mNumSamples);
 
+   if (sJournal) {
+      // Refer to the blocks if the journal has them already.  A block
+      // array that is still shared can't have changed since.
+      int id = -1;
+      std::map<BlockArray *, int>::iterator it = sJournal->mWritten.find(mBlock);
+      if (it != sJournal->mWritten.end())
+         id = it->second;
+      else {
+         it = sJournal->mWriting.find(mBlock);
+         if (it != sJournal->mWriting.end())
+            id = it->second;
+      }
+
+      if (id >= 0) {
+         sJournal->mWriting[mBlock] = id;
+         xmlFile.WriteAttr(wxT("blocksref"), id);
+         xmlFile.EndTag(wxT("sequence"));
+         return;
+      }
+
+      sJournal->mWriting[mBlock] = sJournal->mNextId;
+      xmlFile.WriteAttr(wxT("blocksid"), sJournal->mNextId++);
+   }
+
    for (b = 0; b < mBlock->GetCount(); b++) {
       SeqBlock *bb = mBlock->Item(b);
 
@@ -1060,9 +1565,126 @@ void Sequence::WriteXML(XMLWriter &xmlFile)
       xmlFile.EndTag(wxT("waveblock"));
    }
 
+   if (sIndex)
+      WriteBlocksToIndex();
+
    xmlFile.EndTag(wxT("sequence"));
 }
 
+// Simple and silent blocks can go in the index; the others have more
+// to them than it keeps
+static int GetIndexBlockType(BlockFile *f)
+{
+   if (dynamic_cast<SilentBlockFile *>(f))
+      return kIndexSilent;
+   if (!f->IsAlias() &&
+       dynamic_cast<SimpleBlockFile *>(f) &&
+       !dynamic_cast<ODDecodeBlockFile *>(f))
+      return kIndexSimple;
+   return kIndexNotIndexed;
+}
+
+void Sequence::WriteBlocksToIndex()
+{
+   unsigned int b;
+
+   for (b = 0; b < mBlock->GetCount(); b++) {
+      if (GetIndexBlockType(mBlock->Item(b)->f) == kIndexNotIndexed) {
+         sIndex->Put(kIndexNotIndexed);
+         return;
+      }
+   }
+
+   sIndex->Put((wxInt32)mBlock->GetCount());
+   for (b = 0; b < mBlock->GetCount(); b++) {
+      SeqBlock *bb = mBlock->Item(b);
+      float min, max, rms;
+      bb->f->GetMinMax(&min, &max, &rms);
+      wxCharBuffer name = bb->f->GetFileName().GetFullName().mb_str(wxConvUTF8);
+      wxUint16 nameLen = (wxUint16)strlen(name.data());
+
+      sIndex->Put(bb->start);
+      sIndex->Put((sampleCount)bb->f->GetLength());
+      sIndex->Put((wxInt32)GetIndexBlockType(bb->f));
+      sIndex->Put(min);
+      sIndex->Put(max);
+      sIndex->Put(rms);
+      sIndex->Put(nameLen);
+      sIndex->mData.insert(sIndex->mData.end(),
+                           name.data(), name.data() + nameLen);
+   }
+}
+
+// One block as the index has it
+struct IndexBlock {
+   sampleCount start;
+   sampleCount len;
+   wxInt32 type;
+   float min, max, rms;
+   wxString name;
+};
+
+// Builds the blocks of the sequence being read from the index, unless
+// it has them only in the XML.  Everything is checked before any block
+// is made, so that the XML can still be read if something is amiss.
+bool Sequence::ReadBlocksFromIndex()
+{
+   wxInt32 count;
+   if (!sIndex->Get(&count) || count == kIndexNotIndexed)
+      return false;
+
+   std::vector<IndexBlock> blocks;
+   sampleCount numSamples = 0;
+   bool ok = (count >= 0) && (mBlock->GetCount() == 0);
+   for (wxInt32 i = 0; ok && i < count; i++) {
+      IndexBlock block;
+      wxUint16 nameLen;
+      ok = sIndex->Get(&block.start) && sIndex->Get(&block.len) &&
+           sIndex->Get(&block.type) &&
+           sIndex->Get(&block.min) && sIndex->Get(&block.max) &&
+           sIndex->Get(&block.rms) && sIndex->Get(&nameLen) &&
+           sIndex->mData.size() - sIndex->mPos >= nameLen;
+      if (!ok)
+         break;
+
+      block.name = wxString(&sIndex->mData[sIndex->mPos], wxConvUTF8, nameLen);
+      sIndex->mPos += nameLen;
+
+      ok = (block.start == numSamples) &&
+           (block.len > 0) && (block.len <= mMaxSamples) &&
+           (block.type == kIndexSilent ||
+            (block.type == kIndexSimple &&
+             XMLValueChecker::IsGoodFileString(block.name)));
+      numSamples += block.len;
+      blocks.push_back(block);
+   }
+
+   if (!ok || numSamples != mNumSamples) {
+      sIndex->mValid = false;
+      return false;
+   }
+
+   for (size_t i = 0; i < blocks.size(); i++) {
+      SeqBlock *wb = new SeqBlock();
+      wb->start = blocks[i].start;
+
+      if (blocks[i].type == kIndexSilent)
+         wb->f = new SilentBlockFile(blocks[i].len);
+      else {
+         wxFileName fileName;
+         if (!mDirManager->AssignFile(fileName, blocks[i].name, false))
+            fileName.Clear();
+         wb->f = mDirManager->AddLoadedBlockFile(
+            new SimpleBlockFile(fileName, blocks[i].len,
+                                blocks[i].min, blocks[i].max, blocks[i].rms));
+      }
+
+      mBlock->Add(wb);
+   }
+
+   return true;
+}
+
 int Sequence::FindBlock(sampleCount pos, sampleCount lo,
                         sampleCount guess, sampleCount hi) const
 {
@@ -1112,6 +1734,16 @@ bool Sequence::Read(samplePtr buffer, sampleFormat format,
 
    BlockFile *f = b->f;
 
+   // Copy straight from cached or mapped samples when the block can
+   // hand them out in the requested format
+   void *token;
+   samplePtr direct = f->GetDirectData(format, start, len, &token);
+   if (direct) {
+      memcpy(buffer, direct, len * SAMPLE_SIZE(format));
+      f->ReleaseDirectData(token);
+      return true;
+   }
+
    int result = f->ReadData(buffer, format, start, len);
 
    if (result != len)
@@ -1179,6 +1811,78 @@ bool Sequence::Get(samplePtr buffer, sampleFormat format,
    return true;
 }
 
+bool Sequence::GetMany(SeqRequest *requests, int count,
+                       sampleFormat format) const
+{
+   int i;
+   for (i = 0; i < count; i++) {
+      if (requests[i].start < 0 || requests[i].len < 0 ||
+          requests[i].start + requests[i].len > mNumSamples)
+         return false;
+      if (i > 0 && requests[i].start < requests[i - 1].start)
+         return false;
+   }
+
+   int sampleSize = SAMPLE_SIZE(format);
+
+   // The first request that still needs samples
+   int first = 0;
+   while (first < count && requests[first].len == 0)
+      first++;
+   if (first == count)
+      return true;
+
+   samplePtr temp = NewSamples(mMaxSamples, format);
+   int b = FindBlock(requests[first].start);
+
+   while (first < count) {
+      SeqBlock *block = mBlock->Item(b);
+      sampleCount blockStart = block->start;
+      sampleCount blockEnd = blockStart + block->f->GetLength();
+
+      // Read the part of the block that spans all the requests touching
+      // it, then hand each of them its share
+      sampleCount lo = blockEnd;
+      sampleCount hi = blockStart;
+      for (i = first; i < count && requests[i].start < blockEnd; i++) {
+         sampleCount s = wxMax(requests[i].start, blockStart);
+         sampleCount e = wxMin(requests[i].start + requests[i].len, blockEnd);
+         if (s < e) {
+            lo = wxMin(lo, s);
+            hi = wxMax(hi, e);
+         }
+      }
+
+      if (hi > lo) {
+         Read(temp, format, block, lo - blockStart, hi - lo);
+
+         for (i = first; i < count && requests[i].start < blockEnd; i++) {
+            sampleCount s = wxMax(requests[i].start, blockStart);
+            sampleCount e = wxMin(requests[i].start + requests[i].len, blockEnd);
+            if (s < e)
+               memcpy(requests[i].buffer + (s - requests[i].start) * sampleSize,
+                      temp + (s - lo) * sampleSize,
+                      (e - s) * sampleSize);
+         }
+      }
+
+      while (first < count &&
+             requests[first].start + requests[first].len <= blockEnd)
+         first++;
+
+      if (first < count) {
+         if (requests[first].start < blockEnd)
+            b++;
+         else
+            b = FindBlock(requests[first].start);
+      }
+   }
+
+   DeleteSamples(temp);
+
+   return true;
+}
+
 // Pass NULL to set silence
 bool Sequence::Set(samplePtr buffer, sampleFormat format,
                    sampleCount start, sampleCount len)
@@ -1187,6 +1891,10 @@ bool Sequence::Set(samplePtr buffer, sampleFormat format,
        start+len > mNumSamples)
       return false;
 
+   mEdits++;
+
+   MakeBlocksUnique();
+
    samplePtr temp = NULL;
    if (format != mSampleFormat) {
       temp = NewSamples(mMaxSamples, mSampleFormat);
@@ -1258,13 +1966,16 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms,int* bl,
    if (s0 >= mNumSamples)
       return false;
 
-   int divisor;
-   if (samplesPerPixel >= 65536)
-      divisor = 65536;
-   else if (samplesPerPixel >= 256)
-      divisor = 256;
+   // Use the coarsest summary level with no more than one frame per
+   // pixel; levels are 4x apart from 256 to 64K
+   int levelDivisor;
+   if (samplesPerPixel >= 256) {
+      levelDivisor = 256;
+      while (levelDivisor < 65536 && samplesPerPixel >= levelDivisor * 4)
+         levelDivisor *= 4;
+   }
    else
-      divisor = 1;
+      levelDivisor = 1;
 
    if (s1 > mNumSamples)
       s1 = mNumSamples;
@@ -1284,6 +1995,11 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms,int* bl,
    int blockStatus = 1;
 
    while (srcX < s1) {
+      // Legacy block files only have the 256 and 64K levels
+      int divisor = levelDivisor;
+      if (divisor > 1 && !mBlock->Item(b)->f->HasSummaryLevel(divisor))
+         divisor = 256;
+
       // Get more samples
       sampleCount num;
 
@@ -1303,29 +2019,20 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms,int* bl,
          blockStatus=b;
          break;
       case 256:
-         //check to see if summary data has been computed
-         if(mBlock->Item(b)->f->IsSummaryAvailable())
-         {
-            mBlock->Item(b)->f->Read256(temp,
-                 (srcX - mBlock->Item(b)->start) / divisor, num);
-            blockStatus=b;
-         }
-         else
-         {
-            //otherwise, mark the display as not yet computed
-            blockStatus=-1-b;
-         }
-         break;
+      case 1024:
+      case 4096:
+      case 16384:
       case 65536:
          //check to see if summary data has been computed
          if(mBlock->Item(b)->f->IsSummaryAvailable())
          {
-            mBlock->Item(b)->f->Read64K(temp,
+            mBlock->Item(b)->f->ReadSummaryLevel(divisor, temp,
                  (srcX - mBlock->Item(b)->start) / divisor, num);
             blockStatus=b;
          }
          else
          {
+            //otherwise, mark the display as not yet computed
             blockStatus=-1-b;
          }
          break;
@@ -1389,6 +2096,9 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms,int* bl,
             }
             break;
          case 256:
+         case 1024:
+         case 4096:
+         case 16384:
          case 65536:
             while (x < stop) {
                if (temp[3 * x] < theMin)
@@ -1451,7 +2161,9 @@ sampleCount Sequence::GetIdealAppendLen()
       return max;
 
    lastBlockLen = mBlock->Item(numBlocks-1)->f->GetLength();
-   if (lastBlockLen == max)
+   // Append() only tops up a last block shorter than mMinSamples, which
+   // matters once the block size has grown
+   if (lastBlockLen == max || lastBlockLen >= mMinSamples)
       return max;
    else
       return max - lastBlockLen;
@@ -1464,6 +2176,16 @@ bool Sequence::Append(samplePtr buffer, sampleFormat format,
    if (((double)mNumSamples) + ((double)len) > wxLL(9223372036854775807))
       return false;
 
+   MakeBlocksUnique();
+
+   // Long recordings and imports move on to larger blocks as they grow.
+   // The block size never shrinks here, since the existing blocks
+   // must still fit; Reblock() does that.
+   sampleCount maxSamples = ChooseMaxSamples(mSampleFormat, mNumSamples + len,
+                                             mEdits);
+   if (maxSamples > mMaxSamples)
+      SetMaxSamples(maxSamples);
+
    // If the last block is not full, we need to add samples to it
    int numBlocks = mBlock->GetCount();
    if (numBlocks > 0 && mBlock->Item(numBlocks - 1)->f->GetLength() < mMinSamples) {
@@ -1474,6 +2196,7 @@ bool Sequence::Append(samplePtr buffer, sampleFormat format,
       else
          addLen = GetIdealBlockSize() - lastBlock->f->GetLength();
 
+      CountWatchedAllocation();
       SeqBlock *newLastBlock = new SeqBlock();
 
       samplePtr buffer2 = NewSamples((lastBlock->f->GetLength() + addLen), mSampleFormat);
@@ -1523,6 +2246,7 @@ bool Sequence::Append(samplePtr buffer, sampleFormat format,
    while (len) {
       sampleCount idealSamples = GetIdealBlockSize();
       sampleCount l = (len > idealSamples ? idealSamples : len);
+      CountWatchedAllocation();
       SeqBlock *w = new SeqBlock();
       w->start = mNumSamples;
 
@@ -1592,11 +2316,15 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
    if (len < 0 || start < 0 || start >= mNumSamples)
       return false;
 
+   mEdits++;
+
    //TODO: add a ref-deref mechanism to SeqBlock/BlockArray so we don't have to make this a critical section.
    //On-demand threads iterate over the mBlocks and the GUI thread deletes them, so for now put a mutex here over
    //both functions,
    LockDeleteUpdateMutex();
 
+   MakeBlocksUnique();
+
    unsigned int numBlocks = mBlock->GetCount();
    unsigned int newNumBlocks = 0;
 
@@ -1868,6 +2596,16 @@ void Sequence::DebugPrintf(wxString *dest)
 }
 
 // static
+void Sequence::SetJournal(SequenceJournal *journal)
+{
+   sJournal = journal;
+}
+
+void Sequence::SetIndex(SequenceIndex *index)
+{
+   sIndex = index;
+}
+
 void Sequence::SetMaxDiskBlockSize(int bytes)
 {
    sMaxDiskBlockSize = bytes;
@@ -1878,8 +2616,162 @@ int Sequence::GetMaxDiskBlockSize()
    return sMaxDiskBlockSize;
 }
 
+// static
+sampleCount Sequence::ChooseMaxSamples(sampleFormat format,
+                                       sampleCount numSamples,
+                                       int edits /* = 0 */)
+{
+   sampleCount bytes = numSamples * SAMPLE_SIZE(format);
+   int blockSize = sMaxDiskBlockSize;
+
+   int largest = kLargestDiskBlockSize;
+   for (int e = edits; e >= kEditsPerHalving && largest > blockSize;
+        e -= kEditsPerHalving)
+      largest /= 2;
+
+   while (blockSize < largest &&
+          bytes / blockSize > kBlocksPerSequence)
+      blockSize *= 2;
+
+   return blockSize / SAMPLE_SIZE(format);
+}
+
+void Sequence::SetMaxSamples(sampleCount maxSamples)
+{
+   mMinSamples = maxSamples / 2;
+   mMaxSamples = maxSamples;
+}
+
+bool Sequence::Reblock(sampleCount maxSamples)
+{
+   MakeBlocksUnique();
+
+   unsigned int numBlocks = mBlock->GetCount();
+   unsigned int b;
+
+   if (maxSamples == 0)
+      maxSamples = ChooseMaxSamples(mSampleFormat, mNumSamples, mEdits);
+
+   // Blocks we can't split must still fit
+   for (b = 0; b < numBlocks; b++)
+      if (IsFixedBlock(mBlock->Item(b)->f) &&
+          mBlock->Item(b)->f->GetLength() > maxSamples)
+         maxSamples = mBlock->Item(b)->f->GetLength();
+
+   // The same limits that HandleXMLTag() accepts
+   if (maxSamples < 1024 || maxSamples > 64 * 1024 * 1024)
+      return false;
+
+   if (maxSamples == mMaxSamples)
+      return true;
+
+   // Keep the ODTasks from updating blocks while we replace them
+   LockDeleteUpdateMutex();
+
+   sampleCount oldMaxSamples = mMaxSamples;
+   SetMaxSamples(maxSamples);
+
+   BlockArray *newBlock = new BlockArray();
+   samplePtr buffer = NewSamples(mMaxSamples, mSampleFormat);
+   bool bSuccess = true;
+
+   b = 0;
+   while (b < numBlocks && bSuccess) {
+      SeqBlock *first = mBlock->Item(b);
+
+      if (IsFixedBlock(first->f) || IsSilentBlock(first->f)) {
+         sampleCount len = first->f->GetLength();
+         if (len <= mMaxSamples) {
+            SeqBlock *w = new SeqBlock();
+            w->start = first->start;
+            w->f = first->f;
+            mDirManager->Ref(w->f);
+            newBlock->Add(w);
+         }
+         else {
+            int num = (len + (mMaxSamples - 1)) / mMaxSamples;
+            for (int i = 0; i < num; i++) {
+               SeqBlock *w = new SeqBlock();
+               w->start = first->start + i * len / num;
+               w->f = new SilentBlockFile(first->start + (i + 1) * len / num -
+                                          w->start);
+               newBlock->Add(w);
+            }
+         }
+         b++;
+         continue;
+      }
+
+      // Rewrite the whole run of blocks up to the next one of those as
+      // evenly sized blocks of the new size, as Blockify() does
+      unsigned int end = b;
+      sampleCount len = 0;
+      bool fits = true;
+      while (end < numBlocks && !IsFixedBlock(mBlock->Item(end)->f) &&
+             !IsSilentBlock(mBlock->Item(end)->f)) {
+         len += mBlock->Item(end)->f->GetLength();
+         if (mBlock->Item(end)->f->GetLength() > mMaxSamples)
+            fits = false;
+         end++;
+      }
+
+      int num = (len + (mMaxSamples - 1)) / mMaxSamples;
+      if (fits && num == (int)(end - b)) {
+         // Already as good as rewriting would make it
+         for (; b < end; b++) {
+            SeqBlock *w = new SeqBlock();
+            w->start = mBlock->Item(b)->start;
+            w->f = mBlock->Item(b)->f;
+            mDirManager->Ref(w->f);
+            newBlock->Add(w);
+         }
+         continue;
+      }
+
+      for (int i = 0; i < num && bSuccess; i++) {
+         sampleCount start = first->start + i * len / num;
+         sampleCount blockLen = first->start + (i + 1) * len / num - start;
+
+         bSuccess = Get(buffer, mSampleFormat, start, blockLen);
+         if (bSuccess) {
+            SeqBlock *w = new SeqBlock();
+            w->start = start;
+            w->f = mDirManager->NewSimpleBlockFile(buffer, blockLen,
+                                                   mSampleFormat);
+            newBlock->Add(w);
+         }
+      }
+      b = end;
+   }
+
+   DeleteSamples(buffer);
+
+   // Whichever array we end up with, drop the other one's references
+   BlockArray *discard = bSuccess ? mBlock : newBlock;
+   for (b = 0; b < discard->GetCount(); b++) {
+      mDirManager->Deref(discard->Item(b)->f);
+      delete discard->Item(b);
+   }
+   delete discard;
+
+   if (bSuccess)
+      mBlock = newBlock;
+   else
+      SetMaxSamples(oldMaxSamples);
+
+   UnlockDeleteUpdateMutex();
+
+   return bSuccess && ConsistencyCheck(wxT("Reblock"));
+}
+
 void Sequence::AppendBlockFile(BlockFile* blockFile)
 {
+   // The block may come from a recording whose block size had grown
+   if (blockFile->GetLength() > mMaxSamples)
+      SetMaxSamples(blockFile->GetLength());
+
+   MakeBlocksUnique();
+
    SeqBlock *w = new SeqBlock();
    w->start = mNumSamples;
    w->f = blockFile;
@@ -19,6 +19,9 @@
 #include "xml/XMLWriter.h"
 #include "ondemand/ODTaskThread.h"
 
+#include <map>
+#include <vector>
+
 typedef wxLongLong_t sampleCount; /** < A native 64-bit integer type, because
                                     32-bit integers may not be enough */
 
@@ -34,6 +37,70 @@ class SeqBlock {
 };
 WX_DEFINE_ARRAY(SeqBlock *, BlockArray);
 
+class Sequence;
+
+/// The block lists that the auto-save journal has written, by id.  While
+/// it is set with Sequence::SetJournal(), Sequence::WriteXML() writes a
+/// reference in place of a block list that it wrote in the last entry,
+/// and Sequence::HandleXMLTag() looks such references up.
+class SequenceJournal {
+ public:
+   SequenceJournal();
+   ~SequenceJournal();
+
+   /// Forgets all block lists, to start a new file
+   void Reset();
+   /// Lets the next entry refer to the block lists of this one.  The
+   /// writer must keep those block arrays alive, by keeping copies of
+   /// the sequences, until it ends the next entry or resets.
+   void EndEntry();
+
+ private:
+   friend class Sequence;
+
+   std::map<BlockArray *, int> mWritten; // by the last entry
+   std::map<BlockArray *, int> mWriting; // by the entry being written
+   std::map<int, Sequence *>   mRead;    // copies of the sequences read
+   int mNextId;
+};
+
+/// A binary copy of the block lists of a saved project, written next to
+/// the .aup file, so that opening the project needn't build every block
+/// from the XML.  While it is set with Sequence::SetIndex(),
+/// Sequence::WriteXML() records its blocks in it, and HandleXMLTag()
+/// takes them from it.  It is only read along with the very .aup file
+/// that it was written with, and sequences with blocks other than simple
+/// and silent ones are always read from the XML.
+class SequenceIndex {
+ public:
+   SequenceIndex();
+
+   static wxString GetFileName(const wxString &projectFileName);
+
+   /// Writes the block lists recorded while the project file was written
+   bool Write(const wxString &projectFileName);
+   /// Reads the index of the project file, if it has a matching one
+   bool Read(const wxString &projectFileName);
+
+ private:
+   friend class Sequence;
+
+   template<class T> void Put(const T &value);
+   template<class T> bool Get(T *value);
+
+   std::vector<char> mData; // the block list of each sequence, in order
+   size_t mPos;             // where reading is in mData
+   bool   mValid;           // false once reading hasn't gone as expected
+};
+
+/// One of the ranges of samples read by Sequence::GetMany()
+class SeqRequest {
+ public:
+   sampleCount start;
+   sampleCount len;
+   samplePtr   buffer;
+};
+
 class Sequence: public XMLTagHandler {
  public:
 
@@ -44,9 +111,22 @@ class Sequence: public XMLTagHandler {
    // Static methods
    //
 
+   static void SetJournal(SequenceJournal *journal);
+   static void SetIndex(SequenceIndex *index);
+
    static void SetMaxDiskBlockSize(int bytes);
    static int GetMaxDiskBlockSize();
 
+   /// Returns the block size, in samples, for a sequence of numSamples
+   /// samples in format: GetMaxDiskBlockSize() bytes for short ones,
+   /// doubling for long ones so that they aren't split into tens of
+   /// thousands of block files.  Every edit rewrites the blocks it
+   /// touches, so the more edits a sequence has had, the less the size
+   /// may grow.
+   static sampleCount ChooseMaxSamples(sampleFormat format,
+                                       sampleCount numSamples,
+                                       int edits = 0);
+
    //
    // Constructor / Destructor / Duplicator
    //
@@ -71,6 +151,9 @@ class Sequence: public XMLTagHandler {
 
    bool Get(samplePtr buffer, sampleFormat format,
             sampleCount start, sampleCount len) const;
+   /// Like calling Get() for each of the count requests, which must be
+   /// sorted by start, but each block they touch is found and read once.
+   bool GetMany(SeqRequest *requests, int count, sampleFormat format) const;
    bool Set(samplePtr buffer, sampleFormat format,
             sampleCount start, sampleCount len);
 
@@ -147,6 +230,15 @@ class Sequence: public XMLTagHandler {
    bool GetRMS(sampleCount start, sampleCount len,
                   float * outRMS) const;
 
+   /// Appends to runs the start and end of each run of samples in
+   /// [start, start + len) whose magnitude is below threshold, if it is
+   /// at least minRun long or touches either end of the range.  Uses
+   /// the block and 256-sample summaries, and only reads samples where
+   /// such a run can begin or end.
+   bool GetQuietRuns(sampleCount start, sampleCount len, float threshold,
+                     sampleCount minRun,
+                     std::vector<sampleCount> &runs) const;
+
    //
    // Getting block size information
    //
@@ -155,12 +247,23 @@ class Sequence: public XMLTagHandler {
    sampleCount GetMaxBlockSize() const;
    sampleCount GetIdealBlockSize() const;
 
+   /// Rewrites the blocks of this sequence to be at most maxSamples
+   /// long, or the size ChooseMaxSamples() picks if maxSamples is 0.
+   /// Alias blocks are kept as they are, so the size never goes below
+   /// the longest of them.
+   bool Reblock(sampleCount maxSamples = 0);
+
    //
    // This should only be used if you really, really know what
    // you're doing!
    //
 
+   /// The blocks may be shared with copies of this Sequence; don't
+   /// change them through this pointer, use GetWritableBlockArray()
    BlockArray *GetBlockArray() {return mBlock;}
+   const BlockArray *GetBlockArray() const {return mBlock;}
+   /// Gives this Sequence blocks of its own and returns them
+   BlockArray *GetWritableBlockArray() {MakeBlocksUnique(); return mBlock;}
 
    ///
    void LockDeleteUpdateMutex(){mDeleteUpdateMutex.Lock();}
@@ -173,6 +276,8 @@ class Sequence: public XMLTagHandler {
    //
 
    static int    sMaxDiskBlockSize;
+   static SequenceJournal *sJournal;
+   static SequenceIndex *sIndex;
 
    //
    // Private variables
@@ -181,6 +286,9 @@ class Sequence: public XMLTagHandler {
    DirManager   *mDirManager;
 
    BlockArray   *mBlock;
+   /// Copies made with the same DirManager (as for undo states) share
+   /// mBlock until one of them changes it; this counts the sharers
+   int          *mBlockShares;
    sampleFormat  mSampleFormat;
    sampleCount   mNumSamples;
 
@@ -188,6 +296,9 @@ class Sequence: public XMLTagHandler {
    sampleCount   mMaxSamples; // max samples per block
 
    bool          mErrorOpening;
+   int           mJournalId; // of the block list being read, or -1
+   bool          mBlocksFromIndex; // so the XML of the blocks is skipped
+   int           mEdits; // Paste(), Delete() and Set() calls so far
 
    ///To block the Delete() method against the ODCalcSummaryTask::Update() method
    ODLock   mDeleteUpdateMutex;
@@ -198,6 +309,17 @@ class Sequence: public XMLTagHandler {
 
    void CalcSummaryInfo();
 
+   void SetMaxSamples(sampleCount maxSamples);
+
+   /// Copies mBlock if it is shared, so it can be changed
+   void MakeBlocksUnique();
+   void WriteBlocksToIndex();
+   bool ReadBlocksFromIndex();
+
+   /// Drops this Sequence's blocks and shares those of other instead
+   void ShareBlocks(const Sequence &other);
+   void ReleaseBlocks();
+
    int FindBlock(sampleCount pos) const;
    int FindBlock(sampleCount pos, sampleCount lo,
                  sampleCount guess, sampleCount hi) const;
@@ -1053,70 +1053,33 @@ void TrackArtist::DrawWaveformBackground(wxDC &dc, const wxRect &r, const double
 }
 
 
-#ifdef EXPERIMENTAL_OUTPUT_DISPLAY
-void TrackArtist::DrawMinMaxRMS(wxDC &dc, const wxRect &r, const double env[],
-                                float zoomMin, float zoomMax, bool dB,
-                                const float min[], const float max[], const float rms[],
-                                const int bl[], bool showProgress, bool muted, const float gain)
-#else
-void TrackArtist::DrawMinMaxRMS(wxDC &dc, const wxRect &r, const double env[],
-                                float zoomMin, float zoomMax, bool dB,
-                                const float min[], const float max[], const float rms[],
-                                const int bl[], bool WXUNUSED(showProgress), bool muted)
-#endif
+/// Computes the pixel rows of the waveform in each column of r, relative
+/// to r.y: the sample line runs from top[x] to bot[x] and the RMS line
+/// from rmsTop[x] to rmsBot[x].  If clipped is not NULL it says which
+/// columns have samples at or beyond full scale.
+void TrackArtist::GetMinMaxRMSRows(const wxRect &r, const double env[],
+                                   float zoomMin, float zoomMax, bool dB,
+                                   const float min[], const float max[],
+                                   const float rms[], float gain,
+                                   int top[], int bot[],
+                                   int rmsTop[], int rmsBot[], bool clipped[])
 {
-   // Display a line representing the
-   // min and max of the samples in this region
    int lasth1 = std::numeric_limits<int>::max();
    int lasth2 = std::numeric_limits<int>::min();
    int h1;
    int h2;
-   int *r1 = new int[r.width];
-   int *r2 = new int[r.width];
-   int *clipped = NULL;
-   int clipcnt = 0;
-   int x;
-
-   if (mShowClipping) {
-      clipped =  new int[r.width];
-   }
-
-   long pixAnimOffset = (long)fabs((double)(wxDateTime::Now().GetTicks() * -10)) +
-      wxDateTime::Now().GetMillisecond() / 100; //10 pixels a second
 
-   bool drawStripes = true;
-   bool drawWaveform = true;
-
-   dc.SetPen(muted ? muteSamplePen : samplePen);
-   for (x = 0; x < r.width; x++) {
-      int xx = r.x + x;
+   for (int x = 0; x < r.width; x++) {
       double v;
-#ifdef EXPERIMENTAL_OUTPUT_DISPLAY
-     //JWA: "gain" variable passed to function includes the pan value and is used below 4/14/13
       v = min[x] * env[x] * gain;
-#else
-      v = min[x] * env[x];
-#endif
-      if (clipped && mShowClipping && (v <= -MAX_AUDIO))
-      {
-         if (clipcnt == 0 || clipped[clipcnt - 1] != xx) {
-            clipped[clipcnt++] = xx;
-         }
-      }
+      if (clipped)
+         clipped[x] = (v <= -MAX_AUDIO);
       h1 = GetWaveYPos(v, zoomMin, zoomMax,
                        r.height, dB, true, mdBrange, true);
 
-#ifdef EXPERIMENTAL_OUTPUT_DISPLAY
       v = max[x] * env[x] * gain;
-#else
-      v = max[x] * env[x];
-#endif
-      if (clipped && mShowClipping && (v >= MAX_AUDIO))
-      {
-         if (clipcnt == 0 || clipped[clipcnt - 1] != xx) {
-            clipped[clipcnt++] = xx;
-         }
-      }
+      if (clipped && v >= MAX_AUDIO)
+         clipped[x] = true;
       h2 = GetWaveYPos(v, zoomMin, zoomMax,
                        r.height, dB, true, mdBrange, true);
 
@@ -1133,28 +1096,72 @@ void TrackArtist::DrawMinMaxRMS(wxDC &dc, const wxRect &r, const double env[],
       lasth1 = h1;
       lasth2 = h2;
 
-#ifdef EXPERIMENTAL_OUTPUT_DISPLAY
-      r1[x] = GetWaveYPos(-rms[x] * env[x]*gain, zoomMin, zoomMax,
-                          r.height, dB, true, mdBrange, true);
-      r2[x] = GetWaveYPos(rms[x] * env[x]*gain, zoomMin, zoomMax,
-                          r.height, dB, true, mdBrange, true);
-#else
-      r1[x] = GetWaveYPos(-rms[x] * env[x], zoomMin, zoomMax,
-                          r.height, dB, true, mdBrange, true);
-      r2[x] = GetWaveYPos(rms[x] * env[x], zoomMin, zoomMax,
-                          r.height, dB, true, mdBrange, true);
-#endif
+      int r1 = GetWaveYPos(-rms[x] * env[x] * gain, zoomMin, zoomMax,
+                           r.height, dB, true, mdBrange, true);
+      int r2 = GetWaveYPos(rms[x] * env[x] * gain, zoomMin, zoomMax,
+                           r.height, dB, true, mdBrange, true);
       // Make sure the rms isn't larger than the waveform min/max
-      if (r1[x] > h1 - 1) {
-         r1[x] = h1 - 1;
+      if (r1 > h1 - 1) {
+         r1 = h1 - 1;
       }
-      if (r2[x] < h2 + 1) {
-         r2[x] = h2 + 1;
+      if (r2 < h2 + 1) {
+         r2 = h2 + 1;
       }
-      if (r2[x] > r1[x]) {
-         r2[x] = r1[x];
+      if (r2 > r1) {
+         r2 = r1;
       }
 
+      top[x] = h2;
+      bot[x] = h1;
+      rmsTop[x] = r2;
+      rmsBot[x] = r1;
+   }
+}
+
+#ifdef EXPERIMENTAL_OUTPUT_DISPLAY
+void TrackArtist::DrawMinMaxRMS(wxDC &dc, const wxRect &r, const double env[],
+                                float zoomMin, float zoomMax, bool dB,
+                                const float min[], const float max[], const float rms[],
+                                const int bl[], bool showProgress, bool muted, const float gain)
+#else
+void TrackArtist::DrawMinMaxRMS(wxDC &dc, const wxRect &r, const double env[],
+                                float zoomMin, float zoomMax, bool dB,
+                                const float min[], const float max[], const float rms[],
+                                const int bl[], bool WXUNUSED(showProgress), bool muted)
+#endif
+{
+   // Display a line representing the
+   // min and max of the samples in this region
+   int *h1 = new int[r.width];
+   int *h2 = new int[r.width];
+   int *r1 = new int[r.width];
+   int *r2 = new int[r.width];
+   bool *clipped = NULL;
+   int x;
+
+   if (mShowClipping) {
+      clipped =  new bool[r.width];
+   }
+
+#ifdef EXPERIMENTAL_OUTPUT_DISPLAY
+   //JWA: "gain" variable passed to function includes the pan value and is used below 4/14/13
+   GetMinMaxRMSRows(r, env, zoomMin, zoomMax, dB, min, max, rms, gain,
+                    h2, h1, r2, r1, clipped);
+#else
+   GetMinMaxRMSRows(r, env, zoomMin, zoomMax, dB, min, max, rms, 1.0f,
+                    h2, h1, r2, r1, clipped);
+#endif
+
+   long pixAnimOffset = (long)fabs((double)(wxDateTime::Now().GetTicks() * -10)) +
+      wxDateTime::Now().GetMillisecond() / 100; //10 pixels a second
+
+   bool drawStripes = true;
+   bool drawWaveform = true;
+
+   dc.SetPen(muted ? muteSamplePen : samplePen);
+   for (x = 0; x < r.width; x++) {
+      int xx = r.x + x;
+
       if (bl[x] <= -1) {
          if (drawStripes) {
             // TODO:unify with buffer drawing.
@@ -1183,7 +1190,7 @@ void TrackArtist::DrawMinMaxRMS(wxDC &dc, const wxRect &r, const double env[],
          }
       }
       else {
-         AColor::Line(dc, xx, r.y + h2, xx, r.y + h1);
+         AColor::Line(dc, xx, r.y + h2[x], xx, r.y + h1[x]);
       }
    }
 
@@ -1198,22 +1205,171 @@ void TrackArtist::DrawMinMaxRMS(wxDC &dc, const wxRect &r, const double env[],
    }
 
    // Draw the clipping lines
-   if (clipcnt) {
+   if (clipped) {
       dc.SetPen(muted ? muteClippedPen : clippedPen);
-      while (--clipcnt >= 0) {
-         int xx = clipped[clipcnt];
-         AColor::Line(dc, xx, r.y, xx, r.y + r.height);
+      for (x = 0; x < r.width; x++) {
+         if (clipped[x]) {
+            int xx = r.x + x;
+            AColor::Line(dc, xx, r.y, xx, r.y + r.height);
+         }
       }
    }
 
-   if (mShowClipping) {
-      delete[] clipped;
-   }
-
+   delete[] clipped;
+   delete [] h1;
+   delete [] h2;
    delete [] r1;
    delete [] r2;
 }
 
+// Sets rows y0 to y1 (both included, in either order) of a column of
+// the offscreen waveform to colour, keeping within the height.
+static inline void FillWaveColumn(wxUint32 *column, int height,
+                                  int y0, int y1, wxUint32 colour)
+{
+   if (y0 > y1) {
+      int tmp = y0;
+      y0 = y1;
+      y1 = tmp;
+   }
+   if (y0 < 0)
+      y0 = 0;
+   if (y1 >= height)
+      y1 = height - 1;
+   for (int y = y0; y <= y1; y++)
+      column[y] = colour;
+}
+
+static inline wxUint32 PackColour(const wxColour &colour)
+{
+   return ((wxUint32)colour.Red() << 16) |
+          ((wxUint32)colour.Green() << 8) |
+          (wxUint32)colour.Blue();
+}
+
+/// Draws what DrawWaveformBackground() and DrawMinMaxRMS() would, but
+/// into a 32-bit pixel buffer in memory, one column after another, and
+/// blits the result to dc in one go.  Doesn't do the sync-lock tiles.
+void TrackArtist::RasterizeWaveform(wxDC &dc, const wxRect &r, const double env[],
+                                    float zoomMin, float zoomMax, bool dB,
+                                    const sampleCount where[],
+                                    sampleCount ssel0, sampleCount ssel1,
+                                    bool drawEnvelope, bool bIsSyncLockSelected,
+                                    const float min[], const float max[],
+                                    const float rms[], const int bl[],
+                                    bool muted, float gain)
+{
+   int h = r.height;
+   int halfHeight = wxMax(h / 2, 1);
+   int x;
+
+   int *h1 = new int[r.width];
+   int *h2 = new int[r.width];
+   int *r1 = new int[r.width];
+   int *r2 = new int[r.width];
+   bool *clipped = mShowClipping ? new bool[r.width] : NULL;
+   GetMinMaxRMSRows(r, env, zoomMin, zoomMax, dB, min, max, rms, gain,
+                    h2, h1, r2, r1, clipped);
+
+   long pixAnimOffset = (long)fabs((double)(wxDateTime::Now().GetTicks() * -10)) +
+      wxDateTime::Now().GetMillisecond() / 100; //10 pixels a second
+
+   wxUint32 blank = PackColour(blankBrush.GetColour());
+   wxUint32 unselected = PackColour(unselectedBrush.GetColour());
+   wxUint32 selected = PackColour(selectedBrush.GetColour());
+   wxUint32 sample = PackColour(samplePen.GetColour());
+   wxUint32 muteSample = PackColour(muteSamplePen.GetColour());
+   wxUint32 line = PackColour((muted ? muteSamplePen : samplePen).GetColour());
+   wxUint32 rmsLine = PackColour((muted ? muteRmsPen : rmsPen).GetColour());
+   wxUint32 clipLine = PackColour((muted ? muteClippedPen : clippedPen).GetColour());
+   wxUint32 zeroLine = PackColour(*wxBLACK);
+
+   int zero = -1;
+   if (zoomMin < 0 && zoomMax > 0)
+      zero = (int)((zoomMax / (zoomMax - zoomMin)) * h);
+
+   // Each column is contiguous, so filling one is a simple loop
+   wxUint32 *pixels = new wxUint32[r.width * h];
+
+   for (x = 0; x < r.width; x++) {
+      wxUint32 *column = pixels + x * h;
+
+      // The background, as in DrawWaveformBackground()
+      int maxtop = GetWaveYPos(env[x], zoomMin, zoomMax,
+                               h, dB, true, mdBrange, true);
+      int maxbot = GetWaveYPos(env[x], zoomMin, zoomMax,
+                               h, dB, false, mdBrange, true);
+      int mintop = GetWaveYPos(-env[x], zoomMin, zoomMax,
+                               h, dB, false, mdBrange, true) + 1;
+      int minbot = GetWaveYPos(-env[x], zoomMin, zoomMax,
+                               h, dB, true, mdBrange, true) + 1;
+      if (!drawEnvelope || maxbot > mintop) {
+         maxbot = halfHeight;
+         mintop = halfHeight;
+      }
+      bool sel = (ssel0 <= where[x] && where[x + 1] < ssel1) && !bIsSyncLockSelected;
+      wxUint32 back = sel ? selected : unselected;
+
+      FillWaveColumn(column, h, 0, h - 1, blank);
+      if (maxbot != mintop - 1) {
+         if (maxbot > maxtop)
+            FillWaveColumn(column, h, maxtop, maxbot - 1, back);
+         if (minbot > mintop)
+            FillWaveColumn(column, h, mintop, minbot - 1, back);
+      }
+      else if (minbot > maxtop)
+         FillWaveColumn(column, h, maxtop, minbot - 1, back);
+
+      if (zero >= 0 && zero < h)
+         column[zero] = zeroLine;
+
+      // The samples, as in DrawMinMaxRMS()
+      if (bl[x] <= -1) {
+         wxUint32 stripe = (bl[x] % 2) ? muteSample : sample;
+         for (int y = 0; y < h / 25 + 1; y++)
+            FillWaveColumn(column, h, 25 * y + x % 25, 25 * y + x % 25 + 6, stripe);
+
+         int triX = fabs((double)((x + pixAnimOffset) % (2 * h)) - h) + h;
+         for (int y = 0; y < h; y++) {
+            if ((y + triX) % h == 0)
+               column[y] = sample;
+         }
+      }
+      else {
+         FillWaveColumn(column, h, h2[x], h1[x], line);
+         if (r1[x] != r2[x])
+            FillWaveColumn(column, h, r2[x], r1[x], rmsLine);
+      }
+
+      if (clipped && clipped[x])
+         FillWaveColumn(column, h, 0, h - 1, clipLine);
+   }
+
+   // Turn the columns into the rows of an image and put it on the dc
+   wxImage image(r.width, h);
+   unsigned char *data = image.GetData();
+   for (int y = 0; y < h; y++) {
+      const wxUint32 *pixel = pixels + y;
+      for (x = 0; x < r.width; x++, pixel += h) {
+         *data++ = (unsigned char)(*pixel >> 16);
+         *data++ = (unsigned char)(*pixel >> 8);
+         *data++ = (unsigned char)*pixel;
+      }
+   }
+
+   wxBitmap converted = wxBitmap(image);
+   wxMemoryDC memDC;
+   memDC.SelectObject(converted);
+   dc.Blit(r.x, r.y, r.width, h, &memDC, 0, 0, wxCOPY, FALSE);
+
+   delete[] pixels;
+   delete[] clipped;
+   delete[] h1;
+   delete[] h2;
+   delete[] r1;
+   delete[] r2;
+}
+
 void TrackArtist::DrawIndividualSamples(wxDC &dc, const wxRect &r,
                                         float zoomMin, float zoomMax, bool dB,
                                         WaveClip *clip,
@@ -1588,26 +1744,45 @@ void TrackArtist::DrawClipWaveform(WaveTrack *track,
    double *envValues = new double[mid.width];
    clip->GetEnvelope()->GetValues(envValues, mid.width, t0 + tOffset, tstep);
 
-   // Draw the background of the track, outlining the shape of
-   // the envelope and using a colored pen for the selected
-   // part of the waveform
-   DrawWaveformBackground(dc, mid, envValues, zoomMin, zoomMax, dB,
-                          where, ssel0, ssel1, drawEnvelope,
-                          !track->GetSelected());
+   // Unless there are sync-lock tiles to go between the background and
+   // the samples, draw both into memory and put them on the dc at once.
+   // This is much quicker than a few DrawLine() calls per column.
+   bool rasterize = mRasterizeWaveform && !showIndividualSamples &&
+      (track->GetSelected() || ssel0 >= ssel1);
 
-   if (!showIndividualSamples) {
+   if (rasterize) {
 #ifdef EXPERIMENTAL_OUTPUT_DISPLAY
-      DrawMinMaxRMS(dc, mid, envValues, zoomMin, zoomMax, dB,
-                    min, max, rms, bl, isLoadingOD, muted, track->GetChannelGain(track->GetChannel()));
+      float gain = track->GetChannelGain(track->GetChannel());
 #else
-      DrawMinMaxRMS(dc, mid, envValues, zoomMin, zoomMax, dB,
-                    min, max, rms, bl, isLoadingOD, muted);
+      float gain = 1.0f;
 #endif
+      RasterizeWaveform(dc, mid, envValues, zoomMin, zoomMax, dB,
+                        where, ssel0, ssel1, drawEnvelope,
+                        !track->GetSelected(),
+                        min, max, rms, bl, muted, gain);
    }
    else {
-      DrawIndividualSamples(dc, mid, zoomMin, zoomMax, dB,
-                            clip, t0, pps, h,
-                            drawSamples, showPoints, muted);
+      // Draw the background of the track, outlining the shape of
+      // the envelope and using a colored pen for the selected
+      // part of the waveform
+      DrawWaveformBackground(dc, mid, envValues, zoomMin, zoomMax, dB,
+                             where, ssel0, ssel1, drawEnvelope,
+                             !track->GetSelected());
+
+      if (!showIndividualSamples) {
+#ifdef EXPERIMENTAL_OUTPUT_DISPLAY
+         DrawMinMaxRMS(dc, mid, envValues, zoomMin, zoomMax, dB,
+                       min, max, rms, bl, isLoadingOD, muted, track->GetChannelGain(track->GetChannel()));
+#else
+         DrawMinMaxRMS(dc, mid, envValues, zoomMin, zoomMax, dB,
+                       min, max, rms, bl, isLoadingOD, muted);
+#endif
+      }
+      else {
+         DrawIndividualSamples(dc, mid, zoomMin, zoomMax, dB,
+                               clip, t0, pps, h,
+                               drawSamples, showPoints, muted);
+      }
    }
 
    if (drawEnvelope) {
@@ -1898,8 +2073,9 @@ void TrackArtist::DrawClipSpectrum(WaveTrack *track,
    float *freq = new float[mid.width * half];
    sampleCount *where = new sampleCount[mid.width+1];
 
+   bool isRendering = false; // true while the columns are computed in the background
    bool updated = clip->GetSpectrogram(freq, where, mid.width,
-                              t0, pps, autocorrelation);
+                              t0, pps, autocorrelation, isRendering);
    int ifreq = lrint(rate/2);
 
    int maxFreq;
@@ -1950,6 +2126,29 @@ void TrackArtist::DrawClipSpectrum(WaveTrack *track,
 #endif
    }
 
+   if (isRendering) {
+      // Nothing to cache yet.  Draw stripes like those of blocks still
+      // loading on demand; the track panel is refreshed when the
+      // columns are ready.
+      clip->mSpecPxCache->valid = false;
+      sampleCount w1 = (sampleCount) (t0*rate + .5);
+      for (int x = 0; x < mid.width; x++) {
+         sampleCount w0 = w1;
+         w1 = (sampleCount) ((t0*rate + (x+1) *rate *tstep) + .5);
+         bool selflag = (ssel0 <= w0 && w1 < ssel1);
+         unsigned char rv, gv, bv, srv, sgv, sbv;
+         GetColorGradient(0.0f, selflag, mIsGrayscale, &rv, &gv, &bv);
+         GetColorGradient(0.5f, selflag, mIsGrayscale, &srv, &sgv, &sbv);
+         for (int yy = 0; yy < mid.height; yy++) {
+            bool stripe = (yy + 25 - x % 25) % 25 < 7;
+            int px = (yy * mid.width + x) * 3;
+            data[px++] = stripe ? srv : rv;
+            data[px++] = stripe ? sgv : gv;
+            data[px] = stripe ? sbv : bv;
+         }
+      }
+   }
+
    int minSamples = int ((double)minFreq * (double)windowSize / rate + 0.5);   // units are fft bins
    int maxSamples = int ((double)maxFreq * (double)windowSize / rate + 0.5);
    float binPerPx = float(maxSamples - minSamples) / float(mid.height);
@@ -2014,7 +2213,7 @@ void TrackArtist::DrawClipSpectrum(WaveTrack *track,
    int *indexes=new int[maxTableSize];
 #endif //EXPERIMENTAL_FIND_NOTES
 
-   while (x < mid.width)
+   while (!isRendering && x < mid.width)
    {
       sampleCount w0 = w1;
       w1 = (sampleCount) ((t0*rate + (x+1) *rate *tstep) + .5);
@@ -2956,6 +3155,7 @@ void TrackArtist::UpdatePrefs()
 {
    mdBrange = gPrefs->Read(wxT("/GUI/EnvdBRange"), mdBrange);
    mShowClipping = gPrefs->Read(wxT("/GUI/ShowClipping"), mShowClipping);
+   gPrefs->Read(wxT("/GUI/RasterizeWaveform"), &mRasterizeWaveform, true);
 
    mMaxFreq = gPrefs->Read(wxT("/Spectrum/MaxFreq"), -1);
    mMinFreq = gPrefs->Read(wxT("/Spectrum/MinFreq"), -1);
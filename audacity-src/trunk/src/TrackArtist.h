@@ -163,6 +163,18 @@ class AUDACITY_DLL_API TrackArtist {
                       const float min[], const float max[], const float rms[],
                       const int bl[], bool showProgress, bool muted);
 #endif
+   void GetMinMaxRMSRows(const wxRect & r, const double env[],
+                         float zoomMin, float zoomMax, bool dB,
+                         const float min[], const float max[], const float rms[],
+                         float gain, int top[], int bot[],
+                         int rmsTop[], int rmsBot[], bool clipped[]);
+   void RasterizeWaveform(wxDC & dc, const wxRect & r, const double env[],
+                          float zoomMin, float zoomMax, bool dB,
+                          const sampleCount where[],
+                          sampleCount ssel0, sampleCount ssel1,
+                          bool drawEnvelope, bool bIsSyncLockSelected,
+                          const float min[], const float max[], const float rms[],
+                          const int bl[], bool muted, float gain);
    void DrawIndividualSamples(wxDC & dc, const wxRect & r,
                               float zoomMin, float zoomMax, bool dB,
                               WaveClip *clip,
@@ -185,6 +197,7 @@ class AUDACITY_DLL_API TrackArtist {
    int mWindowSize;           // "/Spectrum/FFTSize"
    bool mIsGrayscale;         // "/Spectrum/Grayscale"
    bool mbShowTrackNameInWaveform;  // "/GUI/ShowTrackNameInWaveform"
+   bool mRasterizeWaveform;   // "/GUI/RasterizeWaveform"
 
 #ifdef EXPERIMENTAL_FFT_SKIP_POINTS
    int mFftSkipPoints;        // "/Spectrum/FFTSkipPoints"
@@ -790,6 +790,9 @@ void TrackPanel::UpdatePrefs()
 
    if (mTrackArtist) {
       mTrackArtist->UpdatePrefs();
+      // The clips' spectrum caches no longer notice changes to the
+      // display settings (gain, range, frequencies), so drop the pixels
+      mTrackArtist->InvalidateSpectrumCache(mTracks);
    }
 
    // All vertical rulers must be recalculated since the minimum and maximum
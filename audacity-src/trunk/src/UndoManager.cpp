@@ -29,9 +29,6 @@ UndoManager
 #include "WaveTrack.h"          // temp
 #include "NoteTrack.h"  // for Sonify* function declarations
 
-#include <map>
-#include <set>
-
 #include "UndoManager.h"
 
 UndoManager::UndoManager()
@@ -47,65 +44,68 @@ UndoManager::~UndoManager()
    ClearStates();
 }
 
-// get the sum of the sizes of all blocks this track list
-// references.  However, if a block is referred to multiple
-// times it is only counted once.  Return value is in bytes.
-wxLongLong UndoManager::CalculateSpaceUsage(int index)
+// Space usage is kept up to date as states come and go, rather than
+// recounted for each state.  Undo states share the block arrays of the
+// sequences an edit didn't touch (see Sequence), so only the blocks of
+// arrays that no state used before are looked at.  If newBytes isn't
+// NULL, it gets the size of the blocks that no other state on the stack
+// uses; otherwise no block is asked for its size.
+void UndoManager::AddStateBlocks(TrackList *l, wxLongLong *newBytes)
 {
    TrackListOfKindIterator iter(Track::Wave);
-   WaveTrack *wt;
    WaveClipList::compatibility_iterator it;
-   BlockArray *blocks;
+   WaveTrack *wt;
    unsigned int i;
 
-   // get a map of all blocks referenced in this TrackList
-   std::map<BlockFile*, wxLongLong> cur;
+   if (newBytes)
+      *newBytes = 0;
 
-   wt = (WaveTrack *) iter.First(stack[index]->tracks);
+   wt = (WaveTrack *) iter.First(l);
    while (wt) {
       for (it = wt->GetClipIterator(); it; it = it->GetNext()) {
-         blocks = it->GetData()->GetSequenceBlockArray();
-         for (i = 0; i < blocks->GetCount(); i++)
-         {
-            BlockFile* pBlockFile = blocks->Item(i)->f;
-            if (pBlockFile->GetFileName().FileExists())
-               cur[pBlockFile] = pBlockFile->GetSpaceUsage();
+         BlockArray *blocks = it->GetData()->GetSequenceBlockArray();
+         if (mArrayUses[blocks]++ > 0)
+            continue;
+
+         for (i = 0; i < blocks->GetCount(); i++) {
+            BlockFile *pBlockFile = blocks->Item(i)->f;
+            if (mBlockUses[pBlockFile]++ == 0 && newBytes)
+               *newBytes += pBlockFile->GetSpaceUsage();
          }
       }
       wt = (WaveTrack *) iter.Next();
    }
+}
 
-   if (index > 0) {
-      // get a set of all blocks referenced in all prev TrackList
-      std::set<BlockFile*> prev;
-      while (--index) {
-         wt = (WaveTrack *) iter.First(stack[index]->tracks);
-         while (wt) {
-            for (it = wt->GetClipIterator(); it; it = it->GetNext()) {
-               blocks = it->GetData()->GetSequenceBlockArray();
-               for (i = 0; i < blocks->GetCount(); i++) {
-                  prev.insert(blocks->Item(i)->f);
-               }
-            }
-            wt = (WaveTrack *) iter.Next();
-         }
-      }
+// Call before the tracks of a state are deleted, while its block arrays
+// still exist
+void UndoManager::RemoveStateBlocks(TrackList *l)
+{
+   TrackListOfKindIterator iter(Track::Wave);
+   WaveClipList::compatibility_iterator it;
+   WaveTrack *wt;
+   unsigned int i;
 
-      // remove all blocks in prevBlockFiles from curBlockFiles
-      std::set<BlockFile*>::const_iterator prevIter;
-      for (prevIter = prev.begin(); prevIter != prev.end(); prevIter++) {
-         cur.erase(*prevIter);
+   wt = (WaveTrack *) iter.First(l);
+   while (wt) {
+      for (it = wt->GetClipIterator(); it; it = it->GetNext()) {
+         BlockArray *blocks = it->GetData()->GetSequenceBlockArray();
+         std::map<BlockArray *, int>::iterator arrayUse = mArrayUses.find(blocks);
+         wxASSERT(arrayUse != mArrayUses.end());
+         if (arrayUse == mArrayUses.end() || --arrayUse->second > 0)
+            continue;
+         mArrayUses.erase(arrayUse);
+
+         for (i = 0; i < blocks->GetCount(); i++) {
+            std::map<BlockFile *, int>::iterator use =
+               mBlockUses.find(blocks->Item(i)->f);
+            wxASSERT(use != mBlockUses.end());
+            if (use != mBlockUses.end() && --use->second == 0)
+               mBlockUses.erase(use);
+         }
       }
+      wt = (WaveTrack *) iter.Next();
    }
-
-   // sum the sizes of the blocks remaining in curBlockFiles;
-   wxLongLong bytes = 0;
-   std::map<BlockFile*, wxLongLong>::const_iterator curIter;
-   for (curIter = cur.begin(); curIter != cur.end(); curIter++) {
-      bytes += curIter->second;
-   }
-
-   return bytes;
 }
 
 void UndoManager::GetLongDescription(unsigned int n, wxString *desc,
@@ -140,6 +140,7 @@ void UndoManager::SetLongDescription(unsigned int n, wxString desc)
 
 void UndoManager::RemoveStateAt(int n)
 {
+   RemoveStateBlocks(stack[n]->tracks);
    stack[n]->tracks->Clear(true);
    delete stack[n]->tracks;
 
@@ -191,9 +192,6 @@ void UndoManager::ModifyState(TrackList * l, double sel0, double sel1)
    }
 
    SonifyBeginModifyState();
-   // Delete current
-   stack[current]->tracks->Clear(true);
-   delete stack[current]->tracks;
 
    // Duplicate
    TrackList *tracksCopy = new TrackList();
@@ -204,6 +202,16 @@ void UndoManager::ModifyState(TrackList * l, double sel0, double sel1)
       t = iter.Next();
    }
 
+   // Account for the new tracks before the old ones, so that the blocks
+   // they have in common aren't forgotten in between.  The state keeps
+   // the space usage it was pushed with.
+   AddStateBlocks(tracksCopy, NULL);
+
+   // Delete current
+   RemoveStateBlocks(stack[current]->tracks);
+   stack[current]->tracks->Clear(true);
+   delete stack[current]->tracks;
+
    // Replace
    stack[current]->tracks = tracksCopy;
    stack[current]->sel0 = sel0;
@@ -252,12 +260,14 @@ void UndoManager::PushState(TrackList * l, double sel0, double sel1,
    push->sel1 = sel1;
    push->description = longDescription;
    push->shortDescription = shortDescription;
-   push->spaceUsage = 0; // Calculate actual value after it's on the stack.
+   push->spaceUsage = 0;
+
+   // The blocks no earlier state uses are the space this state takes up
+   AddStateBlocks(tracksCopy,
+                  ((flags&PUSH_CALC_SPACE)!=0) ? &push->spaceUsage : NULL);
 
    stack.Add(push);
    current++;
-   if( (flags&PUSH_CALC_SPACE)!=0)
-      push->spaceUsage = this->CalculateSpaceUsage(current);
 
    if (saved >= current) {
       saved = -1;
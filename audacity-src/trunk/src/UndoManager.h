@@ -52,6 +52,10 @@
 #include <wx/string.h>
 #include "ondemand/ODTaskThread.h"
 
+#include <map>
+
+class BlockArray;
+class BlockFile;
 class Track;
 class TrackList;
 
@@ -111,7 +115,8 @@ class AUDACITY_DLL_API UndoManager {
    void ResetODChangesFlag();
 
  private:
-   wxLongLong CalculateSpaceUsage(int index);
+   void AddStateBlocks(TrackList *l, wxLongLong *newBytes);
+   void RemoveStateBlocks(TrackList *l);
 
    int current;
    int saved;
@@ -123,6 +128,11 @@ class AUDACITY_DLL_API UndoManager {
    bool mODChanges;
    ODLock mODChangesMutex;//mODChanges is accessed from many threads.
 
+   // How many times the states on the stack use each block array, and
+   // how many of those arrays hold each block file
+   std::map<BlockArray *, int> mArrayUses;
+   std::map<BlockFile *, int> mBlockUses;
+
 };
 
 #endif
@@ -21,13 +21,37 @@
 
 \class SpecCache
 \brief Cache used with WaveClip to cache spectrum information (for
-drawing).  Cache's the Spectrogram frequency samples.
+drawing).  Cache's the Spectrogram frequency samples.  Its columns are
+numbered on a grid of hops of rate / pps samples, so that a panned or
+resized view can find the ones it already has by index.
+
+*//****************************************************************//**
+
+\class SpectrogramWorker
+\brief One of the threads WaveClip::GetSpectrogram starts to transform
+the columns of a long spectrogram in parallel.  The calling thread reads
+the samples for each SpectrogramChunk and the workers window, transform
+and convert them to dB, each with its own FFT tables.
+
+*//****************************************************************//**
+
+\class WaveClipRenderer
+\brief Queue of the cold WaveCache and SpecCache contents that
+WaveClip::GetWaveDisplay and WaveClip::GetSpectrogram have asked to be
+filled in the background, so drawing a long clip doesn't hold up the
+GUI.  Each WaveClipRenderJob carries a clip that shares the samples of
+its owner as they were asked for; a WaveClipRenderThread fills that
+clip's cache, which the owner adopts on its next draw if it hasn't
+changed since.
 
 *//*******************************************************************/
 
 #include <math.h>
+#include <algorithm>
+#include <deque>
 #include <vector>
 #include <wx/log.h>
+#include <wx/thread.h>
 
 #include "Spectrum.h"
 #include "Prefs.h"
@@ -35,6 +59,8 @@ drawing).  Cache's the Spectrogram frequency samples.
 #include "Envelope.h"
 #include "Resample.h"
 #include "Project.h"
+#include "AudioIO.h"
+#include "ondemand/ODManager.h"
 
 #include <wx/listimpl.cpp>
 WX_DEFINE_LIST(WaveClipList);
@@ -213,14 +239,38 @@ protected:
 
 };
 
+/// The preferences that change the columns of a spectrogram.  They are
+/// read on the GUI thread, and given to the background renderer with
+/// the request, since gPrefs is not safe to read from other threads.
+class SpectrogramPrefs {
+public:
+   void Read()
+   {
+      frequencyGain = gPrefs->Read(wxT("/Spectrum/FrequencyGain"), 0L);
+      windowSize = gPrefs->Read(wxT("/Spectrum/FFTSize"), 256);
+#ifdef EXPERIMENTAL_FFT_SKIP_POINTS
+      fftSkipPoints = gPrefs->Read(wxT("/Spectrum/FFTSkipPoints"), 0L);
+#endif //EXPERIMENTAL_FFT_SKIP_POINTS
+      gPrefs->Read(wxT("/Spectrum/WindowType"), &windowType, 3);
+      // 0 means one thread per processor, 1 computes on this thread only
+      numThreads = gPrefs->Read(wxT("/Spectrum/Threads"), 0L);
+      if (numThreads <= 0)
+         numThreads = wxThread::GetCPUCount();
+   }
+
+   int frequencyGain;
+   int windowType;
+   int windowSize;
+#ifdef EXPERIMENTAL_FFT_SKIP_POINTS
+   int fftSkipPoints;
+#endif //EXPERIMENTAL_FFT_SKIP_POINTS
+   int numThreads;
+};
+
 class SpecCache {
 public:
    SpecCache(int cacheLen, int half, bool autocorrelation)
    {
-      minFreqOld = -1;
-      maxFreqOld = -1;
-      gainOld = -1;
-      rangeOld = -1;
       windowTypeOld = -1;
       windowSizeOld = -1;
       frequencyGainOld = false;
@@ -228,7 +278,7 @@ public:
       fftSkipPointsOld = -1;
 #endif //EXPERIMENTAL_FFT_SKIP_POINTS
       dirty = -1;
-      start = -1.0;
+      start = 0;
       pps = 0.0;
       len = cacheLen;
       ac = autocorrelation;
@@ -242,10 +292,25 @@ public:
       delete[] where;
    }
 
-   int          minFreqOld;
-   int          maxFreqOld;
-   int          gainOld;
-   int          rangeOld;
+   /// True if the columns were computed the way they would be now, so
+   /// that any of them can be reused
+   bool Matches(const SpectrogramPrefs &prefs, int clipDirty,
+                bool autocorrelation, double pixelsPerSecond) const
+   {
+      return windowTypeOld == prefs.windowType &&
+         windowSizeOld == prefs.windowSize &&
+         frequencyGainOld == prefs.frequencyGain &&
+#ifdef EXPERIMENTAL_FFT_SKIP_POINTS
+         fftSkipPointsOld == prefs.fftSkipPoints &&
+#endif //EXPERIMENTAL_FFT_SKIP_POINTS
+         dirty == clipDirty &&
+         ac == autocorrelation &&
+         pps == pixelsPerSecond;
+   }
+
+   // Only the settings that change the computed columns are kept; the
+   // display settings (frequency range, gain, range) are applied when
+   // drawing and don't invalidate anything here.
    int          windowTypeOld;
    int          windowSizeOld;
    int          frequencyGainOld;
@@ -255,7 +320,7 @@ public:
    int          dirty;
    bool         ac;
    sampleCount  len;
-   double       start;
+   sampleCount  start;  // grid index of the first column
    double       pps;
    sampleCount *where;
    float       *freq;
@@ -290,6 +355,516 @@ static void ComputeSpectrumUsingRealFFTf(float *buffer, HFFT hFFT, float *window
 }
 #endif // EXPERIMENTAL_USE_REALFFTF
 
+#if defined(EXPERIMENTAL_USE_REALFFTF) && !defined(EXPERIMENTAL_FFT_SKIP_POINTS)
+
+// Columns handed to a SpectrogramWorker at a time.  Their samples are
+// fetched together, so neighbouring windows share block reads.
+#define SPEC_COLUMNS_PER_CHUNK 16
+
+// Below this many columns it is not worth starting threads.
+#define SPEC_MIN_PARALLEL_COLUMNS (4 * SPEC_COLUMNS_PER_CHUNK)
+
+struct SpectrogramChunk {
+   int    count;
+   float *out[SPEC_COLUMNS_PER_CHUNK]; // where each column's spectrum goes
+   float *samples;                     // count windows, one after the other
+};
+
+/// The queue of SpectrogramChunks between the thread fetching samples
+/// and the SpectrogramWorkers.  There are only a few chunks; the fetching
+/// thread waits for one to come back when all of them are in use.
+class SpectrogramJob {
+ public:
+   SpectrogramJob(int numChunks, int windowSize,
+                  float *window, float *gainfactor)
+      : mChanged(&mLock)
+   {
+      mWindowSize = windowSize;
+      mWindow = window;
+      mGainFactor = gainfactor;
+      mBusy = 0;
+      mFinished = false;
+
+      mNumChunks = numChunks;
+      mChunks = new SpectrogramChunk[numChunks];
+      mSamples = new float[numChunks * SPEC_COLUMNS_PER_CHUNK * windowSize];
+      for (int i = 0; i < numChunks; i++) {
+         mChunks[i].count = 0;
+         mChunks[i].samples =
+            &mSamples[i * SPEC_COLUMNS_PER_CHUNK * windowSize];
+         mFree.push_back(&mChunks[i]);
+      }
+   }
+
+   ~SpectrogramJob()
+   {
+      delete[] mChunks;
+      delete[] mSamples;
+   }
+
+   /// Called by the fetching thread: returns an unused chunk, waiting
+   /// for the workers to finish one if necessary.
+   SpectrogramChunk *GetFreeChunk()
+   {
+      mLock.Lock();
+      while (mFree.empty())
+         mChanged.Wait();
+      SpectrogramChunk *chunk = mFree.front();
+      mFree.pop_front();
+      mLock.Unlock();
+      return chunk;
+   }
+
+   /// Called by the fetching thread once the samples of chunk are in.
+   void Post(SpectrogramChunk *chunk)
+   {
+      mLock.Lock();
+      mPosted.push_back(chunk);
+      mChanged.Broadcast();
+      mLock.Unlock();
+   }
+
+   /// Called by the fetching thread after the last Post(): waits until
+   /// every chunk has been transformed and lets the workers return.
+   void Finish()
+   {
+      mLock.Lock();
+      while (!mPosted.empty() || mBusy > 0)
+         mChanged.Wait();
+      mFinished = true;
+      mChanged.Broadcast();
+      mLock.Unlock();
+   }
+
+   /// Called by a worker: returns the next chunk to transform, or NULL
+   /// once Finish() has been called.
+   SpectrogramChunk *GetPostedChunk()
+   {
+      SpectrogramChunk *chunk = NULL;
+      mLock.Lock();
+      while (mPosted.empty() && !mFinished)
+         mChanged.Wait();
+      if (!mPosted.empty()) {
+         chunk = mPosted.front();
+         mPosted.pop_front();
+         mBusy++;
+      }
+      mLock.Unlock();
+      return chunk;
+   }
+
+   /// Called by a worker when it has written the spectra of chunk.
+   void Done(SpectrogramChunk *chunk)
+   {
+      mLock.Lock();
+      mBusy--;
+      mFree.push_back(chunk);
+      mChanged.Broadcast();
+      mLock.Unlock();
+   }
+
+   int    mWindowSize;
+   float *mWindow;
+   float *mGainFactor;
+
+ private:
+   ODLock      mLock;
+   ODCondition mChanged;
+   std::deque<SpectrogramChunk *> mFree;
+   std::deque<SpectrogramChunk *> mPosted;
+   int         mBusy;
+   bool        mFinished;
+
+   int               mNumChunks;
+   SpectrogramChunk *mChunks;
+   float            *mSamples;
+};
+
+class SpectrogramWorker : public wxThread {
+ public:
+   // hFFT is created by the caller, as InitializeFFT is not reentrant
+   SpectrogramWorker(SpectrogramJob *job, HFFT hFFT)
+      : wxThread(wxTHREAD_JOINABLE)
+   {
+      mJob = job;
+      mFFT = hFFT;
+   }
+
+   virtual void *Entry()
+   {
+      int windowSize = mJob->mWindowSize;
+      int half = windowSize / 2;
+      SpectrogramChunk *chunk;
+
+      while ((chunk = mJob->GetPostedChunk()) != NULL) {
+         for (int c = 0; c < chunk->count; c++) {
+            float *out = chunk->out[c];
+            // Each column owns its window of samples, so the FFT can
+            // run in place there without a scratch copy
+            ComputeSpectrumUsingRealFFTf(&chunk->samples[c * windowSize],
+                                         mFFT, mJob->mWindow,
+                                         windowSize, out);
+            if (mJob->mGainFactor) {
+               for (int i = 0; i < half; i++)
+                  out[i] += mJob->mGainFactor[i];
+            }
+         }
+         mJob->Done(chunk);
+      }
+      return NULL;
+   }
+
+ private:
+   SpectrogramJob *mJob;
+   HFFT            mFFT;
+};
+
+// Reads the count windows of windowSize samples beginning at starts[],
+// which must be ascending, into consecutive stretches of samples, padding
+// with zeros outside the sequence.  Overlapping windows share the block
+// reads through Sequence::GetMany.
+static void FetchSpectrogramWindows(Sequence *sequence,
+                                    const sampleCount *starts, int count,
+                                    int windowSize, float *samples)
+{
+   sampleCount numSamples = sequence->GetNumSamples();
+   SeqRequest requests[SPEC_COLUMNS_PER_CHUNK];
+   int numRequests = 0;
+
+   for (int c = 0; c < count; c++) {
+      float *dst = &samples[c * windowSize];
+      sampleCount a = wxMax(starts[c], 0);
+      sampleCount b = wxMin(starts[c] + windowSize, numSamples);
+      if (b <= a) {
+         memset(dst, 0, windowSize * sizeof(float));
+         continue;
+      }
+
+      int lead = (int)(a - starts[c]);
+      int len = (int)(b - a);
+      memset(dst, 0, lead * sizeof(float));
+      memset(&dst[lead + len], 0, (windowSize - lead - len) * sizeof(float));
+
+      requests[numRequests].start = a;
+      requests[numRequests].len = len;
+      requests[numRequests].buffer = (samplePtr)&dst[lead];
+      numRequests++;
+   }
+
+   sequence->GetMany(requests, numRequests, floatSample);
+}
+
+// Computes the count spectra whose windows begin at starts[] into out[],
+// on numThreads workers, while this thread reads their samples.
+static void ComputeSpectrogramInParallel(Sequence *sequence, int numThreads,
+                                         const sampleCount *starts,
+                                         float **out, int count,
+                                         int windowSize, float *window,
+                                         float *gainfactor)
+{
+   int numChunks = (count + SPEC_COLUMNS_PER_CHUNK - 1) / SPEC_COLUMNS_PER_CHUNK;
+   if (numThreads > numChunks)
+      numThreads = numChunks;
+
+   // Two chunks per worker keeps them busy while the next ones are read
+   SpectrogramJob job(wxMin(2 * numThreads, numChunks),
+                      windowSize, window, gainfactor);
+
+   std::vector<HFFT> ffts(numThreads);
+   std::vector<SpectrogramWorker *> workers(numThreads);
+   for (int t = 0; t < numThreads; t++) {
+      ffts[t] = InitializeFFT(windowSize);
+      workers[t] = new SpectrogramWorker(&job, ffts[t]);
+      workers[t]->Create();
+      workers[t]->Run();
+   }
+
+   for (int first = 0; first < count; first += SPEC_COLUMNS_PER_CHUNK) {
+      SpectrogramChunk *chunk = job.GetFreeChunk();
+      chunk->count = wxMin(SPEC_COLUMNS_PER_CHUNK, count - first);
+      for (int c = 0; c < chunk->count; c++)
+         chunk->out[c] = out[first + c];
+      FetchSpectrogramWindows(sequence, &starts[first], chunk->count,
+                              windowSize, chunk->samples);
+      job.Post(chunk);
+   }
+
+   job.Finish();
+   for (int t = 0; t < numThreads; t++) {
+      workers[t]->Wait();
+      delete workers[t];
+      EndFFT(ffts[t]);
+   }
+}
+
+#endif // EXPERIMENTAL_USE_REALFFTF && !EXPERIMENTAL_FFT_SKIP_POINTS
+
+// Views spanning fewer blocks than this are computed while drawing, as
+// they are quick and showing placeholders for them would only flicker.
+#define RENDER_MIN_BLOCKS 32
+
+class WaveClipRenderJob {
+ public:
+   enum State { Queued, Running, Done };
+
+   WaveClipRenderJob()
+   {
+      owner = NULL;
+      snapshot = NULL;
+      dirManager = NULL;
+      state = Queued;
+      ok = false;
+   }
+
+   ~WaveClipRenderJob()
+   {
+      // Only on the GUI thread, as the snapshot dereferences block files
+      delete snapshot;
+   }
+
+   /// Called by the render thread: fills the cache of the snapshot
+   void Render()
+   {
+      if (spectrogram) {
+         float *freq = new float[numPixels * (prefs.windowSize / 2)];
+         sampleCount *where = new sampleCount[numPixels + 1];
+         snapshot->ComputeSpectrogram(freq, where, numPixels, t0, pps,
+                                      autocorrelation, prefs);
+         ok = true;
+         delete[] freq;
+         delete[] where;
+      }
+      else {
+         float *min = new float[numPixels];
+         float *max = new float[numPixels];
+         float *rms = new float[numPixels];
+         int *bl = new int[numPixels];
+         sampleCount *where = new sampleCount[numPixels + 1];
+         bool isLoadingOD;
+         ok = snapshot->ComputeWaveDisplay(min, max, rms, bl, where,
+                                           numPixels, t0, pps, isLoadingOD);
+         delete[] min;
+         delete[] max;
+         delete[] rms;
+         delete[] bl;
+         delete[] where;
+      }
+   }
+
+   WaveClip *owner;     // NULL once the owner is deleted
+   WaveClip *snapshot;  // shares the owner's samples as they were
+   DirManager *dirManager; // of the owner's project, which is repainted
+   State     state;
+   bool      ok;
+
+   bool      spectrogram;
+   int       numPixels;
+   double    t0;
+   double    pps;
+   bool      autocorrelation;
+   SpectrogramPrefs prefs;
+};
+
+class WaveClipRenderThread;
+
+class WaveClipRenderer {
+ public:
+   WaveClipRenderer()
+      : mChanged(&mLock)
+   {
+      mStopping = false;
+      mThread = NULL;
+   }
+
+   /// Called on the GUI thread: queues job, starting the thread if
+   /// necessary.  Returns false if rendering has been stopped.
+   bool Add(WaveClipRenderJob *job);
+
+   /// Called on the GUI thread to stop the thread before exit
+   void Stop();
+
+   bool IsDone(WaveClipRenderJob *job)
+   {
+      mLock.Lock();
+      bool done = (job->state == WaveClipRenderJob::Done);
+      mLock.Unlock();
+      return done;
+   }
+
+   /// Called on the GUI thread when the owner no longer wants job.
+   /// Returns true if the caller should delete it; a running job is
+   /// instead deleted by CollectOrphans() once it is done.
+   bool Cancel(WaveClipRenderJob *job)
+   {
+      mLock.Lock();
+      bool unused = (job->state != WaveClipRenderJob::Running);
+      if (job->state == WaveClipRenderJob::Queued) {
+         std::deque<WaveClipRenderJob *>::iterator it =
+            std::find(mQueue.begin(), mQueue.end(), job);
+         if (it != mQueue.end())
+            mQueue.erase(it);
+      }
+      job->owner = NULL;
+      mLock.Unlock();
+      return unused;
+   }
+
+   /// Called on the GUI thread: deletes the finished jobs whose owners
+   /// have gone
+   void CollectOrphans()
+   {
+      mLock.Lock();
+      std::vector<WaveClipRenderJob *> orphans;
+      orphans.swap(mOrphans);
+      mLock.Unlock();
+
+      for (size_t i = 0; i < orphans.size(); i++)
+         delete orphans[i];
+   }
+
+   /// Called by the render thread: returns the next job to render, or
+   /// NULL once Stop() has been called
+   WaveClipRenderJob *Next()
+   {
+      WaveClipRenderJob *job = NULL;
+      mLock.Lock();
+      while (mQueue.empty() && !mStopping)
+         mChanged.Wait();
+      if (!mStopping) {
+         job = mQueue.front();
+         mQueue.pop_front();
+         job->state = WaveClipRenderJob::Running;
+      }
+      mLock.Unlock();
+      return job;
+   }
+
+   /// Called by the render thread when it has rendered job
+   void Done(WaveClipRenderJob *job)
+   {
+      mLock.Lock();
+      job->state = WaveClipRenderJob::Done;
+      if (!job->owner)
+         mOrphans.push_back(job);
+      mLock.Unlock();
+   }
+
+ private:
+   ODLock      mLock;
+   ODCondition mChanged;
+   std::deque<WaveClipRenderJob *> mQueue;
+   std::vector<WaveClipRenderJob *> mOrphans;
+   bool        mStopping;
+   WaveClipRenderThread *mThread;
+};
+
+class WaveClipRenderThread : public wxThread {
+ public:
+   WaveClipRenderThread(WaveClipRenderer *renderer)
+      : wxThread(wxTHREAD_JOINABLE)
+   {
+      mRenderer = renderer;
+   }
+
+   virtual void *Entry()
+   {
+      WaveClipRenderJob *job;
+      while ((job = mRenderer->Next()) != NULL) {
+         job->Render();
+         bool ok = job->ok;
+         // Only compared from here on, as the job may be deleted
+         DirManager *dirManager = job->dirManager;
+         mRenderer->Done(job);
+
+         // Repaint the project the owner is in, even in the background,
+         // so it picks up the cache.  A failed job isn't worth a repaint,
+         // which would only ask for it again.
+         if (ok) {
+            wxCommandEvent event(EVT_ODTASK_UPDATE);
+            AudacityProject::AllProjectsDeleteLock();
+            for (unsigned i = 0; i < gAudacityProjects.GetCount(); i++) {
+               if (gAudacityProjects[i]->GetDirManager() == dirManager)
+                  gAudacityProjects[i]->AddPendingEvent(event);
+            }
+            AudacityProject::AllProjectsDeleteUnlock();
+         }
+      }
+      return NULL;
+   }
+
+ private:
+   WaveClipRenderer *mRenderer;
+};
+
+bool WaveClipRenderer::Add(WaveClipRenderJob *job)
+{
+   mLock.Lock();
+   if (mStopping) {
+      mLock.Unlock();
+      return false;
+   }
+   mQueue.push_back(job);
+   mChanged.Broadcast();
+   mLock.Unlock();
+
+   if (!mThread) {
+      mThread = new WaveClipRenderThread(this);
+      mThread->Create();
+      mThread->Run();
+   }
+   return true;
+}
+
+void WaveClipRenderer::Stop()
+{
+   mLock.Lock();
+   mStopping = true;
+   mChanged.Broadcast();
+   mLock.Unlock();
+
+   if (mThread) {
+      mThread->Wait();
+      delete mThread;
+      mThread = NULL;
+   }
+
+   // The jobs still queued will never run; their owners delete them
+   mLock.Lock();
+   for (size_t i = 0; i < mQueue.size(); i++) {
+      mQueue[i]->state = WaveClipRenderJob::Done;
+      mQueue[i]->ok = false;
+   }
+   mQueue.clear();
+   mLock.Unlock();
+
+   CollectOrphans();
+}
+
+// Created on the GUI thread when a clip first starts a job, and deleted
+// by StopRendering()
+static WaveClipRenderer *sRenderer = NULL;
+static bool sRenderingStopped = false;
+// The /GUI/BackgroundRendering preference, which is read for every draw;
+// -1 until UpdateRenderPrefs() first reads it
+static int sBackgroundRendering = -1;
+
+void WaveClip::StopRendering()
+{
+   if (sRenderer) {
+      sRenderer->Stop();
+      delete sRenderer;
+      sRenderer = NULL;
+   }
+   sRenderingStopped = true;
+}
+
+void WaveClip::UpdateRenderPrefs()
+{
+   bool background;
+   gPrefs->Read(wxT("/GUI/BackgroundRendering"), &background, true);
+   sBackgroundRendering = background ? 1 : 0;
+}
+
 WaveClip::WaveClip(DirManager *projDirManager, sampleFormat format, int rate)
 {
    mOffset = 0;
@@ -307,8 +882,12 @@ WaveClip::WaveClip(DirManager *projDirManager, sampleFormat format, int rate)
    mSpecPxCache = new SpecPxCache(1);
    mAppendBuffer = NULL;
    mAppendBufferLen = 0;
+   mAppendBufferSize = 0;
    mDirty = 0;
    mIsPlaceholder = false;
+   mWaveJob = NULL;
+   mSpecJob = NULL;
+   mLayoutVersion = NULL;
 }
 
 WaveClip::WaveClip(WaveClip& orig, DirManager *projDirManager)
@@ -339,12 +918,21 @@ WaveClip::WaveClip(WaveClip& orig, DirManager *projDirManager)
 
    mAppendBuffer = NULL;
    mAppendBufferLen = 0;
+   mAppendBufferSize = 0;
    mDirty = 0;
    mIsPlaceholder = orig.GetIsPlaceholder();
+   mWaveJob = NULL;
+   mSpecJob = NULL;
+   mLayoutVersion = NULL;
 }
 
 WaveClip::~WaveClip()
 {
+   MarkLayoutChanged();
+
+   CancelRenderJob(mWaveJob);
+   CancelRenderJob(mSpecJob);
+
    delete mSequence;
 
    delete mEnvelope;
@@ -371,6 +959,7 @@ void WaveClip::SetOffset(double offset)
 {
     mOffset = offset;
     mEnvelope->SetOffset(mOffset);
+    MarkLayoutChanged();
 }
 
 bool WaveClip::GetSamples(samplePtr buffer, sampleFormat format,
@@ -460,6 +1049,29 @@ bool WaveClip::GetWaveDisplay(float *min, float *max, float *rms,int* bl,
                                sampleCount *where,
                                int numPixels, double t0,
                                double pixelsPerSecond, bool &isLoadingOD)
+{
+   if (RenderWaveDisplayLater(numPixels, t0, pixelsPerSecond)) {
+      // Draw stripes, as for blocks still loading on demand, until the
+      // renderer is done
+      for (int x = 0; x < numPixels + 1; x++)
+         where[x] = (sampleCount) floor(t0 * mRate +
+                                        ((double) x) * mRate / pixelsPerSecond + 0.5);
+      for (int x = 0; x < numPixels; x++) {
+         min[x] = max[x] = rms[x] = 0.0f;
+         bl[x] = -1;
+      }
+      isLoadingOD = true;
+      return true;
+   }
+
+   return ComputeWaveDisplay(min, max, rms, bl, where,
+                             numPixels, t0, pixelsPerSecond, isLoadingOD);
+}
+
+bool WaveClip::ComputeWaveDisplay(float *min, float *max, float *rms,int* bl,
+                                  sampleCount *where,
+                                  int numPixels, double t0,
+                                  double pixelsPerSecond, bool &isLoadingOD)
 {
    mWaveCacheMutex.Lock();
 
@@ -723,21 +1335,41 @@ bool WaveClip::GetWaveDisplay(float *min, float *max, float *rms,int* bl,
 bool WaveClip::GetSpectrogram(float *freq, sampleCount *where,
                                int numPixels,
                                double t0, double pixelsPerSecond,
-                               bool autocorrelation)
+                               bool autocorrelation, bool &isRendering)
 {
-   int minFreq = gPrefs->Read(wxT("/Spectrum/MinFreq"), 0L);
-   int maxFreq = gPrefs->Read(wxT("/Spectrum/MaxFreq"), 8000L);
-   int range = gPrefs->Read(wxT("/Spectrum/Range"), 80L);
-   int gain = gPrefs->Read(wxT("/Spectrum/Gain"), 20L);
-   int frequencygain = gPrefs->Read(wxT("/Spectrum/FrequencyGain"), 0L);
-   int windowType;
-   int windowSize = gPrefs->Read(wxT("/Spectrum/FFTSize"), 256);
+   SpectrogramPrefs prefs;
+   prefs.Read();
+
+   isRendering = RenderSpectrogramLater(numPixels, t0, pixelsPerSecond,
+                                        autocorrelation, prefs);
+   if (isRendering) {
+      sampleCount firstColumn = (sampleCount)floor(t0 * pixelsPerSecond + 0.5);
+      double hop = mRate / pixelsPerSecond;
+      for (int x = 0; x < numPixels + 1; x++)
+         where[x] = (sampleCount)floor((firstColumn + x) * hop + 1.);
+      memset(freq, 0, numPixels * (prefs.windowSize / 2) * sizeof(float));
+      return true;
+   }
+
+   return ComputeSpectrogram(freq, where, numPixels, t0, pixelsPerSecond,
+                             autocorrelation, prefs);
+}
+
+bool WaveClip::ComputeSpectrogram(float *freq, sampleCount *where,
+                                  int numPixels,
+                                  double t0, double pixelsPerSecond,
+                                  bool autocorrelation,
+                                  const SpectrogramPrefs &prefs)
+{
+   int frequencygain = prefs.frequencyGain;
+   int windowType = prefs.windowType;
+   int windowSize = prefs.windowSize;
 #ifdef EXPERIMENTAL_FFT_SKIP_POINTS
-   int fftSkipPoints = gPrefs->Read(wxT("/Spectrum/FFTSkipPoints"), 0L);
+   int fftSkipPoints = prefs.fftSkipPoints;
    int fftSkipPoints1 = fftSkipPoints+1;
 #endif //EXPERIMENTAL_FFT_SKIP_POINTS
    int half = windowSize/2;
-   gPrefs->Read(wxT("/Spectrum/WindowType"), &windowType, 3);
+   int numThreads = prefs.numThreads;
 
 #ifdef EXPERIMENTAL_USE_REALFFTF
    // Update the FFT and window if necessary
@@ -767,24 +1399,22 @@ bool WaveClip::GetSpectrogram(float *freq, sampleCount *where,
    }
 #endif // EXPERIMENTAL_USE_REALFFTF
 
-   if (mSpecCache &&
-       mSpecCache->minFreqOld == minFreq &&
-       mSpecCache->maxFreqOld == maxFreq &&
-       mSpecCache->rangeOld == range &&
-       mSpecCache->gainOld == gain &&
-       mSpecCache->windowTypeOld == windowType &&
-       mSpecCache->windowSizeOld == windowSize &&
-       mSpecCache->frequencyGainOld == frequencygain &&
-#ifdef EXPERIMENTAL_FFT_SKIP_POINTS
-       mSpecCache->fftSkipPointsOld == fftSkipPoints &&
-#endif //EXPERIMENTAL_FFT_SKIP_POINTS
-       mSpecCache->dirty == mDirty &&
-       mSpecCache->start == t0 &&
-       mSpecCache->ac == autocorrelation &&
-       mSpecCache->len >= numPixels &&
-       mSpecCache->pps == pixelsPerSecond) {
-      memcpy(freq, mSpecCache->freq, numPixels*half*sizeof(float));
-      memcpy(where, mSpecCache->where, (numPixels+1)*sizeof(sampleCount));
+   // Columns are centred on a fixed grid of hops of mRate / pixelsPerSecond
+   // samples, so the same column has the same index whatever t0 is
+   sampleCount firstColumn = (sampleCount)floor(t0 * pixelsPerSecond + 0.5);
+   double hop = mRate / pixelsPerSecond;
+
+   bool match = mSpecCache &&
+       mSpecCache->Matches(prefs, mDirty, autocorrelation, pixelsPerSecond);
+
+   if (match &&
+       firstColumn >= mSpecCache->start &&
+       firstColumn + numPixels <= mSpecCache->start + mSpecCache->len) {
+      sampleCount offset = firstColumn - mSpecCache->start;
+      memcpy(freq, &mSpecCache->freq[half * offset],
+             numPixels*half*sizeof(float));
+      memcpy(where, &mSpecCache->where[offset],
+             (numPixels+1)*sizeof(sampleCount));
       return false;  //hit cache completely
    }
 
@@ -792,7 +1422,7 @@ bool WaveClip::GetSpectrogram(float *freq, sampleCount *where,
 
    mSpecCache = new SpecCache(numPixels, half, autocorrelation);
    mSpecCache->pps = pixelsPerSecond;
-   mSpecCache->start = t0;
+   mSpecCache->start = firstColumn;
 
    sampleCount x;
 
@@ -803,46 +1433,23 @@ bool WaveClip::GetSpectrogram(float *freq, sampleCount *where,
       // purposely offset the display 1/2 bin to the left (as compared
       // to waveform display to properly center response of the FFT
       mSpecCache->where[x] =
-         (sampleCount)floor((t0*mRate) + (x*mRate/pixelsPerSecond) + 1.);
+         (sampleCount)floor((firstColumn + x) * hop + 1.);
    }
 
-   // Optimization: if the old cache is good and overlaps
-   // with the current one, re-use as much of the cache as
-   // possible
-   if (oldCache->dirty == mDirty &&
-       oldCache->minFreqOld == minFreq &&
-       oldCache->maxFreqOld == maxFreq &&
-       oldCache->rangeOld == range &&
-       oldCache->gainOld == gain &&
-       oldCache->windowTypeOld == windowType &&
-       oldCache->windowSizeOld == windowSize &&
-       oldCache->frequencyGainOld == frequencygain &&
-#ifdef EXPERIMENTAL_FFT_SKIP_POINTS
-       oldCache->fftSkipPointsOld == fftSkipPoints &&
-#endif //EXPERIMENTAL_FFT_SKIP_POINTS
-       oldCache->pps == pixelsPerSecond &&
-       oldCache->ac == autocorrelation &&
-       oldCache->where[0] < mSpecCache->where[mSpecCache->len] &&
-       oldCache->where[oldCache->len] > mSpecCache->where[0]) {
-
-      for (x = 0; x < mSpecCache->len; x++)
-         if (mSpecCache->where[x] >= oldCache->where[0] &&
-             mSpecCache->where[x] <= oldCache->where[oldCache->len]) {
-
-            int ox = (int) ((double (oldCache->len) *
-                      (mSpecCache->where[x] - oldCache->where[0]))
-                       / (oldCache->where[oldCache->len] -
-                                             oldCache->where[0]) + 0.5);
-            if (ox >= 0 && ox < oldCache->len &&
-                mSpecCache->where[x] == oldCache->where[ox]) {
-
-               for (sampleCount i = 0; i < (sampleCount)half; i++)
-                  mSpecCache->freq[half * x + i] =
-                     oldCache->freq[half * ox + i];
-
-               recalc[x] = false;
-            }
-         }
+   // Optimization: after panning or resizing, the old cache holds
+   // a run of the columns we want; copy those and compute only the
+   // newly exposed ones
+   if (match) {
+      sampleCount first = wxMax(firstColumn, oldCache->start);
+      sampleCount last = wxMin(firstColumn + mSpecCache->len,
+                               oldCache->start + oldCache->len);
+      if (first < last) {
+         memcpy(&mSpecCache->freq[half * (first - firstColumn)],
+                &oldCache->freq[half * (first - oldCache->start)],
+                (last - first) * half * sizeof(float));
+         for (x = first - firstColumn; x < last - firstColumn; x++)
+            recalc[x] = false;
+      }
    }
 
 #ifdef EXPERIMENTAL_FFT_SKIP_POINTS
@@ -851,10 +1458,6 @@ bool WaveClip::GetSpectrogram(float *freq, sampleCount *where,
 #else //!EXPERIMENTAL_FFT_SKIP_POINTS
    float *buffer = new float[windowSize];
 #endif //EXPERIMENTAL_FFT_SKIP_POINTS
-   mSpecCache->minFreqOld = minFreq;
-   mSpecCache->maxFreqOld = maxFreq;
-   mSpecCache->gainOld = gain;
-   mSpecCache->rangeOld = range;
    mSpecCache->windowTypeOld = windowType;
    mSpecCache->windowSizeOld = windowSize;
    mSpecCache->frequencyGainOld = frequencygain;
@@ -870,6 +1473,34 @@ bool WaveClip::GetSpectrogram(float *freq, sampleCount *where,
       }
    }
 
+#if defined(EXPERIMENTAL_USE_REALFFTF) && !defined(EXPERIMENTAL_FFT_SKIP_POINTS)
+   if (!autocorrelation && numThreads > 1) {
+      sampleCount numSamples = mSequence->GetNumSamples();
+      std::vector<sampleCount> starts;
+      std::vector<float *> out;
+      for (x = 0; x < mSpecCache->len; x++) {
+         sampleCount start = mSpecCache->where[x];
+         if (recalc[x] && start > 0 && start < numSamples) {
+            starts.push_back(start - (windowSize >> 1));
+            out.push_back(&mSpecCache->freq[half * x]);
+         }
+      }
+
+      if ((int)starts.size() >= SPEC_MIN_PARALLEL_COLUMNS) {
+         ComputeSpectrogramInParallel(mSequence, numThreads,
+                                      &starts[0], &out[0], (int)starts.size(),
+                                      windowSize, mWindow, gainfactor);
+         // Only the columns outside the sequence are left, which the
+         // loop below fills with zeros
+         for (x = 0; x < mSpecCache->len; x++) {
+            sampleCount start = mSpecCache->where[x];
+            if (start > 0 && start < numSamples)
+               recalc[x] = false;
+         }
+      }
+   }
+#endif // EXPERIMENTAL_USE_REALFFTF && !EXPERIMENTAL_FFT_SKIP_POINTS
+
    for (x = 0; x < mSpecCache->len; x++)
       if (recalc[x]) {
 
@@ -955,6 +1586,189 @@ bool WaveClip::GetSpectrogram(float *freq, sampleCount *where,
    return true;
 }
 
+// Whether the background renderer should be used at all, and whether
+// a view from sample s0 to s1 is big enough for it
+static bool ShouldRenderLater(Sequence *sequence, sampleCount s0, sampleCount s1)
+{
+   if (sBackgroundRendering < 0)
+      WaveClip::UpdateRenderPrefs();
+   return sBackgroundRendering &&
+      s1 - s0 >= RENDER_MIN_BLOCKS * (sampleCount)sequence->GetMaxBlockSize();
+}
+
+bool WaveClip::RenderWaveDisplayLater(int numPixels, double t0,
+                                      double pixelsPerSecond)
+{
+   TakeRenderJob(mWaveJob);
+
+   if (mWaveJob) {
+      if (mWaveJob->snapshot->mDirty == mDirty &&
+          mWaveJob->t0 == t0 &&
+          mWaveJob->pps == pixelsPerSecond &&
+          mWaveJob->numPixels >= numPixels)
+         return true;
+      CancelRenderJob(mWaveJob);
+   }
+
+   // While recording, the append buffer has to be drawn too, and the audio
+   // thread may change the blocks a snapshot would share
+   if (mAppendBufferLen > 0 || gAudioIO->IsCapturingInto(this))
+      return false;
+
+   sampleCount s0 = (sampleCount) floor(t0 * mRate + 0.5);
+   sampleCount s1 = (sampleCount) floor(t0 * mRate +
+                                        ((double) numPixels) * mRate / pixelsPerSecond + 0.5);
+
+   // Panning at the same zoom reuses most of the cache, and only the
+   // newly exposed pixels are computed
+   mWaveCacheMutex.Lock();
+   bool warm = mWaveCache->dirty == mDirty &&
+      mWaveCache->pps == pixelsPerSecond &&
+      mWaveCache->where[0] < s1 &&
+      mWaveCache->where[mWaveCache->len] > s0;
+   mWaveCacheMutex.Unlock();
+
+   if (warm || !ShouldRenderLater(mSequence, s0, s1))
+      return false;
+
+   mWaveJob = StartRenderJob(numPixels, t0, pixelsPerSecond, false, NULL);
+   return mWaveJob != NULL;
+}
+
+bool WaveClip::RenderSpectrogramLater(int numPixels, double t0,
+                                      double pixelsPerSecond,
+                                      bool autocorrelation,
+                                      const SpectrogramPrefs &prefs)
+{
+   TakeRenderJob(mSpecJob);
+
+   sampleCount firstColumn = (sampleCount)floor(t0 * pixelsPerSecond + 0.5);
+
+   if (mSpecJob) {
+      const SpectrogramPrefs &was = mSpecJob->prefs;
+      if (mSpecJob->snapshot->mDirty == mDirty &&
+          (sampleCount)floor(mSpecJob->t0 * pixelsPerSecond + 0.5) == firstColumn &&
+          mSpecJob->pps == pixelsPerSecond &&
+          mSpecJob->numPixels >= numPixels &&
+          mSpecJob->autocorrelation == autocorrelation &&
+          was.windowType == prefs.windowType &&
+          was.windowSize == prefs.windowSize &&
+#ifdef EXPERIMENTAL_FFT_SKIP_POINTS
+          was.fftSkipPoints == prefs.fftSkipPoints &&
+#endif //EXPERIMENTAL_FFT_SKIP_POINTS
+          was.frequencyGain == prefs.frequencyGain)
+         return true;
+      CancelRenderJob(mSpecJob);
+   }
+
+   if (mAppendBufferLen > 0 || gAudioIO->IsCapturingInto(this))
+      return false;
+
+   bool warm = mSpecCache->Matches(prefs, mDirty, autocorrelation, pixelsPerSecond) &&
+      firstColumn < mSpecCache->start + mSpecCache->len &&
+      firstColumn + numPixels > mSpecCache->start;
+
+   double hop = mRate / pixelsPerSecond;
+   sampleCount s0 = (sampleCount)floor(firstColumn * hop);
+   sampleCount s1 = (sampleCount)floor((firstColumn + numPixels) * hop);
+
+   if (warm || !ShouldRenderLater(mSequence, s0, s1))
+      return false;
+
+   mSpecJob = StartRenderJob(numPixels, t0, pixelsPerSecond,
+                             autocorrelation, &prefs);
+   return mSpecJob != NULL;
+}
+
+// Queues a job for a clip sharing this one's samples, or returns NULL if
+// the renderer has been stopped.  It renders a spectrogram if prefs is
+// given, otherwise a waveform.
+WaveClipRenderJob *WaveClip::StartRenderJob(int numPixels, double t0,
+                                            double pixelsPerSecond,
+                                            bool autocorrelation,
+                                            const SpectrogramPrefs *prefs)
+{
+   if (sRenderingStopped)
+      return NULL;
+   if (!sRenderer)
+      sRenderer = new WaveClipRenderer();
+   sRenderer->CollectOrphans();
+
+   WaveClipRenderJob *job = new WaveClipRenderJob();
+   job->owner = this;
+   job->dirManager = mSequence->GetDirManager();
+   job->spectrogram = (prefs != NULL);
+   job->numPixels = numPixels;
+   job->t0 = t0;
+   job->pps = pixelsPerSecond;
+   job->autocorrelation = autocorrelation;
+   if (prefs)
+      job->prefs = *prefs;
+
+   // Sharing the block array is cheap, and the snapshot keeps it as it
+   // is now however this clip is edited
+   WaveClip *snapshot = new WaveClip(mSequence->GetDirManager(),
+                                     mSequence->GetSampleFormat(), mRate);
+   delete snapshot->mSequence;
+   snapshot->mSequence = new Sequence(*mSequence, mSequence->GetDirManager());
+   snapshot->mDirty = mDirty;
+   job->snapshot = snapshot;
+
+   if (!sRenderer->Add(job)) {
+      delete job;
+      return NULL;
+   }
+   return job;
+}
+
+// Takes the cache a finished job filled, if this clip hasn't changed
+// since it was asked for
+void WaveClip::TakeRenderJob(WaveClipRenderJob *&job)
+{
+   // Once the renderer is gone, every job left is done
+   if (!job || (sRenderer && !sRenderer->IsDone(job)))
+      return;
+
+   if (job->ok && job->snapshot->mDirty == mDirty) {
+      WaveClip *snapshot = job->snapshot;
+      if (job->spectrogram) {
+         SpecCache *cache = mSpecCache;
+         mSpecCache = snapshot->mSpecCache;
+         snapshot->mSpecCache = cache;
+      }
+      else {
+         mWaveCacheMutex.Lock();
+         WaveCache *cache = mWaveCache;
+         mWaveCache = snapshot->mWaveCache;
+         snapshot->mWaveCache = cache;
+
+         // Blocks loading on demand may have been summarized since the
+         // snapshot read them; look at those pixels again on the next draw
+         for (int x = 0; x < mWaveCache->len; x++) {
+            if (mWaveCache->bl[x] < 0) {
+               int x1 = x;
+               while (x1 < mWaveCache->len && mWaveCache->bl[x1] < 0)
+                  x1++;
+               mWaveCache->AddInvalidRegion(mWaveCache->where[x],
+                                            mWaveCache->where[x1]);
+               x = x1;
+            }
+         }
+         mWaveCacheMutex.Unlock();
+      }
+   }
+
+   delete job;
+   job = NULL;
+}
+
+void WaveClip::CancelRenderJob(WaveClipRenderJob *&job)
+{
+   if (job && (!sRenderer || sRenderer->Cancel(job)))
+      delete job;
+   job = NULL;
+}
+
 bool WaveClip::GetMinMax(float *min, float *max,
                           double t0, double t1)
 {
@@ -1003,8 +1817,29 @@ void WaveClip::ConvertToSampleFormat(sampleFormat format)
    wxASSERT(bResult); // TODO: Throw an actual error.
 }
 
+bool WaveClip::Reblock(sampleCount maxSamples, bool *changed)
+{
+   // The sequence is left as it is, or restored if it fails, unless it
+   // takes on another block size
+   sampleCount oldMaxSamples = mSequence->GetMaxBlockSize();
+   bool bResult = mSequence->Reblock(maxSamples);
+   bool bChanged = (mSequence->GetMaxBlockSize() != oldMaxSamples);
+
+   for (WaveClipList::compatibility_iterator it=mCutLines.GetFirst(); it; it=it->GetNext())
+      bResult &= it->GetData()->Reblock(maxSamples, &bChanged);
+
+   if (bChanged) {
+      MarkChanged();
+      if (changed)
+         *changed = true;
+   }
+   return bResult;
+}
+
 void WaveClip::UpdateEnvelopeTrackLen()
 {
+   // Called whenever the length changes
+   MarkLayoutChanged();
    mEnvelope->SetTrackLen(((double)mSequence->GetNumSamples()) / mRate);
 }
 
@@ -1040,14 +1875,25 @@ bool WaveClip::Append(samplePtr buffer, sampleFormat format,
 {
    //wxLogDebug(wxT("Append: len=%i"), len);
 
-   sampleCount maxBlockSize = mSequence->GetMaxBlockSize();
+   sampleCount maxBlockSize;
    sampleCount blockSize = mSequence->GetIdealAppendLen();
    sampleFormat seqFormat = mSequence->GetSampleFormat();
 
-   if (!mAppendBuffer)
-      mAppendBuffer = NewSamples(maxBlockSize, seqFormat);
-
    for(;;) {
+      // The sequence's block size grows as it gets longer, so the
+      // buffer may need to grow too
+      maxBlockSize = mSequence->GetMaxBlockSize();
+      if (mAppendBufferSize < maxBlockSize) {
+         samplePtr newBuffer = NewSamples(maxBlockSize, seqFormat);
+         if (mAppendBuffer) {
+            memcpy(newBuffer, mAppendBuffer,
+                   mAppendBufferLen * SAMPLE_SIZE(seqFormat));
+            DeleteSamples(mAppendBuffer);
+         }
+         mAppendBuffer = newBuffer;
+         mAppendBufferSize = maxBlockSize;
+      }
+
       if (mAppendBufferLen >= blockSize) {
          bool success =
             mSequence->Append(mAppendBuffer, seqFormat, blockSize,
@@ -1217,6 +2063,7 @@ bool WaveClip::CreateFromCopy(double t0, double t1, WaveClip* other)
    mEnvelope->CopyFrom(other->mEnvelope, (double)s0/mRate, (double)s1/mRate);
 
    MarkChanged();
+   MarkLayoutChanged();
 
    return true;
 }
@@ -1253,6 +2100,7 @@ bool WaveClip::Paste(double t0, WaveClip* other)
    if (mSequence->Paste(s0, pastedClip->mSequence))
    {
       MarkChanged();
+      MarkLayoutChanged();
       mEnvelope->Paste((double)s0/mRate + mOffset, pastedClip->mEnvelope);
       mEnvelope->RemoveUnneededPoints();
       OffsetCutLines(t0, pastedClip->GetEndTime() - pastedClip->GetStartTime());
@@ -1293,6 +2141,7 @@ bool WaveClip::InsertSilence(double t, double len)
    OffsetCutLines(t, len);
    GetEnvelope()->InsertSpace(t, len);
    MarkChanged();
+   MarkLayoutChanged();
 
    return true;
 }
@@ -1350,6 +2199,7 @@ bool WaveClip::Clear(double t0, double t1)
          Offset(-(GetStartTime() - t0));
 
       MarkChanged();
+      MarkLayoutChanged();
       return true;
    }
 
@@ -1409,6 +2259,7 @@ bool WaveClip::ClearAndAddCutLine(double t0, double t1)
          Offset(-(GetStartTime() - t0));
 
       MarkChanged();
+      MarkLayoutChanged();
 
       mCutLines.Append(newClip);
       return true;
@@ -1600,6 +2451,7 @@ bool WaveClip::Resample(int rate, ProgressDialog *progress)
       delete mSequence;
       mSequence = newSequence;
       mRate = rate;
+      MarkLayoutChanged();
 
       // Invalidate wave display cache
       if (mWaveCache)
@@ -32,6 +32,8 @@
 class Envelope;
 class WaveCache;
 class SpecCache;
+class SpectrogramPrefs;
+class WaveClipRenderJob;
 
 class SpecPxCache {
 public:
@@ -89,6 +91,10 @@ public:
 
    void ConvertToSampleFormat(sampleFormat format);
 
+   /// Rewrites the clip's blocks; see Sequence::Reblock().  Sets *changed
+   /// to true if the blocks or their size changed.
+   bool Reblock(sampleCount maxSamples = 0, bool *changed = NULL);
+
    void TimeToSamplesClip(double t0, sampleCount *s0) const;
    int GetRate() const { return mRate; }
 
@@ -133,17 +139,34 @@ public:
     * has changed, like when member functions SetSamples() etc. are called. */
    void MarkChanged() { mDirty++; }
 
+   /** The clip layout version of the WaveTrack that indexes this clip,
+    * which changes whenever the clip is deleted, moves, changes length
+    * or changes rate, so that the track can tell when its clip index is
+    * out of date.  NULL for clips no track indexes, such as cut lines,
+    * clipboard copies and render snapshots. */
+   void SetLayoutVersion(volatile int *version) { mLayoutVersion = version; }
+   void MarkLayoutChanged() { if (mLayoutVersion) (*mLayoutVersion)++; }
+
    /// Create clip from copy, discarding previous information in the clip
    bool CreateFromCopy(double t0, double t1, WaveClip* other);
 
    /** Getting high-level data from the for screen display and clipping
-    * calculations and Contrast */
+    * calculations and Contrast.  When the cache is cold and the view
+    * spans many blocks, these return placeholders at once (bl[] of -1,
+    * or isRendering set) and have the data computed in the background;
+    * the project the clip belongs to is refreshed when it is ready. */
    bool GetWaveDisplay(float *min, float *max, float *rms,int* bl, sampleCount *where,
                        int numPixels, double t0, double pixelsPerSecond, bool &isLoadingOD);
    bool GetSpectrogram(float *buffer, sampleCount *where,
                        int numPixels,
                        double t0, double pixelsPerSecond,
-                       bool autocorrelation);
+                       bool autocorrelation, bool &isRendering);
+
+   /// Stops the thread that renders cold display caches.  Call on exit.
+   static void StopRendering();
+   /// Rereads whether cold display caches are rendered in the background.
+   /// Call when the preferences change.
+   static void UpdateRenderPrefs();
    bool GetMinMax(float *min, float *max, double t0, double t1);
    bool GetRMS(float *rms, double t0, double t1);
 
@@ -238,6 +261,8 @@ public:
 protected:
    wxRect mDisplayRect;
 
+   volatile int *mLayoutVersion;
+
    double mOffset;
    int mRate;
    int mDirty;
@@ -257,6 +282,7 @@ protected:
 #endif
    samplePtr     mAppendBuffer;
    sampleCount   mAppendBufferLen;
+   sampleCount   mAppendBufferSize;
 
    // Cut Lines are nothing more than ordinary wave clips, with the
    // offset relative to the start of the clip.
@@ -264,6 +290,37 @@ protected:
 
    // AWD, Oct. 2009: for whitespace-at-end-of-selection pasting
    bool mIsPlaceholder;
+
+   // Caches being filled in the background, or NULL
+   WaveClipRenderJob *mWaveJob;
+   WaveClipRenderJob *mSpecJob;
+
+private:
+   friend class WaveClipRenderJob;
+
+   bool ComputeWaveDisplay(float *min, float *max, float *rms, int* bl,
+                           sampleCount *where, int numPixels, double t0,
+                           double pixelsPerSecond, bool &isLoadingOD);
+   bool ComputeSpectrogram(float *buffer, sampleCount *where,
+                           int numPixels,
+                           double t0, double pixelsPerSecond,
+                           bool autocorrelation,
+                           const SpectrogramPrefs &prefs);
+
+   // Each returns true if the view is queued for the background renderer,
+   // after adopting the cache of any finished job
+   bool RenderWaveDisplayLater(int numPixels, double t0,
+                               double pixelsPerSecond);
+   bool RenderSpectrogramLater(int numPixels, double t0,
+                               double pixelsPerSecond,
+                               bool autocorrelation,
+                               const SpectrogramPrefs &prefs);
+   WaveClipRenderJob *StartRenderJob(int numPixels, double t0,
+                                     double pixelsPerSecond,
+                                     bool autocorrelation,
+                                     const SpectrogramPrefs *prefs);
+   void TakeRenderJob(WaveClipRenderJob *&job);
+   void CancelRenderJob(WaveClipRenderJob *&job);
 };
 
 #endif
@@ -99,6 +99,9 @@ WaveTrack::WaveTrack(DirManager *projDirManager, sampleFormat format, double rat
    mDisplayLocations = NULL;
    mDisplayNumLocationsAllocated = 0;
    mLastDisplay = -1;
+   mClipLayoutVersion = 0;
+   mClipIndexVersion = 0;
+   mClipIndexValid = false;
 }
 
 WaveTrack::WaveTrack(WaveTrack &orig):
@@ -108,6 +111,9 @@ WaveTrack::WaveTrack(WaveTrack &orig):
    mLastDisplay=-1;
 
    mLegacyProjectFileOffset = 0;
+   mClipLayoutVersion = 0;
+   mClipIndexVersion = 0;
+   mClipIndexValid = false;
 
    Init(orig);
 
@@ -340,6 +346,15 @@ bool WaveTrack::ConvertToSampleFormat(sampleFormat format)
    return true;
 }
 
+bool WaveTrack::Reblock(sampleCount maxSamples, bool *changed)
+{
+   bool bResult = true;
+   for (WaveClipList::compatibility_iterator it=GetClipIterator(); it; it=it->GetNext())
+      bResult &= it->GetData()->Reblock(maxSamples, changed);
+
+   return bResult;
+}
+
 bool WaveTrack::IsEmpty(double t0, double t1)
 {
    WaveClipList::compatibility_iterator it;
@@ -753,6 +768,8 @@ WaveClip* WaveTrack::RemoveAndReturnClip(WaveClip* clip)
    WaveClipList::compatibility_iterator node = mClips.Find(clip);
    WaveClip* clipReturn = node->GetData();
    mClips.DeleteNode(node);
+   clipReturn->SetLayoutVersion(NULL);
+   MarkClipsChanged();
    return clipReturn;
 }
 
@@ -761,6 +778,7 @@ void WaveTrack::AddClip(WaveClip* clip)
    // Uncomment the following line after we correct the problem of zero-length clips
    //if (CanInsertClip(clip))
       mClips.Append(clip);
+   MarkClipsChanged();
 }
 
 bool WaveTrack::HandleClear(double t0, double t1,
@@ -885,6 +903,7 @@ bool WaveTrack::HandleClear(double t0, double t1,
    {
       mClips.Append(it->GetData());
    }
+   MarkClipsChanged();
 
    return true;
 }
@@ -1102,6 +1121,7 @@ bool WaveTrack::Paste(double t0, Track *src)
          newClip->Offset(t0);
          newClip->MarkChanged();
          mClips.Append(newClip);
+         MarkClipsChanged();
       }
    }
    return true;
@@ -1665,15 +1685,18 @@ bool WaveTrack::GetMinMax(float *min, float *max,
 
    bool result = true;
 
-   for (WaveClipList::compatibility_iterator it=GetClipIterator(); it; it=it->GetNext())
+   wxCriticalSectionLocker locker(mClipIndexCriticalSection);
+   size_t first, last;
+   FindClips(t0, t1, &first, &last);
+   for (size_t i = first; i < last; i++)
    {
-      WaveClip* clip = it->GetData();
+      WaveClip* clip = mClipIndex[i];
 
       if (t1 >= clip->GetStartTime() && t0 <= clip->GetEndTime())
       {
          clipFound = true;
          float clipmin, clipmax;
-         if (it->GetData()->GetMinMax(&clipmin, &clipmax, t0, t1))
+         if (clip->GetMinMax(&clipmin, &clipmax, t0, t1))
          {
             if (clipmin < *min)
                *min = clipmin;
@@ -1707,16 +1730,19 @@ bool WaveTrack::GetRMS(float *rms, double t0, double t1)
    double sumsq = 0.0;
    sampleCount length = 0;
 
-   for (WaveClipList::compatibility_iterator it=GetClipIterator(); it; it=it->GetNext())
+   wxCriticalSectionLocker locker(mClipIndexCriticalSection);
+   size_t first, last;
+   FindClips(t0, t1, &first, &last);
+   for (size_t i = first; i < last; i++)
    {
-      WaveClip* clip = it->GetData();
+      WaveClip* clip = mClipIndex[i];
 
       if (t1 >= clip->GetStartTime() && t0 <= clip->GetEndTime())
       {
          float cliprms;
          sampleCount clipStart, clipEnd;
 
-         if (it->GetData()->GetRMS(&cliprms, t0, t1))
+         if (clip->GetRMS(&cliprms, t0, t1))
          {
             clip->TimeToSamplesClip(wxMax(t0, clip->GetStartTime()), &clipStart);
             clip->TimeToSamplesClip(wxMin(t1, clip->GetEndTime()), &clipEnd);
@@ -1739,12 +1765,15 @@ bool WaveTrack::Get(samplePtr buffer, sampleFormat format,
    // Simple optimization: When this buffer is completely contained within one clip,
    // don't clear anything (because we won't have to). Otherwise, just clear
    // everything to be on the safe side.
-   WaveClipList::compatibility_iterator it;
+   wxCriticalSectionLocker locker(mClipIndexCriticalSection);
+   size_t first, last;
+   FindClips(LongSamplesToTime(start), LongSamplesToTime(start + len),
+             &first, &last);
 
    bool doClear = true;
-   for (it=GetClipIterator(); it; it=it->GetNext())
+   for (size_t i = first; i < last; i++)
    {
-      WaveClip *clip = it->GetData();
+      WaveClip *clip = mClipIndex[i];
       if (start >= clip->GetStartSample() && start+len <= clip->GetEndSample())
       {
          doClear = false;
@@ -1770,9 +1799,9 @@ bool WaveTrack::Get(samplePtr buffer, sampleFormat format,
       }
    }
 
-   for (it=GetClipIterator(); it; it=it->GetNext())
+   for (size_t i = first; i < last; i++)
    {
-      WaveClip *clip = it->GetData();
+      WaveClip *clip = mClipIndex[i];
 
       sampleCount clipStart = clip->GetStartSample();
       sampleCount clipEnd = clip->GetEndSample();
@@ -1804,14 +1833,78 @@ bool WaveTrack::Get(samplePtr buffer, sampleFormat format,
    return true;
 }
 
+bool WaveTrack::GetQuietRuns(sampleCount start, sampleCount len,
+                             float threshold, sampleCount minRun,
+                             std::vector<sampleCount> &runs)
+{
+   wxCriticalSectionLocker locker(mClipIndexCriticalSection);
+   size_t first, last;
+   FindClips(LongSamplesToTime(start), LongSamplesToTime(start + len),
+             &first, &last);
+
+   // Collect the runs of each clip and the space between clips, which
+   // Get() fills with zeros, in order; then join the ones that touch.
+   sampleCount end = start + len;
+   std::vector<sampleCount> found;
+   sampleCount pos = start;
+   for (size_t i = first; i < last; i++)
+   {
+      WaveClip *clip = mClipIndex[i];
+      sampleCount clipStart = clip->GetStartSample();
+      sampleCount clipEnd = clipStart + clip->GetNumSamples();
+      sampleCount s0 = wxMax(clipStart, pos);
+      sampleCount s1 = wxMin(clipEnd, end);
+      if (s0 >= s1)
+         continue;
+
+      if (s0 > pos && threshold > 0) {
+         found.push_back(pos);
+         found.push_back(s0);
+      }
+
+      std::vector<sampleCount> clipRuns;
+      if (!clip->GetSequence()->GetQuietRuns(s0 - clipStart, s1 - s0,
+                                             threshold, minRun, clipRuns))
+         return false;
+      for (size_t j = 0; j < clipRuns.size(); j++)
+         found.push_back(clipStart + clipRuns[j]);
+
+      pos = s1;
+   }
+   if (end > pos && threshold > 0) {
+      found.push_back(pos);
+      found.push_back(end);
+   }
+
+   for (size_t i = 0; i < found.size(); i += 2)
+   {
+      sampleCount runStart = found[i];
+      sampleCount runEnd = found[i + 1];
+      while (i + 2 < found.size() && found[i + 2] == runEnd) {
+         i += 2;
+         runEnd = found[i + 1];
+      }
+      if (runEnd - runStart >= minRun || runStart == start || runEnd == end) {
+         runs.push_back(runStart);
+         runs.push_back(runEnd);
+      }
+   }
+
+   return true;
+}
+
 bool WaveTrack::Set(samplePtr buffer, sampleFormat format,
                     sampleCount start, sampleCount len)
 {
    bool result = true;
 
-   for (WaveClipList::compatibility_iterator it=GetClipIterator(); it; it=it->GetNext())
+   wxCriticalSectionLocker locker(mClipIndexCriticalSection);
+   size_t first, last;
+   FindClips(LongSamplesToTime(start), LongSamplesToTime(start + len),
+             &first, &last);
+   for (size_t i = first; i < last; i++)
    {
-      WaveClip *clip = it->GetData();
+      WaveClip *clip = mClipIndex[i];
 
       sampleCount clipStart = clip->GetStartSample();
       sampleCount clipEnd = clip->GetEndSample();
@@ -1861,9 +1954,12 @@ void WaveTrack::GetEnvelopeValues(double *buffer, int bufferLen,
    double startTime = t0;
    double endTime = t0+tstep*bufferLen;
 
-   for (WaveClipList::compatibility_iterator it=GetClipIterator(); it; it=it->GetNext())
+   wxCriticalSectionLocker locker(mClipIndexCriticalSection);
+   size_t first, last;
+   FindClips(startTime, endTime, &first, &last);
+   for (size_t i = first; i < last; i++)
    {
-      WaveClip *clip = it->GetData();
+      WaveClip *clip = mClipIndex[i];
 
       // IF clip intersects startTime..endTime THEN...
       double dClipStartTime = clip->GetStartTime();
@@ -1902,6 +1998,38 @@ void WaveTrack::GetEnvelopeValues(double *buffer, int bufferLen,
    }
 }
 
+bool WaveTrack::GetConstantEnvelopeValue(double t0, double t1, double *value)
+{
+   // Between clips there are no samples to scale
+   bool found = false;
+   *value = 1.0;
+
+   wxCriticalSectionLocker locker(mClipIndexCriticalSection);
+   size_t first, last;
+   FindClips(t0, t1, &first, &last);
+   for (size_t i = first; i < last; i++)
+   {
+      WaveClip *clip = mClipIndex[i];
+
+      double dClipStartTime = clip->GetStartTime();
+      double dClipEndTime = clip->GetEndTime();
+      if ((dClipStartTime <= t1) && (dClipEndTime > t0))
+      {
+         double clipValue;
+         if (!clip->GetEnvelope()->GetConstantValue(std::max(t0, dClipStartTime),
+                                                    std::min(t1, dClipEndTime),
+                                                    &clipValue))
+            return false;
+         if (found && clipValue != *value)
+            return false;
+         found = true;
+         *value = clipValue;
+      }
+   }
+
+   return true;
+}
+
 WaveClip* WaveTrack::GetClipAtX(int xcoord)
 {
    for (WaveClipList::compatibility_iterator it=GetClipIterator(); it; it=it->GetNext())
@@ -1917,12 +2045,16 @@ WaveClip* WaveTrack::GetClipAtX(int xcoord)
 
 WaveClip* WaveTrack::GetClipAtSample(sampleCount sample)
 {
-   for (WaveClipList::compatibility_iterator it=GetClipIterator(); it; it=it->GetNext())
+   wxCriticalSectionLocker locker(mClipIndexCriticalSection);
+   size_t first, last;
+   double t = LongSamplesToTime(sample);
+   FindClips(t, t, &first, &last);
+   for (size_t i = first; i < last; i++)
    {
       WaveClip *clip;
       sampleCount start, len;
 
-      clip  = it->GetData();
+      clip  = mClipIndex[i];
       start = clip->GetStartSample();
       len   = clip->GetNumSamples();
 
@@ -1968,6 +2100,7 @@ WaveClip* WaveTrack::CreateClip()
 {
    WaveClip* clip = new WaveClip(mDirManager, mFormat, mRate);
    mClips.Append(clip);
+   MarkClipsChanged();
    return clip;
 }
 
@@ -2015,7 +2148,10 @@ void WaveTrack::MoveClipToTrack(WaveClip *clip, WaveTrack* dest)
       if (it->GetData() == clip) {
          WaveClip* clip = it->GetData(); //vvv ANSWER-ME: Why declare and assign this to another variable, when we just verified the 'clip' parameter is the right value?!
          mClips.DeleteNode(it);
+         clip->SetLayoutVersion(NULL);
+         MarkClipsChanged();
          dest->mClips.Append(clip);
+         dest->MarkClipsChanged();
          return; // JKC iterator is now 'defunct' so better return straight away.
       }
    }
@@ -2121,6 +2257,7 @@ bool WaveTrack::SplitAt(double t)
          sampleCount here = llrint(floor(((t - c->GetStartTime()) * mRate) + 0.5));
          newClip->Offset((double)here/(double)mRate);
          mClips.Append(newClip);
+         MarkClipsChanged();
          return true;
       }
    }
@@ -2317,6 +2454,50 @@ static int SortClipArrayCmpFunc(WaveClip** clip1, WaveClip** clip2)
       return 1;
 }
 
+static bool CompareClipStarts(WaveClip *clip1, WaveClip *clip2)
+{
+   return clip1->GetStartTime() < clip2->GetStartTime();
+}
+
+void WaveTrack::FindClips(double t0, double t1, size_t *first, size_t *last)
+{
+   int version = mClipLayoutVersion;
+   if (!mClipIndexValid || mClipIndexVersion != version ||
+       mClipIndex.size() != mClips.GetCount())
+   {
+      mClipIndex.clear();
+      for (WaveClipList::compatibility_iterator it=GetClipIterator(); it; it=it->GetNext()) {
+         // From now on the clip tells this track when it changes
+         it->GetData()->SetLayoutVersion(&mClipLayoutVersion);
+         mClipIndex.push_back(it->GetData());
+      }
+      std::stable_sort(mClipIndex.begin(), mClipIndex.end(), CompareClipStarts);
+
+      size_t numClips = mClipIndex.size();
+      mClipIndexStart.resize(numClips);
+      mClipIndexMaxEnd.resize(numClips);
+      for (size_t i = 0; i < numClips; i++) {
+         mClipIndexStart[i] = mClipIndex[i]->GetStartTime();
+         mClipIndexMaxEnd[i] = mClipIndex[i]->GetEndTime();
+         if (i > 0 && mClipIndexMaxEnd[i - 1] > mClipIndexMaxEnd[i])
+            mClipIndexMaxEnd[i] = mClipIndexMaxEnd[i - 1];
+      }
+
+      mClipIndexVersion = version;
+      mClipIndexValid = true;
+   }
+
+   // Callers compare in samples as well as in time, so allow a sample
+   // either side
+   double slop = 1.0 / mRate;
+   *first = std::lower_bound(mClipIndexMaxEnd.begin(), mClipIndexMaxEnd.end(),
+                             t0 - slop) - mClipIndexMaxEnd.begin();
+   *last = std::upper_bound(mClipIndexStart.begin(), mClipIndexStart.end(),
+                            t1 + slop) - mClipIndexStart.begin();
+   if (*last < *first)
+      *last = *first;
+}
+
 void WaveTrack::FillSortedClipArray(WaveClipArray& clips)
 {
    clips.Empty();
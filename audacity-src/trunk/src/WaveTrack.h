@@ -22,6 +22,8 @@
 #include <wx/longlong.h>
 #include <wx/thread.h>
 
+#include <vector>
+
 class TimeWarper;
 
 //
@@ -145,6 +147,10 @@ class AUDACITY_DLL_API WaveTrack: public Track {
    sampleFormat GetSampleFormat() { return mFormat; }
    bool ConvertToSampleFormat(sampleFormat format);
 
+   /// Rewrites the blocks of every clip; see Sequence::Reblock().  Sets
+   /// *changed to true if the blocks of any clip changed.
+   bool Reblock(sampleCount maxSamples = 0, bool *changed = NULL);
+
    //
    // High-level editing
    //
@@ -236,9 +242,19 @@ class AUDACITY_DLL_API WaveTrack: public Track {
                    sampleCount start, sampleCount len);
    void GetEnvelopeValues(double *buffer, int bufferLen,
                          double t0, double tstep);
+   /// Returns true, and the value, if the envelopes of all clips between
+   /// t0 and t1 have the same constant value there, so that callers can
+   /// skip GetEnvelopeValues() and scale by one gain instead
+   bool GetConstantEnvelopeValue(double t0, double t1, double *value);
    bool GetMinMax(float *min, float *max,
                   double t0, double t1);
    bool GetRMS(float *rms, double t0, double t1);
+   /// Appends to runs the start and end of each run of samples in
+   /// [start, start + len) that Get() would return below threshold in
+   /// magnitude, if it is at least minRun long or touches either end of
+   /// the range.  See Sequence::GetQuietRuns().
+   bool GetQuietRuns(sampleCount start, sampleCount len, float threshold,
+                     sampleCount minRun, std::vector<sampleCount> &runs);
 
    //
    // MM: We now have more than one sequence and envelope per track, so
@@ -447,6 +463,30 @@ class AUDACITY_DLL_API WaveTrack: public Track {
    wxCriticalSection mAppendCriticalSection;
    double mLegacyProjectFileOffset;
 
+   //
+   // Index of the clips, sorted by start time, so that lookups by time
+   // or sample don't walk the whole clip list.  It is rebuilt on first use
+   // after mClipLayoutVersion changes: the clips bump it when they move or
+   // change length, and the track when it changes the list.
+   // mClipIndexMaxEnd[i] is the latest end time of clips 0..i, which
+   // never decreases, so both ends of a search are binary searches.
+   //
+   std::vector<WaveClip *> mClipIndex;
+   std::vector<double> mClipIndexStart;
+   std::vector<double> mClipIndexMaxEnd;
+   volatile int mClipLayoutVersion;
+   int mClipIndexVersion;
+   bool mClipIndexValid;
+   wxCriticalSection mClipIndexCriticalSection;
+
+   /// Sets *first and *last to the range of mClipIndex holding every clip
+   /// that may overlap t0..t1, rebuilding the index first if it is out of
+   /// date.  The range can hold clips that don't overlap, so callers still
+   /// test each one.  Call with mClipIndexCriticalSection held.
+   void FindClips(double t0, double t1, size_t *first, size_t *last);
+   /// Lets the clip index know that mClips has changed
+   void MarkClipsChanged() { mClipLayoutVersion++; }
+
 };
 
 #endif // __AUDACITY_WAVETRACK__
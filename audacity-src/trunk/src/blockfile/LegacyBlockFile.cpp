@@ -59,6 +59,9 @@ void ComputeLegacySummaryInfo(wxFileName fileName,
       (summaryLen - 20 -
        (info->frames64K * info->bytesPerFrame)) /
       info->bytesPerFrame;
+   // Legacy summaries have no levels between 256 and 64K
+   info->frames1K = info->frames4K = info->frames16K = 0;
+   info->offset1K = info->offset4K = info->offset16K = 0;
 
    //
    // Compute the min, max, and RMS of the block from the
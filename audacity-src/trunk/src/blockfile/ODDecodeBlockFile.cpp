@@ -28,9 +28,6 @@ The summary is eventually computed and written to a file in a background thread.
 #include "../FileFormats.h"
 #include "../Internat.h"
 
-const int bheaderTagLen = 20;
-char bheaderTag[bheaderTagLen + 1] = "AudacityBlockFile112";
-
 
 
    /// Create a disk file and write summary and sample data to it
@@ -376,143 +373,6 @@ wxFileName ODDecodeBlockFile::GetFileName()
    return name;
 }
 
-/// A thread-safe version of CalcSummary.  BlockFile::CalcSummary
-/// uses a static summary array across the class, which we can't use.
-/// Get a buffer containing a summary block describing this sample
-/// data.  This must be called by derived classes when they
-/// are constructed, to allow them to construct their summary data,
-/// after which they should write that data to their disk file.
-///
-/// This method also has the side effect of setting the mMin, mMax,
-/// and mRMS members of this class.
-///
-/// Unlike BlockFile's implementation You SHOULD delete the returned buffer.
-/// this is protected so it shouldn't be hard to deal with - just override
-/// all BlockFile methods that use this method.
-///
-/// @param buffer A buffer containing the sample data to be analyzed
-/// @param len    The length of the sample data
-/// @param format The format of the sample data.
-void *ODDecodeBlockFile::CalcSummary(samplePtr buffer, sampleCount len,
-                             sampleFormat format)
-{
-   char* localFullSummary = new char[mSummaryInfo.totalSummaryBytes];
-
-   memcpy(localFullSummary, bheaderTag, bheaderTagLen);
-
-   float *summary64K = (float *)(localFullSummary + mSummaryInfo.offset64K);
-   float *summary256 = (float *)(localFullSummary + mSummaryInfo.offset256);
-
-   float *fbuffer;
-
-   //mchinen: think we can hack this - don't allocate and copy if we don't need to.,
-   if(format==floatSample)
-   {
-      fbuffer = (float*)buffer;
-   }
-   else
-   {
-      fbuffer = new float[len];
-      CopySamples(buffer, format,
-               (samplePtr)fbuffer, floatSample, len);
-   }
-   sampleCount sumLen;
-   sampleCount i, j, jcount;
-
-   float min, max;
-   float sumsq;
-
-   // Recalc 256 summaries
-   sumLen = (len + 255) / 256;
-
-
-   for (i = 0; i < sumLen; i++) {
-      min = fbuffer[i * 256];
-      max = fbuffer[i * 256];
-      sumsq = ((float)min) * ((float)min);
-      jcount = 256;
-      if (i * 256 + jcount > len)
-         jcount = len - i * 256;
-      for (j = 1; j < jcount; j++) {
-         float f1 = fbuffer[i * 256 + j];
-         sumsq += ((float)f1) * ((float)f1);
-         if (f1 < min)
-            min = f1;
-         else if (f1 > max)
-            max = f1;
-      }
-
-      float rms = (float)sqrt(sumsq / jcount);
-
-      summary256[i * 3] = min;
-      summary256[i * 3 + 1] = max;
-      summary256[i * 3 + 2] = rms;
-   }
-
-   for (i = sumLen; i < mSummaryInfo.frames256; i++) {
-      // filling in the remaining bits with non-harming/contributing values
-      summary256[i * 3] = FLT_MAX;  // min
-      summary256[i * 3 + 1] = -FLT_MAX;   // max
-      summary256[i * 3 + 2] = 0.0f; // rms
-   }
-
-   // Recalc 64K summaries
-   sumLen = (len + 65535) / 65536;
-
-   for (i = 0; i < sumLen; i++) {
-      min = summary256[3 * i * 256];
-      max = summary256[3 * i * 256 + 1];
-      sumsq = (float)summary256[3 * i * 256 + 2];
-      sumsq *= sumsq;
-
-      for (j = 1; j < 256; j++) {
-         if (summary256[3 * (i * 256 + j)] < min)
-            min = summary256[3 * (i * 256 + j)];
-         if (summary256[3 * (i * 256 + j) + 1] > max)
-            max = summary256[3 * (i * 256 + j) + 1];
-         float r1 = summary256[3 * (i * 256 + j) + 2];
-         sumsq += r1*r1;
-      }
-
-      float rms = (float)sqrt(sumsq / 256);
-
-      summary64K[i * 3] = min;
-      summary64K[i * 3 + 1] = max;
-      summary64K[i * 3 + 2] = rms;
-   }
-   for (i = sumLen; i < mSummaryInfo.frames64K; i++) {
-      summary64K[i * 3] = 0.0f;
-      summary64K[i * 3 + 1] = 0.0f;
-      summary64K[i * 3 + 2] = 0.0f;
-   }
-
-   // Recalc block-level summary
-   min = summary64K[0];
-   max = summary64K[1];
-   sumsq = (float)summary64K[2];
-   sumsq *= sumsq;
-
-   for (i = 1; i < sumLen; i++) {
-      if (summary64K[3*i] < min)
-         min = summary64K[3*i];
-      else if (summary64K[3*i+1] > max)
-         max = summary64K[3*i+1];
-      float r1 = (float)summary64K[3*i+2];
-      sumsq += (r1*r1);
-   }
-
-   mMin = min;
-   mMax = max;
-   mRMS = sqrt(sumsq / sumLen);
-
-
-   //if we've used the float sample..
-   if(format!=floatSample)
-   {
-      delete[] fbuffer;
-   }
-   return localFullSummary;
-}
 
 
 
@@ -155,8 +155,6 @@ class ODDecodeBlockFile : public SimpleBlockFile
   protected:
 
 //   virtual void WriteSimpleBlockFile();
-   virtual void *CalcSummary(samplePtr buffer, sampleCount len,
-                             sampleFormat format);
    //The on demand type.
    unsigned int mType;
 
@@ -137,8 +137,6 @@ class ODPCMAliasBlockFile : public PCMAliasBlockFile
 
   protected:
    virtual void WriteSummary();
-   virtual void *CalcSummary(samplePtr buffer, sampleCount len,
-                             sampleFormat format);
 
   private:
    //Thread-safe versions
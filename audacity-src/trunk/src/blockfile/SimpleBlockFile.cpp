@@ -22,7 +22,8 @@ A block file that writes the audio data to an .au file and reads
 it back using libsndfile.
 
 There are two ways to construct a simple block file.  One is to
-supply data and have the constructor write the file.  The other
+supply data and have the file written (in the background, by
+SimpleBlockFileWriter).  The other
 is for when the file already exists and we simply want to create
 the data structure to refer to it.
 
@@ -50,6 +51,51 @@ default is to disable caching.
 
 *//****************************************************************//**
 
+\class SimpleBlockFileHandlePool
+\brief Keeps a bounded number of SimpleBlockFiles open between reads.
+
+Every uncached ReadData() or ReadSummary() used to open the .au file,
+let libsndfile parse the header, seek, read and close again.  The pool
+keeps the most recently read files open (evicting the least recently
+used ones), and the block remembers where its samples start, so a read
+of an already pooled block is a single positioned read.
+
+A pooled handle is given to one reader at a time; a second thread asking
+for the same block gets a private handle that is closed on Release().
+Whoever renames, rewrites or removes a block file must Close() its
+handle first, since open files can't be renamed or deleted on Windows,
+and truncating a file while a reader copies from its mapping would
+fault.  Close() waits for a reader holding the pooled handle.
+
+*//****************************************************************//**
+
+\class SimpleBlockFileHandle
+\brief An open SimpleBlockFile that can also be mapped into memory.
+
+GetDirectData() maps pooled int16 and float block files whose byte
+order matches ours, so that Sequence::Read can copy samples straight out
+of the page cache without a read call or a conversion buffer.  The
+mapping lives as long as the handle stays in the pool.
+
+*//****************************************************************//**
+
+\class SimpleBlockFileWriter
+\brief Writes new block files on a background thread.
+
+The constructor that takes sample data computes the summary (so that
+min, max and RMS are known at once), hands a copy of the samples to
+the writer and returns.  Reads of the block are served from that copy
+until its file is on disk.  Moving, copying or removing the file waits
+for or cancels the write, and the project waits for all of them
+(DirManager::FlushPendingWrites) before saving or auto-saving, since
+the project file must only name files that exist.  That wait also
+syncs the new files to the disk.  A file that could not be written
+(say, the disk is full) keeps its samples in memory and is tried again
+at each such wait, which fails while any of the project's files are
+still unwritten.
+
+*//****************************************************************//**
+
 \class auHeader
 \brief The auHeader is a structure used by SimpleBlockFile for .au file
 format.  There probably is an 'official' header file we should include
@@ -58,10 +104,14 @@ to get its definition, rather than rolling our own.
 *//*******************************************************************/
 
 #include <wx/wx.h>
+#include <wx/file.h>
 #include <wx/filefn.h>
 #include <wx/ffile.h>
 #include <wx/utils.h>
 #include <wx/log.h>
+#include <wx/thread.h>
+
+#include <algorithm>
 
 #include "../Prefs.h"
 
@@ -71,6 +121,32 @@ to get its definition, rather than rolling our own.
 #include "sndfile.h"
 #include "../Internat.h"
 
+#ifdef __WXMSW__
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Maximum number of block files kept open by SimpleBlockFileHandlePool.
+// Well below the default descriptor limit of every platform we run on.
+static const int kMaxOpenBlockFiles = 64;
+
+static SimpleBlockFileHandlePool gHandlePool;
+
+// Bytes of sample data SimpleBlockFileWriter queues before Add() waits
+static const int kMaxQueuedBlockFileBytes = 32 * 1048576;
+
+// Bytes of written files' buffers SimpleBlockFileWriter keeps for reuse
+static const size_t kMaxFreeBlockFileBytes = 8 * 1048576;
+
+// Each buffer from NewBuffer() is preceded by its size; 16 bytes, so
+// that the samples stay aligned
+static const size_t kBufferHeaderBytes = 16;
+
+static SimpleBlockFileWriter gWriter;
+
 
 static wxUint32 SwapUintEndianess(wxUint32 in)
 {
@@ -84,8 +160,580 @@ static wxUint32 SwapUintEndianess(wxUint32 in)
   return out;
 }
 
-/// Constructs a SimpleBlockFile based on sample data and writes
-/// it to disk.
+/// Reads len bytes at the given offset, using one pread() where we can.
+/// The handle must not be used by another thread at the same time.
+static size_t ReadAt(wxFile &file, wxFileOffset offset, void *buffer, size_t len)
+{
+#ifdef __WXMSW__
+   if (file.Seek(offset) == wxInvalidOffset)
+      return 0;
+   ssize_t read = file.Read(buffer, len);
+#else
+   ssize_t read = pread(file.fd(), buffer, len, (off_t)offset);
+#endif
+   return (read < 0) ? 0 : (size_t)read;
+}
+
+SimpleBlockFileHandle::SimpleBlockFileHandle():
+   mMap(NULL),
+   mMapLength(0)
+#ifdef __WXMSW__
+   , mMapping(NULL)
+#endif
+{
+}
+
+SimpleBlockFileHandle::~SimpleBlockFileHandle()
+{
+#ifdef __WXMSW__
+   if (mMap)
+      UnmapViewOfFile(mMap);
+   if (mMapping)
+      CloseHandle((HANDLE)mMapping);
+#else
+   if (mMap)
+      munmap(mMap, mMapLength);
+#endif
+}
+
+bool SimpleBlockFileHandle::Open(const wxString &fullPath)
+{
+   return file.Open(fullPath);
+}
+
+const char *SimpleBlockFileHandle::Map(size_t *length)
+{
+   if (!mMap) {
+      wxFileOffset fileLength = file.Length();
+      if (fileLength <= 0)
+         return NULL;
+
+#ifdef __WXMSW__
+      mMapping = (void *)CreateFileMapping((HANDLE)_get_osfhandle(file.fd()),
+                                           NULL, PAGE_READONLY, 0, 0, NULL);
+      if (!mMapping)
+         return NULL;
+      mMap = (char *)MapViewOfFile((HANDLE)mMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+      void *map = mmap(NULL, (size_t)fileLength, PROT_READ, MAP_SHARED,
+                       file.fd(), 0);
+      mMap = (map == MAP_FAILED) ? NULL : (char *)map;
+#endif
+      if (!mMap)
+         return NULL;
+      mMapLength = (size_t)fileLength;
+   }
+
+   *length = mMapLength;
+   return mMap;
+}
+
+SimpleBlockFileHandlePool::SimpleBlockFileHandlePool():
+   mMaxOpen(kMaxOpenBlockFiles),
+   mReleased(&mLock)
+{
+}
+
+SimpleBlockFileHandlePool::~SimpleBlockFileHandlePool()
+{
+   CloseAll();
+}
+
+SimpleBlockFileHandlePool *SimpleBlockFileHandlePool::Instance()
+{
+   return &gHandlePool;
+}
+
+SimpleBlockFileHandle *SimpleBlockFileHandlePool::Acquire(const BlockFile *owner,
+                                                          const wxString &fullPath,
+                                                          bool *pooled /* = NULL */)
+{
+   mLock.Lock();
+   EntryMap::iterator found = mEntryMap.find(owner);
+   if (found != mEntryMap.end() && !found->second->inUse) {
+      // Move to the front of the LRU list
+      mEntries.splice(mEntries.begin(), mEntries, found->second);
+      found->second->inUse = true;
+      SimpleBlockFileHandle *handle = found->second->handle;
+      mLock.Unlock();
+      if (pooled)
+         *pooled = true;
+      return handle;
+   }
+   bool busy = (found != mEntryMap.end());
+   mLock.Unlock();
+
+   // Open outside of the lock, so that a slow disk doesn't hold up
+   // readers of other blocks.
+   CountWatchedAllocation();
+   SimpleBlockFileHandle *handle = new SimpleBlockFileHandle();
+   if (!handle->Open(fullPath)) {
+      delete handle;
+      return NULL;
+   }
+
+   // If another thread is reading this block, this handle stays private
+   // and is closed on Release().
+   bool added = false;
+   if (!busy) {
+      mLock.Lock();
+      if (mEntryMap.find(owner) == mEntryMap.end()) {
+         Entry entry;
+         entry.owner = owner;
+         entry.handle = handle;
+         entry.inUse = true;
+         mEntries.push_front(entry);
+         mEntryMap[owner] = mEntries.begin();
+         Trim();
+         added = true;
+      }
+      mLock.Unlock();
+   }
+
+   if (pooled)
+      *pooled = added;
+   return handle;
+}
+
+void SimpleBlockFileHandlePool::Release(const BlockFile *owner,
+                                        SimpleBlockFileHandle *handle)
+{
+   if (!handle)
+      return;
+
+   mLock.Lock();
+   EntryMap::iterator found = mEntryMap.find(owner);
+   if (found != mEntryMap.end() && found->second->handle == handle) {
+      found->second->inUse = false;
+      Trim();
+      handle = NULL;
+      mReleased.Broadcast();
+   }
+   mLock.Unlock();
+
+   // Not (or no longer) pooled
+   delete handle;
+}
+
+void SimpleBlockFileHandlePool::Close(const BlockFile *owner)
+{
+   mLock.Lock();
+   EntryMap::iterator found = mEntryMap.find(owner);
+   while (found != mEntryMap.end() && found->second->inUse) {
+      mReleased.Wait();
+      found = mEntryMap.find(owner);
+   }
+   if (found != mEntryMap.end()) {
+      delete found->second->handle;
+      mEntries.erase(found->second);
+      mEntryMap.erase(found);
+   }
+   mLock.Unlock();
+}
+
+void SimpleBlockFileHandlePool::CloseAll()
+{
+   mLock.Lock();
+   for (EntryList::iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+      if (!it->inUse)
+         delete it->handle;
+   mEntries.clear();
+   mEntryMap.clear();
+   mLock.Unlock();
+}
+
+/// Closes least recently used handles until the pool is within bounds.
+/// Handles in use are skipped.  Call with mLock held.
+void SimpleBlockFileHandlePool::Trim()
+{
+   EntryList::iterator it = mEntries.end();
+   while ((int)mEntryMap.size() > mMaxOpen && it != mEntries.begin()) {
+      --it;
+      if (it->inUse)
+         continue;
+      delete it->handle;
+      mEntryMap.erase(it->owner);
+      it = mEntries.erase(it);
+   }
+}
+
+class SimpleBlockFileWriterThread : public wxThread
+{
+ public:
+   SimpleBlockFileWriterThread(SimpleBlockFileWriter *writer)
+      : wxThread(wxTHREAD_JOINABLE),
+        mWriter(writer)
+   {
+   }
+
+   virtual ExitCode Entry()
+   {
+      mWriter->WriteEntries();
+      return 0;
+   }
+
+ private:
+   SimpleBlockFileWriter *mWriter;
+};
+
+SimpleBlockFileWriter::SimpleBlockFileWriter():
+   mQueuedBytes(0),
+   mNextSerial(0),
+   mQuit(false),
+   mThread(NULL),
+   mChanged(&mLock),
+   mFreeBytes(0)
+{
+}
+
+SimpleBlockFileWriter::~SimpleBlockFileWriter()
+{
+   // Quit() has stopped the thread; anything queued since was written
+   // synchronously
+   for (size_t i = 0; i < mFreeBuffers.size(); i++)
+      delete[] (mFreeBuffers[i] - kBufferHeaderBytes);
+}
+
+static size_t BufferSize(const char *buffer)
+{
+   return *(const size_t *)(buffer - kBufferHeaderBytes);
+}
+
+char *SimpleBlockFileWriter::NewBuffer(size_t bytes)
+{
+   // A kept buffer fits if it isn't much larger; summaries and samples of
+   // the blocks of one recording keep their sizes
+   mBufferLock.Lock();
+   for (size_t i = 0; i < mFreeBuffers.size(); i++) {
+      size_t size = BufferSize(mFreeBuffers[i]);
+      if (size >= bytes && size <= 2 * bytes) {
+         char *buffer = mFreeBuffers[i];
+         mFreeBuffers[i] = mFreeBuffers.back();
+         mFreeBuffers.pop_back();
+         mFreeBytes -= size;
+         mBufferLock.Unlock();
+         return buffer;
+      }
+   }
+   mBufferLock.Unlock();
+
+   CountWatchedAllocation();
+   char *buffer = new char[bytes + kBufferHeaderBytes] + kBufferHeaderBytes;
+   *(size_t *)(buffer - kBufferHeaderBytes) = bytes;
+   return buffer;
+}
+
+void SimpleBlockFileWriter::FreeBuffer(char *buffer)
+{
+   if (!buffer)
+      return;
+
+   size_t size = BufferSize(buffer);
+   mBufferLock.Lock();
+   if (mFreeBytes + size <= kMaxFreeBlockFileBytes) {
+      mFreeBuffers.push_back(buffer);
+      mFreeBytes += size;
+      buffer = NULL;
+   }
+   mBufferLock.Unlock();
+
+   if (buffer)
+      delete[] (buffer - kBufferHeaderBytes);
+}
+
+SimpleBlockFileWriter *SimpleBlockFileWriter::Instance()
+{
+   return &gWriter;
+}
+
+void SimpleBlockFileWriter::Add(SimpleBlockFile *block, samplePtr sampleData,
+                                sampleFormat format, void *summaryData)
+{
+   Entry *entry = new Entry;
+   entry->block = block;
+   entry->sampleData = sampleData;
+   entry->len = block->GetLength();
+   entry->format = format;
+   entry->summaryData = summaryData;
+   entry->bytes = entry->len * SAMPLE_SIZE(format);
+   entry->writing = false;
+   entry->failed = false;
+
+   // The entry and its place in the map
+   CountWatchedAllocation();
+
+   mLock.Lock();
+
+   if (!mThread && !mQuit) {
+      mThread = new SimpleBlockFileWriterThread(this);
+      if (mThread->Create() != wxTHREAD_NO_ERROR) {
+         delete mThread;
+         mThread = NULL;
+      }
+      else
+         mThread->Run();
+   }
+
+   if (!mThread) {
+      // No thread, so write it now
+      mLock.Unlock();
+      bool written = Write(entry);
+      mLock.Lock();
+      if (!written) {
+         entry->serial = mNextSerial++;
+         mEntryMap[block] = entry;
+         Hold(entry);
+         mLock.Unlock();
+         return;
+      }
+      mUnsynced.push_back(block->GetFileName().GetFullPath());
+      mLock.Unlock();
+
+      block->mWritePending = false;
+      FreeBuffer((char *)entry->sampleData);
+      FreeBuffer((char *)entry->summaryData);
+      delete entry;
+      return;
+   }
+
+   // Back-pressure: let the disk catch up
+   while (mQueuedBytes > 0 &&
+          mQueuedBytes + entry->bytes > kMaxQueuedBlockFileBytes)
+      mChanged.Wait();
+
+   entry->serial = mNextSerial++;
+   mQueue.push_back(entry);
+   mEntryMap[block] = entry;
+   mQueuedBytes += entry->bytes;
+   mChanged.Broadcast();
+
+   mLock.Unlock();
+}
+
+bool SimpleBlockFileWriter::ReadData(const BlockFile *block, samplePtr data,
+                                     sampleFormat format,
+                                     sampleCount start, sampleCount len)
+{
+   mLock.Lock();
+   EntryMap::iterator found = mEntryMap.find(block);
+   bool queued = (found != mEntryMap.end());
+   if (queued) {
+      Entry *entry = found->second;
+      CopySamples(entry->sampleData + start * SAMPLE_SIZE(entry->format),
+                  entry->format, data, format, len);
+   }
+   mLock.Unlock();
+
+   return queued;
+}
+
+bool SimpleBlockFileWriter::ReadSummary(const BlockFile *block, void *data,
+                                        int bytes)
+{
+   mLock.Lock();
+   EntryMap::iterator found = mEntryMap.find(block);
+   bool queued = (found != mEntryMap.end());
+   if (queued)
+      memcpy(data, found->second->summaryData, bytes);
+   mLock.Unlock();
+
+   return queued;
+}
+
+void SimpleBlockFileWriter::Wait(const BlockFile *block)
+{
+   mLock.Lock();
+   EntryMap::iterator found;
+   while ((found = mEntryMap.find(block)) != mEntryMap.end() &&
+          (!found->second->failed || found->second->writing))
+      mChanged.Wait();
+   mLock.Unlock();
+}
+
+void SimpleBlockFileWriter::Cancel(const BlockFile *block)
+{
+   mLock.Lock();
+   EntryMap::iterator found = mEntryMap.find(block);
+   if (found != mEntryMap.end() && !found->second->writing) {
+      Remove(found->second);
+      mChanged.Broadcast();
+   }
+   while (mEntryMap.find(block) != mEntryMap.end())
+      mChanged.Wait();
+   mLock.Unlock();
+}
+
+// Makes the written data of a file durable.  A file removed since it was
+// written is no longer wanted, so that isn't an error.
+static bool SyncFile(const wxString &path)
+{
+   if (!wxFileExists(path))
+      return true;
+
+   wxFile file(path, wxFile::read_write);
+   if (!file.IsOpened())
+      return false;
+
+#ifdef __WXMSW__
+   return _commit(file.fd()) == 0;
+#else
+   return fsync(file.fd()) == 0;
+#endif
+}
+
+bool SimpleBlockFileWriter::Flush()
+{
+   mLock.Lock();
+   // The queue is in the order of Add(), so the files queued before now
+   // are written once the front of it is a later one
+   wxLongLong_t end = mNextSerial;
+   while (!mQueue.empty() && mQueue.front()->serial < end)
+      mChanged.Wait();
+
+   // Space may have been freed since; a failed entry stays held, and
+   // readable, while it is tried again
+   std::vector<Entry *> retry;
+   for (size_t i = 0; i < mFailed.size(); i++)
+      if (!mFailed[i]->writing) {
+         mFailed[i]->writing = true;
+         retry.push_back(mFailed[i]);
+      }
+   mLock.Unlock();
+
+   std::vector<bool> retried(retry.size());
+   for (size_t i = 0; i < retry.size(); i++)
+      retried[i] = Write(retry[i]);
+
+   mLock.Lock();
+   for (size_t i = 0; i < retry.size(); i++) {
+      if (retried[i]) {
+         mUnsynced.push_back(retry[i]->block->GetFileName().GetFullPath());
+         Remove(retry[i]);
+      }
+      else {
+         wxLogDebug(wxT("Could not write %s"),
+                    retry[i]->block->GetFileName().GetFullPath().c_str());
+         retry[i]->writing = false;
+      }
+   }
+   if (!retry.empty())
+      mChanged.Broadcast();
+
+   // The project file about to name these files must not survive a
+   // crash of the system that they don't
+   std::vector<wxString> written;
+   written.swap(mUnsynced);
+   mLock.Unlock();
+
+   bool success = true;
+   for (size_t i = 0; i < written.size(); i++) {
+      if (!SyncFile(written[i])) {
+         wxLogDebug(wxT("Could not sync %s"), written[i].c_str());
+         success = false;
+      }
+   }
+   return success;
+}
+
+void SimpleBlockFileWriter::Quit()
+{
+   mLock.Lock();
+   mQuit = true;
+   mChanged.Broadcast();
+   SimpleBlockFileWriterThread *thread = mThread;
+   mThread = NULL;
+   mLock.Unlock();
+
+   if (thread) {
+      thread->Wait();
+      delete thread;
+   }
+}
+
+/// Run by the thread: write queued files, oldest first, until Quit()
+/// and the queue is empty.
+void SimpleBlockFileWriter::WriteEntries()
+{
+   mLock.Lock();
+   for (;;) {
+      while (mQueue.empty() && !mQuit)
+         mChanged.Wait();
+      if (mQueue.empty())
+         break;
+
+      // The entry stays queued, so reads are served from it, until the
+      // file is complete
+      Entry *entry = mQueue.front();
+      entry->writing = true;
+      mLock.Unlock();
+
+      bool written = Write(entry);
+
+      // Still queued, so the file can't have been renamed meanwhile.  A
+      // failure is reported by DirManager::FlushPendingWrites() on the
+      // GUI thread, since wx logging isn't safe here.
+      mLock.Lock();
+      if (written) {
+         mUnsynced.push_back(entry->block->GetFileName().GetFullPath());
+         Remove(entry);
+      }
+      else
+         Hold(entry);
+      mChanged.Broadcast();
+   }
+   mLock.Unlock();
+}
+
+// Writes the file of entry.  A failure is recorded in the block; the
+// project won't save while it refers to the block (see
+// DirManager::FlushPendingWrites).
+bool SimpleBlockFileWriter::Write(Entry *entry)
+{
+   bool bSuccess =
+      entry->block->WriteSimpleBlockFile(entry->sampleData, entry->len,
+                                         entry->format, entry->summaryData);
+   entry->block->mWriteFailed = !bSuccess;
+   return bSuccess;
+}
+
+/// Takes an entry whose write failed off the queue, but keeps its
+/// samples, so that reads are still served from them and Flush() can
+/// try again.  It no longer counts against the queue, which would stall
+/// every producer while the disk is full.  Call with mLock held.
+void SimpleBlockFileWriter::Hold(Entry *entry)
+{
+   for (EntryQueue::iterator it = mQueue.begin(); it != mQueue.end(); ++it)
+      if (*it == entry) {
+         mQueue.erase(it);
+         mQueuedBytes -= entry->bytes;
+         break;
+      }
+   entry->failed = true;
+   entry->writing = false;
+   mFailed.push_back(entry);
+}
+
+/// Takes an entry off the queue and frees it.  Call with mLock held.
+void SimpleBlockFileWriter::Remove(Entry *entry)
+{
+   for (EntryQueue::iterator it = mQueue.begin(); it != mQueue.end(); ++it)
+      if (*it == entry) {
+         mQueue.erase(it);
+         mQueuedBytes -= entry->bytes;
+         break;
+      }
+   if (entry->failed)
+      mFailed.erase(std::find(mFailed.begin(), mFailed.end(), entry));
+   mEntryMap.erase(entry->block);
+   entry->block->mWritePending = false;
+
+   FreeBuffer((char *)entry->sampleData);
+   FreeBuffer((char *)entry->summaryData);
+   delete entry;
+}
+
+/// Constructs a SimpleBlockFile based on sample data and queues it to
+/// be written to disk by SimpleBlockFileWriter.
 ///
 /// @param baseFileName The filename to use, but without an extension.
 ///                     This constructor will add the appropriate
@@ -102,13 +750,38 @@ SimpleBlockFile::SimpleBlockFile(wxFileName baseFileName,
    BlockFile(wxFileName(baseFileName.GetFullPath() + wxT(".au")), sampleLen)
 {
    mCache.active = false;
+   mDataInfo.valid = false;
+   mWritePending = false;
+   mWriteFailed = false;
+
+   // What WriteSimpleBlockFile() will write, so that the undo history
+   // needn't wait for the file to ask for its size.  24-bit samples are
+   // packed into 3 bytes.
+   int bytesPerSample = (format == int24Sample) ? 3 : SAMPLE_SIZE(format);
+   mSpaceUsage = wxLongLong(sizeof(auHeader) + mSummaryInfo.totalSummaryBytes) +
+                 wxLongLong(sampleLen) * bytesPerSample;
 
    bool useCache = GetCache() && (!bypassCache);
 
    if (!(allowDeferredWrite && useCache) && !bypassCache)
    {
-      bool bSuccess = WriteSimpleBlockFile(sampleData, sampleLen, format, NULL);
-      wxASSERT(bSuccess); // TODO: Handle failure here by alert to user and undo partial op.
+      // The summary is computed now, for mMin, mMax and mRMS; the file
+      // is written in the background from a copy of the samples.  The
+      // writer lends the buffers, so the audio thread needn't allocate.
+      SimpleBlockFileWriter *writer = SimpleBlockFileWriter::Instance();
+      char *summaryData = writer->NewBuffer(mSummaryInfo.totalSummaryBytes);
+      float *scratch = NULL;
+      if (format != floatSample)
+         scratch = (float *)writer->NewBuffer(sampleLen * sizeof(float));
+      CalcSummaryInto(summaryData, sampleData, sampleLen, format, scratch);
+      writer->FreeBuffer((char *)scratch);
+
+      size_t bytes = sampleLen * SAMPLE_SIZE(format);
+      samplePtr copy = (samplePtr)writer->NewBuffer(bytes);
+      memcpy(copy, sampleData, bytes);
+
+      mWritePending = true;
+      writer->Add(this, copy, format, summaryData);
    }
 
    if (useCache) {
@@ -116,14 +789,13 @@ SimpleBlockFile::SimpleBlockFile(wxFileName baseFileName,
       mCache.active = true;
       mCache.needWrite = true;
       mCache.format = format;
+      // The cache keeps its own copy and summary
+      CountWatchedAllocation();
       mCache.sampleData = new char[sampleLen * SAMPLE_SIZE(format)];
       memcpy(mCache.sampleData,
              sampleData, sampleLen * SAMPLE_SIZE(format));
-      void* summaryData = BlockFile::CalcSummary(sampleData, sampleLen,
-                                                format);
-      mCache.summaryData = new char[mSummaryInfo.totalSummaryBytes];
-      memcpy(mCache.summaryData, summaryData,
-             (size_t)mSummaryInfo.totalSummaryBytes);
+      mCache.summaryData = BlockFile::CalcSummary(sampleData, sampleLen,
+                                                  format);
     }
 }
 
@@ -140,10 +812,21 @@ SimpleBlockFile::SimpleBlockFile(wxFileName existingFile, sampleCount len,
    mRMS = rms;
 
    mCache.active = false;
+   mDataInfo.valid = false;
+   mWritePending = false;
+   mWriteFailed = false;
+   mSpaceUsage = -1;
 }
 
 SimpleBlockFile::~SimpleBlockFile()
 {
+   // No point writing a file that is about to be removed
+   if (mWritePending)
+      SimpleBlockFileWriter::Instance()->Cancel(this);
+
+   // BlockFile::~BlockFile may remove the file
+   SimpleBlockFileHandlePool::Instance()->Close(this);
+
    if (mCache.active)
    {
       delete[] mCache.sampleData;
@@ -157,6 +840,9 @@ bool SimpleBlockFile::WriteSimpleBlockFile(
     sampleFormat format,
     void* summaryData)
 {
+   SimpleBlockFileHandlePool::Instance()->Close(this);
+   InvalidateDataInfo();
+
    wxFFile file(mFileName.GetFullPath(), wxT("wb"));
    if( !file.IsOpened() ){
       // Can't do anything else.
@@ -200,14 +886,17 @@ bool SimpleBlockFile::WriteSimpleBlockFile(
    header.channels = 1;
 
    // Write the file
+   void *ownSummaryData = NULL;
    if (!summaryData)
-      summaryData = /*BlockFile::*/CalcSummary(sampleData, sampleLen, format); //mchinen:allowing virtual override of calc summary for ODDecodeBlockFile.
+      summaryData = ownSummaryData =
+         /*BlockFile::*/CalcSummary(sampleData, sampleLen, format); //mchinen:allowing virtual override of calc summary for ODDecodeBlockFile.
 
    size_t nBytesToWrite = sizeof(header);
    size_t nBytesWritten = file.Write(&header, nBytesToWrite);
    if (nBytesWritten != nBytesToWrite)
    {
       wxLogDebug(wxT("Wrote %d bytes, expected %d."), nBytesWritten, nBytesToWrite);
+      delete[] (char *)ownSummaryData;
       return false;
    }
 
@@ -216,6 +905,7 @@ bool SimpleBlockFile::WriteSimpleBlockFile(
    if (nBytesWritten != nBytesToWrite)
    {
       wxLogDebug(wxT("Wrote %d bytes, expected %d."), nBytesWritten, nBytesToWrite);
+      delete[] (char *)ownSummaryData;
       return false;
    }
 
@@ -238,6 +928,7 @@ bool SimpleBlockFile::WriteSimpleBlockFile(
          if (nBytesWritten != nBytesToWrite)
          {
             wxLogDebug(wxT("Wrote %d bytes, expected %d."), nBytesWritten, nBytesToWrite);
+            delete[] (char *)ownSummaryData;
             return false;
          }
       }
@@ -251,10 +942,13 @@ bool SimpleBlockFile::WriteSimpleBlockFile(
       if (nBytesWritten != nBytesToWrite)
       {
          wxLogDebug(wxT("Wrote %d bytes, expected %d."), nBytesWritten, nBytesToWrite);
+         delete[] (char *)ownSummaryData;
          return false;
       }
    }
 
+   delete[] (char *)ownSummaryData;
+
     return true;
 }
 
@@ -263,44 +957,24 @@ void SimpleBlockFile::FillCache()
    if (mCache.active)
       return; // cache is already filled
 
+   if (mWritePending)
+      SimpleBlockFileWriter::Instance()->Wait(this);
+
    // Check sample format
-   wxFFile file(mFileName.GetFullPath(), wxT("rb"));
-   if (!file.IsOpened())
+   SimpleBlockFileHandlePool *pool = SimpleBlockFileHandlePool::Instance();
+   SimpleBlockFileHandle *handle = pool->Acquire(this, mFileName.GetFullPath());
+   if (!handle)
    {
       // Don't read into cache if file not available
       return;
    }
 
-   auHeader header;
-
-   if (file.Read(&header, sizeof(header)) != sizeof(header))
-   {
-      // Corrupt file
-      return;
-   }
-
-   wxUint32 encoding;
-
-   if (header.magic == 0x2e736e64)
-      encoding = header.encoding; // correct endianness
-   else
-      encoding = SwapUintEndianess(header.encoding);
+   SimpleBlockFileDataInfo info;
+   bool gotInfo = GetDataInfo(handle->file, info);
+   pool->Release(this, handle);
 
-   switch (encoding)
-   {
-   case AU_SAMPLE_FORMAT_16:
-      mCache.format = int16Sample;
-      break;
-   case AU_SAMPLE_FORMAT_24:
-      mCache.format = int24Sample;
-      break;
-   default:
-      // floatSample is a safe default (we will never loose data)
-      mCache.format = floatSample;
-      break;
-   }
-
-   file.Close();
+   // floatSample is a safe default (we will never loose data)
+   mCache.format = gotInfo ? info.format : floatSample;
 
    // Read samples into cache
    mCache.sampleData = new char[mLen * SAMPLE_SIZE(mCache.format)];
@@ -323,12 +997,88 @@ void SimpleBlockFile::FillCache()
    //wxLogDebug("SimpleBlockFile::FillCache(): Succesfully read simple block file into cache.");
 }
 
+void SimpleBlockFile::SetFileName(wxFileName &name)
+{
+   if (mWritePending)
+      SimpleBlockFileWriter::Instance()->Wait(this);
+   SimpleBlockFileHandlePool::Instance()->Close(this);
+   BlockFile::SetFileName(name);
+}
+
+/// Parse the header of the block file, or return what an earlier call
+/// found.  Returns false if the file isn't one of the .au encodings we
+/// write ourselves, in which case libsndfile has to read it.
+bool SimpleBlockFile::GetDataInfo(wxFile &file, SimpleBlockFileDataInfo &info)
+{
+   mDataInfoMutex.Lock();
+   info = mDataInfo;
+   mDataInfoMutex.Unlock();
+   if (info.valid)
+      return true;
+
+   auHeader header;
+   if (ReadAt(file, 0, &header, sizeof(header)) != sizeof(header))
+      return false;
+
+   // AU files can be either big or little endian; the byte order of the
+   // magic tells which (see WriteSimpleBlockFile())
+   if (header.magic == 0x2e736e64)
+      info.swapBytes = false;
+   else if (SwapUintEndianess(header.magic) == 0x2e736e64)
+      info.swapBytes = true;
+   else
+      return false;
+
+   wxUint32 encoding = header.encoding;
+   info.dataOffset = header.dataOffset;
+   if (info.swapBytes) {
+      encoding = SwapUintEndianess(encoding);
+      info.dataOffset = SwapUintEndianess(info.dataOffset);
+   }
+
+   switch (encoding)
+   {
+   case AU_SAMPLE_FORMAT_16:
+      info.format = int16Sample;
+      break;
+   case AU_SAMPLE_FORMAT_24:
+      info.format = int24Sample;
+      break;
+   case AU_SAMPLE_FORMAT_FLOAT:
+      info.format = floatSample;
+      break;
+   default:
+      return false;
+   }
+
+   info.valid = true;
+
+   mDataInfoMutex.Lock();
+   mDataInfo = info;
+   mDataInfoMutex.Unlock();
+
+   return true;
+}
+
+void SimpleBlockFile::InvalidateDataInfo()
+{
+   mDataInfoMutex.Lock();
+   mDataInfo.valid = false;
+   mDataInfoMutex.Unlock();
+}
+
 /// Read the summary section of the disk file.
 ///
 /// @param *data The buffer to write the data to.  It must be at least
 /// mSummaryinfo.totalSummaryBytes long.
 bool SimpleBlockFile::ReadSummary(void *data)
 {
+   // A file not written yet is read from SimpleBlockFileWriter's queue
+   if (mWritePending &&
+       SimpleBlockFileWriter::Instance()->ReadSummary(this, data,
+                                                     mSummaryInfo.totalSummaryBytes))
+      return true;
+
    if (mCache.active)
    {
       //wxLogDebug("SimpleBlockFile::ReadSummary(): Summary is already in cache.");
@@ -338,12 +1088,13 @@ bool SimpleBlockFile::ReadSummary(void *data)
    {
       //wxLogDebug("SimpleBlockFile::ReadSummary(): Reading summary from disk.");
 
-      wxFFile file(mFileName.GetFullPath(), wxT("rb"));
-
       wxLogNull *silence=0;
       if(mSilentLog)silence= new wxLogNull();
 
-      if(!file.IsOpened() ){
+      SimpleBlockFileHandlePool *pool = SimpleBlockFileHandlePool::Instance();
+      SimpleBlockFileHandle *handle = pool->Acquire(this, mFileName.GetFullPath());
+
+      if(!handle){
 
          memset(data,0,(size_t)mSummaryInfo.totalSummaryBytes);
 
@@ -357,20 +1108,33 @@ bool SimpleBlockFile::ReadSummary(void *data)
       if(silence) delete silence;
       mSilentLog=FALSE;
 
-      // The offset is just past the au header
-      if( !file.Seek(sizeof(auHeader)) )
-         return false;
+      // The summary is just past the au header.  In files written before
+      // it gained its 1K, 4K and 16K levels, the samples begin after the
+      // 256 level, as the header's data offset tells.
+      size_t summaryBytes = (size_t)mSummaryInfo.totalSummaryBytes;
+      SimpleBlockFileDataInfo info;
+      if (GetDataInfo(handle->file, info) &&
+          info.dataOffset >= sizeof(auHeader) &&
+          info.dataOffset - sizeof(auHeader) < summaryBytes)
+         summaryBytes = info.dataOffset - sizeof(auHeader);
 
-      int read = (int)file.Read(data, (size_t)mSummaryInfo.totalSummaryBytes);
+      int read = (int)ReadAt(handle->file, sizeof(auHeader), data,
+                             summaryBytes);
+
+      pool->Release(this, handle);
 
       FixSummary(data);
 
-      return (read == mSummaryInfo.totalSummaryBytes);
+      return CompleteSummary(data, read);
    }
 }
 
-/// Read the data portion of the block file using libsndfile.  Convert it
-/// to the given format if it is not already.
+/// Read the data portion of the block file.  Convert it to the given
+/// format if it is not already.
+///
+/// Files in the encodings written by WriteSimpleBlockFile() are read
+/// directly with one positioned read; anything else goes through
+/// libsndfile.
 ///
 /// @param data   The buffer where the data will be stored
 /// @param format The format the data will be stored in
@@ -379,6 +1143,15 @@ bool SimpleBlockFile::ReadSummary(void *data)
 int SimpleBlockFile::ReadData(samplePtr data, sampleFormat format,
                         sampleCount start, sampleCount len)
 {
+   if (mWritePending) {
+      // A file not written yet is read from SimpleBlockFileWriter's queue
+      sampleCount queuedLen = (start >= mLen) ? 0 :
+                              (len > mLen - start) ? mLen - start : len;
+      if (SimpleBlockFileWriter::Instance()->ReadData(this, data, format,
+                                                      start, queuedLen))
+         return queuedLen;
+   }
+
    if (mCache.active)
    {
       //wxLogDebug("SimpleBlockFile::ReadData(): Data are already in cache.");
@@ -394,23 +1167,13 @@ int SimpleBlockFile::ReadData(samplePtr data, sampleFormat format,
    {
       //wxLogDebug("SimpleBlockFile::ReadData(): Reading data from disk.");
 
-      SF_INFO info;
       wxLogNull *silence=0;
       if(mSilentLog)silence= new wxLogNull();
 
-      memset(&info, 0, sizeof(info));
-
-      wxFile f;   // will be closed when it goes out of scope
-      SNDFILE *sf = NULL;
+      SimpleBlockFileHandlePool *pool = SimpleBlockFileHandlePool::Instance();
+      SimpleBlockFileHandle *handle = pool->Acquire(this, mFileName.GetFullPath());
 
-      if (f.Open(mFileName.GetFullPath())) {
-         // Even though there is an sf_open() that takes a filename, use the one that
-         // takes a file descriptor since wxWidgets can open a file with a Unicode name and
-         // libsndfile can't (under Windows).
-         sf = sf_open_fd(f.fd(), SFM_READ, &info, FALSE);
-      }
-
-      if (!sf) {
+      if (!handle) {
 
          memset(data,0,SAMPLE_SIZE(format)*len);
 
@@ -419,49 +1182,207 @@ int SimpleBlockFile::ReadData(samplePtr data, sampleFormat format,
 
          return len;
       }
+
+      SimpleBlockFileDataInfo info;
+      if (!GetDataInfo(handle->file, info)) {
+         int framesRead = ReadDataWithLibsndfile(handle->file, data, format, start, len);
+         pool->Release(this, handle);
+         if(silence) delete silence;
+         return framesRead;
+      }
       if(silence) delete silence;
       mSilentLog=FALSE;
 
-      sf_seek(sf, start, SEEK_SET);
-      samplePtr buffer = NewSamples(len, floatSample);
-
-      int framesRead = 0;
+      if (start >= mLen)
+         len = 0;
+      else if (len > mLen - start)
+         len = mLen - start;
 
-      // If both the src and dest formats are integer formats,
-      // read integers from the file (otherwise we would be
-      // converting to float and back, which is unneccesary)
-      if (format == int16Sample &&
-          sf_subtype_is_integer(info.format)) {
-         framesRead = sf_readf_short(sf, (short *)data, len);
+      int diskSize = SAMPLE_SIZE_DISK(info.format);
+
+      // Read straight into the caller's buffer when no conversion is needed
+      bool direct = (info.format == format && format != int24Sample);
+      samplePtr buffer = direct ? data : NewSamples(len, info.format);
+
+      size_t bytesRead =
+         ReadAt(handle->file, (wxFileOffset)info.dataOffset + (wxFileOffset)start * diskSize,
+                buffer, (size_t)len * diskSize);
+
+      pool->Release(this, handle);
+
+      int framesRead = (int)(bytesRead / diskSize);
+
+      if (info.format == int24Sample) {
+         // 24-bit samples are packed in three bytes on disk.  Unpack them
+         // in place from the end, sign extending to an int.
+         bool fileIsLittleEndian = (wxBYTE_ORDER == wxLITTLE_ENDIAN) != info.swapBytes;
+         unsigned char *packed = (unsigned char *)buffer;
+         int *unpacked = (int *)buffer;
+         for (int i = framesRead - 1; i >= 0; i--) {
+            unsigned char *p = packed + 3 * i;
+            int value = fileIsLittleEndian ?
+               (p[0] | (p[1] << 8) | (p[2] << 16)) :
+               ((p[0] << 16) | (p[1] << 8) | p[2]);
+            if (value & 0x00800000)
+               value |= 0xFF000000;
+            unpacked[i] = value;
+         }
       }
-      else
-      if (format == int24Sample &&
-          sf_subtype_is_integer(info.format))
-      {
-         framesRead = sf_readf_int(sf, (int *)data, len);
-
-         // libsndfile gave us the 3 byte sample in the 3 most
-         // significant bytes -- we want it in the 3 least
-         // significant bytes.
-         int *intPtr = (int *)data;
-         for( int i = 0; i < framesRead; i++ )
-            intPtr[i] = intPtr[i] >> 8;
+      else if (info.swapBytes) {
+         if (info.format == int16Sample) {
+            wxUint16 *p = (wxUint16 *)buffer;
+            for (int i = 0; i < framesRead; i++)
+               p[i] = wxUINT16_SWAP_ALWAYS(p[i]);
+         }
+         else {
+            wxUint32 *p = (wxUint32 *)buffer;
+            for (int i = 0; i < framesRead; i++)
+               p[i] = wxUINT32_SWAP_ALWAYS(p[i]);
+         }
       }
-      else {
-         // Otherwise, let libsndfile handle the conversion and
-         // scaling, and pass us normalized data as floats.  We can
-         // then convert to whatever format we want.
-         framesRead = sf_readf_float(sf, (float *)buffer, len);
-         CopySamples(buffer, floatSample,
-                     (samplePtr)data, format, framesRead);
+
+      if (!direct) {
+         // Integer to integer conversions never dithered when libsndfile
+         // did them, so keep it that way.
+         if (info.format == floatSample)
+            CopySamples(buffer, info.format, data, format, framesRead);
+         else
+            CopySamplesNoDither(buffer, info.format, data, format, framesRead);
+         DeleteSamples(buffer);
       }
 
-      DeleteSamples(buffer);
+      return framesRead;
+   }
+}
 
-      sf_close(sf);
+/// Read the data portion of the block file using libsndfile, for files
+/// whose header we don't handle ourselves.
+int SimpleBlockFile::ReadDataWithLibsndfile(wxFile &file, samplePtr data,
+                                            sampleFormat format,
+                                            sampleCount start, sampleCount len)
+{
+   SF_INFO info;
 
-      return framesRead;
+   memset(&info, 0, sizeof(info));
+
+   // Even though there is an sf_open() that takes a filename, use the one that
+   // takes a file descriptor since wxWidgets can open a file with a Unicode name and
+   // libsndfile can't (under Windows).
+   file.Seek(0);
+   SNDFILE *sf = sf_open_fd(file.fd(), SFM_READ, &info, FALSE);
+
+   if (!sf) {
+
+      memset(data,0,SAMPLE_SIZE(format)*len);
+
+      mSilentLog=TRUE;
+
+      return len;
+   }
+   mSilentLog=FALSE;
+
+   sf_seek(sf, start, SEEK_SET);
+   samplePtr buffer = NewSamples(len, floatSample);
+
+   int framesRead = 0;
+
+   // If both the src and dest formats are integer formats,
+   // read integers from the file (otherwise we would be
+   // converting to float and back, which is unneccesary)
+   if (format == int16Sample &&
+       sf_subtype_is_integer(info.format)) {
+      framesRead = sf_readf_short(sf, (short *)data, len);
    }
+   else
+   if (format == int24Sample &&
+       sf_subtype_is_integer(info.format))
+   {
+      framesRead = sf_readf_int(sf, (int *)data, len);
+
+      // libsndfile gave us the 3 byte sample in the 3 most
+      // significant bytes -- we want it in the 3 least
+      // significant bytes.
+      int *intPtr = (int *)data;
+      for( int i = 0; i < framesRead; i++ )
+         intPtr[i] = intPtr[i] >> 8;
+   }
+   else {
+      // Otherwise, let libsndfile handle the conversion and
+      // scaling, and pass us normalized data as floats.  We can
+      // then convert to whatever format we want.
+      framesRead = sf_readf_float(sf, (float *)buffer, len);
+      CopySamples(buffer, floatSample,
+                  (samplePtr)data, format, framesRead);
+   }
+
+   DeleteSamples(buffer);
+
+   sf_close(sf);
+
+   return framesRead;
+}
+
+/// Returns a pointer into the cached or memory-mapped samples, when they
+/// are stored in exactly the requested format and native byte order.
+/// 24-bit samples are packed on disk and can't be used in place.
+samplePtr SimpleBlockFile::GetDirectData(sampleFormat format,
+                                         sampleCount start, sampleCount len,
+                                         void **token)
+{
+   *token = NULL;
+
+   if (start < 0 || len < 0 || start + len > mLen)
+      return NULL;
+
+   // Not on disk yet; ReadData() copies from SimpleBlockFileWriter
+   if (mWritePending)
+      return NULL;
+
+   if (mCache.active) {
+      if (mCache.format != format)
+         return NULL;
+      return mCache.sampleData + start * SAMPLE_SIZE(format);
+   }
+
+   if (format != int16Sample && format != floatSample)
+      return NULL;
+
+   SimpleBlockFileHandlePool *pool = SimpleBlockFileHandlePool::Instance();
+   bool pooled = false;
+   SimpleBlockFileHandle *handle =
+      pool->Acquire(this, mFileName.GetFullPath(), &pooled);
+   if (!handle)
+      return NULL;
+
+   // Private handles are closed on Release(), so only the pooled one
+   // can keep a mapping alive until ReleaseDirectData().  The pool won't
+   // close it, nor let the file be rewritten, until then.
+   SimpleBlockFileDataInfo info;
+   const char *map = NULL;
+   size_t mapLength = 0;
+   if (pooled &&
+       GetDataInfo(handle->file, info) &&
+       info.format == format && !info.swapBytes)
+      map = handle->Map(&mapLength);
+
+   size_t offset = 0;
+   if (map)
+      offset = info.dataOffset + (size_t)start * SAMPLE_SIZE(format);
+   if (!map ||
+       offset + (size_t)len * SAMPLE_SIZE(format) > mapLength) {
+      pool->Release(this, handle);
+      return NULL;
+   }
+
+   *token = handle;
+   return (samplePtr)(map + offset);
+}
+
+void SimpleBlockFile::ReleaseDirectData(void *token)
+{
+   if (token)
+      SimpleBlockFileHandlePool::Instance()->Release(
+         this, (SimpleBlockFileHandle *)token);
 }
 
 void SimpleBlockFile::SaveXML(XMLWriter &xmlFile)
@@ -539,16 +1460,25 @@ wxLongLong SimpleBlockFile::GetSpaceUsage()
 {
    if (mCache.active && mCache.needWrite)
    {
-      // We don't know space usage yet
+      // Not on disk yet
       return 0;
-   } else
+   }
+
+   if (mSpaceUsage < 0)
    {
       wxFFile dataFile(mFileName.GetFullPath());
-      return dataFile.Length();
+      mSpaceUsage = dataFile.Length();
    }
+   return mSpaceUsage;
 }
 
 void SimpleBlockFile::Recover(){
+   if (mWritePending)
+      SimpleBlockFileWriter::Instance()->Wait(this);
+   SimpleBlockFileHandlePool::Instance()->Close(this);
+   InvalidateDataInfo();
+   mSpaceUsage = -1;
+
    wxFFile file(mFileName.GetFullPath(), wxT("wb"));
    int i;
 
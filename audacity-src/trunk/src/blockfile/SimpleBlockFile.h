@@ -11,12 +11,22 @@
 #ifndef __AUDACITY_SIMPLE_BLOCKFILE__
 #define __AUDACITY_SIMPLE_BLOCKFILE__
 
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
+
 #include <wx/string.h>
 #include <wx/filename.h>
 
 #include "../BlockFile.h"
 #include "../DirManager.h"
 #include "../xml/XMLWriter.h"
+#include "../ondemand/ODTaskThread.h"
+
+class wxFile;
+class SimpleBlockFile;
+class SimpleBlockFileWriterThread;
 
 struct SimpleBlockFileCache {
    bool active;
@@ -42,6 +52,173 @@ typedef struct {
    wxUint32 channels;   // number of interleaved channels
 } auHeader;
 
+/// Where the samples of a SimpleBlockFile live on disk, parsed once from
+/// its auHeader so that later reads don't need to look at the header again.
+struct SimpleBlockFileDataInfo {
+   bool valid;
+   wxUint32 dataOffset;   // byte offset of the first sample
+   sampleFormat format;   // sample format matching the on-disk encoding
+   bool swapBytes;        // written on a machine with the other byte order
+};
+
+/// An open SimpleBlockFile, optionally mapped into memory.
+class SimpleBlockFileHandle {
+ public:
+   SimpleBlockFileHandle();
+   ~SimpleBlockFileHandle();
+
+   bool Open(const wxString &fullPath);
+
+   /// Maps the whole file read-only on first use.  Returns NULL if the
+   /// file can't be mapped.
+   const char *Map(size_t *length);
+
+   wxFile file;
+
+ private:
+   char *mMap;
+   size_t mMapLength;
+#ifdef __WXMSW__
+   void *mMapping;
+#endif
+};
+
+/// A bounded, least-recently-used set of open SimpleBlockFile handles.
+///
+/// Scrolling and playback read the same blocks over and over, and opening
+/// the file and parsing its header for every read dominated the cost of
+/// Sequence::Get.  The pool keeps up to a fixed number of files open and
+/// hands each one to a single reader at a time.
+class SimpleBlockFileHandlePool {
+ public:
+   SimpleBlockFileHandlePool();
+   ~SimpleBlockFileHandlePool();
+
+   static SimpleBlockFileHandlePool *Instance();
+
+   /// Returns an open handle for the given block, or NULL if the file
+   /// can't be opened.  Must be given back with Release().  If pooled is
+   /// not NULL, it tells whether the handle belongs to the pool; private
+   /// handles are handed out while another reader holds the pooled one.
+   SimpleBlockFileHandle *Acquire(const BlockFile *owner,
+                                  const wxString &fullPath,
+                                  bool *pooled = NULL);
+   void Release(const BlockFile *owner, SimpleBlockFileHandle *handle);
+
+   /// Closes the pooled handle of a block, if any, unmapping the file.
+   /// Must be called before the block's file is renamed, rewritten or
+   /// removed.  If a reader holds the handle, waits until it is released,
+   /// since truncating a mapped file would fault the reader's copy.
+   void Close(const BlockFile *owner);
+   void CloseAll();
+
+ private:
+   struct Entry {
+      const BlockFile *owner;
+      SimpleBlockFileHandle *handle;
+      bool inUse;
+   };
+   typedef std::list<Entry> EntryList;
+   typedef std::map<const BlockFile *, EntryList::iterator> EntryMap;
+
+   void Trim();
+
+   EntryList mEntries; // most recently used first
+   EntryMap mEntryMap;
+   int mMaxOpen;
+   ODLock mLock;
+   ODCondition mReleased;
+};
+
+/// Writes the files of new SimpleBlockFiles on a background thread.
+///
+/// A new block used to write its file before its constructor returned,
+/// so effects and recording waited on the disk for every block.  Now it
+/// computes its summary, queues a copy of its samples here and returns;
+/// until the file is written, its reads are served from that copy.  The
+/// queue holds a bounded number of bytes, so a producer that outruns
+/// the disk waits in Add().  Anything that is about to use the files
+/// themselves -- saving, auto-recovery, moving or copying them -- must
+/// call Wait() or Flush() first.
+class SimpleBlockFileWriter {
+ public:
+   SimpleBlockFileWriter();
+   ~SimpleBlockFileWriter();
+
+   static SimpleBlockFileWriter *Instance();
+
+   /// Queues the file of block to be written.  Takes ownership of
+   /// sampleData and summaryData, which must come from NewBuffer().
+   void Add(SimpleBlockFile *block, samplePtr sampleData,
+            sampleFormat format, void *summaryData);
+
+   /// Returns a buffer of at least bytes bytes, reusing one that
+   /// FreeBuffer() kept if it can, so that recording a block doesn't
+   /// allocate once the writer has handed back buffers of its size.
+   char *NewBuffer(size_t bytes);
+   void FreeBuffer(char *buffer);
+
+   /// If the file of block is still queued, copies from the queued data
+   /// and returns true; otherwise returns false and the file can be read.
+   bool ReadData(const BlockFile *block, samplePtr data, sampleFormat format,
+                 sampleCount start, sampleCount len);
+   bool ReadSummary(const BlockFile *block, void *data, int bytes);
+
+   /// Waits until the file of block is written, if it is queued.  If
+   /// the write failed, returns at once; the samples stay in memory, and
+   /// the write is tried again under the file name the block has then.
+   void Wait(const BlockFile *block);
+   /// Drops the write of block if it hasn't started, else waits for it
+   void Cancel(const BlockFile *block);
+   /// Waits until every file queued before the call is written, tries
+   /// the failed writes again, then syncs the files written since the
+   /// last Flush() to the disk.  Files other threads queue meanwhile
+   /// aren't waited for.  Returns false if a file could not be synced; a
+   /// write that still fails is recorded in its block instead (see
+   /// SimpleBlockFile::GetWriteFailed()).
+   bool Flush();
+   /// Writes what is queued and stops the thread.  Later blocks are
+   /// written synchronously.
+   void Quit();
+
+ private:
+   friend class SimpleBlockFileWriterThread;
+
+   struct Entry {
+      SimpleBlockFile *block;
+      samplePtr sampleData;
+      sampleCount len;
+      sampleFormat format;
+      void *summaryData;
+      int bytes;
+      bool writing;
+      bool failed;          // held in mFailed for another try
+      wxLongLong_t serial;  // order of Add()
+   };
+   typedef std::deque<Entry *> EntryQueue;
+   typedef std::map<const BlockFile *, Entry *> EntryMap;
+
+   void WriteEntries();
+   static bool Write(Entry *entry);
+   void Hold(Entry *entry);
+   void Remove(Entry *entry);
+
+   EntryQueue mQueue; // oldest first; the front one may be being written
+   std::vector<Entry *> mFailed; // not counted in mQueuedBytes
+   EntryMap mEntryMap;
+   int mQueuedBytes;
+   wxLongLong_t mNextSerial;
+   std::vector<wxString> mUnsynced; // written since the last Flush()
+   bool mQuit;
+   SimpleBlockFileWriterThread *mThread;
+   ODLock mLock;
+   ODCondition mChanged;
+
+   std::vector<char *> mFreeBuffers;
+   size_t mFreeBytes;
+   ODLock mBufferLock; // guards the free buffers; never wait for mLock
+};
+
 class SimpleBlockFile : public BlockFile {
  public:
 
@@ -67,6 +244,11 @@ class SimpleBlockFile : public BlockFile {
    virtual int ReadData(samplePtr data, sampleFormat format,
                         sampleCount start, sampleCount len);
 
+   virtual samplePtr GetDirectData(sampleFormat format,
+                                   sampleCount start, sampleCount len,
+                                   void **token);
+   virtual void ReleaseDirectData(void *token);
+
    /// Create a new block file identical to this one
    virtual BlockFile *Copy(wxFileName newFileName);
    /// Write an XML representation of this file
@@ -80,9 +262,13 @@ class SimpleBlockFile : public BlockFile {
    virtual bool GetNeedWriteCacheToDisk();
    virtual void WriteCacheToDisk();
 
+   virtual bool GetWriteFailed() { return mWriteFailed; }
+
    virtual bool GetNeedFillCache() { return !mCache.active; }
    virtual void FillCache();
 
+   virtual void SetFileName(wxFileName &name);
+
  protected:
 
    bool WriteSimpleBlockFile(samplePtr sampleData, sampleCount sampleLen,
@@ -90,7 +276,26 @@ class SimpleBlockFile : public BlockFile {
    static bool GetCache();
    void ReadIntoCache();
 
+   bool GetDataInfo(wxFile &file, SimpleBlockFileDataInfo &info);
+   void InvalidateDataInfo();
+   int ReadDataWithLibsndfile(wxFile &file, samplePtr data,
+                              sampleFormat format,
+                              sampleCount start, sampleCount len);
+
    SimpleBlockFileCache mCache;
+
+   /// Set while SimpleBlockFileWriter has yet to write the file
+   volatile bool mWritePending;
+   /// Set by SimpleBlockFileWriter while the file could not be written;
+   /// its samples are held in memory until a retry succeeds
+   volatile bool mWriteFailed;
+   /// Size of the file; known from the start for a file we write, and
+   /// -1 for an existing one until GetSpaceUsage() looks at it
+   wxLongLong mSpaceUsage;
+   friend class SimpleBlockFileWriter;
+
+   SimpleBlockFileDataInfo mDataInfo;
+   ODLock mDataInfoMutex;
 };
 
 #endif
@@ -30,6 +30,7 @@
 #include <wx/list.h>
 #include <wx/listimpl.cpp>
 #include <limits>
+#include <vector>
 #include <math.h>
 
 #include "../Experimental.h"
@@ -160,8 +161,8 @@ bool EffectTruncSilence::Process()
       sampleCount start = wt->TimeToLongSamples(mT0);
       sampleCount end = wt->TimeToLongSamples(mT1);
 
-      // Allocate buffer
-      float *buffer = new float[blockLen];
+      // Quiet runs of the current block
+      std::vector<sampleCount> runs;
 
       sampleCount index = start;
       sampleCount silentFrames = 0;
@@ -215,34 +216,37 @@ bool EffectTruncSilence::Process()
             count = end - index;
          }
 
-         // Fill buffer
-         wt->Get((samplePtr)(buffer), floatSample, index, count);
-
-         // Look for silences in current block
-         for (sampleCount i = 0; i < count; ++i) {
-            if (fabs(buffer[i]) < truncDbSilenceThreshold) {
-               ++silentFrames;
-            }
-            else {
+         // Look for silences in current block.  The block summaries
+         // tell us most of this without reading the samples.
+         runs.clear();
+         wt->GetQuietRuns(index, count, truncDbSilenceThreshold,
+                          minSilenceFrames, runs);
+
+         sampleCount pos = index;
+         for (size_t i = 0; i <= runs.size(); i += 2) {
+            sampleCount loud = (i < runs.size()) ? runs[i] : index + count;
+            if (loud > pos) {
+               // The sample at loud ends the current silence
                if (silentFrames >= minSilenceFrames)
                {
                   // Record the silent region
                   Region *r = new Region;
-                  r->start = wt->LongSamplesToTime(index + i - silentFrames);
-                  r->end = wt->LongSamplesToTime(index + i);
+                  r->start = wt->LongSamplesToTime(pos - silentFrames);
+                  r->end = wt->LongSamplesToTime(pos);
                   trackSilences.push_back(r);
                }
                silentFrames = 0;
             }
+            if (i < runs.size()) {
+               silentFrames += runs[i + 1] - runs[i];
+               pos = runs[i + 1];
+            }
          }
 
          // Next block
          index += count;
       }
 
-      delete [] buffer;
-
-      // Buffer has been freed, so we're OK to return if cancelled
       if (cancelled)
       {
          ReplaceProcessedTracks(false);
@@ -26,6 +26,12 @@
 \class ExportMixerPanel
 \brief Panel that displays mixing for advanced mixing option.
 
+*//****************************************************************//**
+
+\class ExportMixer
+\brief Mixes for an ExportPlugin on an ExportMixerThread, ahead of the
+encoder, through a ring of EXPORT_MIXER_BUFFERS ExportMixerBuffers.
+
 *//********************************************************************/
 
 // For compilers that support precompilation, includes "wx/wx.h".
@@ -74,6 +80,7 @@
 #include "../AColor.h"
 #include "../TimeTrack.h"
 #include "../Dependencies.h"
+#include "../ondemand/ODTaskThread.h"
 
 // Callback to display format options
 static void ExportCallback(void *cbdata, int index)
@@ -254,6 +261,51 @@ int ExportPlugin::Export(AudacityProject *project,
   return DoExport(project, channels, fName, selectedOnly, t0, t1, mixerSpec, subformat);
 }
 
+bool ExportPlugin::CanCreateJob(int WXUNUSED(subformat))
+{
+   return false;
+}
+
+ExportJob *ExportPlugin::CreateJob(AudacityProject * WXUNUSED(project),
+                                   int WXUNUSED(channels),
+                                   wxString WXUNUSED(fName),
+                                   bool WXUNUSED(selectedOnly),
+                                   double WXUNUSED(t0),
+                                   double WXUNUSED(t1),
+                                   MixerSpec * WXUNUSED(mixerSpec),
+                                   Tags * WXUNUSED(metadata),
+                                   int WXUNUSED(subformat))
+{
+   return NULL;
+}
+
+int ExportPlugin::RunJob(ExportJob *job)
+{
+   if (!job)
+      return false;
+
+   int updateResult = eProgressSuccess;
+
+   ProgressDialog *progress = new ProgressDialog(
+      wxFileName(job->GetFileName()).GetName(), job->GetMessage());
+
+   while (updateResult == eProgressSuccess && !job->Failed() && job->Encode())
+      updateResult = progress->Update(job->GetDone(), job->GetDuration());
+
+   delete progress;
+
+   job->Finish();
+
+   if (job->Failed()) {
+      wxMessageBox(job->GetError());
+      updateResult = eProgressFailed;
+   }
+
+   delete job;
+
+   return updateResult;
+}
+
 int ExportPlugin::DoExport(AudacityProject * WXUNUSED(project),
                             int WXUNUSED(channels),
                             wxString WXUNUSED(fName),
@@ -267,7 +319,7 @@ int ExportPlugin::DoExport(AudacityProject * WXUNUSED(project),
 }
 
 //Create a mixer by computing the time warp factor
-Mixer* ExportPlugin::CreateMixer(int numInputTracks, WaveTrack **inputTracks,
+ExportMixer* ExportPlugin::CreateMixer(int numInputTracks, WaveTrack **inputTracks,
          TimeTrack *timeTrack,
          double startTime, double stopTime,
          int numOutChannels, int outBufferSize, bool outInterleaved,
@@ -275,13 +327,232 @@ Mixer* ExportPlugin::CreateMixer(int numInputTracks, WaveTrack **inputTracks,
          bool highQuality, MixerSpec *mixerSpec)
 {
    // MB: the stop time should not be warped, this was a bug.
-   return new Mixer(numInputTracks, inputTracks,
+   Mixer *mixer = new Mixer(numInputTracks, inputTracks,
                   timeTrack,
                   startTime, stopTime,
                   numOutChannels, outBufferSize, outInterleaved,
                   outRate, outFormat,
                   highQuality, mixerSpec);
+
+   return new ExportMixer(mixer, numOutChannels, outBufferSize,
+                          outInterleaved, outFormat);
+}
+
+//----------------------------------------------------------------------------
+// ExportMixer
+//----------------------------------------------------------------------------
+
+// How many buffers the mixer may be ahead of the encoder, counting the
+// one the encoder is reading
+#define EXPORT_MIXER_BUFFERS 3
+
+class ExportMixerBuffer
+{
+public:
+   samplePtr *buffers;
+   sampleCount len;
+   double time;    // of the mixer after making this buffer
+};
+
+class ExportMixerThread : public wxThread
+{
+public:
+   ExportMixerThread(ExportMixer *mixer)
+      : wxThread(wxTHREAD_JOINABLE)
+   {
+      mMixer = mixer;
+   }
+
+   virtual void *Entry()
+   {
+      mMixer->MixAhead();
+      return NULL;
+   }
+
+private:
+   ExportMixer *mMixer;
+};
+
+ExportMixer::ExportMixer(Mixer *mixer, int numChannels, int bufferSize,
+                         bool interleaved, sampleFormat format)
+   : mChanged(&mLock)
+{
+   mMixer = mixer;
+   mNumChannels = numChannels;
+   mNumBuffers = interleaved ? 1 : numChannels;
+   mBufferSize = bufferSize;
+   mFormat = format;
+
+   int samplesPerBuffer = interleaved ? bufferSize * numChannels : bufferSize;
+   mBuffers = new ExportMixerBuffer[EXPORT_MIXER_BUFFERS];
+   for (int i = 0; i < EXPORT_MIXER_BUFFERS; i++) {
+      mBuffers[i].buffers = new samplePtr[mNumBuffers];
+      for (int c = 0; c < mNumBuffers; c++)
+         mBuffers[i].buffers[c] = NewSamples(samplesPerBuffer, format);
+      mBuffers[i].len = 0;
+      mBuffers[i].time = 0.0;
+   }
+   mNumFilled = 0;
+   mRead = 0;
+   mHolding = false;
+   mFinished = false;
+   mStopping = false;
+   mTime = mixer->MixGetCurrentTime();
+
+   mThread = new ExportMixerThread(this);
+   if (mThread->Create() != wxTHREAD_NO_ERROR ||
+       mThread->Run() != wxTHREAD_NO_ERROR) {
+      // Nothing will be mixed, so Process() mustn't wait for it
+      delete mThread;
+      mThread = NULL;
+      mFinished = true;
+   }
+}
+
+ExportMixer::~ExportMixer()
+{
+   // The exporter may stop early, as when it is cancelled
+   mLock.Lock();
+   mStopping = true;
+   mChanged.Broadcast();
+   mLock.Unlock();
+
+   if (mThread) {
+      mThread->Wait();
+      delete mThread;
+   }
+   delete mMixer;
+
+   for (int i = 0; i < EXPORT_MIXER_BUFFERS; i++) {
+      for (int c = 0; c < mNumBuffers; c++)
+         DeleteSamples(mBuffers[i].buffers[c]);
+      delete[] mBuffers[i].buffers;
+   }
+   delete[] mBuffers;
+}
+
+void ExportMixer::MixAhead()
+{
+   int write = 0;
+
+   for (;;) {
+      mLock.Lock();
+      while (mNumFilled == EXPORT_MIXER_BUFFERS && !mStopping)
+         mChanged.Wait();
+      bool stopping = mStopping;
+      mLock.Unlock();
+      if (stopping)
+         break;
+
+      // No other thread looks at this buffer until it is counted in
+      // mNumFilled
+      ExportMixerBuffer &buffer = mBuffers[write];
+      buffer.len = mMixer->Process(mBufferSize);
+      buffer.time = mMixer->MixGetCurrentTime();
+      if (mNumBuffers == 1)
+         CopySamples(mMixer->GetBuffer(), mFormat,
+                     buffer.buffers[0], mFormat,
+                     buffer.len * mNumChannels);
+      else {
+         for (int c = 0; c < mNumBuffers; c++)
+            CopySamples(mMixer->GetBuffer(c), mFormat,
+                        buffer.buffers[c], mFormat, buffer.len);
+      }
+
+      mLock.Lock();
+      if (buffer.len == 0)
+         mFinished = true;
+      else
+         mNumFilled++;
+      mChanged.Broadcast();
+      mLock.Unlock();
+
+      if (buffer.len == 0)
+         break;
+      write = (write + 1) % EXPORT_MIXER_BUFFERS;
+   }
+}
+
+sampleCount ExportMixer::Process(sampleCount maxSamples)
+{
+   // The buffers are all mixed at the size the mixer was made with
+   wxASSERT(maxSamples == mBufferSize);
+   (void)maxSamples;
+
+   mLock.Lock();
+
+   // The buffer given out last time is done with
+   if (mHolding) {
+      mHolding = false;
+      mNumFilled--;
+      mRead = (mRead + 1) % EXPORT_MIXER_BUFFERS;
+      mChanged.Broadcast();
+   }
+
+   while (mNumFilled == 0 && !mFinished)
+      mChanged.Wait();
+
+   sampleCount len = 0;
+   if (mNumFilled > 0) {
+      mHolding = true;
+      len = mBuffers[mRead].len;
+      mTime = mBuffers[mRead].time;
+   }
+   mLock.Unlock();
+
+   return len;
+}
+
+double ExportMixer::MixGetCurrentTime()
+{
+   return mTime;
+}
+
+samplePtr ExportMixer::GetBuffer()
+{
+   return mBuffers[mRead].buffers[0];
 }
+
+samplePtr ExportMixer::GetBuffer(int channel)
+{
+   return mBuffers[mRead].buffers[channel];
+}
+
+// static
+wxString ExportMixer::GetError()
+{
+   return _("Audacity could not start a thread to mix the audio for export.");
+}
+
+//----------------------------------------------------------------------------
+// ExportJob
+//----------------------------------------------------------------------------
+
+ExportJob::ExportJob(const wxString &fName, double t0, double t1)
+{
+   mMixer = NULL;
+   mFileName = fName;
+   mT0 = t0;
+   mT1 = t1;
+}
+
+ExportJob::~ExportJob()
+{
+   delete mMixer;
+}
+
+void ExportJob::SetMixer(ExportMixer *mixer)
+{
+   mMixer = mixer;
+   if (mixer && mixer->Failed())
+      mError = ExportMixer::GetError();
+}
+
+double ExportJob::GetDone()
+{
+   return mMixer ? mMixer->MixGetCurrentTime() - mT0 : 0.0;
+}
+
 //----------------------------------------------------------------------------
 // Export
 //----------------------------------------------------------------------------
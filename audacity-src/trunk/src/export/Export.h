@@ -17,6 +17,7 @@
 #include <wx/panel.h>
 #include "../Tags.h"
 #include "../SampleFormat.h"
+#include "../ondemand/ODTaskThread.h"
 
 class wxMemoryDC;
 class wxStaticText;
@@ -28,6 +29,8 @@ class MixerSpec;
 class FileDialog;
 class TimeTrack;
 class Mixer;
+class ExportMixerThread;
+class ExportMixerBuffer;
 
 class AUDACITY_DLL_API FormatInfo
 {
@@ -45,6 +48,100 @@ class AUDACITY_DLL_API FormatInfo
 
 WX_DECLARE_USER_EXPORTED_OBJARRAY(FormatInfo, FormatInfoArray, AUDACITY_DLL_API);
 
+//----------------------------------------------------------------------------
+// ExportMixer
+//----------------------------------------------------------------------------
+/// Runs a Mixer on a thread of its own, a few buffers ahead of the
+/// exporter reading from it, so that mixing, resampling and dithering
+/// overlap with encoding.  It is used like the Mixer: Process() must be
+/// asked for the buffer size the mixer was made with, and the buffers
+/// stay valid until the next call.
+class AUDACITY_DLL_API ExportMixer
+{
+public:
+   /// Takes over mixer, which makes numChannels channels of bufferSize
+   /// samples in format
+   ExportMixer(Mixer *mixer, int numChannels, int bufferSize,
+               bool interleaved, sampleFormat format);
+   ~ExportMixer();
+
+   sampleCount Process(sampleCount maxSamples);
+   double MixGetCurrentTime();
+   samplePtr GetBuffer();
+   samplePtr GetBuffer(int channel);
+
+   /// Whether the mixing thread couldn't be started; then Process()
+   /// returns nothing and the export must fail with GetError()
+   bool Failed() { return mThread == NULL; }
+   static wxString GetError();
+
+private:
+   friend class ExportMixerThread;
+
+   /// Body of the mixing thread
+   void MixAhead();
+
+   Mixer *mMixer;
+   ExportMixerThread *mThread;
+   int mNumChannels;
+   int mNumBuffers;        // per ExportMixerBuffer: 1 if interleaved
+   int mBufferSize;
+   sampleFormat mFormat;
+
+   ODLock mLock;
+   ODCondition mChanged;   // both threads wait on this for the other
+   ExportMixerBuffer *mBuffers;
+   int mNumFilled;         // mixed and not yet released by Process()
+   int mRead;              // the buffer Process() gave out, if mHolding
+   bool mHolding;
+   bool mFinished;         // the mixer has nothing more
+   bool mStopping;
+   double mTime;
+};
+
+//----------------------------------------------------------------------------
+// ExportJob
+//----------------------------------------------------------------------------
+/// The encoding half of one export.  An ExportPlugin makes it on the GUI
+/// thread, asking the user and reading the preferences as it must, and
+/// opening the file; after that it touches neither, so it can be run on
+/// any thread, and several can run at once.
+class AUDACITY_DLL_API ExportJob
+{
+public:
+   ExportJob(const wxString &fName, double t0, double t1);
+   /// Deletes the mixer
+   virtual ~ExportJob();
+
+   /// Encodes another buffer of the mix.  Returns false when the mix is
+   /// done, or on an error, which is then set in mError.
+   virtual bool Encode() = 0;
+   /// Completes and closes the file.  Called once after the last Encode(),
+   /// even if the export was cancelled.
+   virtual void Finish() = 0;
+
+   wxString GetFileName() { return mFileName; }
+   /// What a progress dialog for this export says
+   wxString GetMessage() { return mMessage; }
+   /// How much of GetDuration() has been encoded
+   double GetDone();
+   double GetDuration() { return mT1 - mT0; }
+   bool Failed() { return !mError.IsEmpty(); }
+   wxString GetError() { return mError; }
+
+   /// Takes over mixer; the job fails if the mixer did
+   void SetMixer(ExportMixer *mixer);
+   void SetMessage(const wxString &message) { mMessage = message; }
+
+protected:
+   ExportMixer *mMixer;
+   wxString mFileName;
+   wxString mMessage;
+   wxString mError;
+   double mT0;
+   double mT1;
+};
+
 //----------------------------------------------------------------------------
 // ExportPlugin
 //----------------------------------------------------------------------------
@@ -117,8 +214,29 @@ public:
                          MixerSpec *mixerSpec,
                          int subformat);
 
+   /// Whether CreateJob() can make jobs for the sub-format
+   virtual bool CanCreateJob(int subformat = 0);
+
+   /** \brief Does the part of Export() that must be done on the GUI thread,
+    * and returns the job that does the rest, which the caller runs and
+    * deletes.  Returns NULL, having told the user why, if the export can't
+    * be done.  Arguments are as for Export(). */
+   virtual ExportJob *CreateJob(AudacityProject *project,
+                                int channels,
+                                wxString fName,
+                                bool selectedOnly,
+                                double t0,
+                                double t1,
+                                MixerSpec *mixerSpec = NULL,
+                                Tags *metadata = NULL,
+                                int subformat = 0);
+
 protected:
-   Mixer* CreateMixer(int numInputTracks, WaveTrack **inputTracks,
+   /// Export() for plug-ins that make jobs: runs job under a progress
+   /// dialog, then deletes it
+   int RunJob(ExportJob *job);
+
+   ExportMixer* CreateMixer(int numInputTracks, WaveTrack **inputTracks,
          TimeTrack *timeTrack,
          double startTime, double stopTime,
          int numOutChannels, int outBufferSize, bool outInterleaved,
@@ -408,7 +408,7 @@ int ExportCL::Export(AudacityProject *project,
    WaveTrack **waveTracks;
    TrackList *tracks = project->GetTracks();
    tracks->GetWaveTracks(selectionOnly, &numWaveTracks, &waveTracks);
-   Mixer *mixer = CreateMixer(numWaveTracks,
+   ExportMixer *mixer = CreateMixer(numWaveTracks,
                             waveTracks,
                             tracks->GetTimeTrack(),
                             t0,
@@ -478,6 +478,11 @@ int ExportCL::Export(AudacityProject *project,
    // Done with the progress display
    delete progress;
 
+   if (mixer->Failed()) {
+      wxMessageBox(ExportMixer::GetError());
+      updateResult = eProgressFailed;
+   }
+
    // Should make the process die
    p->CloseOutput();
 
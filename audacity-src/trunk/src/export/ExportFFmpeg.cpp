@@ -806,7 +806,7 @@ int ExportFFmpeg::Export(AudacityProject *project,
    int numWaveTracks;
    WaveTrack **waveTracks;
    tracks->GetWaveTracks(selectionOnly, &numWaveTracks, &waveTracks);
-   Mixer *mixer = CreateMixer(numWaveTracks, waveTracks,
+   ExportMixer *mixer = CreateMixer(numWaveTracks, waveTracks,
       tracks->GetTimeTrack(),
       t0, t1,
       channels, pcmBufferSize, true,
@@ -835,6 +835,11 @@ int ExportFFmpeg::Export(AudacityProject *project,
 
    delete progress;
 
+   if (mixer->Failed()) {
+      wxMessageBox(ExportMixer::GetError());
+      updateResult = eProgressFailed;
+   }
+
    delete mixer;
 
    Finalize();
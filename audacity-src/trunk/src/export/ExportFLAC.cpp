@@ -168,6 +168,24 @@ static struct
 
 //----------------------------------------------------------------------------
 
+class ExportFLACJob : public ExportJob
+{
+public:
+   ExportFLACJob(const wxString &fName, double t0, double t1, int numChannels);
+   virtual ~ExportFLACJob();
+
+   bool Encode();
+   void Finish();
+
+   FLAC::Encoder::File encoder;
+#ifndef LEGACY_FLAC
+   wxFFile f;
+#endif
+   int numChannels;
+   sampleFormat format;
+   FLAC__int32 **tmpsmplbuf;
+};
+
 class ExportFLAC : public ExportPlugin
 {
 public:
@@ -188,6 +206,17 @@ public:
                Tags *metadata = NULL,
                int subformat = 0);
 
+   bool CanCreateJob(int subformat = 0);
+   ExportJob *CreateJob(AudacityProject *project,
+                        int channels,
+                        wxString fName,
+                        bool selectedOnly,
+                        double t0,
+                        double t1,
+                        MixerSpec *mixerSpec = NULL,
+                        Tags *metadata = NULL,
+                        int subformat = 0);
+
 private:
 
    bool GetMetadata(AudacityProject *project, Tags *tags);
@@ -221,13 +250,31 @@ int ExportFLAC::Export(AudacityProject *project,
                         double t1,
                         MixerSpec *mixerSpec,
                         Tags *metadata,
-                        int WXUNUSED(subformat))
+                        int subformat)
+{
+   return RunJob(CreateJob(project, numChannels, fName, selectionOnly,
+                           t0, t1, mixerSpec, metadata, subformat));
+}
+
+bool ExportFLAC::CanCreateJob(int WXUNUSED(subformat))
+{
+   return true;
+}
+
+ExportJob *ExportFLAC::CreateJob(AudacityProject *project,
+                                 int numChannels,
+                                 wxString fName,
+                                 bool selectionOnly,
+                                 double t0,
+                                 double t1,
+                                 MixerSpec *mixerSpec,
+                                 Tags *metadata,
+                                 int WXUNUSED(subformat))
 {
    double    rate    = project->GetRate();
    TrackList *tracks = project->GetTracks();
 
    wxLogNull logNo;            // temporarily disable wxWidgets error messages
-   int updateResult = eProgressSuccess;
 
    int levelPref;
    gPrefs->Read(wxT("/FileFormats/FLACLevel"), &levelPref, 5);
@@ -235,7 +282,8 @@ int ExportFLAC::Export(AudacityProject *project,
    wxString bitDepthPref =
       gPrefs->Read(wxT("/FileFormats/FLACBitDepth"), wxT("16"));
 
-   FLAC::Encoder::File encoder;
+   ExportFLACJob *job = new ExportFLACJob(fName, t0, t1, numChannels);
+   FLAC::Encoder::File &encoder = job->encoder;
 
 #ifdef LEGACY_FLAC
    encoder.set_filename(OSOUTPUT(fName));
@@ -245,19 +293,19 @@ int ExportFLAC::Export(AudacityProject *project,
 
    // See note in GetMetadata() about a bug in libflac++ 1.1.2
    if (!GetMetadata(project, metadata)) {
-      return false;
+      delete job;
+      return NULL;
    }
 
    if (mMetadata) {
       encoder.set_metadata(&mMetadata, 1);
    }
 
-   sampleFormat format;
    if (bitDepthPref == wxT("24")) {
-      format = int24Sample;
+      job->format = int24Sample;
       encoder.set_bits_per_sample(24);
    } else { //convert float to 16 bits
-      format = int16Sample;
+      job->format = int16Sample;
       encoder.set_bits_per_sample(16);
    }
 
@@ -284,19 +332,21 @@ int ExportFLAC::Export(AudacityProject *project,
 #ifdef LEGACY_FLAC
    encoder.init();
 #else
-   wxFFile f;     // will be closed when it goes out of scope
-   if (!f.Open(fName, wxT("w+b"))) {
+   // will be closed when the job is deleted
+   if (!job->f.Open(fName, wxT("w+b"))) {
       wxMessageBox(wxString::Format(_("FLAC export couldn't open %s"), fName.c_str()));
-      return false;
+      delete job;
+      return NULL;
    }
 
    // Even though there is an init() method that takes a filename, use the one that
    // takes a file handle because wxWidgets can open a file with a Unicode name and
    // libflac can't (under Windows).
-   int status = encoder.init(f.fp());
+   int status = encoder.init(job->f.fp());
    if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
       wxMessageBox(wxString::Format(_("FLAC encoder failed to initialize\nStatus: %d"), status));
-      return false;
+      delete job;
+      return NULL;
    }
 #endif
 
@@ -307,60 +357,18 @@ int ExportFLAC::Export(AudacityProject *project,
    int numWaveTracks;
    WaveTrack **waveTracks;
    tracks->GetWaveTracks(selectionOnly, &numWaveTracks, &waveTracks);
-   Mixer *mixer = CreateMixer(numWaveTracks, waveTracks,
-                            tracks->GetTimeTrack(),
-                            t0, t1,
-                            numChannels, SAMPLES_PER_RUN, false,
-                            rate, format, true, mixerSpec);
+   job->SetMixer(CreateMixer(numWaveTracks, waveTracks,
+                             tracks->GetTimeTrack(),
+                             t0, t1,
+                             numChannels, SAMPLES_PER_RUN, false,
+                             rate, job->format, true, mixerSpec));
    delete [] waveTracks;
 
-   int i, j;
-   FLAC__int32 **tmpsmplbuf = new FLAC__int32*[numChannels];
-   for (i = 0; i < numChannels; i++) {
-      tmpsmplbuf[i] = (FLAC__int32 *) calloc(SAMPLES_PER_RUN, sizeof(FLAC__int32));
-   }
-
-   ProgressDialog *progress = new ProgressDialog(wxFileName(fName).GetName(),
-         selectionOnly ?
+   job->SetMessage(selectionOnly ?
          _("Exporting the selected audio as FLAC") :
          _("Exporting the entire project as FLAC"));
 
-   while (updateResult == eProgressSuccess) {
-      sampleCount samplesThisRun = mixer->Process(SAMPLES_PER_RUN);
-      if (samplesThisRun == 0) { //stop encoding
-         break;
-      }
-      else {
-         for (i = 0; i < numChannels; i++) {
-            samplePtr mixed = mixer->GetBuffer(i);
-            if (format == int24Sample) {
-               for (j = 0; j < samplesThisRun; j++) {
-                  tmpsmplbuf[i][j] = ((int *) mixed)[j];
-               }
-            }
-            else {
-               for (j = 0; j < samplesThisRun; j++) {
-                  tmpsmplbuf[i][j] = ((short *) mixed)[j];
-               }
-            }
-         }
-         encoder.process(tmpsmplbuf, samplesThisRun);
-      }
-      updateResult = progress->Update(mixer->MixGetCurrentTime()-t0, t1-t0);
-   }
-   f.Detach(); // libflac closes the file
-   encoder.finish();
-
-   delete progress;
-
-   for (i = 0; i < numChannels; i++) {
-      free(tmpsmplbuf[i]);
-   }
-   delete mixer;
-
-   delete[] tmpsmplbuf;
-
-   return updateResult;
+   return job;
 }
 
 bool ExportFLAC::DisplayOptions(wxWindow *parent, int WXUNUSED(format))
@@ -401,6 +409,64 @@ bool ExportFLAC::GetMetadata(AudacityProject *project, Tags *tags)
    return true;
 }
 
+//----------------------------------------------------------------------------
+// ExportFLACJob
+//----------------------------------------------------------------------------
+
+ExportFLACJob::ExportFLACJob(const wxString &fName, double t0, double t1,
+                             int numChannels)
+:  ExportJob(fName, t0, t1)
+{
+   this->numChannels = numChannels;
+   format = int16Sample;
+   tmpsmplbuf = new FLAC__int32*[numChannels];
+   for (int i = 0; i < numChannels; i++) {
+      tmpsmplbuf[i] = (FLAC__int32 *) calloc(SAMPLES_PER_RUN, sizeof(FLAC__int32));
+   }
+}
+
+ExportFLACJob::~ExportFLACJob()
+{
+   for (int i = 0; i < numChannels; i++) {
+      free(tmpsmplbuf[i]);
+   }
+   delete[] tmpsmplbuf;
+}
+
+bool ExportFLACJob::Encode()
+{
+   int i, j;
+   sampleCount samplesThisRun = mMixer->Process(SAMPLES_PER_RUN);
+   if (samplesThisRun == 0) { //stop encoding
+      return false;
+   }
+
+   for (i = 0; i < numChannels; i++) {
+      samplePtr mixed = mMixer->GetBuffer(i);
+      if (format == int24Sample) {
+         for (j = 0; j < samplesThisRun; j++) {
+            tmpsmplbuf[i][j] = ((int *) mixed)[j];
+         }
+      }
+      else {
+         for (j = 0; j < samplesThisRun; j++) {
+            tmpsmplbuf[i][j] = ((short *) mixed)[j];
+         }
+      }
+   }
+   encoder.process(tmpsmplbuf, samplesThisRun);
+
+   return true;
+}
+
+void ExportFLACJob::Finish()
+{
+#ifndef LEGACY_FLAC
+   f.Detach(); // libflac closes the file
+#endif
+   encoder.finish();
+}
+
 ExportPlugin *New_ExportFLAC()
 {
    return new ExportFLAC();
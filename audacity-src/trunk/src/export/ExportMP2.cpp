@@ -267,7 +267,7 @@ int ExportMP2::Export(AudacityProject *project,
    int numWaveTracks;
    WaveTrack **waveTracks;
    tracks->GetWaveTracks(selectionOnly, &numWaveTracks, &waveTracks);
-   Mixer *mixer = CreateMixer(numWaveTracks, waveTracks,
+   ExportMixer *mixer = CreateMixer(numWaveTracks, waveTracks,
                             tracks->GetTimeTrack(),
                             t0, t1,
                             stereo? 2: 1, pcmBufferSize, true,
@@ -302,6 +302,11 @@ int ExportMP2::Export(AudacityProject *project,
 
    delete progress;
 
+   if (mixer->Failed()) {
+      wxMessageBox(ExportMixer::GetError());
+      updateResult = eProgressFailed;
+   }
+
    delete mixer;
 
    int mp2BufferNumBytes = twolame_encode_flush(
@@ -1546,6 +1546,26 @@ static void dump_config( 	lame_global_flags*	gfp )
 // ExportMP3
 //----------------------------------------------------------------------------
 
+class ExportMP3Job : public ExportJob
+{
+public:
+   ExportMP3Job(const wxString &fName, double t0, double t1, int channels);
+   virtual ~ExportMP3Job();
+
+   bool Encode();
+   void Finish();
+
+   MP3Exporter exporter;
+   wxFFile outFile;
+   int channels;
+   sampleCount inSamples;
+   unsigned char *buffer;
+   char *id3buffer;
+   int id3len;
+   bool endOfFile;
+   wxFileOffset pos;
+};
+
 class ExportMP3 : public ExportPlugin
 {
 public:
@@ -1566,6 +1586,17 @@ public:
                Tags *metadata = NULL,
                int subformat = 0);
 
+   bool CanCreateJob(int subformat = 0);
+   ExportJob *CreateJob(AudacityProject *project,
+                        int channels,
+                        wxString fName,
+                        bool selectedOnly,
+                        double t0,
+                        double t1,
+                        MixerSpec *mixerSpec = NULL,
+                        Tags *metadata = NULL,
+                        int subformat = 0);
+
 private:
 
    int FindValue(CHOICES *choices, int cnt, int needle, int def);
@@ -1602,14 +1633,34 @@ int ExportMP3::Export(AudacityProject *project,
                        double t1,
                        MixerSpec *mixerSpec,
                        Tags *metadata,
-                       int WXUNUSED(subformat))
+                       int subformat)
+{
+   return RunJob(CreateJob(project, channels, fName, selectionOnly,
+                           t0, t1, mixerSpec, metadata, subformat));
+}
+
+bool ExportMP3::CanCreateJob(int WXUNUSED(subformat))
+{
+   return true;
+}
+
+ExportJob *ExportMP3::CreateJob(AudacityProject *project,
+                                int channels,
+                                wxString fName,
+                                bool selectionOnly,
+                                double t0,
+                                double t1,
+                                MixerSpec *mixerSpec,
+                                Tags *metadata,
+                                int WXUNUSED(subformat))
 {
    int rate = lrint(project->GetRate());
 #ifndef DISABLE_DYNAMIC_LOADING_LAME
    wxWindow *parent = project;
 #endif // DISABLE_DYNAMIC_LOADING_LAME
    TrackList *tracks = project->GetTracks();
-   MP3Exporter exporter;
+   ExportMP3Job *job = new ExportMP3Job(fName, t0, t1, channels);
+   MP3Exporter &exporter = job->exporter;
 
 #ifdef DISABLE_DYNAMIC_LOADING_LAME
    if (!exporter.InitLibrary(wxT(""))) {
@@ -1617,7 +1668,8 @@ int ExportMP3::Export(AudacityProject *project,
       gPrefs->Write(wxT("/MP3/MP3LibPath"), wxString(wxT("")));
       gPrefs->Flush();
 
-      return false;
+      delete job;
+      return NULL;
    }
 #else
    if (!exporter.LoadLibrary(parent, MP3Exporter::Maybe)) {
@@ -1625,7 +1677,8 @@ int ExportMP3::Export(AudacityProject *project,
       gPrefs->Write(wxT("/MP3/MP3LibPath"), wxString(wxT("")));
       gPrefs->Flush();
 
-      return false;
+      delete job;
+      return NULL;
    }
 
    if (!exporter.ValidLibraryLoaded()) {
@@ -1633,7 +1686,8 @@ int ExportMP3::Export(AudacityProject *project,
       gPrefs->Write(wxT("/MP3/MP3LibPath"), wxString(wxT("")));
       gPrefs->Flush();
 
-      return false;
+      delete job;
+      return NULL;
    }
 #endif // DISABLE_DYNAMIC_LOADING_LAME
 
@@ -1694,7 +1748,8 @@ int ExportMP3::Export(AudacityProject *project,
       (rate < lowrate) || (rate > highrate)) {
       rate = AskResample(bitrate, rate, lowrate, highrate);
       if (rate == 0) {
-         return false;
+         delete job;
+         return NULL;
       }
    }
 
@@ -1706,10 +1761,11 @@ int ExportMP3::Export(AudacityProject *project,
       exporter.SetChannel(CHANNEL_STEREO);
    }
 
-   sampleCount inSamples = exporter.InitializeStream(channels, rate);
-   if (((int)inSamples) < 0) {
+   job->inSamples = exporter.InitializeStream(channels, rate);
+   if (((int)job->inSamples) < 0) {
       wxMessageBox(_("Unable to initialize MP3 stream"));
-      return false;
+      delete job;
+      return NULL;
    }
 
    // Put ID3 tags at beginning of file
@@ -1717,36 +1773,31 @@ int ExportMP3::Export(AudacityProject *project,
       metadata = project->GetTags();
 
    // Open file for writing
-   wxFFile outFile(fName, wxT("w+b"));
-   if (!outFile.IsOpened()) {
+   if (!job->outFile.Open(fName, wxT("w+b"))) {
       wxMessageBox(_("Unable to open target file for writing"));
-      return false;
+      delete job;
+      return NULL;
    }
 
-   char *id3buffer = NULL;
-   int id3len;
-   bool endOfFile;
-   id3len = AddTags(project, &id3buffer, &endOfFile, metadata);
-   if (id3len && !endOfFile) {
-     outFile.Write(id3buffer, id3len);
+   job->id3len = AddTags(project, &job->id3buffer, &job->endOfFile, metadata);
+   if (job->id3len && !job->endOfFile) {
+     job->outFile.Write(job->id3buffer, job->id3len);
    }
 
-   wxFileOffset pos = outFile.Tell();
-   int updateResult = eProgressSuccess;
-   long bytes;
+   job->pos = job->outFile.Tell();
 
    int bufferSize = exporter.GetOutBufferSize();
-   unsigned char *buffer = new unsigned char[bufferSize];
-   wxASSERT(buffer);
+   job->buffer = new unsigned char[bufferSize];
+   wxASSERT(job->buffer);
 
    int numWaveTracks;
    WaveTrack **waveTracks;
    tracks->GetWaveTracks(selectionOnly, &numWaveTracks, &waveTracks);
-   Mixer *mixer = CreateMixer(numWaveTracks, waveTracks,
-                            tracks->GetTimeTrack(),
-                            t0, t1,
-                            channels, inSamples, true,
-                            rate, int16Sample, true, mixerSpec);
+   job->SetMixer(CreateMixer(numWaveTracks, waveTracks,
+                             tracks->GetTimeTrack(),
+                             t0, t1,
+                             channels, job->inSamples, true,
+                             rate, int16Sample, true, mixerSpec));
    delete [] waveTracks;
 
    wxString title;
@@ -1769,79 +1820,9 @@ int ExportMP3::Export(AudacityProject *project,
                    brate);
    }
 
-   ProgressDialog *progress = new ProgressDialog(wxFileName(fName).GetName(), title);
-
-   while (updateResult == eProgressSuccess) {
-      sampleCount blockLen = mixer->Process(inSamples);
+   job->SetMessage(title);
 
-      if (blockLen == 0) {
-         break;
-      }
-
-      short *mixed = (short *)mixer->GetBuffer();
-
-      if (blockLen < inSamples) {
-         if (channels > 1) {
-            bytes = exporter.EncodeRemainder(mixed,  blockLen , buffer);
-         }
-         else {
-            bytes = exporter.EncodeRemainderMono(mixed,  blockLen , buffer);
-         }
-      }
-      else {
-         if (channels > 1) {
-            bytes = exporter.EncodeBuffer(mixed, buffer);
-         }
-         else {
-            bytes = exporter.EncodeBufferMono(mixed, buffer);
-         }
-      }
-
-      if (bytes < 0) {
-         wxString msg;
-         msg.Printf(_("Error %d returned from MP3 encoder"), bytes);
-         wxMessageBox(msg);
-         break;
-      }
-
-      outFile.Write(buffer, bytes);
-
-      updateResult = progress->Update(mixer->MixGetCurrentTime()-t0, t1-t0);
-   }
-
-   delete progress;
-
-   delete mixer;
-
-   bytes = exporter.FinishStream(buffer);
-
-   if (bytes) {
-      outFile.Write(buffer, bytes);
-   }
-
-   // Write ID3 tag if it was supposed to be at the end of the file
-   if (id3len && endOfFile) {
-      outFile.Write(id3buffer, id3len);
-   }
-
-   if (id3buffer) {
-      free(id3buffer);
-   }
-
-   // Always write the info (Xing/Lame) tag.  Until we stop supporting Lame
-   // versions before 3.98, we must do this after the MP3 file has been
-   // closed.
-   //
-   // Also, if beWriteInfoTag() is used, mGF will no longer be valid after
-   // this call, so do not use it.
-   exporter.PutInfoTag(outFile, pos);
-
-   // Close the file
-   outFile.Close();
-
-   delete [] buffer;
-
-   return updateResult;
+   return job;
 }
 
 bool ExportMP3::DisplayOptions(wxWindow *parent, int WXUNUSED(format))
@@ -2053,6 +2034,95 @@ void ExportMP3::AddFrame(struct id3_tag *tp, const wxString & n, const wxString
 }
 #endif
 
+//----------------------------------------------------------------------------
+// ExportMP3Job
+//----------------------------------------------------------------------------
+
+ExportMP3Job::ExportMP3Job(const wxString &fName, double t0, double t1,
+                           int channels)
+:  ExportJob(fName, t0, t1)
+{
+   this->channels = channels;
+   inSamples = 0;
+   buffer = NULL;
+   id3buffer = NULL;
+   id3len = 0;
+   endOfFile = false;
+   pos = 0;
+}
+
+ExportMP3Job::~ExportMP3Job()
+{
+   if (id3buffer) {
+      free(id3buffer);
+   }
+
+   delete [] buffer;
+}
+
+bool ExportMP3Job::Encode()
+{
+   long bytes;
+   sampleCount blockLen = mMixer->Process(inSamples);
+
+   if (blockLen == 0) {
+      return false;
+   }
+
+   short *mixed = (short *)mMixer->GetBuffer();
+
+   if (blockLen < inSamples) {
+      if (channels > 1) {
+         bytes = exporter.EncodeRemainder(mixed,  blockLen , buffer);
+      }
+      else {
+         bytes = exporter.EncodeRemainderMono(mixed,  blockLen , buffer);
+      }
+   }
+   else {
+      if (channels > 1) {
+         bytes = exporter.EncodeBuffer(mixed, buffer);
+      }
+      else {
+         bytes = exporter.EncodeBufferMono(mixed, buffer);
+      }
+   }
+
+   if (bytes < 0) {
+      mError.Printf(_("Error %d returned from MP3 encoder"), bytes);
+      return false;
+   }
+
+   outFile.Write(buffer, bytes);
+
+   return true;
+}
+
+void ExportMP3Job::Finish()
+{
+   long bytes = exporter.FinishStream(buffer);
+
+   if (bytes) {
+      outFile.Write(buffer, bytes);
+   }
+
+   // Write ID3 tag if it was supposed to be at the end of the file
+   if (id3len && endOfFile) {
+      outFile.Write(id3buffer, id3len);
+   }
+
+   // Always write the info (Xing/Lame) tag.  Until we stop supporting Lame
+   // versions before 3.98, we must do this after the MP3 file has been
+   // closed.
+   //
+   // Also, if beWriteInfoTag() is used, mGF will no longer be valid after
+   // this call, so do not use it.
+   exporter.PutInfoTag(outFile, pos);
+
+   // Close the file
+   outFile.Close();
+}
+
 ExportPlugin *New_ExportMP3()
 {
    return new ExportMP3();
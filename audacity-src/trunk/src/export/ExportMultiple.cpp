@@ -36,6 +36,7 @@
 #include <wx/stattext.h>
 #include <wx/textctrl.h>
 #include <wx/textdlg.h>
+#include <wx/utils.h>
 
 #include "Export.h"
 #include "ExportMultiple.h"
@@ -610,6 +611,9 @@ int ExportMultiple::ExportMultipleByLabel(bool byName,
    wxArrayString otherNames;  // keep track of file names we will use, so we
                               // don't duplicate them
    ExportKit setting;   // the current batch of settings
+   setting.channels = channels;
+   setting.track = NULL;
+   setting.linked = NULL;
    setting.destfile.SetPath(mDir->GetValue());
    setting.destfile.SetExt(mPlugins[mPluginIndex]->GetExtension(mSubFormatIndex));
    wxLogDebug(wxT("Plug-in index = %d, Sub-format = %d"), mPluginIndex, mSubFormatIndex);
@@ -685,23 +689,9 @@ int ExportMultiple::ExportMultipleByLabel(bool byName,
       l++;  // next label, count up one
    }
 
-   int ok = eProgressSuccess;   // did it work?
-   int count = 0; // count the number of sucessful runs
-   ExportKit activeSetting;  // pointer to the settings in use for this export
    /* Go round again and do the exporting (so this run is slow but
     * non-interactive) */
-   for (count = 0; count < numFiles; count++) {
-      /* get the settings to use for the export from the array */
-      activeSetting = exportSettings[count];
-
-      // Export it
-      ok = DoExport(channels, activeSetting.destfile, false, activeSetting.t0, activeSetting.t1, activeSetting.filetags);
-      if (ok != eProgressSuccess && ok != eProgressStopped) {
-         break;
-      }
-   }
-
-   return ok;
+   return DoExports(exportSettings, false);
 }
 
 int ExportMultiple::ExportMultipleByTrack(bool byName,
@@ -770,6 +760,9 @@ int ExportMultiple::ExportMultipleByTrack(bool byName,
          }
       }
 
+      setting.track = tr;
+      setting.linked = tr2;
+
       // number of export channels?
       // Needs to be per track.
       if (tr2 == NULL && tr->GetChannel() == WaveTrack::MonoChannel &&
@@ -822,48 +815,7 @@ int ExportMultiple::ExportMultipleByTrack(bool byName,
       l++;  // next track, count up one
    }
    // end of user-interactive data gathering loop, start of export processing
-   // loop
-   int count = 0; // count the number of sucessful runs
-   ExportKit activeSetting;  // pointer to the settings in use for this export
-   for (tr = mIterator.First(mTracks); tr != NULL; tr = mIterator.Next()) {
-
-      // Want only non-muted wave tracks.
-      if ((tr->GetKind() != Track::Wave) || (tr->GetMute() == true)) {
-         continue;
-      }
-
-      /* Select the track */
-      tr->SetSelected(true);
-
-      // Check for a linked track
-      tr2 = NULL;
-      if (tr->GetLinked()) {
-         tr2 = mIterator.Next();
-         if (tr2) {
-            // Select it also
-            tr2->SetSelected(true);
-         }
-      }
-
-      /* get the settings to use for the export from the array */
-      activeSetting = exportSettings[count];
-      // Export the data. "channels" are per track.
-      ok = DoExport(activeSetting.channels, activeSetting.destfile, true, activeSetting.t0, activeSetting.t1, activeSetting.filetags);
-
-      // Reset selection state
-      tr->SetSelected(false);
-      if (tr2) {
-         tr2->SetSelected(false);
-      }
-
-      // Stop if an error occurred
-      if (ok != eProgressSuccess && ok != eProgressStopped) {
-         break;
-      }
-      // increment export counter
-      count++;
-
-   }
+   ok = DoExports(exportSettings, true);
 
    // Restore the selection states
    for (size_t i = 0; i < mSelected.GetCount(); i++) {
@@ -885,18 +837,8 @@ int ExportMultiple::DoExport(int channels,
    if (selectedOnly) wxLogDebug(wxT("Selected Region Only"));
    else wxLogDebug(wxT("Whole Project"));
 
-   if (mOverwrite->GetValue()) {
-      // Make sure we don't overwrite (corrupt) alias files
-      if (!mProject->GetDirManager()->EnsureSafeFilename(name)) {
-         return false;
-      }
-   }
-   else {
-      int i = 2;
-      wxString base(name.GetName());
-      while (name.FileExists()) {
-         name.SetName(wxString::Format(wxT("%s-%d"), base.c_str(), i++));
-      }
+   if (!PrepareFileName(name)) {
+      return false;
    }
 
    // Call the format export routine
@@ -917,6 +859,306 @@ int ExportMultiple::DoExport(int channels,
    return success;
 }
 
+int ExportMultiple::DoExports(ExportKitArray &exportSettings, bool selectedOnly)
+{
+   // 0 means one export per processor, 1 exports one file at a time
+   int numThreads = gPrefs->Read(wxT("/Export/Threads"), 0L);
+   if (numThreads <= 0)
+      numThreads = wxThread::GetCPUCount();
+   if (numThreads > (int)exportSettings.GetCount())
+      numThreads = exportSettings.GetCount();
+
+   if (numThreads > 1 && mPlugins[mPluginIndex]->CanCreateJob(mSubFormatIndex))
+      return DoExportJobs(exportSettings, selectedOnly, numThreads);
+
+   int ok = eProgressSuccess;
+   for (size_t i = 0; i < exportSettings.GetCount(); i++) {
+      ExportKit &kit = exportSettings[i];
+
+      // Select the tracks to export
+      if (kit.track) {
+         kit.track->SetSelected(true);
+         if (kit.linked)
+            kit.linked->SetSelected(true);
+      }
+
+      ok = DoExport(kit.channels, kit.destfile, selectedOnly, kit.t0, kit.t1, kit.filetags);
+
+      // Reset selection state
+      if (kit.track) {
+         kit.track->SetSelected(false);
+         if (kit.linked)
+            kit.linked->SetSelected(false);
+      }
+
+      // Stop if an error occurred
+      if (ok != eProgressSuccess && ok != eProgressStopped) {
+         break;
+      }
+   }
+
+   return ok;
+}
+
+/// Runs one ExportJob to its end, or until it is stopped
+class ExportJobThread : public wxThread
+{
+public:
+   ExportJobThread(ExportJob *job, int kit)
+      : wxThread(wxTHREAD_JOINABLE)
+   {
+      mJob = job;
+      mKit = kit;
+      mDone = 0.0;
+      mStop = false;
+      mStopped = false;
+      mFinished = false;
+   }
+
+   virtual void *Entry()
+   {
+      bool more = true;
+      while (more) {
+         mLock.Lock();
+         bool stop = mStop;
+         mLock.Unlock();
+         if (stop)
+            break;
+
+         more = mJob->Encode();
+
+         double done = mJob->GetDone();
+         mLock.Lock();
+         mDone = done;
+         mLock.Unlock();
+      }
+
+      mJob->Finish();
+
+      mLock.Lock();
+      mStopped = more;
+      mFinished = true;
+      mLock.Unlock();
+      return NULL;
+   }
+
+   ExportJob *GetJob() { return mJob; }
+   int GetKit() { return mKit; }
+
+   double GetDone()
+   {
+      mLock.Lock();
+      double done = mDone;
+      mLock.Unlock();
+      return done;
+   }
+
+   void Stop()
+   {
+      mLock.Lock();
+      mStop = true;
+      mLock.Unlock();
+   }
+
+   /// Whether Entry() is done; then Wait() won't block
+   bool IsFinished()
+   {
+      mLock.Lock();
+      bool finished = mFinished;
+      mLock.Unlock();
+      return finished;
+   }
+
+   /// Whether the job was stopped before it was done
+   bool WasStopped()
+   {
+      mLock.Lock();
+      bool stopped = mStopped;
+      mLock.Unlock();
+      return stopped;
+   }
+
+private:
+   ExportJob *mJob;
+   int mKit;
+   ODLock mLock;
+   double mDone;
+   bool mStop;
+   bool mStopped;
+   bool mFinished;
+};
+
+int ExportMultiple::DoExportJobs(ExportKitArray &exportSettings,
+                                 bool selectedOnly, int numThreads)
+{
+   ExportPlugin *plugin = mPlugins[mPluginIndex];
+   int numFiles = exportSettings.GetCount();
+   int i;
+
+   double total = 0.0;
+   for (i = 0; i < numFiles; i++)
+      total += exportSettings[i].t1 - exportSettings[i].t0;
+
+   ExportJobThread **threads = new ExportJobThread*[numThreads];
+   for (i = 0; i < numThreads; i++)
+      threads[i] = NULL;
+   bool *exported = new bool[numFiles];
+   for (i = 0; i < numFiles; i++)
+      exported[i] = false;
+
+   ProgressDialog *progress = new ProgressDialog(_("Export Multiple"),
+      wxString::Format(_("Exporting %d files, %d at a time"),
+                       numFiles, numThreads));
+
+   int ok = eProgressSuccess;
+   int next = 0;         // the next kit to start
+   int running = 0;
+   double finished = 0.0;  // the length of the exports that are over
+
+   while (running > 0 || (ok == eProgressSuccess && next < numFiles)) {
+      double done = finished;
+
+      for (i = 0; i < numThreads; i++) {
+         ExportJobThread *thread = threads[i];
+
+         // Collect a job that is over
+         if (thread && thread->IsFinished()) {
+            thread->Wait();
+
+            ExportJob *job = thread->GetJob();
+            if (job->Failed()) {
+               if (ok == eProgressSuccess || ok == eProgressStopped) {
+                  wxMessageBox(job->GetError());
+                  ok = eProgressFailed;
+               }
+            }
+            // A stopped file is kept, as when exporting one at a time
+            else if (!thread->WasStopped() || ok == eProgressStopped) {
+               exported[thread->GetKit()] = true;
+            }
+            finished += job->GetDuration();
+            done += job->GetDuration();
+
+            delete job;
+            delete thread;
+            threads[i] = thread = NULL;
+            running--;
+         }
+
+         // Start the next one.  The plug-in may ask the user things and
+         // reads the tracks and preferences, so that is done here.
+         if (!thread && ok == eProgressSuccess && next < numFiles) {
+            ExportKit &kit = exportSettings[next];
+
+            ExportJob *job = NULL;
+            wxFileName name = kit.destfile;
+            if (PrepareFileName(name)) {
+               if (kit.track) {
+                  kit.track->SetSelected(true);
+                  if (kit.linked)
+                     kit.linked->SetSelected(true);
+               }
+
+               job = plugin->CreateJob(mProject, kit.channels,
+                                       name.GetFullPath(), selectedOnly,
+                                       kit.t0, kit.t1, NULL, &kit.filetags,
+                                       mSubFormatIndex);
+
+               if (kit.track) {
+                  kit.track->SetSelected(false);
+                  if (kit.linked)
+                     kit.linked->SetSelected(false);
+               }
+            }
+
+            // A job that failed already, or whose thread can't be
+            // started, never runs
+            wxString error;
+            if (job && job->Failed())
+               error = job->GetError();
+            else if (job) {
+               thread = new ExportJobThread(job, next);
+               if (thread->Create() != wxTHREAD_NO_ERROR ||
+                   thread->Run() != wxTHREAD_NO_ERROR) {
+                  delete thread;
+                  thread = NULL;
+                  error = wxString::Format(
+                     _("Audacity could not start a thread to export \"%s\"."),
+                     name.GetFullPath().c_str());
+               }
+            }
+
+            if (!error.IsEmpty()) {
+               job->Finish();
+               delete job;
+               job = NULL;
+               wxMessageBox(error);
+            }
+
+            if (!job) {
+               ok = eProgressFailed;
+            }
+            else {
+               // Files are listed under the names they were given
+               kit.destfile = name;
+               threads[i] = thread;
+               running++;
+               next++;
+            }
+         }
+
+         if (thread)
+            done += thread->GetDone();
+      }
+
+      if (ok == eProgressSuccess) {
+         ok = progress->Update(done, total);
+      }
+
+      // Cancelled, stopped or failed: whatever is running can stop
+      if (ok != eProgressSuccess) {
+         for (i = 0; i < numThreads; i++) {
+            if (threads[i])
+               threads[i]->Stop();
+         }
+      }
+
+      if (running > 0)
+         wxMilliSleep(50);
+   }
+
+   delete progress;
+
+   for (i = 0; i < numFiles; i++) {
+      if (exported[i])
+         mExported.Add(exportSettings[i].destfile.GetFullPath());
+   }
+
+   delete[] exported;
+   delete[] threads;
+
+   return ok;
+}
+
+bool ExportMultiple::PrepareFileName(wxFileName &name)
+{
+   if (mOverwrite->GetValue()) {
+      // Make sure we don't overwrite (corrupt) alias files
+      if (!mProject->GetDirManager()->EnsureSafeFilename(name)) {
+         return false;
+      }
+   }
+   else {
+      int i = 2;
+      wxString base(name.GetName());
+      while (name.FileExists()) {
+         name.SetName(wxString::Format(wxT("%s-%d"), base.c_str(), i++));
+      }
+   }
+
+   return true;
+}
+
 wxString ExportMultiple::MakeFileName(wxString input)
 {
    wxString newname; // name we are generating
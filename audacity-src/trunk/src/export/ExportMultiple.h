@@ -28,6 +28,7 @@ class wxTextCtrl;
 
 class AudacityProject;
 class ShuttleGui;
+class ExportKitArray;
 
 class ExportMultiple : public wxDialog
 {
@@ -78,6 +79,24 @@ private:
                  double t0,
                  double t1,
                  Tags tags);
+
+   /** \brief Export the files described by exportSettings
+    *
+    * One after another through DoExport(), or, if the plug-in can make
+    * ExportJob s, several at a time through DoExportJobs().
+    * @param selectedOnly Export only the tracks of each kit, which are
+    * selected in turn */
+   int DoExports(ExportKitArray &exportSettings, bool selectedOnly);
+
+   /** \brief Export the files described by exportSettings, running up to
+    * numThreads jobs at once, with one progress dialog for them all */
+   int DoExportJobs(ExportKitArray &exportSettings, bool selectedOnly,
+                    int numThreads);
+
+   /** \brief Settle the name of one file of the set before exporting it,
+    * making it unique unless overwriting is allowed.  Returns false if
+    * the file must not be written */
+   bool PrepareFileName(wxFileName &name);
    /** \brief Takes an arbitrary text string and converts it to a form that can
     * be used as a file name, if necessary prompting the user to edit the file
     * name produced */
@@ -199,6 +218,8 @@ private:
       double t0;           /**< Start time for the export */
       double t1;           /**< End time for the export */
       int channels;        /**< Number of channels for ExportMultipleByTrack */
+      Track *track;        /**< Track to select for ExportMultipleByTrack */
+      Track *linked;       /**< The track linked to it, or NULL */
    };  // end of ExportKit declaration
    /* we are going to want an set of these kits, and don't know how many until
     * runtime. I would dearly like to use a std::vector, but it seems that
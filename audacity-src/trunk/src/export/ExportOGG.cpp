@@ -121,6 +121,29 @@ void ExportOGGOptions::OnOK(wxCommandEvent& WXUNUSED(event))
 
 #define SAMPLES_PER_RUN 8192
 
+class ExportOGGJob : public ExportJob
+{
+public:
+   ExportOGGJob(const wxString &fName, double t0, double t1, int numChannels);
+
+   bool Encode();
+   void Finish();
+
+   FileIO outFile;
+   int numChannels;
+   int eos;
+
+   // All the Ogg and Vorbis encoding data
+   ogg_stream_state stream;
+   ogg_page         page;
+   ogg_packet       packet;
+
+   vorbis_info      info;
+   vorbis_comment   comment;
+   vorbis_dsp_state dsp;
+   vorbis_block     block;
+};
+
 class ExportOGG : public ExportPlugin
 {
 public:
@@ -141,6 +164,17 @@ public:
                Tags *metadata = NULL,
                int subformat = 0);
 
+   bool CanCreateJob(int subformat = 0);
+   ExportJob *CreateJob(AudacityProject *project,
+                        int channels,
+                        wxString fName,
+                        bool selectedOnly,
+                        double t0,
+                        double t1,
+                        MixerSpec *mixerSpec = NULL,
+                        Tags *metadata = NULL,
+                        int subformat = 0);
+
 private:
 
    bool FillComment(AudacityProject *project, vorbis_comment *comment, Tags *metadata);
@@ -170,51 +204,61 @@ int ExportOGG::Export(AudacityProject *project,
                        double t1,
                        MixerSpec *mixerSpec,
                        Tags *metadata,
-                       int WXUNUSED(subformat))
+                       int subformat)
+{
+   return RunJob(CreateJob(project, numChannels, fName, selectionOnly,
+                           t0, t1, mixerSpec, metadata, subformat));
+}
+
+bool ExportOGG::CanCreateJob(int WXUNUSED(subformat))
+{
+   return true;
+}
+
+ExportJob *ExportOGG::CreateJob(AudacityProject *project,
+                                int numChannels,
+                                wxString fName,
+                                bool selectionOnly,
+                                double t0,
+                                double t1,
+                                MixerSpec *mixerSpec,
+                                Tags *metadata,
+                                int WXUNUSED(subformat))
 {
    double    rate    = project->GetRate();
    TrackList *tracks = project->GetTracks();
    double    quality = (gPrefs->Read(wxT("/FileFormats/OggExportQuality"), 50)/(float)100.0);
 
    wxLogNull logNo;            // temporarily disable wxWidgets error messages
-   int updateResult = eProgressSuccess;
-   int       eos = 0;
 
-   FileIO outFile(fName, FileIO::Output);
+   ExportOGGJob *job = new ExportOGGJob(fName, t0, t1, numChannels);
 
-   if (!outFile.IsOpened()) {
+   if (!job->outFile.IsOpened()) {
       wxMessageBox(_("Unable to open target file for writing"));
-      return false;
+      delete job;
+      return NULL;
    }
 
-   // All the Ogg and Vorbis encoding data
-   ogg_stream_state stream;
-   ogg_page         page;
-   ogg_packet       packet;
-
-   vorbis_info      info;
-   vorbis_comment   comment;
-   vorbis_dsp_state dsp;
-   vorbis_block     block;
-
    // Encoding setup
-   vorbis_info_init(&info);
-   vorbis_encode_init_vbr(&info, numChannels, int(rate + 0.5), quality);
+   vorbis_info_init(&job->info);
+   vorbis_encode_init_vbr(&job->info, numChannels, int(rate + 0.5), quality);
 
    // Retrieve tags
-   if (!FillComment(project, &comment, metadata)) {
-      return false;
+   if (!FillComment(project, &job->comment, metadata)) {
+      vorbis_info_clear(&job->info);
+      delete job;
+      return NULL;
    }
 
    // Set up analysis state and auxiliary encoding storage
-   vorbis_analysis_init(&dsp, &info);
-   vorbis_block_init(&dsp, &block);
+   vorbis_analysis_init(&job->dsp, &job->info);
+   vorbis_block_init(&job->dsp, &job->block);
 
    // Set up packet->stream encoder.  According to encoder example,
    // a random serial number makes it more likely that you can make
    // chained streams with concatenation.
    srand(time(NULL));
-   ogg_stream_init(&stream, rand());
+   ogg_stream_init(&job->stream, rand());
 
    // First we need to write the required headers:
    //    1. The Ogg bitstream header, which contains codec setup params
@@ -228,109 +272,36 @@ int ExportOGG::Export(AudacityProject *project,
    ogg_packet comment_header;
    ogg_packet codebook_header;
 
-   vorbis_analysis_headerout(&dsp, &comment, &bitstream_header, &comment_header,
-         &codebook_header);
+   vorbis_analysis_headerout(&job->dsp, &job->comment, &bitstream_header,
+         &comment_header, &codebook_header);
 
    // Place these headers into the stream
-   ogg_stream_packetin(&stream, &bitstream_header);
-   ogg_stream_packetin(&stream, &comment_header);
-   ogg_stream_packetin(&stream, &codebook_header);
+   ogg_stream_packetin(&job->stream, &bitstream_header);
+   ogg_stream_packetin(&job->stream, &comment_header);
+   ogg_stream_packetin(&job->stream, &codebook_header);
 
    // Flushing these headers now guarentees that audio data will
    // start on a new page, which apparently makes streaming easier
-   while (ogg_stream_flush(&stream, &page)) {
-      outFile.Write(page.header, page.header_len);
-      outFile.Write(page.body, page.body_len);
+   while (ogg_stream_flush(&job->stream, &job->page)) {
+      job->outFile.Write(job->page.header, job->page.header_len);
+      job->outFile.Write(job->page.body, job->page.body_len);
    }
 
    int numWaveTracks;
    WaveTrack **waveTracks;
    tracks->GetWaveTracks(selectionOnly, &numWaveTracks, &waveTracks);
-   Mixer *mixer = CreateMixer(numWaveTracks, waveTracks,
-                            tracks->GetTimeTrack(),
-                            t0, t1,
-                            numChannels, SAMPLES_PER_RUN, false,
-                            rate, floatSample, true, mixerSpec);
+   job->SetMixer(CreateMixer(numWaveTracks, waveTracks,
+                             tracks->GetTimeTrack(),
+                             t0, t1,
+                             numChannels, SAMPLES_PER_RUN, false,
+                             rate, floatSample, true, mixerSpec));
    delete [] waveTracks;
 
-   ProgressDialog *progress = new ProgressDialog(wxFileName(fName).GetName(),
-      selectionOnly ?
+   job->SetMessage(selectionOnly ?
       _("Exporting the selected audio as Ogg Vorbis") :
       _("Exporting the entire project as Ogg Vorbis"));
 
-   while (updateResult == eProgressSuccess && !eos) {
-      float **vorbis_buffer = vorbis_analysis_buffer(&dsp, SAMPLES_PER_RUN);
-      sampleCount samplesThisRun = mixer->Process(SAMPLES_PER_RUN);
-
-      if (samplesThisRun == 0) {
-         // Tell the library that we wrote 0 bytes - signalling the end.
-         vorbis_analysis_wrote(&dsp, 0);
-      }
-      else {
-
-         for (int i = 0; i < numChannels; i++) {
-            float *temp = (float *)mixer->GetBuffer(i);
-            memcpy(vorbis_buffer[i], temp, sizeof(float)*SAMPLES_PER_RUN);
-         }
-
-         // tell the encoder how many samples we have
-         vorbis_analysis_wrote(&dsp, samplesThisRun);
-      }
-
-      // I don't understand what this call does, so here is the comment
-      // from the example, verbatim:
-      //
-      //    vorbis does some data preanalysis, then divvies up blocks
-      //    for more involved (potentially parallel) processing. Get
-      //    a single block for encoding now
-      while (vorbis_analysis_blockout(&dsp, &block) == 1) {
-
-         // analysis, assume we want to use bitrate management
-         vorbis_analysis(&block, NULL);
-         vorbis_bitrate_addblock(&block);
-
-         while (vorbis_bitrate_flushpacket(&dsp, &packet)) {
-
-            // add the packet to the bitstream
-            ogg_stream_packetin(&stream, &packet);
-
-            // From vorbis-tools-1.0/oggenc/encode.c:
-            //   If we've gone over a page boundary, we can do actual output,
-            //   so do so (for however many pages are available).
-
-            while (!eos) {
-               int result = ogg_stream_pageout(&stream, &page);
-               if (!result) {
-                  break;
-               }
-
-               outFile.Write(page.header, page.header_len);
-               outFile.Write(page.body, page.body_len);
-
-               if (ogg_page_eos(&page)) {
-                  eos = 1;
-               }
-            }
-         }
-      }
-
-      updateResult = progress->Update(mixer->MixGetCurrentTime()-t0, t1-t0);
-   }
-
-   delete progress;;
-
-   delete mixer;
-
-   ogg_stream_clear(&stream);
-
-   vorbis_block_clear(&block);
-   vorbis_dsp_clear(&dsp);
-   vorbis_info_clear(&info);
-   vorbis_comment_clear(&comment);
-
-   outFile.Close();
-
-   return updateResult;
+   return job;
 }
 
 bool ExportOGG::DisplayOptions(wxWindow *parent, int format)
@@ -363,6 +334,91 @@ bool ExportOGG::FillComment(AudacityProject *project, vorbis_comment *comment, T
    return true;
 }
 
+//----------------------------------------------------------------------------
+// ExportOGGJob
+//----------------------------------------------------------------------------
+
+ExportOGGJob::ExportOGGJob(const wxString &fName, double t0, double t1,
+                           int numChannels)
+:  ExportJob(fName, t0, t1),
+   outFile(fName, FileIO::Output)
+{
+   this->numChannels = numChannels;
+   eos = 0;
+}
+
+bool ExportOGGJob::Encode()
+{
+   float **vorbis_buffer = vorbis_analysis_buffer(&dsp, SAMPLES_PER_RUN);
+   sampleCount samplesThisRun = mMixer->Process(SAMPLES_PER_RUN);
+
+   if (samplesThisRun == 0) {
+      // Tell the library that we wrote 0 bytes - signalling the end.
+      vorbis_analysis_wrote(&dsp, 0);
+   }
+   else {
+
+      for (int i = 0; i < numChannels; i++) {
+         float *temp = (float *)mMixer->GetBuffer(i);
+         memcpy(vorbis_buffer[i], temp, sizeof(float)*SAMPLES_PER_RUN);
+      }
+
+      // tell the encoder how many samples we have
+      vorbis_analysis_wrote(&dsp, samplesThisRun);
+   }
+
+   // I don't understand what this call does, so here is the comment
+   // from the example, verbatim:
+   //
+   //    vorbis does some data preanalysis, then divvies up blocks
+   //    for more involved (potentially parallel) processing. Get
+   //    a single block for encoding now
+   while (vorbis_analysis_blockout(&dsp, &block) == 1) {
+
+      // analysis, assume we want to use bitrate management
+      vorbis_analysis(&block, NULL);
+      vorbis_bitrate_addblock(&block);
+
+      while (vorbis_bitrate_flushpacket(&dsp, &packet)) {
+
+         // add the packet to the bitstream
+         ogg_stream_packetin(&stream, &packet);
+
+         // From vorbis-tools-1.0/oggenc/encode.c:
+         //   If we've gone over a page boundary, we can do actual output,
+         //   so do so (for however many pages are available).
+
+         while (!eos) {
+            int result = ogg_stream_pageout(&stream, &page);
+            if (!result) {
+               break;
+            }
+
+            outFile.Write(page.header, page.header_len);
+            outFile.Write(page.body, page.body_len);
+
+            if (ogg_page_eos(&page)) {
+               eos = 1;
+            }
+         }
+      }
+   }
+
+   return !eos;
+}
+
+void ExportOGGJob::Finish()
+{
+   ogg_stream_clear(&stream);
+
+   vorbis_block_clear(&block);
+   vorbis_dsp_clear(&dsp);
+   vorbis_info_clear(&info);
+   vorbis_comment_clear(&comment);
+
+   outFile.Close();
+}
+
 ExportPlugin *New_ExportOGG()
 {
    return new ExportOGG();
@@ -297,6 +297,27 @@ bool ExportPCMOptions::ValidatePair(int format)
 // ExportPCM Class
 //----------------------------------------------------------------------------
 
+class ExportPCM;
+
+class ExportPCMJob : public ExportJob
+{
+public:
+   ExportPCMJob(ExportPCM *exporter, const wxString &fName,
+                double t0, double t1);
+
+   bool Encode();
+   void Finish();
+
+   ExportPCM *exporter;
+   wxFile f;   // will be closed when the job is deleted
+   SNDFILE *sf;
+   int sf_format;
+   wxString formatStr;
+   sampleFormat format;
+   int maxBlockLen;
+   Tags *metadata;
+};
+
 class ExportPCM : public ExportPlugin
 {
 public:
@@ -319,7 +340,19 @@ public:
    // optional
    wxString GetExtension(int index = 0);
 
+   bool CanCreateJob(int subformat = 0);
+   ExportJob *CreateJob(AudacityProject *project,
+                        int channels,
+                        wxString fName,
+                        bool selectedOnly,
+                        double t0,
+                        double t1,
+                        MixerSpec *mixerSpec = NULL,
+                        Tags *metadata = NULL,
+                        int subformat = 0);
+
 private:
+   friend class ExportPCMJob;
 
    char *AdjustString(wxString wxStr, int sf_format);
    bool AddStrings(AudacityProject *project, SNDFILE *sf, Tags *tags, int sf_format);
@@ -408,6 +441,25 @@ int ExportPCM::Export(AudacityProject *project,
                        MixerSpec *mixerSpec,
                        Tags *metadata,
                        int subformat)
+{
+   return RunJob(CreateJob(project, numChannels, fName, selectionOnly,
+                           t0, t1, mixerSpec, metadata, subformat));
+}
+
+bool ExportPCM::CanCreateJob(int WXUNUSED(subformat))
+{
+   return true;
+}
+
+ExportJob *ExportPCM::CreateJob(AudacityProject *project,
+                                int numChannels,
+                                wxString fName,
+                                bool selectionOnly,
+                                double t0,
+                                double t1,
+                                MixerSpec *mixerSpec,
+                                Tags *metadata,
+                                int subformat)
 {
    double       rate = project->GetRate();
    TrackList   *tracks = project->GetTracks();
@@ -436,7 +488,6 @@ int ExportPCM::Export(AudacityProject *project,
    wxString     formatStr;
    SF_INFO      info;
    SNDFILE     *sf = NULL;
-   int          err;
 
    //This whole operation should not occur while a file is being loaded on OD,
    //(we are worried about reading from a file being written to,) so we block.
@@ -461,17 +512,19 @@ int ExportPCM::Export(AudacityProject *project,
       info.format = (info.format & SF_FORMAT_TYPEMASK);
    if (!sf_format_check(&info)) {
       wxMessageBox(_("Cannot export audio in this format."));
-      return false;
+      return NULL;
    }
 
-   wxFile f;   // will be closed when it goes out of scope
+   ExportPCMJob *job = new ExportPCMJob(this, fName, t0, t1);
+   job->sf_format = sf_format;
+   job->formatStr = formatStr;
 
-   if (f.Open(fName, wxFile::write)) {
+   if (job->f.Open(fName, wxFile::write)) {
       // Even though there is an sf_open() that takes a filename, use the one that
       // takes a file descriptor since wxWidgets can open a file with a Unicode name and
       // libsndfile can't (under Windows).
       ODManager::LockLibSndFileMutex();
-      sf = sf_open_fd(f.fd(), SFM_WRITE, &info, FALSE);
+      sf = sf_open_fd(job->f.fd(), SFM_WRITE, &info, FALSE);
       //add clipping for integer formats.  We allow floats to clip.
       sf_command(sf, SFC_SET_CLIPPING, NULL,sf_subtype_is_integer(sf_format)?SF_TRUE:SF_FALSE) ;
       ODManager::UnlockLibSndFileMutex();
@@ -480,11 +533,15 @@ int ExportPCM::Export(AudacityProject *project,
    if (!sf) {
       wxMessageBox(wxString::Format(_("Cannot export audio to %s"),
                                     fName.c_str()));
-      return false;
+      delete job;
+      return NULL;
    }
+   job->sf = sf;
+
    // Retrieve tags if not given a set
    if (metadata == NULL)
       metadata = project->GetTags();
+   job->metadata = metadata;
 
     // Install the metata at the beginning of the file (except for
     // WAV and WAVEX formats)
@@ -492,80 +549,103 @@ int ExportPCM::Export(AudacityProject *project,
         (sf_format & SF_FORMAT_TYPEMASK) != SF_FORMAT_WAVEX) {
        if (!AddStrings(project, sf, metadata, sf_format)) {
           sf_close(sf);
-          return false;
+          delete job;
+          return NULL;
        }
    }
 
-   sampleFormat format;
    if (sf_subtype_more_than_16_bits(info.format))
-      format = floatSample;
+      job->format = floatSample;
    else
-      format = int16Sample;
-
-   int maxBlockLen = 44100 * 5;
-
-   int updateResult = eProgressSuccess;
+      job->format = int16Sample;
 
    int numWaveTracks;
    WaveTrack **waveTracks;
    tracks->GetWaveTracks(selectionOnly, &numWaveTracks, &waveTracks);
-   Mixer *mixer = CreateMixer(numWaveTracks, waveTracks,
-                            tracks->GetTimeTrack(),
-                            t0, t1,
-                            info.channels, maxBlockLen, true,
-                            rate, format, true, mixerSpec);
-
-   ProgressDialog *progress = new ProgressDialog(wxFileName(fName).GetName(),
-      selectionOnly ?
+   job->SetMixer(CreateMixer(numWaveTracks, waveTracks,
+                             tracks->GetTimeTrack(),
+                             t0, t1,
+                             info.channels, job->maxBlockLen, true,
+                             rate, job->format, true, mixerSpec));
+   delete[] waveTracks;
+
+   job->SetMessage(selectionOnly ?
       wxString::Format(_("Exporting the selected audio as %s"),
                        formatStr.c_str()) :
       wxString::Format(_("Exporting the entire project as %s"),
                        formatStr.c_str()));
 
-   while(updateResult == eProgressSuccess) {
-      sampleCount samplesWritten;
-      sampleCount numSamples = mixer->Process(maxBlockLen);
+   return job;
+}
 
-      if (numSamples == 0)
-         break;
+//----------------------------------------------------------------------------
+// ExportPCMJob
+//----------------------------------------------------------------------------
 
-      samplePtr mixed = mixer->GetBuffer();
+ExportPCMJob::ExportPCMJob(ExportPCM *exporter, const wxString &fName,
+                           double t0, double t1)
+:  ExportJob(fName, t0, t1)
+{
+   this->exporter = exporter;
+   sf = NULL;
+   sf_format = 0;
+   format = int16Sample;
+   maxBlockLen = 44100 * 5;
+   metadata = NULL;
+}
 
-      ODManager::LockLibSndFileMutex();
-      if (format == int16Sample)
-         samplesWritten = sf_writef_short(sf, (short *)mixed, numSamples);
-      else
-         samplesWritten = sf_writef_float(sf, (float *)mixed, numSamples);
-      ODManager::UnlockLibSndFileMutex();
+bool ExportPCMJob::Encode()
+{
+   sampleCount samplesWritten;
+   sampleCount numSamples = mMixer->Process(maxBlockLen);
 
-      if (samplesWritten != numSamples) {
-        char buffer2[1000];
-        sf_error_str(sf, buffer2, 1000);
-        wxMessageBox(wxString::Format(
-           /* i18n-hint: %s will be the error message from libsndfile, which
-            * is usually something unhelpful (and untranslated) like "system
-            * error" */
-           _("Error while writing %s file (disk full?).\nLibsndfile says \"%s\""),
-           formatStr.c_str(),
-           wxString::FromAscii(buffer2).c_str()));
-        break;
-      }
+   if (numSamples == 0)
+      return false;
 
-      updateResult = progress->Update(mixer->MixGetCurrentTime()-t0, t1-t0);
-   }
+   samplePtr mixed = mMixer->GetBuffer();
 
-   delete progress;
+   ODManager::LockLibSndFileMutex();
+   if (format == int16Sample)
+      samplesWritten = sf_writef_short(sf, (short *)mixed, numSamples);
+   else
+      samplesWritten = sf_writef_float(sf, (float *)mixed, numSamples);
+   ODManager::UnlockLibSndFileMutex();
 
-   delete mixer;
+   if (samplesWritten != numSamples) {
+     char buffer2[1000];
+     sf_error_str(sf, buffer2, 1000);
+     mError = wxString::Format(
+        /* i18n-hint: %s will be the error message from libsndfile, which
+         * is usually something unhelpful (and untranslated) like "system
+         * error" */
+        _("Error while writing %s file (disk full?).\nLibsndfile says \"%s\""),
+        formatStr.c_str(),
+        wxString::FromAscii(buffer2).c_str());
+     return false;
+   }
 
-   delete[] waveTracks;
+   return true;
+}
+
+void ExportPCMJob::Finish()
+{
+   int err;
 
    // Install the WAV metata in a "LIST" chunk at the end of the file
    if ((sf_format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV ||
        (sf_format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAVEX) {
-      if (!AddStrings(project, sf, metadata, sf_format)) {
+      ODManager::LockLibSndFileMutex();
+      bool added = exporter->AddStrings(NULL, sf, metadata, sf_format);
+      ODManager::UnlockLibSndFileMutex();
+      if (!added) {
+         ODManager::LockLibSndFileMutex();
          sf_close(sf);
-         return false;
+         ODManager::UnlockLibSndFileMutex();
+         if (!Failed())
+            mError = wxString::Format(
+               _("Error while writing %s file: could not add the metadata."),
+               formatStr.c_str());
+         return;
       }
    }
 
@@ -573,26 +653,24 @@ int ExportPCM::Export(AudacityProject *project,
    err = sf_close(sf);
    ODManager::UnlockLibSndFileMutex();
 
-   if (err) {
+   if (err && !Failed()) {
       char buffer[1000];
       sf_error_str(sf, buffer, 1000);
-      wxMessageBox(wxString::Format
+      mError = wxString::Format
             /* i18n-hint: %s will be the error message from libsndfile */
                    (_("Error (file may not have been written): %s"),
-                    buffer));
+                    buffer);
    }
 
    if (((sf_format & SF_FORMAT_TYPEMASK) == SF_FORMAT_AIFF) ||
        ((sf_format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV))
-      AddID3Chunk(fName, metadata, sf_format);
+      exporter->AddID3Chunk(mFileName, metadata, sf_format);
 
 #ifdef __WXMAC__
-   wxFileName fn(fName);
+   wxFileName fn(mFileName);
    fn.MacSetTypeAndCreator(sf_header_mactype(sf_format & SF_FORMAT_TYPEMASK),
                            AUDACITY_CREATOR);
 #endif
-
-   return updateResult;
 }
 
 char *ExportPCM::AdjustString(const wxString wxStr, int sf_format)
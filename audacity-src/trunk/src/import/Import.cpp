@@ -71,6 +71,8 @@ Importer::Importer()
    mImportPluginList = new ImportPluginList;
    mUnusableImportPluginList = new UnusableImportPluginList;
    mExtImportItems = NULL;
+   mPendingTrackFactory = NULL;
+   mMaxStarted = 0;
 
    // build the list of import plugin and/or unusableImporters.
    // order is significant.  If none match, they will all be tried
@@ -96,6 +98,7 @@ Importer::Importer()
 
 Importer::~Importer()
 {
+   CancelImports();
    WriteImportItems();
    mImportPluginList->DeleteContents(true);
    delete mImportPluginList;
@@ -321,27 +324,11 @@ ExtImportItem *Importer::CreateDefaultImportItem()
    return new_item;
 }
 
-// returns number of tracks imported
-int Importer::Import(wxString fName,
-                     TrackFactory *trackFactory,
-                     Track *** tracks,
-                     Tags *tags,
-                     wxString &errorMessage)
+void Importer::GetPluginsFor(wxString fName, ImportPluginList &importPlugins)
 {
-   AudacityProject *pProj = GetActiveProject();
-   pProj->mbBusyImporting = true;
-
-   ImportFileHandle *inFile = NULL;
-   int numTracks = 0;
-
-   wxString extension = fName.AfterLast(wxT('.'));
-
-   // This list is used to call plugins in correct order
-   ImportPluginList importPlugins;
    ImportPluginList::compatibility_iterator importPluginNode;
 
-   // This list is used to remember plugins that should have been compatible with the file.
-   ImportPluginList compatiblePlugins;
+   wxString extension = fName.AfterLast(wxT('.'));
 
    // If user explicitly selected a filter,
    // then we should try importing via corresponding plugin first
@@ -495,14 +482,127 @@ int Importer::Import(wxString fName,
 
       importPluginNode = importPluginNode->GetNext();
    }
+}
+
+void Importer::StartImports(const wxArrayString &fileNames,
+                            TrackFactory *trackFactory)
+{
+   CancelImports();
+
+   // How many files may be importing at once; 1 imports them one at a
+   // time, as Import() alone does
+   long concurrentFiles = gPrefs->Read(wxT("/Import/ConcurrentFiles"), 2L);
+   if (concurrentFiles <= 1 || fileNames.GetCount() <= 1)
+      return;
+
+   // Import() finishes one, so as many more may be begun
+   mMaxStarted = concurrentFiles - 1;
+   mPendingFiles = fileNames;
+   mPendingTrackFactory = trackFactory;
+}
+
+void Importer::StartMoreImports()
+{
+   while (mStartedFiles.GetCount() < mMaxStarted &&
+          mPendingFiles.GetCount() > 0)
+   {
+      wxString fName = mPendingFiles[0];
+      mPendingFiles.RemoveAt(0);
+
+      // Begin with the plugin Import() would try first; if it can't
+      // begin, Import() does the whole import as usual.
+      ImportPluginList importPlugins;
+      GetPluginsFor(fName, importPlugins);
+      if (importPlugins.GetCount() == 0)
+         continue;
+
+      ImportFileHandle *inFile = importPlugins.GetFirst()->GetData()->Open(fName);
+      if (inFile == NULL)
+         continue;
+
+      if (inFile->GetStreamCount() == 1)
+      {
+         inFile->SetStreamUsage(0,TRUE);
+         if (inFile->StartImport(mPendingTrackFactory))
+         {
+            mStartedFiles.Add(fName);
+            mStartedHandles.Add(inFile);
+            continue;
+         }
+      }
+
+      delete inFile;
+   }
+}
+
+void Importer::CancelImports()
+{
+   for (size_t i = 0; i < mStartedHandles.GetCount(); i++)
+      delete mStartedHandles[i];
+   mStartedHandles.Clear();
+   mStartedFiles.Clear();
+
+   mPendingFiles.Clear();
+   mPendingTrackFactory = NULL;
+   mMaxStarted = 0;
+}
+
+// returns number of tracks imported
+int Importer::Import(wxString fName,
+                     TrackFactory *trackFactory,
+                     Track *** tracks,
+                     Tags *tags,
+                     wxString &errorMessage)
+{
+   AudacityProject *pProj = GetActiveProject();
+   pProj->mbBusyImporting = true;
+
+   ImportFileHandle *inFile = NULL;
+   int numTracks = 0;
+
+   wxString extension = fName.AfterLast(wxT('.'));
+
+   // This list is used to call plugins in correct order
+   ImportPluginList importPlugins;
+   ImportPluginList::compatibility_iterator importPluginNode;
+
+   // This list is used to remember plugins that should have been compatible with the file.
+   ImportPluginList compatiblePlugins;
+
+   GetPluginsFor(fName, importPlugins);
+
+   // If StartImports() was told of this file, it is no longer pending,
+   // and may have been begun already, with the first of importPlugins
+   ImportFileHandle *startedFile = NULL;
+   int index = mPendingFiles.Index(fName);
+   if (index != wxNOT_FOUND)
+      mPendingFiles.RemoveAt(index);
+   index = mStartedFiles.Index(fName);
+   if (index != wxNOT_FOUND)
+   {
+      startedFile = mStartedHandles[index];
+      mStartedFiles.RemoveAt(index);
+      mStartedHandles.RemoveAt(index);
+   }
+
+   // Keep the next files going while this one is finished
+   StartMoreImports();
 
    importPluginNode = importPlugins.GetFirst();
    while(importPluginNode)
    {
       ImportPlugin *plugin = importPluginNode->GetData();
-      // Try to open the file with this plugin (probe it)
-      wxLogMessage(wxT("Opening with %s"),plugin->GetPluginStringID().c_str());
-      inFile = plugin->Open(fName);
+      if (startedFile)
+      {
+         inFile = startedFile;
+         startedFile = NULL;
+      }
+      else
+      {
+         // Try to open the file with this plugin (probe it)
+         wxLogMessage(wxT("Opening with %s"),plugin->GetPluginStringID().c_str());
+         inFile = plugin->Open(fName);
+      }
       if ( (inFile != NULL) && (inFile->GetStreamCount() > 0) )
       {
          wxLogMessage(wxT("Open(%s) succeeded"),(const char *) fName.c_str());
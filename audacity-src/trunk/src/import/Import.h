@@ -43,6 +43,7 @@ class ExtImportItem;
 
 WX_DECLARE_LIST(Format, FormatList);
 WX_DEFINE_ARRAY_PTR(ImportPlugin *, ImportPluginPtrArray);
+WX_DEFINE_ARRAY_PTR(ImportFileHandle *, ImportFileHandleArray);
 WX_DECLARE_OBJARRAY(ExtImportItem, ExtImportItems);
 
 class ExtImportItem
@@ -135,11 +136,45 @@ public:
               Tags *tags,
               wxString &errorMessage);
 
+   /**
+    * Lets the files that Import() is about to be called for, in this
+    * order, import a few at a time: while one is being finished, the
+    * next ones are begun on threads of their own.  Call CancelImports()
+    * after the last Import().
+    */
+   void StartImports(const wxArrayString &fileNames,
+                     TrackFactory *trackFactory);
+
+   /**
+    * Forgets the files StartImports() was given, and throws away
+    * any imports begun that Import() did not finish
+    */
+   void CancelImports();
+
 private:
 
+   /**
+    * Fills @importPlugins with the plugins to try on the file @fName,
+    * in the order to try them
+    */
+   void GetPluginsFor(wxString fName, ImportPluginList &importPlugins);
+
+   /**
+    * Begins imports of pending files until as many are begun as
+    * "/Import/ConcurrentFiles" allows
+    */
+   void StartMoreImports();
+
    ExtImportItems *mExtImportItems;
    ImportPluginList *mImportPluginList;
    UnusableImportPluginList *mUnusableImportPluginList;
+
+   // Files given to StartImports() not yet begun, and those begun
+   wxArrayString mPendingFiles;
+   wxArrayString mStartedFiles;
+   ImportFileHandleArray mStartedHandles;
+   TrackFactory *mPendingTrackFactory;
+   size_t mMaxStarted;
 };
 
 //----------------------------------------------------------------------------
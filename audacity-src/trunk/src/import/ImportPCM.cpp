@@ -17,6 +17,12 @@
 \class PCMImportPlugin
 \brief An ImportPlugin for PCM data
 
+*//****************************************************************//**
+
+\class PCMImportPipeline
+\brief Copies the samples of a PCM file into its tracks on threads of
+its own, so that reading, splitting into channels and appending overlap
+
 *//*******************************************************************/
 
 #include "../Audacity.h"
@@ -39,15 +45,21 @@
 
 #include "../ondemand/ODManager.h"
 #include "../ondemand/ODComputeSummaryTask.h"
+#include "../ondemand/ODTaskThread.h"
 
 //If OD is enabled, he minimum number of samples a file has to use it.
 //Otherwise, we use the older PCMAliasBlockFile method since it should be fast enough.
 #define kMinimumODFileSampleSize 44100*30
 
+//How many blocks of frames may be between being read and being appended
+//when copying a file in.
+#define kPCMImportBuffers 4
+
 #ifndef SNDFILE_1
 #error Requires libsndfile 1.0 or higher
 #endif
 
+#include "../DirManager.h"
 #include "../FileFormats.h"
 #include "../Prefs.h"
 #include "../WaveTrack.h"
@@ -84,6 +96,79 @@ public:
 };
 
 
+class PCMImportThread;
+
+/// One block of frames of a PCMImportPipeline: read into interleaved,
+/// then split into channels, then appended to the tracks
+struct PCMImportBuffer
+{
+   samplePtr interleaved;
+   samplePtr *channels;
+   sampleCount len;
+};
+
+class PCMImportPipeline
+{
+public:
+   /// Starts the threads.  The buffers hold blockSize frames in format,
+   /// which must be int16Sample or floatSample.  There are numAppenders
+   /// appending threads, and appender t appends the channels c with
+   /// c % numAppenders == t.
+   PCMImportPipeline(SNDFILE *file, sampleFormat format,
+                     int numChannels, WaveTrack **channels,
+                     sampleCount blockSize, int numAppenders);
+   /// Stops the threads, if they are still running
+   ~PCMImportPipeline();
+
+   /// Whether a thread couldn't be started.  Then nothing was read from
+   /// the file, and the caller must copy it in some other way.
+   bool Failed() { return mFailed; }
+   /// Whether every frame of the file is in the tracks
+   bool IsDone();
+   /// How many frames are in every track
+   sampleCount GetFramesDone();
+   /// Reads no more of the file.  What was read still goes into every
+   /// track, so that they all end at the same frame; then IsDone().
+   void StopReading();
+
+private:
+   friend class PCMImportThread;
+
+   // Bodies of the threads
+   void Read();
+   void Split();
+   void Append(int appender);
+
+   int MinAppended();
+
+   SNDFILE *mFile;
+   sampleFormat mFormat;
+   int mNumChannels;
+   WaveTrack **mChannels;
+   sampleCount mBlockSize;
+   int mNumAppenders;
+
+   PCMImportBuffer mBuffers[kPCMImportBuffers];
+   PCMImportThread **mThreads; // NULL where one couldn't be started
+   int mNumThreads;
+   DirManager *mDirManager;
+   bool mFailed;
+
+   // Buffer n of the file is mBuffers[n % kPCMImportBuffers]; these
+   // count the buffers each stage has finished with
+   ODLock mLock;
+   ODCondition mChanged;   // every thread waits on this for the others
+   int mNumRead;
+   int mNumSplit;
+   int *mNumAppended;      // per appender
+   sampleCount *mFramesAppended;
+   bool mReadDone;         // the file has no more frames
+   bool mStopReading;
+   bool mSplitDone;
+   int mNumAppendersDone;
+   bool mStopping;
+};
+
 class PCMImportFileHandle : public ImportFileHandle
 {
 public:
@@ -92,6 +177,7 @@ public:
 
    wxString GetFileDescription();
    int GetFileUncompressedBytes();
+   bool StartImport(TrackFactory *trackFactory);
    int Import(TrackFactory *trackFactory, Track ***outTracks,
               int *outNumTracks, Tags *tags);
 
@@ -105,6 +191,12 @@ private:
    SNDFILE              *mFile;
    SF_INFO               mInfo;
    sampleFormat          mFormat;
+
+   void CreateTracks(TrackFactory *trackFactory);
+   bool StartPipeline();
+
+   WaveTrack            **mChannels;   // until Import() gives them out
+   PCMImportPipeline     *mPipeline;   // while copying the samples in
 };
 
 void GetPCMImportPlugin(ImportPluginList * importPluginList,
@@ -185,7 +277,9 @@ PCMImportFileHandle::PCMImportFileHandle(wxString name,
                                          SNDFILE *file, SF_INFO info)
 :  ImportFileHandle(name),
    mFile(file),
-   mInfo(info)
+   mInfo(info),
+   mChannels(NULL),
+   mPipeline(NULL)
 {
    //
    // Figure out the format to use.
@@ -306,52 +400,117 @@ How do you want to import the current file(s)?"), oldCopyPref == wxT("copy") ? _
    return oldCopyPref;
 }
 
-int PCMImportFileHandle::Import(TrackFactory *trackFactory,
-                                Track ***outTracks,
-                                int *outNumTracks,
-                                Tags *tags)
+void PCMImportFileHandle::CreateTracks(TrackFactory *trackFactory)
 {
-   wxASSERT(mFile);
-
-   // Get the preference / warn the user about aliased files.
-   wxString copyEdit = AskCopyOrEdit();
-
-   if (copyEdit == wxT("cancel"))
-      return eProgressCancelled;
-
-   // Fall back to "copy" if it doesn't match anything else, since it is safer
-   bool doEdit = false;
-   if (copyEdit.IsSameAs(wxT("edit"), false))
-      doEdit = true;
-
-
-   CreateProgress();
-
-   WaveTrack **channels = new WaveTrack *[mInfo.channels];
+   mChannels = new WaveTrack *[mInfo.channels];
 
    int c;
    for (c = 0; c < mInfo.channels; c++) {
-      channels[c] = trackFactory->NewWaveTrack(mFormat, mInfo.samplerate);
+      mChannels[c] = trackFactory->NewWaveTrack(mFormat, mInfo.samplerate);
 
       if (mInfo.channels > 1)
          switch (c) {
          case 0:
-            channels[c]->SetChannel(Track::LeftChannel);
+            mChannels[c]->SetChannel(Track::LeftChannel);
             break;
          case 1:
-            channels[c]->SetChannel(Track::RightChannel);
+            mChannels[c]->SetChannel(Track::RightChannel);
             break;
          default:
-            channels[c]->SetChannel(Track::MonoChannel);
+            mChannels[c]->SetChannel(Track::MonoChannel);
          }
    }
 
    if (mInfo.channels == 2) {
-      channels[0]->SetLinked(true);
+      mChannels[0]->SetLinked(true);
    }
 
+   // Make the clips here, so that the appending threads needn't
+   for (c = 0; c < mInfo.channels; c++)
+      mChannels[c]->GetLastOrCreateClip();
+}
+
+bool PCMImportFileHandle::StartPipeline()
+{
+   // One appending thread per processor, unless set otherwise; there is
+   // no use in more than one per channel.
+   int numAppenders = gPrefs->Read(wxT("/Import/Threads"), 0L);
+   if (numAppenders <= 0)
+      numAppenders = wxThread::GetCPUCount();
+   if (numAppenders > mInfo.channels)
+      numAppenders = mInfo.channels;
+   if (numAppenders < 1)
+      numAppenders = 1;
+
+   //import 24 bit int as float and have the append function convert it.  This is how PCMAliasBlockFile works too.
+   mPipeline = new PCMImportPipeline(mFile,
+                                     (mFormat == int16Sample) ? int16Sample : floatSample,
+                                     mInfo.channels, mChannels,
+                                     mChannels[0]->GetMaxBlockSize(),
+                                     numAppenders);
+   if (mPipeline->Failed()) {
+      delete mPipeline;
+      mPipeline = NULL;
+      return false;
+   }
+   return true;
+}
+
+bool PCMImportFileHandle::StartImport(TrackFactory *trackFactory)
+{
+   // Only a copy the user needn't be asked about can start before
+   // Import(), which asks.
+   wxString copyPref = gPrefs->Read(wxT("/FileFormats/CopyOrEditUncompressedData"), wxT("copy"));
+   bool firstTimeAsk = gPrefs->Read(wxT("/Warnings/CopyOrEditUncompressedDataFirstAsk"), true)?true:false;
+   bool askPref      = gPrefs->Read(wxT("/Warnings/CopyOrEditUncompressedDataAsk"), true)?true:false;
+
+   if (firstTimeAsk || askPref ||
+       (copyPref.IsSameAs(wxT("edit"), false) && mInfo.seekable))
+      return false;
+
+   CreateTracks(trackFactory);
+   if (!StartPipeline()) {
+      // Import() copies the file in on this thread instead
+      for (int c = 0; c < mInfo.channels; c++)
+         delete mChannels[c];
+      delete[] mChannels;
+      mChannels = NULL;
+      return false;
+   }
+
+   return true;
+}
+
+int PCMImportFileHandle::Import(TrackFactory *trackFactory,
+                                Track ***outTracks,
+                                int *outNumTracks,
+                                Tags *tags)
+{
+   wxASSERT(mFile);
+
+   bool doEdit = false;
+
+   // If StartImport() began copying the samples in, there is nothing to
+   // ask and nothing to make.
+   if (!mPipeline) {
+      // Get the preference / warn the user about aliased files.
+      wxString copyEdit = AskCopyOrEdit();
+
+      if (copyEdit == wxT("cancel"))
+         return eProgressCancelled;
+
+      // Fall back to "copy" if it doesn't match anything else, since it is safer
+      if (copyEdit.IsSameAs(wxT("edit"), false))
+         doEdit = true;
+
+      CreateTracks(trackFactory);
+   }
+
+   CreateProgress();
+
+   int c;
    sampleCount fileTotalFrames = (sampleCount)mInfo.frames;
-   sampleCount maxBlockSize = channels[0]->GetMaxBlockSize();
+   sampleCount maxBlockSize = mChannels[0]->GetMaxBlockSize();
    int updateResult = false;
 
    // If the format is not seekable, we must use 'copy' mode,
@@ -377,7 +536,7 @@ int PCMImportFileHandle::Import(TrackFactory *trackFactory,
             blockLen = fileTotalFrames - i;
 
          for (c = 0; c < mInfo.channels; c++)
-            channels[c]->AppendAlias(mFilename, i, blockLen, c,useOD);
+            mChannels[c]->AppendAlias(mFilename, i, blockLen, c,useOD);
 
          if (++updateCounter == 50) {
             updateResult = mProgress->Update(i, fileTotalFrames);
@@ -394,7 +553,7 @@ int PCMImportFileHandle::Import(TrackFactory *trackFactory,
          bool moreThanStereo = mInfo.channels>2;
          for (c = 0; c < mInfo.channels; c++)
          {
-            computeTask->AddWaveTrack(channels[c]);
+            computeTask->AddWaveTrack(mChannels[c]);
             if(moreThanStereo)
             {
                //if we have 3 more channels, they get imported on seperate tracks, so we add individual tasks for each.
@@ -410,57 +569,86 @@ int PCMImportFileHandle::Import(TrackFactory *trackFactory,
    else {
       // Otherwise, we're in the "copy" mode, where we read in the actual
       // samples from the file and store our own local copy of the
-      // samples in the tracks.
-
-      samplePtr srcbuffer = NewSamples(maxBlockSize * mInfo.channels,
-                                       mFormat);
-      samplePtr buffer = NewSamples(maxBlockSize, mFormat);
-
-      unsigned long framescompleted = 0;
-
-      long block;
-      do {
-         block = maxBlockSize;
-
-         if (mFormat == int16Sample)
-            block = sf_readf_short(mFile, (short *)srcbuffer, block);
-         //import 24 bit int as float and have the append function convert it.  This is how PCMAliasBlockFile works too.
-         else
-            block = sf_readf_float(mFile, (float *)srcbuffer, block);
-
-         if (block) {
-            for(c=0; c<mInfo.channels; c++) {
-               if (mFormat==int16Sample) {
-                  for(int j=0; j<block; j++)
-                     ((short *)buffer)[j] =
-                        ((short *)srcbuffer)[mInfo.channels*j+c];
-               }
-               else {
-                  for(int j=0; j<block; j++)
-                     ((float *)buffer)[j] =
-                        ((float *)srcbuffer)[mInfo.channels*j+c];
-               }
+      // samples in the tracks.  The pipeline does that on threads of
+      // its own, which leaves this one only the progress dialog.
+      if (!mPipeline && !StartPipeline()) {
+         // Without the threads, the samples are copied in here
+         sampleFormat format = (mFormat == int16Sample) ? int16Sample : floatSample;
+         samplePtr srcbuffer = NewSamples(maxBlockSize * mInfo.channels, format);
+         samplePtr buffer = NewSamples(maxBlockSize, format);
+
+         unsigned long framescompleted = 0;
+
+         long block;
+         do {
+            block = maxBlockSize;
+
+            // libsndfile is not threadsafe
+            ODManager::LockLibSndFileMutex();
+            if (format == int16Sample)
+               block = sf_readf_short(mFile, (short *)srcbuffer, block);
+            else
+               block = sf_readf_float(mFile, (float *)srcbuffer, block);
+            ODManager::UnlockLibSndFileMutex();
+
+            if (block) {
+               for(c=0; c<mInfo.channels; c++) {
+                  if (format == int16Sample) {
+                     for(int j=0; j<block; j++)
+                        ((short *)buffer)[j] =
+                           ((short *)srcbuffer)[mInfo.channels*j+c];
+                  }
+                  else {
+                     for(int j=0; j<block; j++)
+                        ((float *)buffer)[j] =
+                           ((float *)srcbuffer)[mInfo.channels*j+c];
+                  }
 
-               channels[c]->Append(buffer, (mFormat == int16Sample)?int16Sample:floatSample, block);
+                  mChannels[c]->Append(buffer, format, block);
+               }
+               framescompleted += block;
             }
-            framescompleted += block;
-         }
 
-         updateResult = mProgress->Update((long long unsigned)framescompleted,
-                                        (long long unsigned)fileTotalFrames);
-         if (updateResult != eProgressSuccess)
-            break;
+            updateResult = mProgress->Update((long long unsigned)framescompleted,
+                                             (long long unsigned)fileTotalFrames);
+            if (updateResult != eProgressSuccess)
+               break;
 
-      } while (block > 0);
+         } while (block > 0);
+
+         DeleteSamples(buffer);
+         DeleteSamples(srcbuffer);
+      }
+      else {
+         for (;;) {
+            bool done = mPipeline->IsDone();
+
+            updateResult = mProgress->Update((long long unsigned)mPipeline->GetFramesDone(),
+                                             (long long unsigned)fileTotalFrames);
+            if (done || updateResult != eProgressSuccess)
+               break;
 
-      DeleteSamples(buffer);
-      DeleteSamples(srcbuffer);
+            wxMilliSleep(50);
+         }
+
+         // Stopping keeps what was read so far, in every channel alike
+         if (updateResult == eProgressStopped) {
+            mPipeline->StopReading();
+            while (!mPipeline->IsDone())
+               wxMilliSleep(10);
+         }
+
+         // Stops the threads, if the user cancelled
+         delete mPipeline;
+         mPipeline = NULL;
+      }
    }
 
    if (updateResult == eProgressFailed || updateResult == eProgressCancelled) {
       for (c = 0; c < mInfo.channels; c++)
-         delete channels[c];
-      delete[] channels;
+         delete mChannels[c];
+      delete[] mChannels;
+      mChannels = NULL;
 
       return updateResult;
    }
@@ -468,10 +656,11 @@ int PCMImportFileHandle::Import(TrackFactory *trackFactory,
    *outNumTracks = mInfo.channels;
    *outTracks = new Track *[mInfo.channels];
    for(c = 0; c < mInfo.channels; c++) {
-         channels[c]->Flush();
-         (*outTracks)[c] = channels[c];
+         mChannels[c]->Flush();
+         (*outTracks)[c] = mChannels[c];
       }
-      delete[] channels;
+      delete[] mChannels;
+      mChannels = NULL;
 
    const char *str;
 
@@ -668,5 +857,292 @@ int PCMImportFileHandle::Import(TrackFactory *trackFactory,
 
 PCMImportFileHandle::~PCMImportFileHandle()
 {
+   // An import started but never finished leaves its tracks here
+   if (mPipeline)
+      delete mPipeline;
+   if (mChannels) {
+      for (int c = 0; c < mInfo.channels; c++)
+         delete mChannels[c];
+      delete[] mChannels;
+   }
+
    sf_close(mFile);
 }
+
+//
+// PCMImportPipeline
+//
+
+/// One thread of a PCMImportPipeline
+class PCMImportThread : public wxThread
+{
+public:
+   enum {
+      ReadStage = -2,
+      SplitStage = -1
+      // appender t is stage t
+   };
+
+   PCMImportThread(PCMImportPipeline *pipeline, int stage)
+   :  wxThread(wxTHREAD_JOINABLE),
+      mPipeline(pipeline),
+      mStage(stage)
+   {
+   }
+
+   virtual void *Entry()
+   {
+      if (mStage == ReadStage)
+         mPipeline->Read();
+      else if (mStage == SplitStage)
+         mPipeline->Split();
+      else
+         mPipeline->Append(mStage);
+      return NULL;
+   }
+
+private:
+   PCMImportPipeline *mPipeline;
+   int mStage;
+};
+
+PCMImportPipeline::PCMImportPipeline(SNDFILE *file, sampleFormat format,
+                                     int numChannels, WaveTrack **channels,
+                                     sampleCount blockSize, int numAppenders)
+:  mFile(file),
+   mFormat(format),
+   mNumChannels(numChannels),
+   mChannels(channels),
+   mBlockSize(blockSize),
+   mNumAppenders(numAppenders),
+   mChanged(&mLock),
+   mNumRead(0),
+   mNumSplit(0),
+   mReadDone(false),
+   mStopReading(false),
+   mSplitDone(false),
+   mNumAppendersDone(0),
+   mStopping(false),
+   mFailed(false)
+{
+   int i, c;
+   for (i = 0; i < kPCMImportBuffers; i++) {
+      mBuffers[i].interleaved = NewSamples(mBlockSize * mNumChannels, mFormat);
+      mBuffers[i].channels = new samplePtr[mNumChannels];
+      for (c = 0; c < mNumChannels; c++)
+         mBuffers[i].channels[c] = NewSamples(mBlockSize, mFormat);
+      mBuffers[i].len = 0;
+   }
+
+   mNumAppended = new int[mNumAppenders];
+   mFramesAppended = new sampleCount[mNumAppenders];
+   for (i = 0; i < mNumAppenders; i++) {
+      mNumAppended[i] = 0;
+      mFramesAppended[i] = 0;
+   }
+
+   mNumThreads = mNumAppenders + 2;
+   mThreads = new PCMImportThread *[mNumThreads];
+   mThreads[0] = new PCMImportThread(this, PCMImportThread::ReadStage);
+   mThreads[1] = new PCMImportThread(this, PCMImportThread::SplitStage);
+   for (i = 0; i < mNumAppenders; i++)
+      mThreads[i + 2] = new PCMImportThread(this, i);
+
+   mDirManager = channels[0]->GetDirManager();
+   mDirManager->BeginBackgroundImport();
+
+   // The reader starts last, so that if any thread can't be started,
+   // nothing has been read from the file.  Those that did start are
+   // stopped by the destructor.
+   for (i = mNumThreads - 1; i >= 0; i--) {
+      if (mThreads[i]->Create() != wxTHREAD_NO_ERROR ||
+          mThreads[i]->Run() != wxTHREAD_NO_ERROR) {
+         mFailed = true;
+         break;
+      }
+   }
+   for (; i >= 0; i--) {
+      delete mThreads[i];
+      mThreads[i] = NULL;
+   }
+}
+
+PCMImportPipeline::~PCMImportPipeline()
+{
+   mLock.Lock();
+   mStopping = true;
+   mChanged.Broadcast();
+   mLock.Unlock();
+
+   int i, c;
+   for (i = 0; i < mNumThreads; i++) {
+      // Never Wait() for one that never ran
+      if (mThreads[i]) {
+         mThreads[i]->Wait();
+         delete mThreads[i];
+      }
+   }
+   delete[] mThreads;
+
+   mDirManager->EndBackgroundImport();
+
+   delete[] mNumAppended;
+   delete[] mFramesAppended;
+
+   for (i = 0; i < kPCMImportBuffers; i++) {
+      for (c = 0; c < mNumChannels; c++)
+         DeleteSamples(mBuffers[i].channels[c]);
+      delete[] mBuffers[i].channels;
+      DeleteSamples(mBuffers[i].interleaved);
+   }
+}
+
+bool PCMImportPipeline::IsDone()
+{
+   mLock.Lock();
+   bool done = (mNumAppendersDone == mNumAppenders);
+   mLock.Unlock();
+   return done;
+}
+
+sampleCount PCMImportPipeline::GetFramesDone()
+{
+   mLock.Lock();
+   sampleCount frames = mFramesAppended[0];
+   for (int i = 1; i < mNumAppenders; i++)
+      if (mFramesAppended[i] < frames)
+         frames = mFramesAppended[i];
+   mLock.Unlock();
+   return frames;
+}
+
+void PCMImportPipeline::StopReading()
+{
+   mLock.Lock();
+   mStopReading = true;
+   mChanged.Broadcast();
+   mLock.Unlock();
+}
+
+// Call with mLock locked
+int PCMImportPipeline::MinAppended()
+{
+   int n = mNumAppended[0];
+   for (int i = 1; i < mNumAppenders; i++)
+      if (mNumAppended[i] < n)
+         n = mNumAppended[i];
+   return n;
+}
+
+void PCMImportPipeline::Read()
+{
+   int n = 0;
+   for (;;) {
+      // Wait for the slowest appender to give back a buffer
+      mLock.Lock();
+      while (!mStopping && !mStopReading &&
+             n - MinAppended() == kPCMImportBuffers)
+         mChanged.Wait();
+      bool stopping = mStopping;
+      if (mStopReading && !stopping) {
+         mReadDone = true;
+         mChanged.Broadcast();
+      }
+      bool stopReading = mStopReading;
+      mLock.Unlock();
+      if (stopping || stopReading)
+         break;
+
+      PCMImportBuffer &buffer = mBuffers[n % kPCMImportBuffers];
+
+      // libsndfile is not threadsafe
+      ODManager::LockLibSndFileMutex();
+      if (mFormat == int16Sample)
+         buffer.len = sf_readf_short(mFile, (short *)buffer.interleaved, mBlockSize);
+      else
+         buffer.len = sf_readf_float(mFile, (float *)buffer.interleaved, mBlockSize);
+      ODManager::UnlockLibSndFileMutex();
+
+      mLock.Lock();
+      if (buffer.len > 0)
+         mNumRead = ++n;
+      else
+         mReadDone = true;
+      mChanged.Broadcast();
+      mLock.Unlock();
+
+      if (buffer.len <= 0)
+         break;
+   }
+}
+
+void PCMImportPipeline::Split()
+{
+   int n = 0;
+   for (;;) {
+      mLock.Lock();
+      while (!mStopping && n == mNumRead && !mReadDone)
+         mChanged.Wait();
+      bool more = !mStopping && n < mNumRead;
+      if (!more) {
+         mSplitDone = true;
+         mChanged.Broadcast();
+      }
+      mLock.Unlock();
+      if (!more)
+         break;
+
+      PCMImportBuffer &buffer = mBuffers[n % kPCMImportBuffers];
+      int len = (int)buffer.len;
+      for (int c = 0; c < mNumChannels; c++) {
+         if (mFormat == int16Sample) {
+            short *src = (short *)buffer.interleaved + c;
+            short *dst = (short *)buffer.channels[c];
+            for (int j = 0; j < len; j++)
+               dst[j] = src[mNumChannels * j];
+         }
+         else {
+            float *src = (float *)buffer.interleaved + c;
+            float *dst = (float *)buffer.channels[c];
+            for (int j = 0; j < len; j++)
+               dst[j] = src[mNumChannels * j];
+         }
+      }
+
+      mLock.Lock();
+      mNumSplit = ++n;
+      mChanged.Broadcast();
+      mLock.Unlock();
+   }
+}
+
+void PCMImportPipeline::Append(int appender)
+{
+   int n = 0;
+   for (;;) {
+      mLock.Lock();
+      while (!mStopping && n == mNumSplit && !mSplitDone)
+         mChanged.Wait();
+      bool more = !mStopping && n < mNumSplit;
+      mLock.Unlock();
+      if (!more)
+         break;
+
+      // Making the blocks and their summaries is the slow part, which is
+      // why the channels are shared out among several appenders
+      PCMImportBuffer &buffer = mBuffers[n % kPCMImportBuffers];
+      for (int c = appender; c < mNumChannels; c += mNumAppenders)
+         mChannels[c]->Append(buffer.channels[c], mFormat, buffer.len);
+
+      mLock.Lock();
+      mNumAppended[appender] = ++n;
+      mFramesAppended[appender] += buffer.len;
+      mChanged.Broadcast();
+      mLock.Unlock();
+   }
+
+   mLock.Lock();
+   mNumAppendersDone++;
+   mChanged.Broadcast();
+   mLock.Unlock();
+}
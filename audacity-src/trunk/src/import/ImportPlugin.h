@@ -153,6 +153,14 @@ public:
    // imported
    virtual int GetFileUncompressedBytes() = 0;
 
+   // Begin the import on threads of its own, if the importer can, before
+   // Import() is called to finish it; returns false if it can't.  Only
+   // done for files with a single stream, after SetStreamUsage(0, true).
+   virtual bool StartImport(TrackFactory * WXUNUSED(trackFactory))
+   {
+      return false;
+   }
+
    // do the actual import, creating whatever tracks are necessary with
    // the TrackFactory and calling the progress callback every iteration
    // through the importing loop
@@ -19,6 +19,7 @@ ODTask requests and internals.
 #include "ODTaskThread.h"
 #include "ODWaveTrackTaskQueue.h"
 #include "../Project.h"
+#include "../Prefs.h"
 #include <NonGuiThread.h>
 #include <wx/utils.h>
 #include <wx/wx.h>
@@ -70,6 +71,7 @@ ODManager::ODManager()
 
    //must set up the queue condition
    mQueueNotEmptyCond = new ODCondition(&mQueueNotEmptyCondLock);
+   mQueueSignals = 0;
 }
 
 //private destructor - delete with static method Quit()
@@ -87,20 +89,16 @@ ODManager::~ODManager()
 void ODManager::AddTask(ODTask* task)
 {
    mTasksMutex.Lock();
-   mTasks.push_back(task);
+   //a task that was run before goes back to its worker, whose thread has the task's data warm.
+   int worker = task->GetWorker();
+   if(worker >= 0 && worker < (int)mWorkerTasks.size() && mWorkerActive[worker])
+      mWorkerTasks[worker].push_back(task);
+   else
+      mTasks.push_back(task);
    mTasksMutex.Unlock();
-   //signal the queue not empty condition.
-   bool paused;
-
-   mPauseLock.Lock();
-   paused=mPause;
-   mPauseLock.Unlock();
 
-   mQueueNotEmptyCondLock.Lock();
-   //don't signal if we are paused since if we wake up the loop it will start processing other tasks while paused
-   if(!paused)
-      mQueueNotEmptyCond->Signal();
-   mQueueNotEmptyCondLock.Unlock();
+   //signal the queue not empty condition.
+   SignalTaskQueueLoop();
 }
 
 void ODManager::SignalTaskQueueLoop()
@@ -111,9 +109,12 @@ void ODManager::SignalTaskQueueLoop()
    paused=mPause;
    mPauseLock.Unlock();
    mQueueNotEmptyCondLock.Lock();
-   //don't signal if we are paused
+   //don't signal if we are paused since if we wake up the loop it will start processing other tasks while paused
    if(!paused)
+   {
+      mQueueSignals++;
       mQueueNotEmptyCond->Signal();
+   }
    mQueueNotEmptyCondLock.Unlock();
 }
 
@@ -130,6 +131,17 @@ void ODManager::RemoveTaskIfInQueue(ODTask* task)
          break;
       }
    }
+   for(unsigned int i=0;i<mWorkerTasks.size();i++)
+   {
+      for(unsigned int j=0;j<mWorkerTasks[i].size();j++)
+      {
+         if(mWorkerTasks[i][j]==task)
+         {
+            mWorkerTasks[i].erase(mWorkerTasks[i].begin()+j);
+            break;
+         }
+      }
+   }
    mTasksMutex.Unlock();
 
 }
@@ -210,7 +222,15 @@ bool ODManager::IsInstanceCreated()
 void ODManager::Init()
 {
    mCurrentThreads = 0;
-   mMaxThreads = 5;
+   // 0 means one thread per processor
+   mMaxThreads = gPrefs->Read(wxT("/OnDemand/Threads"), 0L);
+   if(mMaxThreads <= 0)
+      mMaxThreads = wxThread::GetCPUCount();
+   if(mMaxThreads <= 0)
+      mMaxThreads = 1;
+
+   mWorkerTasks.resize(mMaxThreads);
+   mWorkerActive.resize(mMaxThreads, false);
 
    //   wxLogDebug(wxT("Initializing ODManager...Creating manager thread"));
    ODManagerHelperThread* startThread = new ODManagerHelperThread;
@@ -231,13 +251,115 @@ void ODManager::DecrementCurrentThreads()
    mCurrentThreadsMutex.Unlock();
 }
 
+///Gives an ODTaskThread the next task to work on.  A task the user is waiting on comes first,
+///then the worker's own deque, then tasks no worker has run yet, and then the back of the
+///fullest other deque.  Returns NULL and frees the worker slot if there is nothing to do.
+ODTask* ODManager::GetNextTask(int worker)
+{
+   ODTask* task = NULL;
+   bool stop;
+
+   mPauseLock.Lock();
+   stop = mPause;
+   mPauseLock.Unlock();
+   mTerminateMutex.Lock();
+   stop = stop || mTerminate;
+   mTerminateMutex.Unlock();
+
+   mTasksMutex.Lock();
+   std::deque<ODTask*> &own = mWorkerTasks[worker];
+   if(!stop)
+   {
+      task = TakeDemandedTask();
+      if(!task && !own.empty())
+      {
+         task = own.front();
+         own.pop_front();
+      }
+      if(!task && !mTasks.empty())
+      {
+         task = mTasks[0];
+         mTasks.erase(mTasks.begin());
+      }
+      if(!task)
+      {
+         //steal from the worker with the most waiting.
+         int victim = -1;
+         for(unsigned int i=0;i<mWorkerTasks.size();i++)
+         {
+            if(mWorkerTasks[i].size() > 0 &&
+               (victim < 0 || mWorkerTasks[i].size() > mWorkerTasks[victim].size()))
+               victim = i;
+         }
+         if(victim >= 0)
+         {
+            task = mWorkerTasks[victim].back();
+            mWorkerTasks[victim].pop_back();
+         }
+      }
+   }
+
+   if(task)
+      task->SetWorker(worker);
+   else
+   {
+      //hand anything left to whichever thread starts next (only happens when pausing/quitting)
+      mTasks.insert(mTasks.end(), own.begin(), own.end());
+      own.clear();
+      mWorkerActive[worker] = false;
+      DecrementCurrentThreads();
+   }
+   mTasksMutex.Unlock();
+
+   return task;
+}
+
+///Takes a waiting task that the user has demanded a new position from, if there is one.
+///Call with mTasksMutex locked.
+ODTask* ODManager::TakeDemandedTask()
+{
+   ODTask* task;
+   for(unsigned int i=0;i<mTasks.size();i++)
+   {
+      if(mTasks[i]->GetNeedsODUpdate())
+      {
+         task = mTasks[i];
+         mTasks.erase(mTasks.begin()+i);
+         return task;
+      }
+   }
+   for(unsigned int i=0;i<mWorkerTasks.size();i++)
+   {
+      for(unsigned int j=0;j<mWorkerTasks[i].size();j++)
+      {
+         if(mWorkerTasks[i][j]->GetNeedsODUpdate())
+         {
+            task = mWorkerTasks[i][j];
+            mWorkerTasks[i].erase(mWorkerTasks[i].begin()+j);
+            return task;
+         }
+      }
+   }
+   return NULL;
+}
+
+///Number of tasks waiting in mTasks and the worker deques.  Call with mTasksMutex locked.
+int ODManager::GetNumWaitingTasks()
+{
+   int ret = mTasks.size();
+   for(unsigned int i=0;i<mWorkerTasks.size();i++)
+      ret += mWorkerTasks[i].size();
+   return ret;
+}
+
 ///Main loop for managing threads and tasks.
 void ODManager::Start()
 {
    ODTaskThread* thread;
-   bool tasksInArray;
+   int  waitingTasks;
    bool paused;
    int  numQueues=0;
+   int  seenSignals;
 
    mNeedsDraw=0;
 
@@ -251,13 +373,18 @@ void ODManager::Start()
       mTerminateMutex.Unlock();
 //    printf("ODManager thread running \n");
 
+      //anything signalled after this point will keep us from waiting below.
+      mQueueNotEmptyCondLock.Lock();
+      seenSignals = mQueueSignals;
+      mQueueNotEmptyCondLock.Unlock();
+
       //we should look at our WaveTrack queues to see if we can process a new task to the running queue.
       UpdateQueues();
 
       //start some threads if necessary
 
       mTasksMutex.Lock();
-      tasksInArray = mTasks.size()>0;
+      waitingTasks = GetNumWaitingTasks();
       mTasksMutex.Unlock();
 
       mPauseLock.Lock();
@@ -265,23 +392,27 @@ void ODManager::Start()
       mPauseLock.Unlock();
 
       mCurrentThreadsMutex.Lock();
-      // keep adding tasks if there is work to do, up to the limit.
-      while(!paused && tasksInArray && (mCurrentThreads < mMaxThreads))
+      // keep adding threads while there are tasks no thread will get to, up to the limit.
+      // Running threads pick up the rest themselves.
+      while(!paused && waitingTasks>0 && (mCurrentThreads < mMaxThreads))
       {
          mCurrentThreads++;
          mCurrentThreadsMutex.Unlock();
 
          mTasksMutex.Lock();
+         int worker = 0;
+         while(mWorkerActive[worker])
+            worker++;
+         mWorkerActive[worker] = true;
+         mTasksMutex.Unlock();
+
          //detach a new thread.
-         thread = new ODTaskThread(mTasks[0]);//task);
+         thread = new ODTaskThread(worker);
          //thread->SetPriority(10);//default is 50.
          thread->Create();
          thread->Run();
 
-         mTasks.erase(mTasks.begin());
-         tasksInArray = mTasks.size()>0;
-         mTasksMutex.Unlock();
-
+         waitingTasks--;
          mCurrentThreadsMutex.Lock();
       }
 
@@ -290,8 +421,9 @@ void ODManager::Start()
 
       // JKC: If there are no tasks ready to run, or we're paused then
       // we wait for there to be tasks in the queue.
+      // Otherwise the threads are all busy, and we wait for them to requeue or finish a task.
       mQueueNotEmptyCondLock.Lock();
-      if( (!tasksInArray) || paused)
+      if(seenSignals == mQueueSignals)
          mQueueNotEmptyCond->Wait();
       mQueueNotEmptyCondLock.Unlock();
 
@@ -339,6 +471,7 @@ void ODManager::Pause(bool pause)
 
       //we should check the queue again.
       pMan->mQueueNotEmptyCondLock.Lock();
+      pMan->mQueueSignals++;
       pMan->mQueueNotEmptyCond->Signal();
       pMan->mQueueNotEmptyCondLock.Unlock();
    }
@@ -371,6 +504,7 @@ void ODManager::Quit()
 
          //signal the queue not empty condition since the ODMan thread will wait on the queue condition
          pMan->mQueueNotEmptyCondLock.Lock();
+         pMan->mQueueSignals++;
          pMan->mQueueNotEmptyCond->Signal();
          pMan->mQueueNotEmptyCondLock.Unlock();
 
@@ -20,6 +20,7 @@ number of threads.
 #define __AUDACITY_ODMANAGER__
 
 #include <vector>
+#include <deque>
 #include "ODTask.h"
 #include "ODTaskThread.h"
 #include <wx/thread.h>
@@ -61,6 +62,10 @@ class ODManager
    ///Reduces the count of current threads running.  Meant to be called when ODTaskThreads end in their own threads.  Thread-safe.
    void DecrementCurrentThreads();
 
+   ///Gives an ODTaskThread the next task to work on, or NULL if it should exit.  Thread-safe.
+   ///@param worker the worker slot the calling thread was started with.
+   ODTask* GetNextTask(int worker);
+
    ///Adds a wavetrack, creates a queue member.
    void AddNewTask(ODTask* task, bool lockMutex=true);
 
@@ -129,6 +134,13 @@ class ODManager
    ///Remove references in our array to Tasks that have been completed/Schedule new ones
    void UpdateQueues();
 
+   ///Takes a waiting task that the user has demanded a new position from, if there is one.
+   ///Call with mTasksMutex locked.
+   ODTask* TakeDemandedTask();
+
+   ///Number of tasks waiting in mTasks and the worker deques.  Call with mTasksMutex locked.
+   int GetNumWaitingTasks();
+
    //instance
    static ODManager* pMan;
 
@@ -136,9 +148,14 @@ class ODManager
    std::vector<ODWaveTrackTaskQueue*> mQueues;
    ODLock mQueuesMutex;
 
-   //List of current Task to do.
+   //List of current Task to do that no worker has run yet.
    std::vector<ODTask*> mTasks;
-   //mutex for above variable
+   //Tasks waiting for each worker slot.  A task that is not finished goes back to the
+   //worker that ran it, and idle workers steal from the back of the others' deques.
+   std::vector< std::deque<ODTask*> > mWorkerTasks;
+   //whether each worker slot has a running thread.
+   std::vector<bool> mWorkerActive;
+   //mutex for above variables
    ODLock mTasksMutex;
 
    //global pause switch for OD
@@ -152,7 +169,7 @@ class ODManager
    //mutex for above variable
    ODLock mCurrentThreadsMutex;
 
-   ///Maximum number of threads allowed out.
+   ///Maximum number of threads allowed out.  One per processor unless /OnDemand/Threads says otherwise.
    int mMaxThreads;
 
    volatile bool mTerminate;
@@ -164,6 +181,8 @@ class ODManager
    //for the queue not empty comdition
    ODLock         mQueueNotEmptyCondLock;
    ODCondition*   mQueueNotEmptyCond;
+   //counts signals so the loop does not wait on one that came while it was busy.
+   int            mQueueSignals;
 
 #ifdef __WXMAC__
 
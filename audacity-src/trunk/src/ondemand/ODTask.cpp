@@ -38,6 +38,7 @@ ODTask::ODTask()
    mTerminate = false;
    mNeedsODUpdate=false;
    mIsRunning = false;
+   mWorker = -1;
 
    mTaskNumber=sTaskNumber++;
 
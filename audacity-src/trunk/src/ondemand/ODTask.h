@@ -122,6 +122,9 @@ class ODTask
 
    bool IsRunning();
 
+   ///the ODManager worker that last ran this task, or -1.  Only used under the ODManager's task lock.
+   int GetWorker(){return mWorker;}
+   void SetWorker(int worker){mWorker=worker;}
 
  protected:
 
@@ -170,6 +173,8 @@ class ODTask
    volatile bool mNeedsODUpdate;
    ODLock mNeedsODUpdateMutex;
 
+   int mWorker;
+
 
 
 };
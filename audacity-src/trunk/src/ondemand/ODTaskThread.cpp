@@ -11,7 +11,8 @@
 ******************************************************************//**
 
 \class ODTaskThread
-\brief A thread that executes a part of the task specfied by an ODTask.
+\brief A worker thread that executes parts of the ODTasks that the
+ODManager hands it until there is nothing left to do.
 
 *//*******************************************************************/
 
@@ -21,12 +22,12 @@
 #include "ODManager.h"
 
 
-ODTaskThread::ODTaskThread(ODTask* task)
+ODTaskThread::ODTaskThread(int worker)
 #ifndef __WXMAC__
 : wxThread()
 #endif
 {
-   mTask=task;
+   mWorker=worker;
 #ifdef __WXMAC__
    mDestroy = false;
    mThread = NULL;
@@ -44,11 +45,11 @@ void *ODTaskThread::Entry()
 {
    //TODO: Figure out why this has no effect at all.
    //wxThread::This()->SetPriority( 40);
-   //Do at least 5 percent of the task
-   mTask->DoSome(0.05f);
-
-   //release the thread count so that the ODManager knows how many active threads are alive.
-   ODManager::Instance()->DecrementCurrentThreads();
+   //Do at least 5 percent of a task at a time.  The ODManager releases our slot
+   //and the thread count when it returns NULL.
+   ODTask* task;
+   while((task = ODManager::Instance()->GetNextTask(mWorker)))
+      task->DoSome(0.05f);
 
 
 #ifndef __WXMAC__
@@ -11,7 +11,8 @@
 ******************************************************************//**
 
 \class ODTaskThread
-\brief A thread that executes a part of the task specfied by an ODTask.
+\brief A worker thread that executes parts of the ODTasks that the
+ODManager hands it until there is nothing left to do.
 
 *//*******************************************************************/
 
@@ -38,7 +39,7 @@ class ODTask;
 class ODTaskThread {
  public:
    typedef int ExitCode;
-   ODTaskThread(ODTask* task);
+   ODTaskThread(int worker);
    /*ExitCode*/ void Entry();
    void Create() {}
    void Delete() {
@@ -77,7 +78,7 @@ class ODTaskThread {
    bool mDestroy;
    pthread_t mThread;
 
-   ODTask* mTask;
+   int mWorker;
 };
 
 class ODLock {
@@ -129,14 +130,14 @@ class ODTaskThread : public wxThread
 {
 public:
    ///Constructs a ODTaskThread
-   ///@param task the task to be launched as an
-   ODTaskThread(ODTask* task);
+   ///@param worker the ODManager worker slot this thread takes its tasks from
+   ODTaskThread(int worker);
 
 
 protected:
-   ///Executes a part of the task
+   ///Executes parts of tasks until the ODManager has none left for us
    virtual void* Entry();
-   ODTask* mTask;
+   int mWorker;
 
 };
 
@@ -113,6 +113,21 @@ void PlaybackPrefs::PopulateOrExchange(ShuttleGui & S)
       S.EndThreeColumn();
    }
    S.EndStatic();
+
+   S.StartStatic(_("Performance"));
+   {
+      S.StartTwoColumn();
+      {
+         // Read by AudioIO when playback starts
+         S.TieSpinCtrl(_("&Mixing threads:"),
+                       wxT("/AudioIO/PlaybackMixThreads"),
+                       1,
+                       64,
+                       1);
+      }
+      S.EndTwoColumn();
+   }
+   S.EndStatic();
 }
 
 bool PlaybackPrefs::Apply()
@@ -382,3 +382,14 @@ void XMLStringWriter::Write(const wxString &data)
 {
    Append(data);
 }
+
+void XMLStringWriter::Reset()
+{
+   // Empty() keeps the buffer, unlike Clear()
+   Empty();
+   mInTag = false;
+   mDepth = 0;
+   mTagstack.Empty();
+   mHasKids.Empty();
+   mHasKids.Add(false);
+}
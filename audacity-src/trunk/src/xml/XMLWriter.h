@@ -123,6 +123,10 @@ class XMLStringWriter:public wxString, public XMLWriter {
 
    wxString Get();
 
+   /// Empties the string and ends any open tags, keeping the allocated
+   /// buffer so that the writer can be reused without reallocating
+   void Reset();
+
  private:
 
 };
@@ -3,6 +3,7 @@
 #include "DirManager.h"
 #include <wx/hash.h>
 #include <vector>
+#include <math.h>
 #include <iostream>
 
 class SequenceTest
@@ -131,6 +132,225 @@ public:
       std::cout << "ok\n";
    }
 
+   void TestGetMany()
+   {
+      std::cout << "\tSequence::GetMany() should return the same samples as Get() for each range..." << std::flush;
+
+      int appendBufLen = (int)(mSequence->GetMaxBlockSize() * 1.4);
+      float *appendBuf = new float[appendBufLen];
+      int i;
+
+      for(i = 0; i < 5; i++) {
+         for(int j = 0; j < appendBufLen; j++)
+            appendBuf[j] = (float)rand() / RAND_MAX;
+         mSequence->Append((samplePtr)appendBuf, floatSample, appendBufLen);
+      }
+
+      /* overlapping windows, as an FFT with 50% overlap would read */
+      const int windowSize = 1024;
+      int numRequests = (int)(mSequence->GetNumSamples() / (windowSize / 2)) - 1;
+      SeqRequest *requests = new SeqRequest[numRequests];
+      float *many = new float[numRequests * windowSize];
+      float *one = new float[windowSize];
+
+      for(i = 0; i < numRequests; i++) {
+         requests[i].start = i * (windowSize / 2);
+         requests[i].len = windowSize;
+         requests[i].buffer = (samplePtr)&many[i * windowSize];
+      }
+
+      assert(mSequence->GetMany(requests, numRequests, floatSample));
+
+      for(i = 0; i < numRequests; i++) {
+         mSequence->Get((samplePtr)one, floatSample, requests[i].start, windowSize);
+         assert(memcmp(one, &many[i * windowSize], windowSize * sizeof(float)) == 0);
+      }
+
+      /* should fail, the requests must be sorted by start */
+      SeqRequest tmp = requests[0];
+      requests[0] = requests[1];
+      requests[1] = tmp;
+      assert(mSequence->GetMany(requests, numRequests, floatSample) == false);
+
+      delete[] requests;
+      delete[] many;
+      delete[] one;
+      delete[] appendBuf;
+
+      std::cout << "ok\n";
+   }
+
+   void TestReblock()
+   {
+      std::cout << "\tSequence::Reblock() should keep the samples and change the block size..." << std::flush;
+
+      sampleCount maxBlockSize = mSequence->GetMaxBlockSize();
+      int appendBufLen = (int)(maxBlockSize * 3.3);
+      float *appendBuf = new float[appendBufLen];
+      float *getBuf = new float[appendBufLen];
+      int i;
+
+      for(i = 0; i < appendBufLen; i++)
+         appendBuf[i] = (float)rand() / RAND_MAX;
+      mSequence->Append((samplePtr)appendBuf, floatSample, appendBufLen);
+
+      assert(mSequence->Reblock(maxBlockSize / 4));
+      assert(mSequence->GetMaxBlockSize() == maxBlockSize / 4);
+      assert(mSequence->GetBlockArray()->GetCount() >= 13);
+      mSequence->Get((samplePtr)getBuf, floatSample, 0, appendBufLen);
+      assert(memcmp(appendBuf, getBuf, appendBufLen * sizeof(float)) == 0);
+
+      assert(mSequence->Reblock(maxBlockSize * 4));
+      assert(mSequence->GetBlockArray()->GetCount() == 1);
+      mSequence->Get((samplePtr)getBuf, floatSample, 0, appendBufLen);
+      assert(memcmp(appendBuf, getBuf, appendBufLen * sizeof(float)) == 0);
+
+      /* should fail, smaller than a project file may hold */
+      assert(mSequence->Reblock(512) == false);
+
+      delete[] appendBuf;
+      delete[] getBuf;
+
+      std::cout << "ok\n";
+   }
+
+   void TestPasteKeepsBlockSize()
+   {
+      std::cout << "\tSequence::Paste() should keep the block size and split longer blocks..." << std::flush;
+
+      sampleCount maxBlockSize = mSequence->GetMaxBlockSize();
+      int pasteBufLen = (int)(maxBlockSize * 3.3);
+      int appendBufLen = (int)(maxBlockSize * 1.5);
+      float *pasteBuf = new float[pasteBufLen];
+      float *appendBuf = new float[appendBufLen];
+      float *getBuf = new float[pasteBufLen];
+      int i;
+
+      for(i = 0; i < pasteBufLen; i++)
+         pasteBuf[i] = (float)rand() / RAND_MAX;
+      for(i = 0; i < appendBufLen; i++)
+         appendBuf[i] = (float)rand() / RAND_MAX;
+
+      Sequence *src = new Sequence(mDirManager, floatSample);
+      src->Append((samplePtr)pasteBuf, floatSample, pasteBufLen);
+      assert(src->Reblock(maxBlockSize * 4));
+      mSequence->Append((samplePtr)appendBuf, floatSample, appendBufLen);
+
+      assert(mSequence->Paste(100, src));
+      assert(mSequence->GetMaxBlockSize() == maxBlockSize);
+      BlockArray *blocks = mSequence->GetBlockArray();
+      for(i = 0; i < (int)blocks->GetCount(); i++)
+         assert(blocks->Item(i)->f->GetLength() <= maxBlockSize);
+      mSequence->Get((samplePtr)getBuf, floatSample, 100, pasteBufLen);
+      assert(memcmp(pasteBuf, getBuf, pasteBufLen * sizeof(float)) == 0);
+
+      /* edited sequences don't move on to the largest blocks */
+      sampleCount hours = (sampleCount)44100 * 3600 * 24;
+      assert(Sequence::ChooseMaxSamples(floatSample, hours) > maxBlockSize);
+      assert(Sequence::ChooseMaxSamples(floatSample, hours, 1000) == maxBlockSize);
+
+      delete src;
+      delete[] pasteBuf;
+      delete[] appendBuf;
+      delete[] getBuf;
+
+      std::cout << "ok\n";
+   }
+
+   void TestCopyOnWrite()
+   {
+      std::cout << "\ta copy should share blocks until one of the two changes..." << std::flush;
+
+      sampleCount maxBlockSize = mSequence->GetMaxBlockSize();
+      int appendBufLen = (int)(maxBlockSize * 2.5);
+      float *appendBuf = new float[appendBufLen];
+      float *getBuf = new float[appendBufLen];
+      int i;
+
+      for(i = 0; i < appendBufLen; i++)
+         appendBuf[i] = (float)rand() / RAND_MAX;
+      mSequence->Append((samplePtr)appendBuf, floatSample, appendBufLen);
+
+      Sequence *copy = new Sequence(*mSequence, mDirManager);
+      assert(copy->GetBlockArray() == mSequence->GetBlockArray());
+
+      /* changing the original leaves the copy as it was */
+      mSequence->SetSilence(0, appendBufLen / 2);
+      assert(copy->GetBlockArray() != mSequence->GetBlockArray());
+      copy->Get((samplePtr)getBuf, floatSample, 0, appendBufLen);
+      assert(memcmp(appendBuf, getBuf, appendBufLen * sizeof(float)) == 0);
+
+      /* deleting either one releases only its own references */
+      delete copy;
+      mSequence->Get((samplePtr)getBuf, floatSample, 0, appendBufLen);
+      assert(getBuf[0] == 0.0f);
+      assert(memcmp(appendBuf + appendBufLen / 2, getBuf + appendBufLen / 2,
+                    (appendBufLen - appendBufLen / 2) * sizeof(float)) == 0);
+
+      delete mSequence;
+      mSequence = NULL;
+      assert(mDirManager->blockFileHash->GetCount() == 0);
+
+      delete[] appendBuf;
+      delete[] getBuf;
+
+      std::cout << "ok\n";
+   }
+
+   void TestQuietRuns()
+   {
+      std::cout << "\tSequence::GetQuietRuns() should find the same runs as a scan of every sample..." << std::flush;
+
+      sampleCount maxBlockSize = mSequence->GetMaxBlockSize();
+      int appendBufLen = (int)(maxBlockSize * 3.5);
+      float *appendBuf = new float[appendBufLen];
+      const float threshold = 0.01f;
+      int i;
+
+      /* quiet stretches of random length with a few loud samples between */
+      for(i = 0; i < appendBufLen; i++)
+         appendBuf[i] = 0.001f;
+      for(i = 0; i < 200; i++)
+         appendBuf[rand() % appendBufLen] = (rand() % 2) ? 0.5f : -0.5f;
+      mSequence->Append((samplePtr)appendBuf, floatSample, appendBufLen);
+
+      for(int trial = 0; trial < 50; trial++)
+      {
+         sampleCount start = rand() % appendBufLen;
+         sampleCount len = rand() % (appendBufLen - start + 1);
+         sampleCount minRun = (trial % 2) ? 1 + rand() % 100 : 511 + rand() % 5000;
+
+         std::vector<sampleCount> runs;
+         assert(mSequence->GetQuietRuns(start, len, threshold, minRun, runs));
+
+         std::vector<sampleCount> expected;
+         sampleCount runStart = -1;
+         for(sampleCount s = start; s <= start + len; s++)
+         {
+            if(s < start + len && fabs(appendBuf[s]) < threshold)
+            {
+               if(runStart < 0)
+                  runStart = s;
+            }
+            else if(runStart >= 0)
+            {
+               if(s - runStart >= minRun || runStart == start || s == start + len)
+               {
+                  expected.push_back(runStart);
+                  expected.push_back(s);
+               }
+               runStart = -1;
+            }
+         }
+
+         assert(runs == expected);
+      }
+
+      delete[] appendBuf;
+
+      std::cout << "ok\n";
+   }
+
 };
 
 int main()
@@ -149,6 +369,26 @@ int main()
    tester.TestGetGarbageInput();
    tester.TearDown();
 
+   tester.SetUp();
+   tester.TestGetMany();
+   tester.TearDown();
+
+   tester.SetUp();
+   tester.TestReblock();
+   tester.TearDown();
+
+   tester.SetUp();
+   tester.TestPasteKeepsBlockSize();
+   tester.TearDown();
+
+   tester.SetUp();
+   tester.TestCopyOnWrite();
+   tester.TearDown();
+
+   tester.SetUp();
+   tester.TestQuietRuns();
+   tester.TearDown();
+
    return 0;
 }
 
@@ -55,6 +55,9 @@ public:
                                            (samplePtr)floatData, dataLen,
                                            floatSample);
 
+      // The files are written in the background
+      bool flushed = SimpleBlockFileWriter::Instance()->Flush();
+      assert(flushed);
    }
 
    void tearDown() {
@@ -186,6 +189,29 @@ public:
 
        std::cout << "OK\n";
    }
+
+   void testWriteFailure() {
+      std::cout << "\ta file that can't be written should be marked as failed and kept...";
+      std::cout << std::flush;
+
+      assert(!int16BlockFile->GetWriteFailed());
+
+      SimpleBlockFile *unwritable =
+         new SimpleBlockFile(wxFileName("/nonexistent/int16"),
+                             (samplePtr)int16Data, dataLen, int16Sample);
+      SimpleBlockFileWriter::Instance()->Flush();
+      assert(unwritable->GetWriteFailed());
+
+      // The samples are kept for another try
+      samplePtr buf = NewSamples(dataLen, int16Sample);
+      unwritable->ReadData(buf, int16Sample, 0, dataLen);
+      AssertBuffersEqual(int16Data, (short*)buf, dataLen);
+      DeleteSamples(buf);
+
+      delete unwritable;
+
+      std::cout << "OK\n";
+   }
 };
 
 int main()
@@ -204,6 +230,10 @@ int main()
     tester.testReads();
     tester.tearDown();
 
+    tester.setUp();
+    tester.testWriteFailure();
+    tester.tearDown();
+
     return 0;
 }
 